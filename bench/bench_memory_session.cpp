@@ -0,0 +1,93 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh in-memory session benchmark -- drives the session state machine
+// through MemoryTransport (no kernel sockets) to measure the cost of the
+// input path (IAC filter, line editing, echo, dispatch) and the output path.
+//
+// Usage:
+//   ./telsh_bench_memory_session [input_mb] [output_mb]
+
+#include "telsh/telnet_session.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t kChunk = 1024;  ///< Bytes per command for "blob"
+char g_blob[kChunk];
+
+int NopCmd(int, char*[], void*) { return 0; }
+
+int BlobCmd(int, char*[], void*) {
+  telsh::ExecContext* ec = telsh::CurrentExec();
+  ec->output_fn(g_blob, kChunk, ec->output_ctx);
+  return 0;
+}
+
+double Seconds(Clock::time_point t0) { return std::chrono::duration<double>(Clock::now() - t0).count(); }
+
+telsh::BasicTelnetSession<telsh::MemoryTransport> g_session;
+
+/// Feed @p line repeatedly until @p total bytes went in; drain output as
+/// it accumulates.  @return seconds spent.
+double Drive(const char* line, uint64_t total) {
+  telsh::MemoryTransport& peer = g_session.GetTransport();
+  char block[32 * 1024];
+  const uint32_t line_len = static_cast<uint32_t>(std::strlen(line));
+  uint32_t block_len = 0;
+  while (block_len + line_len <= sizeof(block)) {
+    std::memcpy(block + block_len, line, line_len);
+    block_len += line_len;
+  }
+
+  const Clock::time_point t0 = Clock::now();
+  for (uint64_t fed = 0; fed < total; fed += block_len) {
+    peer.Feed(block, block_len);
+    while (peer.InputPending() > 0) {
+      g_session.OnReadable();
+    }
+    peer.ClearOutput();
+  }
+  return Seconds(t0);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const uint32_t input_mb = (argc > 1) ? static_cast<uint32_t>(std::atoi(argv[1])) : 64;
+  const uint32_t output_mb = (argc > 2) ? static_cast<uint32_t>(std::atoi(argv[2])) : 256;
+  std::memset(g_blob, 'x', sizeof(g_blob));
+
+  telsh::CommandRegistry registry;
+  registry.Register("nop", "no output", NopCmd);
+  registry.Register("blob", "1 KiB of output", BlobCmd);
+  telsh::SessionConfig cfg;
+  cfg.prompt = "> ";
+  cfg.banner = nullptr;
+  g_session.Init(0, registry, cfg);
+  g_session.Begin();
+
+  telsh::MemoryTransport& peer = g_session.GetTransport();
+  std::printf("telsh in-memory session benchmark (MemoryTransport)\n");
+
+  // Input path: typed lines of a no-op command (echo + dispatch + prompt).
+  const uint64_t in_bytes = static_cast<uint64_t>(input_mb) << 20;
+  uint64_t sent0 = peer.BytesSent();
+  const char* nop_line = "nop 0123456789 abcdef\r";
+  double secs = Drive(nop_line, in_bytes);
+  std::printf("input   %6.1f MB/s in, %6.1f MB/s echoed, %9.0f cmds/s\n", static_cast<double>(in_bytes) / secs / 1e6,
+              static_cast<double>(peer.BytesSent() - sent0) / secs / 1e6,
+              static_cast<double>(in_bytes / std::strlen(nop_line)) / secs);
+
+  // Output path: each 5-byte line produces kChunk bytes of command output.
+  const uint64_t out_lines = (static_cast<uint64_t>(output_mb) << 20) / kChunk;
+  sent0 = peer.BytesSent();
+  secs = Drive("blob\r", out_lines * 5U);
+  std::printf("output  %6.1f MB/s\n", static_cast<double>(peer.BytesSent() - sent0) / secs / 1e6);
+  return 0;
+}
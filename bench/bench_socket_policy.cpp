@@ -0,0 +1,156 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh socket policy benchmark -- keystroke echo latency and dump
+// throughput of a loopback session under each SocketPolicy profile.
+//
+// Usage:
+//   ./telsh_bench_socket_policy [echo_rounds] [dump_kb]
+
+#include "telsh/telnet_server.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t kMaxRounds = 100000;
+uint64_t g_samples[kMaxRounds];
+
+int ConnectLoopback(uint16_t port) {
+  int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  if (fd < 0 || ::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+    std::perror("connect");
+    std::exit(1);
+  }
+  int32_t on = 1;  // keep the client side out of the measurement
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return fd;
+}
+
+/// Read until @p tail has been seen at the end of the stream.
+/// @return bytes read.
+uint64_t ReadUntil(int fd, const char* tail) {
+  static char buf[64 * 1024];
+  const size_t tail_len = std::strlen(tail);
+  char last[64] = {};
+  size_t last_len = 0;
+  uint64_t total = 0;
+  for (;;) {
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      return total;
+    }
+    total += static_cast<uint64_t>(n);
+    // Keep the last tail_len bytes across reads
+    for (ssize_t i = 0; i < n; ++i) {
+      if (last_len == tail_len) {
+        std::memmove(last, last + 1, tail_len - 1);
+        --last_len;
+      }
+      last[last_len++] = buf[i];
+    }
+    if (last_len == tail_len && std::memcmp(last, tail, tail_len) == 0) {
+      return total;
+    }
+  }
+}
+
+void ReadExact(int fd, uint32_t len) {
+  char buf[16];
+  while (len > 0) {
+    ssize_t n = ::read(fd, buf, len < sizeof(buf) ? len : sizeof(buf));
+    if (n <= 0) {
+      std::exit(1);
+    }
+    len -= static_cast<uint32_t>(n);
+  }
+}
+
+int DumpCmd(int argc, char* argv[], void* ctx) {
+  (void)ctx;
+  static char line[128];
+  std::memset(line, 'x', sizeof(line) - 2);
+  line[sizeof(line) - 2] = '\r';
+  line[sizeof(line) - 1] = '\n';
+  const uint64_t bytes = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : 0;
+  telsh::ExecContext* ec = telsh::CurrentExec();
+  for (uint64_t sent = 0; sent < bytes; sent += sizeof(line)) {
+    ec->output_fn(line, sizeof(line), ec->output_ctx);
+  }
+  return 0;
+}
+
+void RunProfile(const char* name, const telsh::SocketPolicy& policy, uint32_t rounds, uint32_t dump_kb) {
+  telsh::CommandRegistry registry;
+  registry.Register("dump", "dump <bytes>", DumpCmd);
+  telsh::ServerConfig cfg;
+  cfg.port = 0;
+  cfg.prompt = "$ ";
+  cfg.banner = "";
+  cfg.socket_policy = policy;
+  telsh::TelnetServer server(registry, cfg);
+  if (!server.Start()) {
+    std::exit(1);
+  }
+
+  int fd = ConnectLoopback(server.Port());
+  ReadUntil(fd, "$ ");
+
+  // Keystroke echo: type a character, wait for its echo, erase it again
+  for (uint32_t i = 0; i < rounds; ++i) {
+    auto t0 = Clock::now();
+    (void)::write(fd, "a", 1);
+    ReadExact(fd, 1);
+    g_samples[i] = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count());
+    (void)::write(fd, "\x7f", 1);
+    ReadExact(fd, 3);  // "\b \b"
+  }
+  std::sort(g_samples, g_samples + rounds);
+
+  // Dump throughput: one command producing dump_kb KiB, timed to the prompt
+  char cmd[64];
+  int len = std::snprintf(cmd, sizeof(cmd), "dump %u\r", dump_kb * 1024U);
+  auto t0 = Clock::now();
+  (void)::write(fd, cmd, static_cast<size_t>(len));
+  uint64_t bytes = ReadUntil(fd, "\r\n$ ");
+  double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+
+  std::printf("%-14s echo p50 %7.1f us  p99 %7.1f us  max %8.1f us | dump %6.1f MB/s\n", name,
+              static_cast<double>(g_samples[rounds / 2]) / 1e3, static_cast<double>(g_samples[rounds * 99 / 100]) / 1e3,
+              static_cast<double>(g_samples[rounds - 1]) / 1e3, static_cast<double>(bytes) / secs / 1e6);
+
+  ::close(fd);
+  server.Stop();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  uint32_t rounds = (argc > 1) ? static_cast<uint32_t>(std::atoi(argv[1])) : 2000;
+  uint32_t dump_kb = (argc > 2) ? static_cast<uint32_t>(std::atoi(argv[2])) : 32768;
+  rounds = std::min(std::max(rounds, 1U), kMaxRounds);
+
+  osp::log::SetLevel(osp::log::Level::kWarn);
+  std::printf("telsh socket policy benchmark: %u echo rounds, %u KiB dump (loopback)\n", rounds, dump_kb);
+  RunProfile("kernel-default", telsh::SocketPolicy::KernelDefault(), rounds, dump_kb);
+  RunProfile("default", telsh::SocketPolicy(), rounds, dump_kb);
+  RunProfile("interactive", telsh::SocketPolicy::Interactive(), rounds, dump_kb);
+  RunProfile("bulk", telsh::SocketPolicy::Bulk(), rounds, dump_kb);
+  return 0;
+}
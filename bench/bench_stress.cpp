@@ -0,0 +1,473 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh concurrency stress -- one TelnetServer, persistent listener
+// clients running commands, churn clients connecting and disconnecting
+// as fast as the pool allows, and producer threads hammering tel_printf().
+//
+// Every broadcast record carries its producer, a sequence number and a
+// checksum, so each client can tell:
+//   - interleaved output: a record that is not alone and intact on its line
+//   - reordering: a producer's records arriving out of order
+//   - silent loss: sequence gaps not covered by "[N messages dropped]"
+//   - lost replies: a command whose output never came back
+// Exits 1 on any of these or if the session pool leaks a slot.  The run
+// ends with TelnetServer::Stop() while listeners and producers are still
+// busy.  Build with -fsanitize=thread to check Broadcast / FindFreeSlot /
+// SessionLoop / Stop.
+//
+// Usage:
+//   ./telsh_bench_stress [seconds] [listeners] [churners] [producers] [detach_ms]
+//   (detach_ms > 0: clients log in and dropped churn sessions are parked as
+//   detached, so broadcasts race with slot expiry and reuse)
+
+#include "telsh/telnet_server.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint32_t kMaxThreads = 64;
+constexpr uint32_t kChurnIdBase = 100;  ///< Record ids of "bcast" run by churners
+constexpr uint32_t kMaxIds = kChurnIdBase + kMaxThreads;
+constexpr uint32_t kPayloadLen = 48;
+constexpr int kReplyTimeoutMs = 5000;
+const char* const kPrompt = "telsh> ";
+const char* const kLogin = "stress\rstress\r";  ///< Username and password lines (detach needs a login)
+
+bool g_login = false;  ///< Set before any client starts
+
+std::atomic<bool> g_stop{false};             ///< Churners stop
+std::atomic<bool> g_server_stopping{false};  ///< EOF on a session is expected from now on
+std::atomic<bool> g_done{false};             ///< Listeners and producers stop
+
+struct Totals {
+  std::atomic<uint64_t> produced{0};
+  std::atomic<uint64_t> records{0};  ///< Records received by all clients
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> commands{0};  ///< Replies received
+  std::atomic<uint64_t> missing{0};   ///< Replies never received
+  std::atomic<uint64_t> connects{0};
+  std::atomic<uint64_t> rejected{0};
+  std::atomic<uint64_t> reported{0};  ///< Sum of "[N messages dropped]"
+  std::atomic<uint64_t> gaps{0};      ///< Records missing from a sequence
+  std::atomic<uint64_t> interleaved{0};
+  std::atomic<uint64_t> reordered{0};
+};
+Totals g_totals;
+
+// ---------------------------------------------------------------------------
+// Records: "@P<id>:<seq>:<payload>#<sum>"
+// ---------------------------------------------------------------------------
+
+void MakePayload(uint32_t id, uint32_t seq, char* out) {
+  for (uint32_t i = 0; i < kPayloadLen; ++i) {
+    out[i] = static_cast<char>('a' + (id + seq + i) % 26);
+  }
+  out[kPayloadLen] = '\0';
+}
+
+uint32_t Checksum(uint32_t id, uint32_t seq, const char* payload) {
+  uint32_t sum = id * 31U + seq;
+  for (const char* p = payload; *p != '\0'; ++p) {
+    sum = sum * 131U + static_cast<uint8_t>(*p);
+  }
+  return sum;
+}
+
+void PublishRecord(uint32_t id, uint32_t seq) {
+  char payload[kPayloadLen + 1];
+  MakePayload(id, seq, payload);
+  telsh::tel_printf("@P%u:%u:%s#%u\r\n", id, seq, payload, Checksum(id, seq, payload));
+}
+
+/// Parse a whole line as one record.  @return false if it is not intact.
+bool ParseRecord(const char* line, uint32_t* id, uint32_t* seq) {
+  char payload[kPayloadLen + 8];
+  uint32_t sum = 0;
+  int used = 0;
+  if (std::sscanf(line, "@P%u:%u:%55[a-z]#%u%n", id, seq, payload, &sum, &used) != 4 ||
+      line[used] != '\0' || *id >= kMaxIds) {
+    return false;
+  }
+  char expect[kPayloadLen + 1];
+  MakePayload(*id, *seq, expect);
+  return std::strcmp(payload, expect) == 0 && sum == Checksum(*id, *seq, payload);
+}
+
+// ---------------------------------------------------------------------------
+// Commands
+// ---------------------------------------------------------------------------
+
+void Reply(const char* text) {
+  telsh::ExecContext* ec = telsh::CurrentExec();
+  char line[96];
+  int n = std::snprintf(line, sizeof(line), "%s\r\n", text);
+  ec->output_fn(line, static_cast<uint32_t>(n), ec->output_ctx);
+}
+
+int EchoCmd(int argc, char* argv[], void*) {
+  Reply((argc > 1) ? argv[1] : "");
+  return 0;
+}
+
+/// "bcast <id> <seq> <token>": broadcast a record, then reply with token.
+int BcastCmd(int argc, char* argv[], void*) {
+  if (argc != 4) {
+    return -1;
+  }
+  PublishRecord(static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)),
+                static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)));
+  Reply(argv[3]);
+  return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Client connection with a checking line parser
+// ---------------------------------------------------------------------------
+
+class Client {
+ public:
+  ~Client() { Close(); }
+
+  bool Connect(uint16_t port) {
+    fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (fd_ < 0 || ::connect(fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+      Close();
+      return false;
+    }
+    len_ = 0;
+    iac_skip_ = 0;
+    prompt_ = false;
+    full_ = false;
+    std::fill(last_, last_ + kMaxIds, UINT32_MAX);
+    if (g_login) {
+      // Typed ahead: the session reads them as the username and password
+      (void)::send(fd_, kLogin, std::strlen(kLogin), MSG_NOSIGNAL);
+    }
+    return true;
+  }
+
+  /// Wait for the first prompt.  @return false if the server was full.
+  bool WaitPrompt() {
+    const auto deadline = Clock::now() + std::chrono::milliseconds(kReplyTimeoutMs);
+    while (!prompt_ && Clock::now() < deadline) {
+      if (!Pump(10)) {
+        break;
+      }
+    }
+    if (!prompt_) {
+      (full_ ? g_totals.rejected : g_totals.missing).fetch_add(1, std::memory_order_relaxed);
+    }
+    return prompt_;
+  }
+
+  /// Send @p cmd and wait until a line equal to @p token arrives.
+  bool Command(const char* cmd, const char* token) {
+    std::snprintf(want_, sizeof(want_), "%s", token);
+    got_ = false;
+    char line[160];
+    int n = std::snprintf(line, sizeof(line), "%s\r", cmd);
+    if (::send(fd_, line, static_cast<size_t>(n), MSG_NOSIGNAL) != n) {
+      return false;
+    }
+    const auto deadline = Clock::now() + std::chrono::milliseconds(kReplyTimeoutMs);
+    bool open = true;
+    while (!got_ && open && Clock::now() < deadline) {
+      open = Pump(10);
+    }
+    if (got_) {
+      g_totals.commands.fetch_add(1, std::memory_order_relaxed);
+    } else if (open || !g_server_stopping.load(std::memory_order_relaxed)) {
+      g_totals.missing.fetch_add(1, std::memory_order_relaxed);
+    }
+    return got_;
+  }
+
+  void Send(const char* cmd) {
+    char line[160];
+    int n = std::snprintf(line, sizeof(line), "%s\r", cmd);
+    (void)::send(fd_, line, static_cast<size_t>(n), MSG_NOSIGNAL);
+  }
+
+  /// Read whatever arrives within @p timeout_ms.  @return false on EOF.
+  bool Pump(int timeout_ms) {
+    struct pollfd pfd = {fd_, POLLIN, 0};
+    if (::poll(&pfd, 1, timeout_ms) <= 0) {
+      return true;
+    }
+    char buf[8192];
+    ssize_t n = ::recv(fd_, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      return false;
+    }
+    g_totals.bytes.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+    for (ssize_t i = 0; i < n; ++i) {
+      Feed(static_cast<uint8_t>(buf[i]));
+    }
+    return true;
+  }
+
+  void Close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+ private:
+  void Feed(uint8_t c) {
+    if (iac_skip_ > 0) {  // server only sends 3-byte IAC WILL/WONT/DO/DONT
+      --iac_skip_;
+      return;
+    }
+    if (c == 0xFF) {
+      iac_skip_ = 2;
+      return;
+    }
+    if (c == '\n') {
+      line_[len_] = '\0';
+      OnLine();
+      len_ = 0;
+      return;
+    }
+    if (len_ + 1 < sizeof(line_)) {
+      line_[len_++] = static_cast<char>(c);
+    }
+    const uint32_t plen = static_cast<uint32_t>(std::strlen(kPrompt));
+    if (len_ >= plen && std::memcmp(line_ + len_ - plen, kPrompt, plen) == 0) {
+      prompt_ = true;
+    }
+  }
+
+  /// Text after the last "erase line" of a drained batch, without the CR.
+  void OnLine() {
+    if (len_ > 0 && line_[len_ - 1] == '\r') {
+      line_[--len_] = '\0';
+    }
+    const char* text = line_;
+    for (const char* p = std::strstr(text, "\x1b[K"); p != nullptr; p = std::strstr(text, "\x1b[K")) {
+      text = p + 3;
+    }
+    if (std::strncmp(text, "Server full", 11) == 0) {
+      full_ = true;
+    }
+    uint32_t dropped = 0;
+    if (std::sscanf(text, "[%u messages dropped]", &dropped) == 1) {
+      g_totals.reported.fetch_add(dropped, std::memory_order_relaxed);
+    }
+    if (want_[0] != '\0' && std::strcmp(text, want_) == 0) {
+      got_ = true;
+    }
+    const char* rec = std::strstr(text, "@P");
+    if (rec == nullptr) {
+      return;
+    }
+    uint32_t id = 0;
+    uint32_t seq = 0;
+    if (rec != text || !ParseRecord(text, &id, &seq)) {
+      g_totals.interleaved.fetch_add(1, std::memory_order_relaxed);
+      std::fprintf(stderr, "interleaved: %.120s\n", line_);
+      return;
+    }
+    g_totals.records.fetch_add(1, std::memory_order_relaxed);
+    if (last_[id] != UINT32_MAX) {
+      if (seq <= last_[id]) {
+        g_totals.reordered.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        g_totals.gaps.fetch_add(seq - last_[id] - 1, std::memory_order_relaxed);
+      }
+    }
+    last_[id] = seq;
+  }
+
+  int fd_ = -1;
+  char line_[1024];
+  uint32_t len_ = 0;
+  uint8_t iac_skip_ = 0;
+  bool prompt_ = false;
+  bool full_ = false;
+  bool got_ = false;
+  char want_[64] = {};
+  uint32_t last_[kMaxIds];
+};
+
+// ---------------------------------------------------------------------------
+// Threads
+// ---------------------------------------------------------------------------
+
+void Producer(uint32_t id) {
+  for (uint32_t seq = 0; !g_done.load(std::memory_order_relaxed); ++seq) {
+    PublishRecord(id, seq);
+    g_totals.produced.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+/// Persistent session: commands back to back while reading the broadcasts,
+/// until the server stops.
+void Listener(uint16_t port, uint32_t id) {
+  Client c;
+  while (!c.Connect(port) || !c.WaitPrompt()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  g_totals.connects.fetch_add(1, std::memory_order_relaxed);
+  char cmd[64];
+  char token[32];
+  for (uint32_t n = 0; !g_done.load(std::memory_order_relaxed); ++n) {
+    std::snprintf(token, sizeof(token), "@E%u:%u", id, n);
+    std::snprintf(cmd, sizeof(cmd), "echo %s", token);
+    if (!c.Command(cmd, token)) {
+      break;
+    }
+  }
+}
+
+/// Connect, run one command (or not), disconnect -- repeatedly.
+void Churner(uint16_t port, uint32_t id) {
+  char cmd[96];
+  char token[32];
+  uint32_t seq = 0;
+  for (uint32_t n = 0; !g_stop.load(std::memory_order_relaxed); ++n) {
+    Client c;
+    if (!c.Connect(port)) {
+      continue;
+    }
+    if (!c.WaitPrompt()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+    g_totals.connects.fetch_add(1, std::memory_order_relaxed);
+    std::snprintf(token, sizeof(token), "@C%u:%u", id, n);
+    switch (n % 4) {
+      case 0:  // hang up right after the prompt
+        break;
+      case 1:  // hang up with a command in flight
+        std::snprintf(cmd, sizeof(cmd), "echo %s", token);
+        c.Send(cmd);
+        break;
+      default:  // broadcast from a session thread, wait for completion
+        std::snprintf(cmd, sizeof(cmd), "bcast %u %u %s", kChurnIdBase + id, seq++, token);
+        (void)c.Command(cmd, token);
+        break;
+    }
+  }
+}
+
+uint32_t Arg(int argc, char* argv[], int i, uint32_t def, uint32_t max) {
+  uint32_t v = (argc > i) ? static_cast<uint32_t>(std::atoi(argv[i])) : def;
+  return std::min(std::max(v, 1U), max);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const uint32_t seconds = Arg(argc, argv, 1, 5, 3600);
+  const uint32_t listeners = Arg(argc, argv, 2, 4, telsh::TelnetServer::kMaxSessions - 1);
+  const uint32_t churners = Arg(argc, argv, 3, 24, kMaxThreads);
+  const uint32_t producers = Arg(argc, argv, 4, 4, kMaxThreads);
+  const uint32_t detach_ms = (argc > 5) ? static_cast<uint32_t>(std::atoi(argv[5])) : 0;
+
+  osp::log::SetLevel(osp::log::Level::kError);
+  telsh::CommandRegistry registry;
+  registry.Register("echo", "echo <token>", EchoCmd);
+  registry.Register("bcast", "bcast <id> <seq> <token>", BcastCmd);
+  telsh::ServerConfig cfg;
+  cfg.port = 0;
+  cfg.prompt = kPrompt;
+  cfg.banner = "";
+  cfg.max_sessions = telsh::TelnetServer::kMaxSessions;
+  cfg.detach_grace_ms = detach_ms;
+  if (detach_ms > 0) {
+    cfg.username = "stress";
+    cfg.password = "stress";
+    g_login = true;
+  }
+  telsh::TelnetServer server(registry, cfg);
+  if (!server.Start()) {
+    return 1;
+  }
+  std::printf("telsh stress: %u s, %u listeners, %u churners, %u producers, %u slots, detach %u ms\n", seconds,
+              listeners, churners, producers, cfg.max_sessions, detach_ms);
+
+  std::thread threads[kMaxThreads * 2 + telsh::TelnetServer::kMaxSessions];
+  uint32_t nthreads = 0;
+  for (uint32_t i = 0; i < listeners; ++i) {
+    threads[nthreads++] = std::thread(Listener, server.Port(), i);
+  }
+  while (server.ActiveCount() < listeners) {  // listeners first, churners take the rest
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  for (uint32_t i = 0; i < churners; ++i) {
+    threads[nthreads++] = std::thread(Churner, server.Port(), i);
+  }
+  for (uint32_t i = 0; i < producers; ++i) {
+    threads[nthreads++] = std::thread(Producer, i);
+  }
+
+  const auto t0 = Clock::now();
+  std::this_thread::sleep_for(std::chrono::seconds(seconds));
+  g_stop.store(true);
+  for (uint32_t i = listeners; i < listeners + churners; ++i) {
+    threads[i].join();
+  }
+  const double secs = std::chrono::duration<double>(Clock::now() - t0).count();
+
+  // Every churner has hung up: only the listeners may keep a slot
+  const auto deadline = Clock::now() + std::chrono::seconds(5);
+  while (server.ActiveCount() > listeners && Clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  const uint32_t leaked = server.ActiveCount() - listeners;
+
+  // Stop under load: listeners mid-command, producers broadcasting
+  g_server_stopping.store(true);
+  server.Stop();
+  g_done.store(true);
+  for (uint32_t i = 0; i < nthreads; ++i) {
+    if (threads[i].joinable()) {
+      threads[i].join();
+    }
+  }
+
+  const Totals& t = g_totals;
+  const uint64_t gaps = t.gaps.load();
+  const uint64_t reported = t.reported.load();
+  const uint64_t silent = (gaps > reported) ? gaps - reported : 0;
+  std::printf("tel_printf   %10.0f records/s (%llu)\n", static_cast<double>(t.produced.load()) / secs,
+              static_cast<unsigned long long>(t.produced.load()));
+  std::printf("delivered    %10.0f records/s  %6.1f MB/s\n", static_cast<double>(t.records.load()) / secs,
+              static_cast<double>(t.bytes.load()) / secs / 1e6);
+  std::printf("commands     %10.0f replies/s (%llu missing)\n", static_cast<double>(t.commands.load()) / secs,
+              static_cast<unsigned long long>(t.missing.load()));
+  std::printf("connections  %10.0f /s (%llu accepted, %llu server full)\n", static_cast<double>(t.connects.load()) / secs,
+              static_cast<unsigned long long>(server.AcceptedCount()),
+              static_cast<unsigned long long>(server.RejectedCount()));
+  std::printf("drops        %llu reported, %llu gaps, %llu silent\n", static_cast<unsigned long long>(reported),
+              static_cast<unsigned long long>(gaps), static_cast<unsigned long long>(silent));
+  std::printf("errors       %llu interleaved, %llu reordered, %u leaked slots\n",
+              static_cast<unsigned long long>(t.interleaved.load()),
+              static_cast<unsigned long long>(t.reordered.load()), leaked);
+
+  const bool ok = t.interleaved.load() == 0 && t.reordered.load() == 0 && silent == 0 && t.missing.load() == 0 &&
+                  leaked == 0;
+  std::printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
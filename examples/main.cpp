@@ -50,21 +50,20 @@ TELSH_CMD(add, "Add two integers: add <a> <b>") {
 }
 
 // ============================================================================
-// Example: register a member function via context pointer
+// Example: stateful commands (member function, capturing lambda)
 // ============================================================================
 
 struct Counter {
   int32_t value = 0;
-};
 
-static int cmd_count(int argc, char* argv[], void* ctx) {
-  (void)argc;
-  (void)argv;
-  auto* c = static_cast<Counter*>(ctx);
-  c->value++;
-  telsh::TelnetServer::Printf("Counter: %d\r\n", c->value);
-  return 0;
-}
+  int Count(int argc, char* argv[]) {
+    (void)argc;
+    (void)argv;
+    value++;
+    telsh::TelnetServer::Printf("Counter: %d\r\n", value);
+    return 0;
+  }
+};
 
 // ============================================================================
 // Signal handling for graceful shutdown
@@ -85,9 +84,17 @@ int main() {
   std::signal(SIGINT, SignalHandler);
   std::signal(SIGTERM, SignalHandler);
 
-  // Register commands with context
+  // Register stateful commands
   Counter counter;
-  telsh::CommandRegistry::Instance().Register("count", "Increment and show counter", cmd_count, &counter);
+  telsh::CommandRegistry::Instance().Register<&Counter::Count>("count", "Increment and show counter", &counter);
+  telsh::CommandRegistry::Instance().Register("peek", "Show counter without changing it",
+                                              [&counter](int argc, char* argv[]) {
+                                                (void)argc;
+                                                (void)argv;
+                                                telsh::TelnetServer::Printf("Counter: %d\r\n", counter.value);
+                                                return 0;
+                                              });
+  telsh::RegisterLatencyCommand(telsh::CommandRegistry::Instance());
 
   // Configure server
   telsh::ServerConfig config;
@@ -6,18 +6,39 @@
 // Design:
 //   - Fixed-capacity array (kMaxCommands = 64), zero heap allocation
 //   - Unified command signature: int (*)(int argc, char* argv[], void* ctx)
+//   - Stateful handlers: capturing lambdas (osp::FixedFunction, inline
+//     storage) or member functions bound at compile time
 //   - Thread-safe registration (std::mutex)
 //   - In-place ShellSplit for argc/argv parsing (handles quotes)
-//   - Built-in "help" command
+//   - Built-in "help" command: sorted, column-aligned listing rendered once
+//     per registry change and emitted with a single write; "help <cmd>"
+//     shows one entry
+//   - ExecContext (output sink + scratch arena) visible to the running
+//     command via CurrentExec()
+//   - ExecuteCapture(): run a command line in-process and collect its
+//     output (including TelnetServer::Printf) in a buffer or a callback
+//   - "Did you mean" suggestions for unknown commands (bit-parallel
+//     Levenshtein over all registered names)
+//   - Access control: per-command group id (runtime enable/disable) and
+//     required-role bitmask, checked against the session's role mask
+//   - Per-command run counters (CmdStats: calls, failures, time spent)
 //   - TELSH_CMD macro for static auto-registration
 
 #pragma once
 
+#include "osp/platform.hpp"
+#include "osp/vocabulary.hpp"
+#include "telsh/edit_distance.hpp"
+#include "telsh/scratch_arena.hpp"
+
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 
+#include <atomic>
 #include <mutex>
+#include <type_traits>
+#include <utility>
 
 namespace telsh {
 
@@ -34,15 +55,100 @@ using CmdFn = int (*)(int argc, char* argv[], void* ctx);
 /// Output callback used by Execute to send text back to the caller.
 using OutputFn = void (*)(const char* str, uint32_t len, void* ctx);
 
+/// Role bitmask with every role set (unrestricted caller).
+constexpr uint32_t kRoleAll = 0xFFFFFFFFU;
+
+/// Number of command groups (group ids 0..kMaxGroups-1; 0 = default).
+constexpr uint8_t kMaxGroups = 32;
+
+// ---------------------------------------------------------------------------
+// ExecContext -- per-execution state handed to the running command
+// ---------------------------------------------------------------------------
+
+struct PosixTransport;
+template <typename Transport>
+class BasicTelnetSession;
+using TelnetSession = BasicTelnetSession<PosixTransport>;  ///< telnet_session.hpp
+
+struct ExecContext {
+  OutputFn output_fn = nullptr;  ///< Where command output goes
+  void* output_ctx = nullptr;
+  ScratchArena* arena = nullptr;     ///< Scratch memory, released after the command
+  uint32_t roles = kRoleAll;         ///< Caller's roles (from login)
+  int32_t sock_fd = -1;              ///< Session socket for direct streaming, -1 if none
+  bool may_block = false;            ///< Command may wait on the client (own thread)
+  bool capture_printf = false;       ///< TelnetServer::Printf goes to output_fn, not to all sessions
+  TelnetSession* session = nullptr;  ///< Issuing telnet session, nullptr for local callers
+};
+
+namespace detail {
+inline ExecContext*& CurrentExecRef() {
+  static thread_local ExecContext* current = nullptr;
+  return current;
+}
+
+/// OutputFn that appends to a caller buffer (see ExecuteCapture).
+struct CaptureBuffer {
+  char* buf;
+  size_t cap;
+  size_t len;  ///< Bytes produced, may exceed cap - 1 (truncated)
+
+  static void Append(const char* str, uint32_t n, void* ctx) {
+    auto* self = static_cast<CaptureBuffer*>(ctx);
+    if (self->buf != nullptr && self->len + 1 < self->cap) {
+      const size_t room = self->cap - 1 - self->len;
+      const size_t take = (n < room) ? n : room;
+      std::memcpy(self->buf + self->len, str, take);
+      self->buf[self->len + take] = '\0';
+    }
+    self->len += n;
+  }
+};
+}  // namespace detail
+
+/// Context of the command executing on this thread, nullptr outside Execute().
+inline ExecContext* CurrentExec() {
+  return detail::CurrentExecRef();
+}
+
+/// Allocate scratch memory for the running command.  Freed automatically
+/// when the command returns.  @return nullptr outside a command, when the
+/// caller provided no arena, or when the arena is exhausted.
+inline void* ScratchAlloc(uint32_t size, uint32_t align = ScratchArena::kDefaultAlign) {
+  ExecContext* ec = CurrentExec();
+  if (ec == nullptr || ec->arena == nullptr) {
+    return nullptr;
+  }
+  return ec->arena->Alloc(size, align);
+}
+
 // ---------------------------------------------------------------------------
 // CmdEntry
 // ---------------------------------------------------------------------------
 
+/// Run counters of one command (relaxed atomics, any thread).
+struct CmdStats {
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> failures{0};  ///< Runs returning non-zero
+  std::atomic<uint64_t> total_us{0};  ///< Time spent in the command
+
+  void Record(int rc, uint64_t us) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    failures.fetch_add((rc != 0) ? 1U : 0U, std::memory_order_relaxed);
+    total_us.fetch_add(us, std::memory_order_relaxed);
+  }
+};
+
+/// roles and group can change at runtime (SetAccess); outside the registry
+/// lock they are read with relaxed __atomic loads.
 struct CmdEntry {
   const char* name;  ///< Command name (must point to static storage)
   const char* desc;  ///< Human-readable description (static storage)
   CmdFn fn;          ///< Callback
   void* ctx;         ///< User context
+  uint32_t roles;    ///< Roles required (all bits must be held); 0 = public
+  uint8_t group;     ///< Group id, see CommandRegistry::SetGroupEnabled
+  CmdStats* stats;   ///< Run counters, owned by the registry
 };
 
 // ---------------------------------------------------------------------------
@@ -132,6 +238,15 @@ class CommandRegistry {
  public:
   static constexpr uint32_t kMaxCommands = 64;
   static constexpr int kMaxArgs = 32;
+  static constexpr size_t kClosureSize = 4 * sizeof(void*);
+  static constexpr uint32_t kHelpNameWidth = 32;  ///< Names wider than this break alignment
+  static constexpr uint32_t kHelpDescWidth = 80;  ///< Longer descriptions are truncated
+  static constexpr uint32_t kHelpCacheSize = 8192;
+  static constexpr uint32_t kMaxSuggestions = 3;
+  static constexpr uint32_t kMaxLineLen = 256;  ///< ExecuteCapture() command line limit
+
+  /// Stateful command handler with inline (non-heap) capture storage.
+  using CmdClosure = osp::FixedFunction<int(int, char**), kClosureSize>;
 
   CommandRegistry() = default;
 
@@ -151,22 +266,100 @@ class CommandRegistry {
     }
 
     // Reject duplicates
-    for (uint32_t i = 0; i < count_; ++i) {
-      if (std::strcmp(entries_[i].name, name) == 0) {
-        return false;
-      }
+    if (FindIndexLocked(name) >= 0) {
+      return false;
     }
 
-    entries_[count_] = {name, desc, fn, ctx};
-    ++count_;
+    AddLocked({name, desc, fn, ctx, 0, 0, nullptr});
+    return true;
+  }
+
+  /// Register a capturing lambda / functor callable as int(int, char**).
+  /// Captures live inline in the registry (at most kClosureSize bytes).
+  /// Captureless callables convertible to CmdFn use the overload above.
+  template <typename F, typename = typename std::enable_if<!std::is_convertible<F, CmdFn>::value &&
+                                                          std::is_invocable_r<int, F&, int, char**>::value>::type>
+  bool Register(const char* name, const char* desc, F&& fn) {
+    if (name == nullptr) {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count_ >= kMaxCommands || FindIndexLocked(name) >= 0) {
+      return false;
+    }
+
+    closures_[count_] = CmdClosure(std::forward<F>(fn));
+    AddLocked({name, desc, ClosureThunk, &closures_[count_], 0, 0, nullptr});
     return true;
   }
 
+  /// Register a member function `int T::Method(int argc, char* argv[])`
+  /// bound to @p obj.  The method is a template argument, so dispatch is a
+  /// single indirect call like a plain CmdFn:
+  ///   reg.Register<&Counter::Cmd>("count", "Increment counter", &counter);
+  template <auto Method, typename T>
+  bool Register(const char* name, const char* desc, T* obj) {
+    static_assert(std::is_member_function_pointer<decltype(Method)>::value, "Method must be a member function");
+    if (obj == nullptr) {
+      return false;
+    }
+    CmdFn thunk = [](int argc, char* argv[], void* ctx) -> int { return (static_cast<T*>(ctx)->*Method)(argc, argv); };
+    return Register(name, desc, thunk, obj);
+  }
+
+  /// Restrict @p name to @p group and require all bits of @p roles.
+  /// Works for any registration path, including TELSH_CMD.
+  bool SetAccess(const char* name, uint8_t group, uint32_t roles) {
+    if (name == nullptr || group >= kMaxGroups) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    int32_t idx = FindIndexLocked(name);
+    if (idx < 0) {
+      return false;
+    }
+    // Resolve()d entries are dispatched without the lock
+    __atomic_store_n(&entries_[idx].group, group, __ATOMIC_RELAXED);
+    __atomic_store_n(&entries_[idx].roles, roles, __ATOMIC_RELAXED);
+    help_dirty_ = true;
+    return true;
+  }
+
+  /// Enable or disable a whole group at runtime (e.g. dangerous commands in
+  /// production).  Takes effect on the next dispatch; no table scan.
+  void SetGroupEnabled(uint8_t group, bool enabled) {
+    if (group >= kMaxGroups) {
+      return;
+    }
+    const uint32_t bit = 1U << group;
+    if (enabled) {
+      enabled_groups_.fetch_or(bit, std::memory_order_relaxed);
+    } else {
+      enabled_groups_.fetch_and(~bit, std::memory_order_relaxed);
+    }
+  }
+
+  bool IsGroupEnabled(uint8_t group) const {
+    return group < kMaxGroups && ((enabled_groups_.load(std::memory_order_relaxed) >> group) & 1U) != 0;
+  }
+
   /// Execute a command line (modified in-place).
   /// @param output_fn  callback to send output text
   /// @param output_ctx context for output_fn
-  /// @return command return code, -1 = not found, -2 = parse error
+  /// @return command return code, -1 = not found, -2 = parse error,
+  ///         -3 = command disabled or permission denied
   int Execute(char* cmdline, OutputFn output_fn, void* output_ctx) {
+    ExecContext ec;
+    ec.output_fn = output_fn;
+    ec.output_ctx = output_ctx;
+    return Execute(cmdline, ec);
+  }
+
+  /// Execute with a full execution context.  @p ec is published through
+  /// CurrentExec() for the duration of the command; scratch allocations
+  /// made by the command are released when it returns.
+  int Execute(char* cmdline, ExecContext& ec) {
     if (cmdline == nullptr) {
       return -2;
     }
@@ -180,43 +373,164 @@ class CommandRegistry {
       return 0;
     }
 
-    // Built-in: help
+    // Built-in: help [cmd]
     if (std::strcmp(argv[0], "help") == 0) {
-      PrintHelp(output_fn, output_ctx);
+      if (argc > 1) {
+        return PrintCommandHelp(argv[1], ec);
+      }
+      PrintHelp(ec);
       return 0;
     }
 
     // Lookup
-    std::lock_guard<std::mutex> lock(mutex_);
-    for (uint32_t i = 0; i < count_; ++i) {
-      if (std::strcmp(entries_[i].name, argv[0]) == 0) {
-        return entries_[i].fn(argc, argv, entries_[i].ctx);
+    CmdEntry entry = {};
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      int32_t idx = FindIndexLocked(argv[0]);
+      if (idx >= 0) {
+        entry = entries_[idx];
       }
     }
+    if (entry.fn != nullptr) {
+      return Dispatch(entry, argc, argv, ec);
+    }
 
     // Not found
-    if (output_fn != nullptr) {
-      char buf[128];
+    if (ec.output_fn != nullptr) {
+      char buf[256];
       int n = std::snprintf(buf, sizeof(buf), "Unknown command: %s\r\n", argv[0]);
-      if (n > 0) {
-        output_fn(buf, static_cast<uint32_t>(n), output_ctx);
+      if (n > 0 && static_cast<uint32_t>(n) < sizeof(buf)) {
+        n += FormatSuggestions(argv[0], ec.roles, buf + n, sizeof(buf) - static_cast<uint32_t>(n));
+        ec.output_fn(buf, static_cast<uint32_t>(n), ec.output_ctx);
       }
     }
     return -1;
   }
 
-  /// Find command by name.
-  const CmdEntry* FindByName(const char* name) const {
+  /// Entry registered as @p name, or nullptr.  Entries are never moved or
+  /// removed, so the pointer stays valid for the registry's lifetime
+  /// (e.g. for pre-resolved scripts).
+  const CmdEntry* Resolve(const char* name) const {
     if (name == nullptr) {
       return nullptr;
     }
+    std::lock_guard<std::mutex> lock(mutex_);
+    int32_t idx = FindIndexLocked(name);
+    return (idx >= 0) ? &entries_[idx] : nullptr;
+  }
+
+  /// Run an already resolved @p entry with the group and role checks of
+  /// Execute().  @return command return code, -3 = disabled / denied.
+  int Dispatch(const CmdEntry& entry, int argc, char* argv[], ExecContext& ec) {
+    // SetAccess() may change these concurrently (no lock held here)
+    if (!IsGroupEnabled(__atomic_load_n(&entry.group, __ATOMIC_RELAXED))) {
+      Reply(ec, "Command disabled: %s\r\n", argv[0]);
+      return -3;
+    }
+    if ((__atomic_load_n(&entry.roles, __ATOMIC_RELAXED) & ~ec.roles) != 0) {
+      Reply(ec, "Permission denied: %s\r\n", argv[0]);
+      return -3;
+    }
+    return Invoke(entry, argc, argv, ec);
+  }
+
+  /// Run @p cmdline (copied, not modified) in-process, streaming its output
+  /// to @p output_fn.  TelnetServer::Printf / tel_printf output of the
+  /// command goes there too instead of being broadcast.  No session: the
+  /// command sees sock_fd -1 and no scratch arena.
+  /// @return as Execute(); -2 also for lines of kMaxLineLen bytes or more.
+  int ExecuteCapture(const char* cmdline, OutputFn output_fn, void* output_ctx, uint32_t roles = kRoleAll) {
+    if (cmdline == nullptr) {
+      return -2;
+    }
+    char line[kMaxLineLen];
+    const size_t len = std::strlen(cmdline);
+    if (len >= sizeof(line)) {
+      return -2;
+    }
+    std::memcpy(line, cmdline, len + 1);
+    ExecContext ec;
+    ec.output_fn = output_fn;
+    ec.output_ctx = output_ctx;
+    ec.roles = roles;
+    ec.capture_printf = true;
+    return Execute(line, ec);
+  }
+
+  /// Run @p cmdline and collect its output in @p buf, NUL-terminated and
+  /// truncated to @p cap - 1 bytes.  @p out_len (optional) receives the
+  /// full output length, so out_len >= cap means truncation.
+  /// @return as Execute().
+  int ExecuteCapture(const char* cmdline, char* buf, size_t cap, size_t* out_len = nullptr) {
+    detail::CaptureBuffer cb{buf, cap, 0};
+    if (buf != nullptr && cap > 0) {
+      buf[0] = '\0';
+    }
+    int rc = ExecuteCapture(cmdline, &detail::CaptureBuffer::Append, &cb);
+    if (out_len != nullptr) {
+      *out_len = cb.len;
+    }
+    return rc;
+  }
+
+  /// Collect up to @p max names closest to @p word by edit distance.
+  /// Only names within a length-dependent threshold (1 for <= 3 chars,
+  /// 2 for <= 6, else 3) qualify; "help" is included as a candidate.
+  /// Commands hidden from @p roles (or in disabled groups) are skipped.
+  /// @return number of names written to @p out, best first.
+  uint32_t Suggest(const char* word, const char* out[], uint32_t max, uint32_t roles = kRoleAll) const {
+    if (word == nullptr || out == nullptr || max == 0) {
+      return 0;
+    }
+    const MyersPattern pattern(word);
+    const uint32_t wlen = pattern.Length();
+    const uint32_t limit = (wlen <= 3) ? 1 : ((wlen <= 6) ? 2 : 3);
+
+    uint32_t dist[kMaxSuggestions + 1];
+    uint32_t found = 0;
+    max = (max > kMaxSuggestions) ? kMaxSuggestions : max;
+
+    auto consider = [&](const char* name) {
+      uint32_t d = pattern.Distance(name);
+      if (d == 0 || d > limit) {
+        return;
+      }
+      // Insertion into the small best-first list (stable for ties)
+      uint32_t pos = found;
+      while (pos > 0 && dist[pos - 1] > d) {
+        --pos;
+      }
+      if (pos >= max) {
+        return;
+      }
+      uint32_t end = (found < max) ? found : max - 1;
+      for (uint32_t k = end; k > pos; --k) {
+        out[k] = out[k - 1];
+        dist[k] = dist[k - 1];
+      }
+      out[pos] = name;
+      dist[pos] = d;
+      found = (found < max) ? found + 1 : max;
+    };
+
     std::lock_guard<std::mutex> lock(mutex_);
     for (uint32_t i = 0; i < count_; ++i) {
-      if (std::strcmp(entries_[i].name, name) == 0) {
-        return &entries_[i];
+      if (IsVisible(entries_[order_[i]], roles)) {
+        consider(entries_[order_[i]].name);
       }
     }
-    return nullptr;
+    consider("help");
+    return found;
+  }
+
+  /// Find command by name.
+  const CmdEntry* FindByName(const char* name) const {
+    if (name == nullptr) {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    int32_t idx = FindIndexLocked(name);
+    return (idx >= 0) ? &entries_[idx] : nullptr;
   }
 
   uint32_t Count() const {
@@ -240,27 +554,213 @@ class CommandRegistry {
   }
 
  private:
-  void PrintHelp(OutputFn output_fn, void* output_ctx) {
-    if (output_fn == nullptr) {
+  /// Binary search over the name-sorted index.  Caller holds mutex_.
+  /// @return entry index or -1.
+  int32_t FindIndexLocked(const char* name) const {
+    uint32_t lo = 0;
+    uint32_t hi = count_;
+    while (lo < hi) {
+      uint32_t mid = (lo + hi) / 2;
+      int cmp = std::strcmp(entries_[order_[mid]].name, name);
+      if (cmp == 0) {
+        return order_[mid];
+      }
+      if (cmp < 0) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return -1;
+  }
+
+  /// Append @p entry, keep order_ sorted by name, invalidate the help cache.
+  /// Caller holds mutex_ and has checked capacity and duplicates.
+  void AddLocked(const CmdEntry& entry) {
+    uint32_t pos = count_;
+    while (pos > 0 && std::strcmp(entries_[order_[pos - 1]].name, entry.name) > 0) {
+      order_[pos] = order_[pos - 1];
+      --pos;
+    }
+    order_[pos] = static_cast<uint16_t>(count_);
+    entries_[count_] = entry;
+    entries_[count_].stats = &stats_[count_];
+    ++count_;
+    help_dirty_ = true;
+  }
+
+  static int ClosureThunk(int argc, char* argv[], void* ctx) { return (*static_cast<CmdClosure*>(ctx))(argc, argv); }
+
+  /// Run @p entry with @p ec installed as the thread's current context.
+  static int Invoke(const CmdEntry& entry, int argc, char* argv[], ExecContext& ec) {
+    ExecContext*& current = detail::CurrentExecRef();
+    ExecContext* prev = current;
+    current = &ec;
+    uint32_t mark = (ec.arena != nullptr) ? ec.arena->Mark() : 0;
+
+    const uint64_t start_us = osp::SteadyNowUs();
+    int rc = entry.fn(argc, argv, entry.ctx);
+    if (entry.stats != nullptr) {
+      entry.stats->Record(rc, osp::SteadyNowUs() - start_us);
+    }
+
+    if (ec.arena != nullptr) {
+      ec.arena->Release(mark);
+    }
+    current = prev;
+    return rc;
+  }
+
+  /// Append "Did you mean: a, b?\r\n" to @p buf.  @return bytes written.
+  int FormatSuggestions(const char* word, uint32_t roles, char* buf, uint32_t size) const {
+    const char* names[kMaxSuggestions];
+    uint32_t found = Suggest(word, names, kMaxSuggestions, roles);
+    if (found == 0) {
+      return 0;
+    }
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < found; ++i) {
+      int n = std::snprintf(buf + len, size - len, "%s%s", (i == 0) ? "Did you mean: " : ", ", names[i]);
+      if (n < 0 || static_cast<uint32_t>(n) >= size - len) {
+        return 0;
+      }
+      len += static_cast<uint32_t>(n);
+    }
+    int n = std::snprintf(buf + len, size - len, "?\r\n");
+    if (n < 0 || static_cast<uint32_t>(n) >= size - len) {
+      return 0;
+    }
+    return static_cast<int>(len) + n;
+  }
+
+  bool IsVisible(const CmdEntry& e, uint32_t roles) const { return IsGroupEnabled(e.group) && (e.roles & ~roles) == 0; }
+
+  /// Format into a local buffer and send it to the execution's output.
+  static void Reply(const ExecContext& ec, const char* fmt, const char* arg) {
+    if (ec.output_fn == nullptr) {
+      return;
+    }
+    char buf[128];
+    int n = std::snprintf(buf, sizeof(buf), fmt, arg);
+    if (n > 0) {
+      ec.output_fn(buf, static_cast<uint32_t>(n) < sizeof(buf) ? static_cast<uint32_t>(n) : sizeof(buf) - 1,
+                   ec.output_ctx);
+    }
+  }
+
+  /// The listing is copied out under mutex_ and written after releasing it:
+  /// a slow client (or an output_fn that calls back into the registry) must
+  /// not hold up other sessions.
+  void PrintHelp(const ExecContext& ec) {
+    if (ec.output_fn == nullptr) {
       return;
     }
 
-    const char* hdr = "Available commands:\r\n";
-    output_fn(hdr, static_cast<uint32_t>(std::strlen(hdr)), output_ctx);
+    char out[kHelpCacheSize];
+    uint32_t len = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (help_dirty_) {
+        RenderHelpLocked();
+      }
 
-    std::lock_guard<std::mutex> lock(mutex_);
+      // Common case: caller sees everything -> the whole blob
+      const uint32_t hidden_groups = help_groups_used_ & ~enabled_groups_.load(std::memory_order_relaxed);
+      if ((help_roles_used_ & ~ec.roles) == 0 && hidden_groups == 0) {
+        std::memcpy(out, help_cache_, help_len_);
+        len = help_len_;
+      } else {
+        // Filtered: copy runs of consecutive visible lines
+        uint32_t run_start = 0;
+        uint32_t run_end = help_line_off_[0];  // header
+        for (uint32_t i = 0; i <= help_lines_; ++i) {
+          if (i < help_lines_ && IsVisible(entries_[order_[i]], ec.roles)) {
+            run_end = help_line_off_[i + 1];
+            continue;
+          }
+          std::memcpy(out + len, help_cache_ + run_start, run_end - run_start);
+          len += run_end - run_start;
+          if (i < help_lines_) {
+            run_start = help_line_off_[i + 1];
+            run_end = run_start;
+          }
+        }
+      }
+    }
+    ec.output_fn(out, len, ec.output_ctx);
+  }
+
+  int PrintCommandHelp(const char* name, const ExecContext& ec) {
+    char buf[192];
+    int n = 0;
+    int rc = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      int32_t idx = FindIndexLocked(name);
+      if (idx >= 0 && IsVisible(entries_[idx], ec.roles)) {
+        const CmdEntry& e = entries_[idx];
+        n = std::snprintf(buf, sizeof(buf), "%s\r\n  %s\r\n", e.name, e.desc ? e.desc : "");
+      } else {
+        n = std::snprintf(buf, sizeof(buf), "Unknown command: %s\r\n", name);
+        rc = -1;
+      }
+    }
+    if (ec.output_fn != nullptr && n > 0) {
+      ec.output_fn(buf, static_cast<uint32_t>(n) < sizeof(buf) ? static_cast<uint32_t>(n) : sizeof(buf) - 1,
+                   ec.output_ctx);
+    }
+    return rc;
+  }
+
+  /// Render the sorted listing into help_cache_, recording where each line
+  /// starts so filtered listings can reuse it.  Caller holds mutex_.
+  void RenderHelpLocked() {
+    uint32_t width = 0;
+    help_roles_used_ = 0;
+    help_groups_used_ = 0;
     for (uint32_t i = 0; i < count_; ++i) {
-      char buf[128];
-      int n = std::snprintf(buf, sizeof(buf), "  %-16s - %s\r\n", entries_[i].name,
-                            entries_[i].desc ? entries_[i].desc : "");
-      if (n > 0) {
-        output_fn(buf, static_cast<uint32_t>(n), output_ctx);
+      uint32_t len = static_cast<uint32_t>(std::strlen(entries_[i].name));
+      width = (len > width) ? len : width;
+      help_roles_used_ |= entries_[i].roles;
+      help_groups_used_ |= 1U << entries_[i].group;
+    }
+    width = (width > kHelpNameWidth) ? kHelpNameWidth : width;
+
+    uint32_t len = 0;
+    int n = std::snprintf(help_cache_, kHelpCacheSize, "Available commands:\r\n");
+    len = (n > 0) ? static_cast<uint32_t>(n) : 0;
+    help_line_off_[0] = len;
+    help_lines_ = 0;
+    for (uint32_t i = 0; i < count_ && len < kHelpCacheSize; ++i) {
+      const CmdEntry& e = entries_[order_[i]];
+      n = std::snprintf(help_cache_ + len, kHelpCacheSize - len, "  %-*s - %.*s\r\n", static_cast<int>(width), e.name,
+                        static_cast<int>(kHelpDescWidth), e.desc ? e.desc : "");
+      if (n < 0 || static_cast<uint32_t>(n) >= kHelpCacheSize - len) {
+        break;  // cache full: keep whole lines only
       }
+      len += static_cast<uint32_t>(n);
+      help_line_off_[++help_lines_] = len;
     }
+    help_len_ = len;
+    help_dirty_ = false;
   }
 
   CmdEntry entries_[kMaxCommands] = {};
+  CmdClosure closures_[kMaxCommands];
+  CmdStats stats_[kMaxCommands];
+  uint16_t order_[kMaxCommands] = {};  ///< Entry indices sorted by name
   uint32_t count_ = 0;
+
+  // Rendered "help" listing, rebuilt lazily after registration
+  char help_cache_[kHelpCacheSize] = {};
+  uint32_t help_len_ = 0;
+  uint32_t help_line_off_[kMaxCommands + 1] = {};  ///< End of header, then end of each line
+  uint32_t help_lines_ = 0;
+  uint32_t help_roles_used_ = 0;   ///< Union of all required roles
+  uint32_t help_groups_used_ = 0;  ///< Groups that have at least one command
+  bool help_dirty_ = true;
+
+  std::atomic<uint32_t> enabled_groups_{0xFFFFFFFFU};
   mutable std::mutex mutex_;
 };
 
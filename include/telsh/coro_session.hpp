@@ -0,0 +1,305 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh coroutine sessions -- optional C++20 alternative to thread-per-session.
+//
+// Design:
+//   - RunSessionCoro() is the coroutine form of TelnetSession::Run(): the
+//     same sequential loop, but each read suspends on an epoll executor
+//     instead of blocking a thread
+//   - EpollExecutor: single-threaded, one-shot registration per co_await
+//     (EPOLLIN, plus EPOLLOUT when asked), resumes coroutines from RunOnce()
+//   - CoroTask frames come from a fixed-block pool (no heap); pool
+//     exhaustion yields an invalid task instead of allocating
+//   - The socket is made non-blocking: writes never stall the executor.
+//     Output the kernel does not take is queued by the session (bounded,
+//     as in polled mode) and the coroutine also waits for EPOLLOUT until
+//     it is flushed; a client that lets the queue overflow is dropped
+//   - The coroutine also waits on the session's wake eventfd, so output
+//     posted from other threads (Post, broadcast) is written right away
+//   - Not created by TelnetServer: the owner accepts, Init()s the session
+//     and runs the executor itself
+//   - Only available when compiled as C++20 (__cpp_impl_coroutine)
+
+#pragma once
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+#include "osp/platform.hpp"
+#include "telsh/telnet_session.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+#include <coroutine>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace telsh {
+
+// ---------------------------------------------------------------------------
+// Frame pool
+// ---------------------------------------------------------------------------
+
+#ifndef TELSH_CORO_FRAME_SIZE
+#define TELSH_CORO_FRAME_SIZE 512
+#endif
+
+#ifndef TELSH_CORO_MAX_FRAMES
+#define TELSH_CORO_MAX_FRAMES 16
+#endif
+
+/// Fixed-block allocator for coroutine frames (free list over a static array).
+class CoroFramePool {
+ public:
+  static constexpr size_t kBlockSize = TELSH_CORO_FRAME_SIZE;
+  static constexpr uint32_t kMaxBlocks = TELSH_CORO_MAX_FRAMES;
+
+  CoroFramePool() {
+    for (uint32_t i = 0; i < kMaxBlocks; ++i) {
+      next_[i] = i + 1;
+    }
+  }
+
+  CoroFramePool(const CoroFramePool&) = delete;
+  CoroFramePool& operator=(const CoroFramePool&) = delete;
+
+  /// @return nullptr if @p size exceeds the block size or the pool is empty.
+  void* Allocate(size_t size) {
+    if (size > kBlockSize) {
+      return nullptr;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_head_ >= kMaxBlocks) {
+      return nullptr;
+    }
+    uint32_t idx = free_head_;
+    free_head_ = next_[idx];
+    ++used_;
+    return blocks_[idx].bytes;
+  }
+
+  void Free(void* ptr) {
+    if (ptr == nullptr) {
+      return;
+    }
+    auto* block = static_cast<Block*>(ptr);
+    OSP_ASSERT(block >= blocks_ && block < blocks_ + kMaxBlocks);
+    uint32_t idx = static_cast<uint32_t>(block - blocks_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    next_[idx] = free_head_;
+    free_head_ = idx;
+    --used_;
+  }
+
+  uint32_t Used() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_;
+  }
+
+  static CoroFramePool& Instance() {
+    static CoroFramePool inst;
+    return inst;
+  }
+
+ private:
+  struct Block {
+    alignas(std::max_align_t) unsigned char bytes[kBlockSize];
+  };
+
+  Block blocks_[kMaxBlocks];
+  uint32_t next_[kMaxBlocks];
+  uint32_t free_head_ = 0;
+  uint32_t used_ = 0;
+  mutable std::mutex mutex_;
+};
+
+// ---------------------------------------------------------------------------
+// CoroTask -- owning handle to a pool-allocated coroutine
+// ---------------------------------------------------------------------------
+
+/// Starts eagerly and suspends at the end so the owner can observe Done()
+/// and release the frame (destructor or Reset()).
+class CoroTask {
+ public:
+  struct promise_type {
+    CoroTask get_return_object() noexcept {
+      return CoroTask(std::coroutine_handle<promise_type>::from_promise(*this));
+    }
+    static CoroTask get_return_object_on_allocation_failure() noexcept { return CoroTask(); }
+
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() noexcept { OSP_ASSERT(false); }
+
+    static void* operator new(size_t size) noexcept { return CoroFramePool::Instance().Allocate(size); }
+    static void operator delete(void* ptr) noexcept { CoroFramePool::Instance().Free(ptr); }
+  };
+
+  CoroTask() = default;
+  ~CoroTask() { Reset(); }
+
+  CoroTask(CoroTask&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+  CoroTask& operator=(CoroTask&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      handle_ = other.handle_;
+      other.handle_ = nullptr;
+    }
+    return *this;
+  }
+
+  CoroTask(const CoroTask&) = delete;
+  CoroTask& operator=(const CoroTask&) = delete;
+
+  /// False if the frame pool was exhausted at creation.
+  bool Valid() const { return static_cast<bool>(handle_); }
+  bool Done() const { return !handle_ || handle_.done(); }
+
+  /// Destroy the frame (only call once Done(), or when abandoning).
+  void Reset() {
+    if (handle_) {
+      handle_.destroy();
+      handle_ = nullptr;
+    }
+  }
+
+ private:
+  explicit CoroTask(std::coroutine_handle<promise_type> h) : handle_(h) {}
+
+  std::coroutine_handle<promise_type> handle_ = nullptr;
+};
+
+// ---------------------------------------------------------------------------
+// EpollExecutor
+// ---------------------------------------------------------------------------
+
+class EpollExecutor {
+ public:
+  static constexpr uint32_t kMaxEvents = 16;
+
+  EpollExecutor() : epfd_(::epoll_create1(EPOLL_CLOEXEC)) {}
+  ~EpollExecutor() {
+    if (epfd_ >= 0) {
+      ::close(epfd_);
+    }
+  }
+
+  EpollExecutor(const EpollExecutor&) = delete;
+  EpollExecutor& operator=(const EpollExecutor&) = delete;
+
+  bool Valid() const { return epfd_ >= 0; }
+
+  /// Awaitable: suspend until @p fd is ready for @p events (or hung up),
+  /// or @p wake_fd (if >= 0) is readable.
+  struct IoAwaiter {
+    EpollExecutor* exec;
+    int32_t fd;
+    uint32_t events;
+    int32_t wake_fd = -1;
+    bool ok = true;
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h) noexcept {
+      ok = exec->Arm(fd, events, h) && (wake_fd < 0 || exec->Arm(wake_fd, EPOLLIN, h));
+      return ok;  // registration failure resumes immediately
+    }
+    /// @return false if the fd could not be registered.
+    bool await_resume() const noexcept { return ok; }
+  };
+
+  IoAwaiter Readable(int32_t fd) { return IoAwaiter{this, fd, EPOLLIN}; }
+
+  /// Readable, or also writable when @p writable (output waiting to go out),
+  /// or @p wake_fd readable -- whichever comes first.
+  IoAwaiter Ready(int32_t fd, bool writable, int32_t wake_fd = -1) {
+    const uint32_t events = writable ? static_cast<uint32_t>(EPOLLIN | EPOLLOUT) : static_cast<uint32_t>(EPOLLIN);
+    return IoAwaiter{this, fd, events, wake_fd};
+  }
+
+  /// Wait up to @p timeout_ms and resume every coroutine whose fd is ready.
+  /// A coroutine waiting on two fds is resumed once even if both fired (the
+  /// second event may refer to a frame that has since finished).
+  /// @return number of coroutines resumed, -1 on error.
+  int32_t RunOnce(int32_t timeout_ms) {
+    struct epoll_event events[kMaxEvents];
+    int32_t n = ::epoll_wait(epfd_, events, kMaxEvents, timeout_ms);
+    if (n < 0) {
+      return (errno == EINTR) ? 0 : -1;
+    }
+    void* resumed[kMaxEvents];
+    int32_t count = 0;
+    for (int32_t i = 0; i < n; ++i) {
+      bool seen = false;
+      for (int32_t j = 0; j < count && !seen; ++j) {
+        seen = (resumed[j] == events[i].data.ptr);
+      }
+      if (seen) {
+        continue;
+      }
+      resumed[count++] = events[i].data.ptr;
+      std::coroutine_handle<>::from_address(events[i].data.ptr).resume();
+    }
+    return count;
+  }
+
+  /// Drop @p fd from the interest set (call before closing a parked fd).
+  void Forget(int32_t fd) { ::epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, nullptr); }
+
+ private:
+  bool Arm(int32_t fd, uint32_t events, std::coroutine_handle<> h) {
+    struct epoll_event ev = {};
+    ev.events = events | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = h.address();
+    if (::epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev) == 0) {
+      return true;
+    }
+    return ::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) == 0;
+  }
+
+  int32_t epfd_ = -1;
+};
+
+// ---------------------------------------------------------------------------
+// Session coroutine
+// ---------------------------------------------------------------------------
+
+// GCC mistakes the promise's pooled operator delete for a free() of the
+// static pool object.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfree-nonheap-object"
+#endif
+
+/// Coroutine equivalent of TelnetSession::Run().  The session must have been
+/// Init()ed; the frame suspends until input arrives or another thread
+/// posts output, and while output is queued also until the socket is
+/// writable.  Commands run with may_block off (one thread serves every
+/// frame, and the socket is non-blocking).  Closes the socket on exit.
+inline CoroTask RunSessionCoro(TelnetSession& session, EpollExecutor& exec) {
+  ::fcntl(session.Fd(), F_SETFL, ::fcntl(session.Fd(), F_GETFL, 0) | O_NONBLOCK);
+  session.SetBlockingCommands(false);
+  session.Begin();
+  while (session.IsRunning()) {
+    const bool armed = co_await exec.Ready(session.Fd(), session.HasPendingOutput(), session.WakeFd());
+    if (!armed || !session.OnReadable()) {
+      break;
+    }
+    session.DrainPosted();  // OnReadable() skips it when there was no input
+  }
+  if (session.WakeFd() >= 0) {
+    exec.Forget(session.WakeFd());
+  }
+  exec.Forget(session.Fd());
+  session.Close();
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+}  // namespace telsh
+
+#endif  // __cpp_impl_coroutine
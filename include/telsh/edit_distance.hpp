@@ -0,0 +1,86 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::MyersPattern -- bit-parallel Levenshtein distance (Myers 1999,
+// Hyyro 2003 global-distance formulation).
+//
+// Design:
+//   - Pattern preprocessed once into per-byte match bitmasks (Peq)
+//   - Distance() to any text costs O(len(text)) word operations, so one
+//     typed word can be compared against thousands of names quickly
+//   - Pattern limited to 64 bytes (one machine word); longer input is
+//     truncated, which is harmless for command-name suggestions
+//   - Zero heap allocation
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace telsh {
+
+class MyersPattern {
+ public:
+  static constexpr uint32_t kMaxLen = 64;
+
+  MyersPattern() = default;
+  explicit MyersPattern(const char* pattern) { Init(pattern, pattern ? static_cast<uint32_t>(std::strlen(pattern)) : 0); }
+
+  /// (Re)build the match table for @p pattern.  Only entries touched by the
+  /// previous pattern are cleared, so re-initialisation is O(len).
+  void Init(const char* pattern, uint32_t len) {
+    for (uint32_t i = 0; i < len_; ++i) {
+      peq_[pattern_[i]] = 0;
+    }
+    len_ = (pattern == nullptr) ? 0 : ((len > kMaxLen) ? kMaxLen : len);
+    for (uint32_t i = 0; i < len_; ++i) {
+      pattern_[i] = static_cast<uint8_t>(pattern[i]);
+      peq_[pattern_[i]] |= (uint64_t{1} << i);
+    }
+  }
+
+  uint32_t Length() const { return len_; }
+
+  /// Levenshtein distance between the pattern and @p text.
+  uint32_t Distance(const char* text, uint32_t text_len) const {
+    if (len_ == 0) {
+      return text_len;
+    }
+    if (text == nullptr) {
+      return len_;
+    }
+
+    const uint64_t last = uint64_t{1} << (len_ - 1);
+    uint64_t pv = (len_ == 64) ? ~uint64_t{0} : ((uint64_t{1} << len_) - 1);
+    uint64_t mv = 0;
+    uint32_t score = len_;
+
+    for (uint32_t j = 0; j < text_len; ++j) {
+      const uint64_t eq = peq_[static_cast<uint8_t>(text[j])];
+      const uint64_t xv = eq | mv;
+      const uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+      uint64_t ph = mv | ~(xh | pv);
+      uint64_t mh = pv & xh;
+      if ((ph & last) != 0) {
+        ++score;
+      } else if ((mh & last) != 0) {
+        --score;
+      }
+      ph = (ph << 1) | 1;  // row 0 of the DP matrix grows with the text
+      mh <<= 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+    }
+    return score;
+  }
+
+  uint32_t Distance(const char* text) const {
+    return Distance(text, text ? static_cast<uint32_t>(std::strlen(text)) : 0);
+  }
+
+ private:
+  uint64_t peq_[256] = {};
+  uint8_t pattern_[kMaxLen] = {};
+  uint32_t len_ = 0;
+};
+
+}  // namespace telsh
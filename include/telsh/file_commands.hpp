@@ -0,0 +1,625 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh file commands -- "get", "cat", "tail" and "upload" restricted to
+// configured directories.
+//
+// Design:
+//   - Paths resolved with realpath() and accepted only below a configured
+//     root, so "..", symlinks and absolute paths cannot escape; the opened
+//     descriptor itself is checked again (/proc/self/fd), so a symlink
+//     swapped in after the check does not escape either
+//   - get: each chunk is scanned for 0xFF with pread(); runs without it go
+//     out with sendfile() straight from the page cache, only the short
+//     stretches around 0xFF are copied with it doubled (telnet requires
+//     IAC IAC).  No mmap, so a file truncated or rotated meanwhile only
+//     ends the transfer early (never SIGBUS); bytes rewritten in place
+//     between the scan and sendfile() are sent as they are then.
+//     TRANSMIT-BINARY is negotiated first so CR/NUL pass through untouched.
+//     Streams synchronously, so it needs a session that may block
+//   - upload: receives a byte count of binary data (IAC unescaped in bulk)
+//     into "<file>.part" and renames it into place when complete; the part
+//     file is created exclusively (O_EXCL | O_NOFOLLOW) and checked against
+//     the roots by descriptor, so a planted symlink or file is refused
+//   - cat / tail: text through the ExecContext output (LF -> CRLF), so they
+//     also work for callers without a socket
+//   - tail -f: follows appended data with inotify (no timer polling);
+//     Ctrl-C or 'q' stops it.  Client input goes through the session, so
+//     negotiation and window-size updates keep working and other keys run
+//     after it ends.  Needs a telnet session that may block
+//   - No heap allocation
+
+#pragma once
+
+#include "telsh/command_registry.hpp"
+#include "telsh/telnet_session.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace telsh {
+
+// ---------------------------------------------------------------------------
+// FileCommandsConfig
+// ---------------------------------------------------------------------------
+
+struct FileCommandsConfig {
+  const char* const* roots = nullptr;  ///< Allowed directories (relative paths use roots[0])
+  uint32_t root_count = 0;
+};
+
+namespace detail {
+
+constexpr uint32_t kFileChunk = 1024;
+constexpr uint32_t kStreamChunk = 16384;  ///< get: scan size (doubled for IAC escaping)
+constexpr uint32_t kSendfileMin = 512;    ///< get: shorter clean runs are copied along with the escapes
+
+inline void FileOut(const char* data, uint32_t len) {
+  ExecContext* ec = CurrentExec();
+  if (ec != nullptr && ec->output_fn != nullptr && len > 0) {
+    ec->output_fn(data, len, ec->output_ctx);
+  }
+}
+
+inline void FilePrintf(const char* fmt, ...) {
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n > 0) {
+    FileOut(buf, static_cast<uint32_t>(n) < sizeof(buf) ? static_cast<uint32_t>(n) : sizeof(buf) - 1);
+  }
+}
+
+/// True if the canonical path @p path lies below one of the configured roots.
+inline bool UnderRoot(const FileCommandsConfig& cfg, const char* path) {
+  char root[PATH_MAX];
+  for (uint32_t i = 0; i < cfg.root_count; ++i) {
+    if (cfg.roots[i] == nullptr || ::realpath(cfg.roots[i], root) == nullptr) {
+      continue;
+    }
+    size_t len = std::strlen(root);
+    if (std::strncmp(path, root, len) == 0 && (path[len] == '\0' || path[len] == '/' || len == 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/// Check the file @p fd actually refers to (not the name it was opened
+/// by) against the roots; its path goes to @p out (PATH_MAX bytes).
+inline bool FdAllowed(const FileCommandsConfig& cfg, int32_t fd, char* out) {
+  char link[32];
+  std::snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+  ssize_t n = ::readlink(link, out, PATH_MAX - 1);
+  if (n <= 0) {
+    return false;  // no /proc: fail closed
+  }
+  out[n] = '\0';
+  return UnderRoot(cfg, out);
+}
+
+/// Resolve @p path into @p out (PATH_MAX bytes) and check that it lies
+/// below one of the configured roots.
+inline bool ResolveAllowedPath(const FileCommandsConfig& cfg, const char* path, char* out) {
+  if (cfg.roots == nullptr || cfg.root_count == 0 || path == nullptr || path[0] == '\0') {
+    return false;
+  }
+  char joined[PATH_MAX];
+  if (path[0] != '/') {
+    int n = std::snprintf(joined, sizeof(joined), "%s/%s", cfg.roots[0], path);
+    if (n < 0 || static_cast<uint32_t>(n) >= sizeof(joined)) {
+      return false;
+    }
+    path = joined;
+  }
+  return ::realpath(path, out) != nullptr && UnderRoot(cfg, out);
+}
+
+/// Resolve a file to be created: its directory must be allowed and the
+/// name must be a plain file name.
+inline bool ResolveAllowedTarget(const FileCommandsConfig& cfg, const char* path, char* out) {
+  if (path == nullptr) {
+    return false;
+  }
+  char dir[PATH_MAX];
+  const char* slash = std::strrchr(path, '/');
+  const char* name = (slash != nullptr) ? slash + 1 : path;
+  if (slash == nullptr) {
+    std::snprintf(dir, sizeof(dir), ".");
+  } else if (slash == path) {
+    std::snprintf(dir, sizeof(dir), "/");
+  } else {
+    std::snprintf(dir, sizeof(dir), "%.*s", static_cast<int>(slash - path), path);
+  }
+  if (name[0] == '\0' || std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0 ||
+      !ResolveAllowedPath(cfg, dir, out)) {
+    return false;
+  }
+  size_t len = std::strlen(out);
+  int n = std::snprintf(out + len, PATH_MAX - len, "/%s", name);
+  return n > 0 && static_cast<size_t>(n) < PATH_MAX - len;
+}
+
+/// Open an allowed regular file.  Prints the reason and returns -1 on failure.
+/// The root check is repeated on the opened descriptor: the path may have
+/// been swapped for a symlink since ResolveAllowedPath() looked at it.
+inline int32_t OpenAllowed(const FileCommandsConfig& cfg, const char* path, char* resolved, struct stat* st) {
+  if (!ResolveAllowedPath(cfg, path, resolved)) {
+    FilePrintf("Not allowed or not found: %s\r\n", path);
+    return -1;
+  }
+  // O_NONBLOCK: a FIFO put in place must not hang the open
+  int32_t fd = ::open(resolved, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NONBLOCK);
+  if (fd < 0) {
+    FilePrintf("open(%s): %s\r\n", path, strerror(errno));
+    return -1;
+  }
+  if (!FdAllowed(cfg, fd, resolved)) {
+    FilePrintf("Not allowed or not found: %s\r\n", path);
+    ::close(fd);
+    return -1;
+  }
+  if (::fstat(fd, st) != 0 || !S_ISREG(st->st_mode)) {
+    FilePrintf("Not a regular file: %s\r\n", path);
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+inline bool SendAll(int32_t sock, const char* data, uint32_t len) {
+  while (len > 0) {
+    ssize_t n = ::send(sock, data, len, MSG_NOSIGNAL);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    len -= static_cast<uint32_t>(n);
+  }
+  return true;
+}
+
+/// sendfile() has no MSG_NOSIGNAL: block SIGPIPE on this thread while it
+/// runs and discard one raised meanwhile, so a vanished client is an error
+/// return and not the end of the process.
+class SigpipeGuard {
+ public:
+  SigpipeGuard() {
+    sigset_t pipe;
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    sigset_t pending;
+    sigpending(&pending);
+    was_pending_ = (sigismember(&pending, SIGPIPE) == 1);
+    blocked_ = (pthread_sigmask(SIG_BLOCK, &pipe, &old_) == 0);
+  }
+
+  ~SigpipeGuard() {
+    if (!blocked_) {
+      return;
+    }
+    sigset_t pipe;
+    sigemptyset(&pipe);
+    sigaddset(&pipe, SIGPIPE);
+    sigset_t pending;
+    sigpending(&pending);
+    if (!was_pending_ && sigismember(&pending, SIGPIPE) == 1) {
+      const struct timespec zero = {0, 0};
+      while (sigtimedwait(&pipe, nullptr, &zero) < 0 && errno == EINTR) {
+      }
+    }
+    pthread_sigmask(SIG_SETMASK, &old_, nullptr);
+  }
+
+  SigpipeGuard(const SigpipeGuard&) = delete;
+  SigpipeGuard& operator=(const SigpipeGuard&) = delete;
+
+ private:
+  sigset_t old_;
+  bool was_pending_ = false;
+  bool blocked_ = false;
+};
+
+/// sendfile() [off, off + len) of @p fd to @p sock.
+inline bool SendFileRange(int32_t fd, int32_t sock, uint64_t off, uint64_t len) {
+  off_t pos = static_cast<off_t>(off);
+  while (len > 0) {
+    ssize_t n = ::sendfile(sock, fd, &pos, static_cast<size_t>(len));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;  // error, or truncated underneath us
+    }
+    len -= static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+/// Stream [off, end) of @p fd to @p sock with each 0xFF doubled (IAC IAC).
+/// Every chunk is scanned with pread(); clean runs of kSendfileMin bytes
+/// or more go out with sendfile(), the rest is copied with the escapes.
+/// A file that shrinks meanwhile ends the stream early.
+inline bool StreamEscaped(int32_t fd, int32_t sock, uint64_t off, uint64_t end) {
+  uint8_t in[kStreamChunk];
+  char out[kStreamChunk * 2];
+  SigpipeGuard no_sigpipe;
+  while (off < end) {
+    const uint64_t want = (end - off < kStreamChunk) ? end - off : kStreamChunk;
+    ssize_t n = ::pread(fd, in, static_cast<size_t>(want), static_cast<off_t>(off));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;  // error, or truncated underneath us
+    }
+    uint32_t o = 0;
+    const uint8_t* p = in;
+    const uint8_t* stop = in + n;
+    while (p < stop) {
+      const auto* iac = static_cast<const uint8_t*>(std::memchr(p, 0xFF, static_cast<size_t>(stop - p)));
+      const uint8_t* run_end = (iac != nullptr) ? iac : stop;
+      const auto run = static_cast<uint32_t>(run_end - p);
+      if (run >= kSendfileMin) {
+        // Pending escaped bytes first, then the clean run from the page cache
+        if (!SendAll(sock, out, o) || !SendFileRange(fd, sock, off + static_cast<uint64_t>(p - in), run)) {
+          return false;
+        }
+        o = 0;
+      } else {
+        std::memcpy(out + o, p, run);
+        o += run;
+      }
+      p = run_end;
+      if (iac != nullptr) {
+        out[o++] = '\xFF';
+        out[o++] = '\xFF';
+        ++p;
+      }
+    }
+    if (!SendAll(sock, out, o)) {
+      return false;
+    }
+    off += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+/// Copy [off, end) of @p fd to the command output, LF -> CRLF.
+/// @p last_cr carries the "previous byte was CR" state across calls.
+inline bool CopyText(int32_t fd, uint64_t off, uint64_t end, bool& last_cr) {
+  char in[kFileChunk];
+  char out[kFileChunk * 2];
+  while (off < end) {
+    const uint64_t want = (end - off < kFileChunk) ? end - off : kFileChunk;
+    ssize_t n = ::pread(fd, in, static_cast<size_t>(want), static_cast<off_t>(off));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    uint32_t o = 0;
+    for (ssize_t i = 0; i < n; ++i) {
+      if (in[i] == '\n' && !last_cr) {
+        out[o++] = '\r';
+      }
+      out[o++] = in[i];
+      last_cr = (in[i] == '\r');
+    }
+    FileOut(out, o);
+    off += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+/// Offset where the last @p lines lines of a @p size byte file start.
+inline uint64_t TailOffset(int32_t fd, uint64_t size, uint32_t lines) {
+  char buf[kFileChunk];
+  uint64_t pos = size;
+  uint32_t seen = 0;
+  while (pos > 0) {
+    const uint64_t n = (pos < kFileChunk) ? pos : kFileChunk;
+    pos -= n;
+    if (::pread(fd, buf, static_cast<size_t>(n), static_cast<off_t>(pos)) != static_cast<ssize_t>(n)) {
+      return 0;
+    }
+    for (uint64_t i = n; i-- > 0;) {
+      // The newline terminating the final line does not start a new one
+      if (buf[i] == '\n' && pos + i + 1 != size && ++seen == lines) {
+        return pos + i + 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/// Follow appended data until the client presses Ctrl-C / 'q' or disconnects.
+inline void FollowFile(int32_t fd, const char* path, uint64_t off, int32_t sock, TelnetSession& session,
+                       bool& last_cr) {
+  int32_t in = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (in < 0 || ::inotify_add_watch(in, path, IN_MODIFY | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF) < 0) {
+    FilePrintf("inotify: %s\r\n", strerror(errno));
+    if (in >= 0) {
+      ::close(in);
+    }
+    return;
+  }
+  FilePrintf("--- following %s, press Ctrl-C or q to stop ---\r\n", path);
+
+  alignas(struct inotify_event) char events[sizeof(struct inotify_event) + NAME_MAX + 1];
+  bool gone = false;
+  while (!gone) {
+    session.FlushOutput();  // before waiting, make output so far visible
+    struct pollfd fds[2] = {{in, POLLIN, 0}, {sock, POLLIN, 0}};
+    if (::poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[1].revents != 0 && session.TakeInterrupt()) {
+      break;
+    }
+    ssize_t n;
+    while ((n = ::read(in, events, sizeof(events))) > 0) {
+      for (ssize_t i = 0; i < n;) {
+        const auto* ev = reinterpret_cast<const struct inotify_event*>(events + i);
+        gone = gone || (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) != 0;
+        i += static_cast<ssize_t>(sizeof(struct inotify_event) + ev->len);
+      }
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      break;
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+    if (size < off) {
+      FilePrintf("--- %s truncated ---\r\n", path);
+      off = 0;
+    }
+    if (size > off && CopyText(fd, off, size, last_cr)) {
+      off = size;
+    }
+  }
+  if (gone) {
+    FilePrintf("--- %s removed or renamed ---\r\n", path);
+  }
+  ::close(in);
+}
+
+// ---------------------------------------------------------------------------
+// Command handlers (ctx = const FileCommandsConfig*)
+// ---------------------------------------------------------------------------
+
+inline int GetCmd(int argc, char* argv[], void* ctx) {
+  if (argc != 2) {
+    FilePrintf("Usage: get <file>\r\n");
+    return -1;
+  }
+  char path[PATH_MAX];
+  struct stat st;
+  int32_t fd = OpenAllowed(*static_cast<const FileCommandsConfig*>(ctx), argv[1], path, &st);
+  if (fd < 0) {
+    return -1;
+  }
+  const uint64_t size = static_cast<uint64_t>(st.st_size);
+  ExecContext* ec = CurrentExec();
+  if (ec != nullptr && ec->sock_fd >= 0 && !ec->may_block) {
+    // Streaming waits on the client; that would stall a polled host loop
+    FilePrintf("get needs a threaded telnet session\r\n");
+    ::close(fd);
+    return -1;
+  }
+  bool ok = true;
+  if (ec != nullptr && ec->session != nullptr && ec->session->IsCompressing()) {
+    // MCCP2 owns the byte stream: go through the compressor
+    const bool binary = ec->session->SetBinary(true);
+    char buf[kFileChunk];
+    ssize_t n;
+    while (ok && (n = ::read(fd, buf, sizeof(buf))) > 0) {
+      ok = ec->session->SendBinary(buf, static_cast<uint32_t>(n));
+    }
+    if (binary) {
+      ec->session->SetBinary(false);
+    }
+    ec->session->FlushOutput();
+  } else if (ec != nullptr && ec->sock_fd >= 0) {
+    const bool binary = (ec->session != nullptr && ec->session->SetBinary(true));
+    ok = StreamEscaped(fd, ec->sock_fd, 0, size);
+    if (binary) {
+      ec->session->SetBinary(false);
+    }
+  } else {
+    // No socket (e.g. local Execute): plain copy through the output
+    char buf[kFileChunk];
+    ssize_t n;
+    while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+      FileOut(buf, static_cast<uint32_t>(n));
+    }
+    ok = (n == 0);
+  }
+  ::close(fd);
+  return ok ? 0 : -1;
+}
+
+inline int CatCmd(int argc, char* argv[], void* ctx) {
+  if (argc != 2) {
+    FilePrintf("Usage: cat <file>\r\n");
+    return -1;
+  }
+  char path[PATH_MAX];
+  struct stat st;
+  int32_t fd = OpenAllowed(*static_cast<const FileCommandsConfig*>(ctx), argv[1], path, &st);
+  if (fd < 0) {
+    return -1;
+  }
+  bool last_cr = false;
+  bool ok = CopyText(fd, 0, static_cast<uint64_t>(st.st_size), last_cr);
+  ::close(fd);
+  return ok ? 0 : -1;
+}
+
+inline int TailCmd(int argc, char* argv[], void* ctx) {
+  uint32_t lines = 10;
+  bool follow = false;
+  const char* file = nullptr;
+  bool bad = false;
+  for (int i = 1; i < argc && !bad; ++i) {
+    if (std::strcmp(argv[i], "-f") == 0) {
+      follow = true;
+    } else if (std::strcmp(argv[i], "-n") == 0) {
+      // Digits only: strtoul() would take "-1" (wrapping) and "foo" (0)
+      const char* num = (i + 1 < argc) ? argv[++i] : "";
+      char* end = nullptr;
+      errno = 0;
+      const unsigned long n = std::strtoul(num, &end, 10);
+      bad = (num[0] < '0' || num[0] > '9' || *end != '\0' || errno == ERANGE || n > UINT32_MAX);
+      lines = static_cast<uint32_t>(n);
+    } else {
+      file = argv[i];
+    }
+  }
+  if (bad || file == nullptr) {
+    FilePrintf("Usage: tail [-n N] [-f] <file>\r\n");
+    return -1;
+  }
+  ExecContext* ec = CurrentExec();
+  if (follow && (ec == nullptr || ec->sock_fd < 0 || ec->session == nullptr || !ec->may_block)) {
+    FilePrintf("tail -f needs a threaded telnet session\r\n");
+    return -1;
+  }
+
+  char path[PATH_MAX];
+  struct stat st;
+  int32_t fd = OpenAllowed(*static_cast<const FileCommandsConfig*>(ctx), file, path, &st);
+  if (fd < 0) {
+    return -1;
+  }
+  const uint64_t size = static_cast<uint64_t>(st.st_size);
+  bool last_cr = false;
+  bool ok = (lines == 0) || CopyText(fd, TailOffset(fd, size, lines), size, last_cr);
+  if (ok && follow) {
+    FollowFile(fd, path, size, ec->sock_fd, *ec->session, last_cr);
+  }
+  ::close(fd);
+  return ok ? 0 : -1;
+}
+
+inline bool WriteSink(const uint8_t* data, uint32_t len, void* ctx) {
+  const int32_t fd = *static_cast<int32_t*>(ctx);
+  while (len > 0) {
+    ssize_t n = ::write(fd, data, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    len -= static_cast<uint32_t>(n);
+  }
+  return true;
+}
+
+inline int UploadCmd(int argc, char* argv[], void* ctx) {
+  if (argc != 3) {
+    FilePrintf("Usage: upload <file> <bytes>\r\n");
+    return -1;
+  }
+  ExecContext* ec = CurrentExec();
+  if (ec == nullptr || ec->session == nullptr || !ec->may_block) {
+    FilePrintf("upload needs a threaded telnet session\r\n");
+    return -1;
+  }
+  const uint64_t size = std::strtoull(argv[2], nullptr, 10);
+  char path[PATH_MAX];
+  char part[PATH_MAX + 8];
+  if (!ResolveAllowedTarget(*static_cast<const FileCommandsConfig*>(ctx), argv[1], path)) {
+    FilePrintf("Not allowed: %s\r\n", argv[1]);
+    return -1;
+  }
+  std::snprintf(part, sizeof(part), "%s.part", path);
+  // Never follow or reuse what is already there (e.g. a symlink planted
+  // at <name>.part to make us overwrite some other file)
+  int32_t fd = ::open(part, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    FilePrintf("open(%s.part): %s\r\n", argv[1], strerror(errno));
+    return -1;
+  }
+  // The directory may have been swapped since it was resolved: check what
+  // was created and rename within that directory
+  char real_part[PATH_MAX];
+  size_t part_len = 0;
+  if (FdAllowed(*static_cast<const FileCommandsConfig*>(ctx), fd, real_part)) {
+    part_len = std::strlen(real_part);
+  }
+  if (part_len <= 5 || std::strcmp(real_part + part_len - 5, ".part") != 0) {
+    FilePrintf("Not allowed: %s\r\n", argv[1]);
+    ::close(fd);
+    ::unlink(part);  // ours: created exclusively above
+    return -1;
+  }
+  std::memcpy(part, real_part, part_len + 1);
+  std::memcpy(path, real_part, part_len - 5);
+  path[part_len - 5] = '\0';
+  if (!ec->session->SetBinary(true)) {
+    ec->session->SetBinary(false);
+    FilePrintf("Client refused BINARY mode\r\n");
+    ::close(fd);
+    ::unlink(part);
+    return -1;
+  }
+  FilePrintf("Ready for %llu bytes\r\n", static_cast<unsigned long long>(size));
+  const uint64_t got = ec->session->ReceiveBinary(size, WriteSink, &fd);
+  ec->session->SetBinary(false);
+
+  const bool ok = (got == size) && ::fsync(fd) == 0;
+  ::close(fd);
+  if (!ok || ::rename(part, path) != 0) {
+    ::unlink(part);
+    FilePrintf("Upload failed after %llu of %llu bytes\r\n", static_cast<unsigned long long>(got),
+               static_cast<unsigned long long>(size));
+    return -1;
+  }
+  FilePrintf("Received %llu bytes into %s\r\n", static_cast<unsigned long long>(got), argv[1]);
+  return 0;
+}
+
+}  // namespace detail
+
+// ---------------------------------------------------------------------------
+// Registration
+// ---------------------------------------------------------------------------
+
+/// Register "get", "cat", "tail" and "upload" on @p registry.  @p cfg (and the root
+/// strings it points to) must outlive the registry.
+inline bool RegisterFileCommands(CommandRegistry& registry, const FileCommandsConfig& cfg) {
+  void* ctx = const_cast<FileCommandsConfig*>(&cfg);
+  bool ok = registry.Register("get", "Stream a file unmodified: get <file>", detail::GetCmd, ctx);
+  ok = registry.Register("cat", "Print a text file: cat <file>", detail::CatCmd, ctx) && ok;
+  ok = registry.Register("tail", "Print the end of a file: tail [-n N] [-f] <file>", detail::TailCmd, ctx) && ok;
+  ok = registry.Register("upload", "Receive a binary file: upload <file> <bytes>", detail::UploadCmd, ctx) && ok;
+  return ok;
+}
+
+}  // namespace telsh
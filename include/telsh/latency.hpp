@@ -0,0 +1,123 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::LatencyHistogram -- lock-free log2 latency histogram.
+//
+// Design:
+//   - 32 power-of-two microsecond buckets (bucket i holds [2^i, 2^(i+1)) us,
+//     bucket 0 also holds 0 us), so percentiles are upper bounds within 2x
+//   - Record() is a few relaxed atomic adds: safe from any thread, cheap
+//     enough for every keystroke
+//   - SessionLatency groups the three measured paths: keystroke echo,
+//     command round trip (input to prompt) and network RTT (TIMING-MARK)
+//   - Zero heap allocation
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+namespace telsh {
+
+class LatencyHistogram {
+ public:
+  static constexpr uint32_t kBuckets = 32;
+
+  void Record(uint64_t us) {
+    buckets_[BucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    sum_us_.fetch_add(us, std::memory_order_relaxed);
+    uint64_t prev = max_us_.load(std::memory_order_relaxed);
+    while (us > prev && !max_us_.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {
+    }
+  }
+
+  uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t MaxUs() const { return max_us_.load(std::memory_order_relaxed); }
+  uint64_t MeanUs() const {
+    const uint64_t n = Count();
+    return (n == 0) ? 0 : sum_us_.load(std::memory_order_relaxed) / n;
+  }
+
+  /// Upper bound (us) of the bucket holding the @p permille-th sample.
+  uint64_t PercentileUs(uint32_t permille) const {
+    const uint64_t n = Count();
+    if (n == 0) {
+      return 0;
+    }
+    const uint64_t rank = (n * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < kBuckets; ++i) {
+      seen += buckets_[i].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        const uint64_t upper = (uint64_t{1} << (i + 1)) - 1;
+        return upper < MaxUs() ? upper : MaxUs();
+      }
+    }
+    return MaxUs();
+  }
+
+  uint64_t Bucket(uint32_t i) const { return (i < kBuckets) ? buckets_[i].load(std::memory_order_relaxed) : 0; }
+
+  void Reset() {
+    for (auto& b : buckets_) {
+      b.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+    sum_us_.store(0, std::memory_order_relaxed);
+    max_us_.store(0, std::memory_order_relaxed);
+  }
+
+  /// One-line summary, e.g. "echo      n=42 p50<=63us p99<=255us max=301us\r\n".
+  /// @return bytes written (snprintf semantics, clamped to @p size - 1).
+  uint32_t Format(const char* label, char* buf, uint32_t size) const {
+    if (size == 0) {
+      return 0;
+    }
+    int n = std::snprintf(buf, size, "%-9s n=%llu mean=%lluus p50<=%lluus p90<=%lluus p99<=%lluus max=%lluus\r\n", label,
+                          static_cast<unsigned long long>(Count()), static_cast<unsigned long long>(MeanUs()),
+                          static_cast<unsigned long long>(PercentileUs(500)),
+                          static_cast<unsigned long long>(PercentileUs(900)),
+                          static_cast<unsigned long long>(PercentileUs(990)), static_cast<unsigned long long>(MaxUs()));
+    if (n < 0) {
+      return 0;
+    }
+    return (static_cast<uint32_t>(n) < size) ? static_cast<uint32_t>(n) : size - 1;
+  }
+
+ private:
+  static uint32_t BucketOf(uint64_t us) {
+    uint32_t b = 0;
+    while (us > 1 && b < kBuckets - 1) {
+      us >>= 1;
+      ++b;
+    }
+    return b;
+  }
+
+  std::atomic<uint64_t> buckets_[kBuckets] = {};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> sum_us_{0};
+  std::atomic<uint64_t> max_us_{0};
+};
+
+/// The latency paths measured by a telnet session.
+struct SessionLatency {
+  LatencyHistogram echo;     ///< Input arrival -> echo written (no command)
+  LatencyHistogram command;  ///< Input arrival -> command output + prompt written
+  LatencyHistogram rtt;      ///< IAC DO TIMING-MARK -> client's WILL/WONT
+
+  void Reset() {
+    echo.Reset();
+    command.Reset();
+    rtt.Reset();
+  }
+
+  /// Process-wide aggregate over all sessions.
+  static SessionLatency& Global() {
+    static SessionLatency inst;
+    return inst;
+  }
+};
+
+}  // namespace telsh
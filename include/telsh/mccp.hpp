@@ -0,0 +1,149 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::MccpStream -- MCCP2 (telnet option 86) output compressor.
+//
+// Design:
+//   - One zlib deflate stream per session, started after IAC SB 86 IAC SE
+//   - zlib allocates from a fixed per-stream pool (bump allocator, reset on
+//     End), so compression adds no heap use; window/memLevel are reduced so
+//     the state fits the pool (tunable by macros)
+//   - Caller chooses Z_NO_FLUSH (batching) or Z_SYNC_FLUSH (make the bytes
+//     so far decodable by the client, e.g. at prompt boundaries)
+//   - Compiled only with TELSH_ENABLE_MCCP (links zlib)
+
+#pragma once
+
+#if defined(TELSH_ENABLE_MCCP) && TELSH_ENABLE_MCCP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <zlib.h>
+
+#ifndef TELSH_MCCP_WINDOW_BITS
+#define TELSH_MCCP_WINDOW_BITS 12
+#endif
+
+#ifndef TELSH_MCCP_MEM_LEVEL
+#define TELSH_MCCP_MEM_LEVEL 5
+#endif
+
+#ifndef TELSH_MCCP_LEVEL
+#define TELSH_MCCP_LEVEL 6
+#endif
+
+#ifndef TELSH_MCCP_POOL_SIZE
+#define TELSH_MCCP_POOL_SIZE (48U * 1024U)
+#endif
+
+namespace telsh {
+
+class MccpStream {
+ public:
+  static constexpr uint32_t kPoolSize = TELSH_MCCP_POOL_SIZE;
+  static constexpr uint32_t kOutChunk = 1024;
+
+  /// Receives compressed bytes; return false on a write error.
+  using SinkFn = bool (*)(const uint8_t* data, uint32_t len, void* ctx);
+
+  MccpStream() = default;
+  ~MccpStream() { End(nullptr, nullptr); }
+
+  MccpStream(const MccpStream&) = delete;
+  MccpStream& operator=(const MccpStream&) = delete;
+
+  /// Initialise the deflate stream.  @return false if the pool is too small
+  /// for the configured window/memLevel.
+  bool Start() {
+    if (active_) {
+      return true;
+    }
+    pool_used_ = 0;
+    std::memset(&zs_, 0, sizeof(zs_));
+    zs_.zalloc = &MccpStream::PoolAlloc;
+    zs_.zfree = &MccpStream::PoolFree;
+    zs_.opaque = this;
+    active_ = deflateInit2(&zs_, TELSH_MCCP_LEVEL, Z_DEFLATED, TELSH_MCCP_WINDOW_BITS, TELSH_MCCP_MEM_LEVEL,
+                           Z_DEFAULT_STRATEGY) == Z_OK;
+    return active_;
+  }
+
+  bool Active() const { return active_; }
+
+  /// Compress @p len bytes; @p flush is Z_NO_FLUSH or Z_SYNC_FLUSH.
+  bool Write(const void* data, uint32_t len, int flush, SinkFn sink, void* ctx) {
+    if (!active_) {
+      return false;
+    }
+    zs_.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+    zs_.avail_in = len;
+    return Pump(flush, sink, ctx);
+  }
+
+  /// Emit everything buffered so far as a decodable block.
+  bool Flush(SinkFn sink, void* ctx) { return Write(nullptr, 0, Z_SYNC_FLUSH, sink, ctx); }
+
+  /// Finish the stream (the client sees the zlib end marker) and release
+  /// the pool.  Pass a null @p sink to drop the trailer.
+  void End(SinkFn sink, void* ctx) {
+    if (!active_) {
+      return;
+    }
+    if (sink != nullptr) {
+      zs_.next_in = nullptr;
+      zs_.avail_in = 0;
+      (void)Pump(Z_FINISH, sink, ctx);
+    }
+    deflateEnd(&zs_);
+    active_ = false;
+    pool_used_ = 0;
+  }
+
+  /// Totals since Start(), for statistics.
+  uint64_t BytesIn() const { return active_ ? zs_.total_in : 0; }
+  uint64_t BytesOut() const { return active_ ? zs_.total_out : 0; }
+
+ private:
+  bool Pump(int flush, SinkFn sink, void* ctx) {
+    uint8_t out[kOutChunk];
+    do {
+      zs_.next_out = out;
+      zs_.avail_out = sizeof(out);
+      int rc = deflate(&zs_, flush);
+      if (rc == Z_STREAM_ERROR) {
+        return false;
+      }
+      uint32_t produced = static_cast<uint32_t>(sizeof(out) - zs_.avail_out);
+      if (produced > 0 && !sink(out, produced, ctx)) {
+        return false;
+      }
+      // Output buffer filled completely: more may be pending
+    } while (zs_.avail_out == 0 || zs_.avail_in > 0);
+    return true;
+  }
+
+  static voidpf PoolAlloc(voidpf opaque, uInt items, uInt size) {
+    auto* self = static_cast<MccpStream*>(opaque);
+    const size_t bytes = (static_cast<size_t>(items) * size + alignof(std::max_align_t) - 1) &
+                         ~(alignof(std::max_align_t) - 1);
+    if (bytes > kPoolSize - self->pool_used_) {
+      return Z_NULL;
+    }
+    void* p = self->pool_ + self->pool_used_;
+    self->pool_used_ += bytes;
+    return p;
+  }
+
+  // Everything is released at once by End()
+  static void PoolFree(voidpf, voidpf) {}
+
+  z_stream zs_ = {};
+  bool active_ = false;
+  size_t pool_used_ = 0;
+  alignas(std::max_align_t) uint8_t pool_[kPoolSize];
+};
+
+}  // namespace telsh
+
+#endif  // TELSH_ENABLE_MCCP
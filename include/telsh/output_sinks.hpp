@@ -0,0 +1,410 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::SinkFanout -- tel_printf output fan-out to pluggable sinks.
+//
+// Design:
+//   - Sink table (kMaxSinks) of function pointer + void* ctx, like commands
+//   - tel_printf formats once; Publish() copies the record into a bounded
+//     queue and returns, the fan-out thread hands that same buffer to
+//     every sink in table order, so slow sinks never stall the caller
+//   - A full queue drops the record (counted) rather than blocking
+//   - Stock sinks: FileSink (append-only fd), LogSink (OSP_LOG stream),
+//     RingSink (flight recorder keeping the newest kSize bytes) and
+//     UdpSyslogSink (RFC 3164 datagrams with TIMESTAMP and HOSTNAME,
+//     localhost:514 by default)
+//   - Zero heap allocation
+
+#pragma once
+
+#include "osp/log.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include <arpa/inet.h>
+#include <atomic>
+#include <condition_variable>
+#include <fcntl.h>
+#include <mutex>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace telsh {
+
+/// Receives one formatted record.  Runs on the fan-out thread.
+using SinkFn = void (*)(const char* data, uint32_t len, void* ctx);
+
+// ---------------------------------------------------------------------------
+// SinkFanout
+// ---------------------------------------------------------------------------
+
+class SinkFanout {
+ public:
+  static constexpr uint32_t kMaxSinks = 8;
+  static constexpr uint32_t kQueueSize = 16384;
+  static constexpr uint32_t kMaxRecord = 512;
+
+  SinkFanout() = default;
+  ~SinkFanout() { Stop(); }
+
+  SinkFanout(const SinkFanout&) = delete;
+  SinkFanout& operator=(const SinkFanout&) = delete;
+
+  /// Process-wide fan-out fed by tel_printf / TelnetServer::Printf.
+  static SinkFanout& Instance() {
+    static SinkFanout inst;
+    return inst;
+  }
+
+  /// @return sink id for RemoveSink(), or -1 if the table is full.
+  int32_t AddSink(const char* name, SinkFn fn, void* ctx) {
+    if (fn == nullptr) {
+      return -1;
+    }
+    std::lock_guard<std::mutex> lock(sinks_mutex_);
+    for (uint32_t i = 0; i < kMaxSinks; ++i) {
+      if (sinks_[i].fn == nullptr) {
+        sinks_[i] = {name, fn, ctx};
+        return static_cast<int32_t>(i);
+      }
+    }
+    OSP_LOG_WARN("TELSH", "sink table full, '%s' not added", name != nullptr ? name : "?");
+    return -1;
+  }
+
+  /// Remove a sink; once this returns the fan-out thread no longer calls it.
+  bool RemoveSink(int32_t id) {
+    if (id < 0 || static_cast<uint32_t>(id) >= kMaxSinks) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(sinks_mutex_);
+    const bool had = sinks_[id].fn != nullptr;
+    sinks_[id] = {};
+    return had;
+  }
+
+  uint32_t SinkCount() {
+    std::lock_guard<std::mutex> lock(sinks_mutex_);
+    uint32_t n = 0;
+    for (const Sink& s : sinks_) {
+      n += (s.fn != nullptr) ? 1U : 0U;
+    }
+    return n;
+  }
+
+  /// Start the fan-out thread.  Publish() drops records until then.
+  bool Start() {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (running_) {
+      return true;
+    }
+    running_ = true;
+    thread_ = std::thread([this]() { Loop(); });
+    return true;
+  }
+
+  /// Deliver what is queued, then join the fan-out thread.
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      if (!running_) {
+        return;
+      }
+      running_ = false;
+    }
+    queue_cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+  bool IsRunning() {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return running_;
+  }
+
+  /// Queue one record (truncated to kMaxRecord) for all sinks.
+  /// @return false if not running or the queue is full.
+  bool Publish(const char* data, uint32_t len) {
+    if (data == nullptr || len == 0) {
+      return true;
+    }
+    len = (len < kMaxRecord) ? len : kMaxRecord;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      if (!running_) {
+        return false;
+      }
+      if (queue_len_ + sizeof(uint16_t) + len > kQueueSize) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      const uint16_t hdr = static_cast<uint16_t>(len);
+      Put(reinterpret_cast<const char*>(&hdr), sizeof(hdr));
+      Put(data, len);
+    }
+    queue_cv_.notify_one();
+    return true;
+  }
+
+  /// Block until every record queued so far has reached the sinks.
+  void Flush() {
+    std::unique_lock<std::mutex> lock(queue_mutex_);
+    idle_cv_.wait(lock, [this]() { return (queue_len_ == 0 && !busy_) || !running_; });
+  }
+
+  /// Records lost to a full queue.
+  uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  struct Sink {
+    const char* name;
+    SinkFn fn;
+    void* ctx;
+  };
+
+  // Queue ring: [uint16 len][bytes] records, queue_mutex_ held
+  void Put(const char* src, uint32_t len) {
+    const uint32_t tail = (queue_head_ + queue_len_) % kQueueSize;
+    const uint32_t first = (len < kQueueSize - tail) ? len : kQueueSize - tail;
+    std::memcpy(queue_ + tail, src, first);
+    std::memcpy(queue_, src + first, len - first);
+    queue_len_ += len;
+  }
+
+  void Take(char* dst, uint32_t len) {
+    const uint32_t first = (len < kQueueSize - queue_head_) ? len : kQueueSize - queue_head_;
+    std::memcpy(dst, queue_ + queue_head_, first);
+    std::memcpy(dst + first, queue_, len - first);
+    queue_head_ = (queue_head_ + len) % kQueueSize;
+    queue_len_ -= len;
+  }
+
+  void Loop() {
+    char record[kMaxRecord];
+    for (;;) {
+      uint16_t len = 0;
+      {
+        std::unique_lock<std::mutex> lock(queue_mutex_);
+        busy_ = false;
+        idle_cv_.notify_all();
+        queue_cv_.wait(lock, [this]() { return queue_len_ > 0 || !running_; });
+        if (queue_len_ == 0) {
+          return;  // stopped and drained
+        }
+        Take(reinterpret_cast<char*>(&len), sizeof(len));
+        Take(record, len);
+        busy_ = true;
+      }
+      std::lock_guard<std::mutex> lock(sinks_mutex_);
+      for (const Sink& s : sinks_) {
+        if (s.fn != nullptr) {
+          s.fn(record, len, s.ctx);
+        }
+      }
+    }
+  }
+
+  Sink sinks_[kMaxSinks] = {};
+  std::mutex sinks_mutex_;
+
+  char queue_[kQueueSize] = {};
+  uint32_t queue_head_ = 0;
+  uint32_t queue_len_ = 0;
+  bool running_ = false;
+  bool busy_ = false;  ///< A record is out of the queue but not yet delivered
+  std::mutex queue_mutex_;
+  std::condition_variable queue_cv_;
+  std::condition_variable idle_cv_;
+  std::thread thread_;
+  std::atomic<uint64_t> dropped_{0};
+};
+
+// ---------------------------------------------------------------------------
+// Stock sinks
+// ---------------------------------------------------------------------------
+
+namespace detail {
+
+/// Record without its trailing CR/LF (line-oriented sinks add their own).
+inline uint32_t TrimLineEnd(const char* data, uint32_t len) {
+  while (len > 0 && (data[len - 1] == '\n' || data[len - 1] == '\r')) {
+    --len;
+  }
+  return len;
+}
+
+}  // namespace detail
+
+/// Appends records to a file.  Writes happen on the fan-out thread, so the
+/// caller of tel_printf never waits on the disk.
+class FileSink {
+ public:
+  ~FileSink() { Close(); }
+
+  bool Open(const char* path) {
+    Close();
+    fd_ = ::open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      OSP_LOG_WARN("TELSH", "FileSink: cannot open %s: %s", path, strerror(errno));
+    }
+    return fd_ >= 0;
+  }
+
+  void Close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  static void Write(const char* data, uint32_t len, void* ctx) {
+    auto* self = static_cast<FileSink*>(ctx);
+    while (self->fd_ >= 0 && len > 0) {
+      ssize_t n = ::write(self->fd_, data, len);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        return;
+      }
+      data += n;
+      len -= static_cast<uint32_t>(n);
+    }
+  }
+
+ private:
+  int32_t fd_ = -1;
+};
+
+/// Forwards records to the OSP_LOG stream (category "TELSH", info level).
+struct LogSink {
+  static void Write(const char* data, uint32_t len, void* ctx) {
+    (void)ctx;
+    OSP_LOG_INFO("TELSH", "%.*s", static_cast<int>(detail::TrimLineEnd(data, len)), data);
+  }
+};
+
+/// Flight recorder: keeps the newest kSize bytes of output in memory for
+/// post-mortem inspection (e.g. from a debugger or a crash handler).
+class RingSink {
+ public:
+  static constexpr uint32_t kSize = 8192;
+
+  static void Write(const char* data, uint32_t len, void* ctx) {
+    auto* self = static_cast<RingSink*>(ctx);
+    if (len > kSize) {
+      data += len - kSize;
+      len = kSize;
+    }
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    const uint32_t tail = (self->head_ + self->len_) % kSize;
+    const uint32_t first = (len < kSize - tail) ? len : kSize - tail;
+    std::memcpy(self->buf_ + tail, data, first);
+    std::memcpy(self->buf_, data + first, len - first);
+    self->len_ += len;
+    if (self->len_ > kSize) {
+      self->head_ = (self->head_ + self->len_ - kSize) % kSize;
+      self->len_ = kSize;
+    }
+  }
+
+  /// Copy the recorded bytes, oldest first.  @return bytes copied.
+  uint32_t Snapshot(char* out, uint32_t cap) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint32_t skip = (len_ > cap) ? len_ - cap : 0;  // keep the newest
+    const uint32_t n = len_ - skip;
+    const uint32_t start = (head_ + skip) % kSize;
+    const uint32_t first = (n < kSize - start) ? n : kSize - start;
+    std::memcpy(out, buf_ + start, first);
+    std::memcpy(out + first, buf_, n - first);
+    return n;
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    head_ = 0;
+    len_ = 0;
+  }
+
+ private:
+  char buf_[kSize] = {};
+  uint32_t head_ = 0;
+  uint32_t len_ = 0;
+  std::mutex mutex_;
+};
+
+/// Sends each record as an RFC 3164 syslog datagram to a local daemon.
+class UdpSyslogSink {
+ public:
+  ~UdpSyslogSink() { Close(); }
+
+  /// @p facility / @p severity per RFC 3164 (default user.info).
+  bool Open(uint16_t port = 514, const char* tag = "telsh", uint8_t facility = 1, uint8_t severity = 6) {
+    Close();
+    fd_ = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd_ < 0) {
+      return false;
+    }
+    std::memset(&addr_, 0, sizeof(addr_));
+    addr_.sin_family = AF_INET;
+    addr_.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr_.sin_port = htons(port);
+    tag_ = (tag != nullptr) ? tag : "telsh";
+    pri_ = static_cast<uint32_t>(facility) * 8U + severity;
+    // RFC 3164 HOSTNAME: no domain part, never empty
+    if (::gethostname(host_, sizeof(host_)) != 0 || host_[0] == '\0') {
+      std::snprintf(host_, sizeof(host_), "localhost");
+    }
+    host_[sizeof(host_) - 1] = '\0';
+    char* dot = std::strchr(host_, '.');
+    if (dot != nullptr && dot != host_) {
+      *dot = '\0';
+    }
+    return true;
+  }
+
+  void Close() {
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  static void Write(const char* data, uint32_t len, void* ctx) {
+    auto* self = static_cast<UdpSyslogSink*>(ctx);
+    if (self->fd_ < 0) {
+      return;
+    }
+    // <PRI>Mmm dd hh:mm:ss HOSTNAME TAG: MSG -- without TIMESTAMP and
+    // HOSTNAME, rsyslog / syslog-ng take the tag for the host name
+    static const char* const kMonths[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                            "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    const time_t now = ::time(nullptr);
+    struct tm tm;
+    ::localtime_r(&now, &tm);
+    char msg[SinkFanout::kMaxRecord + 128];
+    int n = std::snprintf(msg, sizeof(msg), "<%u>%s %2d %02d:%02d:%02d %s %s: %.*s", self->pri_,
+                          kMonths[tm.tm_mon % 12], tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, self->host_,
+                          self->tag_, static_cast<int>(detail::TrimLineEnd(data, len)), data);
+    if (n > 0) {
+      const size_t out = (static_cast<size_t>(n) < sizeof(msg)) ? static_cast<size_t>(n) : sizeof(msg) - 1;
+      (void)::sendto(self->fd_, msg, out, MSG_DONTWAIT, reinterpret_cast<const struct sockaddr*>(&self->addr_),
+                     sizeof(self->addr_));
+    }
+  }
+
+ private:
+  int32_t fd_ = -1;
+  struct sockaddr_in addr_ = {};
+  const char* tag_ = "telsh";
+  uint32_t pri_ = 14;
+  char host_[64] = "localhost";
+};
+
+}  // namespace telsh
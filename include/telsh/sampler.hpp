@@ -0,0 +1,470 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::VarSampler -- time-series rings of registered variables
+// ("sample <var> <hz> <n>", "plot <var>").
+//
+// Design:
+//   - kMaxRings fixed rings of up to kMaxPoints doubles; each keeps the
+//     newest n samples of one VarRegistry variable taken at its own rate
+//   - One sampler thread (SCHED_IDLE where available) serves every ring,
+//     sleeping until the earliest one is due; it starts with the first
+//     ring.  Reads use the registered reader (relaxed / seqlock load), so
+//     the sampled code pays nothing
+//   - A late sampler skips missed samples instead of bursting
+//   - "plot" renders min/max/avg/last and a sparkline (Unicode blocks), or
+//     an ASCII chart with "-c", as wide as the client window (NAWS)
+//   - Zero heap allocation
+
+#pragma once
+
+#include "osp/platform.hpp"
+#include "telsh/command_registry.hpp"
+#include "telsh/telnet_session.hpp"
+#include "telsh/vars.hpp"
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+
+namespace telsh {
+
+// ---------------------------------------------------------------------------
+// Rendering
+// ---------------------------------------------------------------------------
+
+namespace detail {
+
+/// Average of the finite @p values[from, to); NaN if there are none
+/// (a variable may read as NaN or +-inf).
+inline double BucketMean(const double* values, uint32_t from, uint32_t to) {
+  double sum = 0;
+  uint32_t count = 0;
+  for (uint32_t i = from; i < to; ++i) {
+    if (std::isfinite(values[i])) {
+      sum += values[i];
+      ++count;
+    }
+  }
+  return (count > 0) ? sum / count : NAN;
+}
+
+/// Min and max of the finite @p values.  @return false if there are none.
+inline bool FiniteRange(const double* values, uint32_t n, double* lo, double* hi) {
+  bool any = false;
+  for (uint32_t i = 0; i < n; ++i) {
+    if (!std::isfinite(values[i])) {
+      continue;
+    }
+    *lo = (!any || values[i] < *lo) ? values[i] : *lo;
+    *hi = (!any || values[i] > *hi) ? values[i] : *hi;
+    any = true;
+  }
+  return any;
+}
+
+/// Step 0..@p top of @p v within [lo, hi], clamped (also when hi - lo
+/// overflows); @p v must be finite.
+inline uint32_t ScaleLevel(double v, double lo, double hi, uint32_t top) {
+  if (!(hi > lo)) {
+    return top / 2;
+  }
+  const double x = (v - lo) / (hi - lo) * top + 0.5;
+  if (!(x >= 1.0)) {
+    return 0;  // also NaN
+  }
+  return (x >= top) ? top : static_cast<uint32_t>(x);
+}
+
+/// Downsample @p n values to at most @p cols column means.
+/// @return columns written to @p cols_out.
+inline uint32_t ToColumns(const double* values, uint32_t n, uint32_t cols, double* cols_out) {
+  if (cols == 0 || n == 0) {
+    return 0;
+  }
+  cols = (n < cols) ? n : cols;
+  for (uint32_t c = 0; c < cols; ++c) {
+    cols_out[c] = BucketMean(values, static_cast<uint32_t>(uint64_t{c} * n / cols),
+                             static_cast<uint32_t>(uint64_t{c + 1} * n / cols));
+  }
+  return cols;
+}
+
+/// Sparkline of @p n values in at most @p width cells ("▁".."█", UTF-8);
+/// a cell without finite values is blank.
+/// @return bytes written to @p out (NUL-terminated, truncated to @p cap).
+inline uint32_t RenderSparkline(const double* values, uint32_t n, uint32_t width, char* out, uint32_t cap) {
+  static const char* const kBlocks[8] = {"\xE2\x96\x81", "\xE2\x96\x82", "\xE2\x96\x83", "\xE2\x96\x84",
+                                         "\xE2\x96\x85", "\xE2\x96\x86", "\xE2\x96\x87", "\xE2\x96\x88"};
+  double cols[512];
+  const uint32_t m = ToColumns(values, n, (width < 512) ? width : 512, cols);
+  if (cap > 0) {
+    out[0] = '\0';
+  }
+  double lo = 0;
+  double hi = 0;
+  if (m == 0 || !FiniteRange(cols, m, &lo, &hi)) {
+    return 0;
+  }
+  uint32_t len = 0;
+  for (uint32_t c = 0; c < m && len + 4 <= cap; ++c) {
+    if (!std::isfinite(cols[c])) {
+      out[len++] = ' ';
+      continue;
+    }
+    std::memcpy(out + len, kBlocks[ScaleLevel(cols[c], lo, hi, 7)], 3);
+    len += 3;
+  }
+  if (cap > 0) {
+    out[len] = '\0';
+  }
+  return len;
+}
+
+}  // namespace detail
+
+// ---------------------------------------------------------------------------
+// VarSampler
+// ---------------------------------------------------------------------------
+
+class VarSampler {
+ public:
+  static constexpr uint32_t kMaxRings = 4;
+  static constexpr uint32_t kMaxPoints = 1024;
+  static constexpr uint32_t kMaxHz = 1000;
+
+  /// Begin() errors.
+  static constexpr int32_t kErrVar = -1;    ///< Unknown variable
+  static constexpr int32_t kErrRange = -2;  ///< Rate or point count out of range
+  static constexpr int32_t kErrFull = -3;   ///< All rings in use
+
+  explicit VarSampler(const VarRegistry& vars = VarRegistry::Instance()) : vars_(vars) {}
+  ~VarSampler() { Shutdown(); }
+
+  VarSampler(const VarSampler&) = delete;
+  VarSampler& operator=(const VarSampler&) = delete;
+
+  /// Record @p var at @p hz into a ring of the newest @p n samples,
+  /// replacing a ring already recording it.  @p start_thread = false
+  /// leaves the sampling to Tick() (host loop, tests).
+  /// @return ring index or a kErr* code.
+  int32_t Begin(const char* var, uint32_t hz, uint32_t n, bool start_thread = true) {
+    const VarEntry* entry = (var != nullptr) ? vars_.Find(var) : nullptr;
+    if (entry == nullptr) {
+      return kErrVar;
+    }
+    if (hz == 0 || hz > kMaxHz || n < 2 || n > kMaxPoints) {
+      return kErrRange;
+    }
+    int32_t idx = -1;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (uint32_t i = 0; i < kMaxRings && idx < 0; ++i) {
+        if (rings_[i].var == entry) {
+          idx = static_cast<int32_t>(i);
+        }
+      }
+      for (uint32_t i = 0; i < kMaxRings && idx < 0; ++i) {
+        if (rings_[i].var == nullptr) {
+          idx = static_cast<int32_t>(i);
+        }
+      }
+      if (idx < 0) {
+        return kErrFull;
+      }
+      Ring& r = rings_[idx];
+      r.var = entry;
+      r.period_us = 1000000 / hz;
+      r.capacity = n;
+      r.count = 0;
+      r.head = 0;
+      r.next_us = osp::SteadyNowUs();
+      if (start_thread && !thread_running_) {
+        thread_running_ = true;
+        thread_ = std::thread([this]() { Loop(); });
+      }
+    }
+    cv_.notify_all();
+    return idx;
+  }
+
+  /// Stop recording @p var and free its ring.
+  bool End(const char* var) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Ring& r : rings_) {
+      if (r.var != nullptr && std::strcmp(r.var->name, var) == 0) {
+        r = Ring{};
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Take the samples due at @p now_us (steady clock).  @return samples taken.
+  uint32_t Tick(uint64_t now_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return TickLocked(now_us);
+  }
+
+  /// Copy the samples of @p var, oldest first.  @return samples copied,
+  /// 0 if @p var is not being sampled.
+  uint32_t Snapshot(const char* var, double* out, uint32_t max, uint32_t* period_us = nullptr) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Ring& r : rings_) {
+      if (r.var == nullptr || std::strcmp(r.var->name, var) != 0) {
+        continue;
+      }
+      const uint32_t n = (r.count < max) ? r.count : max;
+      const uint32_t skip = r.count - n;
+      const uint32_t start = (r.head + r.capacity - r.count + skip) % r.capacity;
+      for (uint32_t i = 0; i < n; ++i) {
+        out[i] = r.values[(start + i) % r.capacity];
+      }
+      if (period_us != nullptr) {
+        *period_us = r.period_us;
+      }
+      return n;
+    }
+    return 0;
+  }
+
+  /// "  var  hz  count/capacity" per ring.  @return bytes written.
+  uint32_t Format(char* buf, uint32_t size) {
+    if (size == 0) {
+      return 0;
+    }
+    buf[0] = '\0';
+    uint32_t len = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Ring& r : rings_) {
+      if (r.var == nullptr || len + 1 >= size) {
+        continue;
+      }
+      int n = std::snprintf(buf + len, size - len, "  %-20s %4u Hz  %u/%u samples\r\n", r.var->name,
+                            1000000 / r.period_us, r.count, r.capacity);
+      len = (n < 0) ? len : (len + static_cast<uint32_t>(n) < size) ? len + static_cast<uint32_t>(n) : size - 1;
+    }
+    return len;
+  }
+
+  /// Stop the sampler thread; rings keep their data.
+  void Shutdown() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!thread_running_) {
+        return;
+      }
+      thread_running_ = false;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+ private:
+  struct Ring {
+    const VarEntry* var = nullptr;  ///< nullptr = free
+    uint32_t period_us = 0;
+    uint32_t capacity = 0;
+    uint32_t count = 0;  ///< Valid samples (<= capacity)
+    uint32_t head = 0;   ///< Next write position
+    uint64_t next_us = 0;
+    double values[kMaxPoints] = {};
+  };
+
+  uint32_t TickLocked(uint64_t now_us) {
+    uint32_t taken = 0;
+    for (Ring& r : rings_) {
+      if (r.var == nullptr || now_us < r.next_us) {
+        continue;
+      }
+      r.values[r.head] = r.var->Read();
+      r.head = (r.head + 1) % r.capacity;
+      r.count += (r.count < r.capacity) ? 1U : 0U;
+      r.next_us += r.period_us;
+      if (r.next_us <= now_us) {
+        r.next_us = now_us + r.period_us;  // late: skip, do not burst
+      }
+      ++taken;
+    }
+    return taken;
+  }
+
+  void Loop() {
+#ifdef SCHED_IDLE
+    struct sched_param param = {};
+    (void)pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (thread_running_) {
+      uint64_t now = osp::SteadyNowUs();
+      TickLocked(now);
+      uint64_t next = now + 1000000;
+      for (const Ring& r : rings_) {
+        next = (r.var != nullptr && r.next_us < next) ? r.next_us : next;
+      }
+      cv_.wait_for(lock, std::chrono::microseconds(next - now));
+    }
+  }
+
+  const VarRegistry& vars_;
+  Ring rings_[kMaxRings];
+  bool thread_running_ = false;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::thread thread_;
+};
+
+// ---------------------------------------------------------------------------
+// sample / plot commands
+// ---------------------------------------------------------------------------
+
+namespace detail {
+
+inline void PlotOut(ExecContext* ec, const char* data, uint32_t len) {
+  if (ec != nullptr && ec->output_fn != nullptr && len > 0) {
+    ec->output_fn(data, len, ec->output_ctx);
+  }
+}
+
+inline void PlotPrintf(ExecContext* ec, const char* fmt, ...) {
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n > 0) {
+    PlotOut(ec, buf, (static_cast<uint32_t>(n) < sizeof(buf)) ? static_cast<uint32_t>(n) : sizeof(buf) - 1);
+  }
+}
+
+inline int SampleCmd(int argc, char* argv[], void* ctx) {
+  auto& sampler = *static_cast<VarSampler*>(ctx);
+  ExecContext* ec = CurrentExec();
+  if (argc == 1) {
+    char buf[VarSampler::kMaxRings * 80];
+    uint32_t n = sampler.Format(buf, sizeof(buf));
+    if (n == 0) {
+      PlotPrintf(ec, "Nothing sampled.\r\n");
+    }
+    PlotOut(ec, buf, n);
+    return 0;
+  }
+  if (argc == 3 && std::strcmp(argv[1], "stop") == 0) {
+    if (!sampler.End(argv[2])) {
+      PlotPrintf(ec, "sample: %s is not sampled\r\n", argv[2]);
+      return -1;
+    }
+    return 0;
+  }
+  if (argc != 4) {
+    PlotPrintf(ec, "Usage: sample <var> <hz> <n> | sample stop <var> | sample\r\n");
+    return -1;
+  }
+  const int32_t rc = sampler.Begin(argv[1], static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)),
+                                   static_cast<uint32_t>(std::strtoul(argv[3], nullptr, 10)));
+  switch (rc) {
+    case VarSampler::kErrVar:
+      PlotPrintf(ec, "sample: unknown variable: %s\r\n", argv[1]);
+      return -1;
+    case VarSampler::kErrRange:
+      PlotPrintf(ec, "sample: need 1..%u Hz and 2..%u samples\r\n", VarSampler::kMaxHz, VarSampler::kMaxPoints);
+      return -1;
+    case VarSampler::kErrFull:
+      PlotPrintf(ec, "sample: all %u rings in use (sample stop <var>)\r\n", VarSampler::kMaxRings);
+      return -1;
+    default:
+      return 0;
+  }
+}
+
+/// ASCII chart: @p rows lines of column means, y labels on the left;
+/// columns without finite values stay empty.
+inline void PlotChart(ExecContext* ec, const double* values, uint32_t n, uint32_t width, uint32_t rows) {
+  constexpr uint32_t kLabel = 11;  // "%10.4g|"
+  double cols[512];
+  const uint32_t m = ToColumns(values, n, (width > kLabel + 1) ? width - kLabel - 1 : 1, cols);
+  double lo = 0;
+  double hi = 0;
+  if (m == 0 || !FiniteRange(cols, m, &lo, &hi)) {
+    return;
+  }
+  const double span = (hi > lo) ? hi - lo : 0;  // flat: every point on the bottom row
+  char line[kLabel + 512 + 3];
+  for (uint32_t row = rows; row-- > 0;) {
+    const double level = lo + span * row / (rows - 1);
+    int len = (row == rows - 1 || row == 0 || row == (rows - 1) / 2)
+                  ? std::snprintf(line, sizeof(line), "%10.4g|", level)
+                  : std::snprintf(line, sizeof(line), "%10s|", "");
+    for (uint32_t c = 0; c < m; ++c) {
+      const bool set = std::isfinite(cols[c]) && (span > 0 ? ScaleLevel(cols[c], lo, hi, rows - 1) : 0) == row;
+      line[len++] = set ? '*' : ' ';
+    }
+    line[len++] = '\r';
+    line[len++] = '\n';
+    PlotOut(ec, line, static_cast<uint32_t>(len));
+  }
+}
+
+inline int PlotCmd(int argc, char* argv[], void* ctx) {
+  auto& sampler = *static_cast<VarSampler*>(ctx);
+  ExecContext* ec = CurrentExec();
+  int i = 1;
+  const bool chart = (argc > 1 && std::strcmp(argv[1], "-c") == 0);
+  i += chart ? 1 : 0;
+  if (i >= argc) {
+    PlotPrintf(ec, "Usage: plot [-c] <var> [rows]\r\n");
+    return -1;
+  }
+  double values[VarSampler::kMaxPoints];
+  uint32_t period_us = 0;
+  const uint32_t n = sampler.Snapshot(argv[i], values, VarSampler::kMaxPoints, &period_us);
+  if (n == 0) {
+    PlotPrintf(ec, "plot: no samples of %s (sample %s <hz> <n>)\r\n", argv[i], argv[i]);
+    return -1;
+  }
+
+  double lo = NAN;
+  double hi = NAN;
+  (void)detail::FiniteRange(values, n, &lo, &hi);
+  PlotPrintf(ec, "%s: n=%u over %.3g s  min=%.6g max=%.6g avg=%.6g last=%.6g\r\n", argv[i], n,
+             static_cast<double>(n) * period_us / 1e6, lo, hi, detail::BucketMean(values, 0, n), values[n - 1]);
+
+  const TelnetSession* session = (ec != nullptr) ? ec->session : nullptr;
+  const uint32_t term_w = (session != nullptr && session->TermWidth() > 0) ? session->TermWidth() : 80;
+  const uint32_t term_h = (session != nullptr && session->TermHeight() > 0) ? session->TermHeight() : 24;
+  const uint32_t width = (term_w > 512) ? 512 : term_w;
+  if (chart) {
+    uint32_t rows = (i + 1 < argc) ? static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10)) : term_h - 4;
+    rows = (rows < 3) ? 3 : (rows > 64) ? 64 : rows;
+    PlotChart(ec, values, n, width, rows);
+    return 0;
+  }
+  char spark[512 * 3 + 3];
+  uint32_t len = RenderSparkline(values, n, width - 1, spark, sizeof(spark) - 2);  // no autowrap in the last column
+  spark[len++] = '\r';
+  spark[len++] = '\n';
+  PlotOut(ec, spark, len);
+  return 0;
+}
+
+}  // namespace detail
+
+/// Register "sample" and "plot" for @p sampler.
+inline bool RegisterSampleCommands(CommandRegistry& registry, VarSampler& sampler) {
+  return registry.Register("sample", "Record a variable: sample <var> <hz> <n> | sample stop <var>",
+                           detail::SampleCmd, &sampler) &&
+         registry.Register("plot", "Plot sampled values: plot [-c] <var> [rows]", detail::PlotCmd, &sampler);
+}
+
+}  // namespace telsh
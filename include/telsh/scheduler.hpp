@@ -0,0 +1,640 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::CommandScheduler -- periodic and cron-style command execution
+// ("schedule add/list/del").
+//
+// Design:
+//   - Hashed timer wheel: kWheelSlots slots of kTickMs; each job sits in
+//     the slot of its expiry with a round count, so a tick only touches the
+//     jobs of one slot, whatever the number of jobs and their periods
+//   - Periods ("500ms", "30s", "5m", "1h") or 5-field cron expressions
+//     ("*/5 * * * *"): cron jobs wake at every minute boundary and run when
+//     the local time matches
+//   - Jobs run in-process through CommandRegistry::ExecuteCapture() with
+//     the roles of the session that added them; the output (tel_printf
+//     included) goes to all sessions and sinks, a file below
+//     SchedulerConfig::output_dir, or a RingSink flight recorder
+//   - Driven by its own thread (Start/Stop) or by the host calling
+//     Advance() from its loop (polled servers)
+//   - Zero heap allocation: fixed job table and wheel
+
+#pragma once
+
+#include "telsh/command_registry.hpp"
+#include "telsh/output_sinks.hpp"
+#include "telsh/telnet_server.hpp"
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace telsh {
+
+// ---------------------------------------------------------------------------
+// CronSpec -- "minute hour day-of-month month day-of-week"
+// ---------------------------------------------------------------------------
+
+struct CronSpec {
+  uint64_t minutes = 0;  ///< Bit per minute 0..59
+  uint32_t hours = 0;    ///< Bit per hour 0..23
+  uint32_t days = 0;     ///< Bit per day of month 1..31
+  uint16_t months = 0;   ///< Bit per month 1..12
+  uint8_t weekdays = 0;  ///< Bit per weekday 0..6 (0 = Sunday, 7 accepted)
+  bool any_day = true;   ///< Day-of-month field was "*"
+  bool any_weekday = true;
+
+  /// Parse five fields of "*", "a", "a-b", each with an optional "/step",
+  /// comma separated.  @return false on syntax or range errors.
+  bool Parse(const char* expr) {
+    *this = CronSpec{};
+    char buf[128];
+    if (expr == nullptr || std::strlen(expr) >= sizeof(buf)) {
+      return false;
+    }
+    std::strcpy(buf, expr);
+    char* fields[5];
+    uint32_t n = 0;
+    for (char* save = nullptr, *tok = strtok_r(buf, " \t", &save); tok != nullptr;
+         tok = strtok_r(nullptr, " \t", &save)) {
+      if (n == 5) {
+        return false;
+      }
+      fields[n++] = tok;
+    }
+    uint64_t bits[5];
+    static constexpr uint32_t kLo[5] = {0, 0, 1, 1, 0};
+    static constexpr uint32_t kHi[5] = {59, 23, 31, 12, 7};
+    for (uint32_t i = 0; i < n; ++i) {
+      if (!ParseField(fields[i], kLo[i], kHi[i], &bits[i])) {
+        return false;
+      }
+    }
+    if (n != 5) {
+      return false;
+    }
+    minutes = bits[0];
+    hours = static_cast<uint32_t>(bits[1]);
+    days = static_cast<uint32_t>(bits[2]);
+    months = static_cast<uint16_t>(bits[3]);
+    weekdays = static_cast<uint8_t>((bits[4] | (bits[4] >> 7)) & 0x7FU);  // 7 = Sunday
+    any_day = (fields[2][0] == '*');
+    any_weekday = (fields[4][0] == '*');
+    return true;
+  }
+
+  /// Cron semantics: when both day fields are restricted either may match.
+  bool Matches(const struct tm& t) const {
+    if ((minutes >> t.tm_min & 1U) == 0 || (hours >> t.tm_hour & 1U) == 0 || (months >> (t.tm_mon + 1) & 1U) == 0) {
+      return false;
+    }
+    const bool day = (days >> t.tm_mday & 1U) != 0;
+    const bool weekday = (weekdays >> t.tm_wday & 1U) != 0;
+    if (!any_day && !any_weekday) {
+      return day || weekday;
+    }
+    return day && weekday;
+  }
+
+ private:
+  static bool ParseField(const char* s, uint32_t lo, uint32_t hi, uint64_t* out) {
+    *out = 0;
+    while (*s != '\0') {
+      uint32_t a = lo;
+      uint32_t b = hi;
+      uint32_t step = 1;
+      char* end = nullptr;
+      if (*s == '*') {
+        ++s;
+      } else {
+        a = static_cast<uint32_t>(std::strtoul(s, &end, 10));
+        if (end == s) {
+          return false;
+        }
+        b = a;
+        s = end;
+        if (*s == '-') {
+          b = static_cast<uint32_t>(std::strtoul(s + 1, &end, 10));
+          if (end == s + 1) {
+            return false;
+          }
+          s = end;
+        }
+      }
+      if (*s == '/') {
+        step = static_cast<uint32_t>(std::strtoul(s + 1, &end, 10));
+        if (end == s + 1 || step == 0) {
+          return false;
+        }
+        s = end;
+      }
+      if (a < lo || b > hi || a > b) {
+        return false;
+      }
+      for (uint32_t v = a; v <= b; v += step) {
+        *out |= uint64_t{1} << v;
+      }
+      if (*s == ',') {
+        ++s;
+      } else if (*s != '\0') {
+        return false;
+      }
+    }
+    return *out != 0;
+  }
+};
+
+// ---------------------------------------------------------------------------
+// SchedulerConfig
+// ---------------------------------------------------------------------------
+
+/// Where a job's output goes.
+enum class ScheduleTarget : uint8_t {
+  kSessions,  ///< TelnetServer::Publish: all sessions and the SinkFanout sinks
+  kFile,      ///< Appended to a file below SchedulerConfig::output_dir
+  kRecorder   ///< SchedulerConfig::recorder (flight recorder)
+};
+
+struct SchedulerConfig {
+  const char* output_dir = nullptr;  ///< Directory for file outputs, nullptr = no file output
+  RingSink* recorder = nullptr;      ///< Flight recorder output, nullptr = none
+};
+
+// ---------------------------------------------------------------------------
+// CommandScheduler
+// ---------------------------------------------------------------------------
+
+class CommandScheduler {
+ public:
+  static constexpr uint32_t kMaxJobs = 16;
+  static constexpr uint32_t kTickMs = 100;
+  static constexpr uint32_t kWheelSlots = 256;  ///< One revolution = 25.6 s
+  static constexpr uint32_t kMaxFileName = 64;
+  static constexpr uint32_t kMaxOutput = 2048;  ///< Per run, the rest is cut
+
+  /// Add() errors.
+  static constexpr int32_t kErrSpec = -1;     ///< Bad period / cron expression
+  static constexpr int32_t kErrCommand = -2;  ///< Unknown command
+  static constexpr int32_t kErrOutput = -3;   ///< Output target not configured / bad name
+  static constexpr int32_t kErrFull = -4;     ///< Job table full
+
+  explicit CommandScheduler(CommandRegistry& registry, const SchedulerConfig& config = {})
+      : registry_(registry), config_(config), last_tick_ms_(NowMs()) {
+    for (int16_t& head : wheel_) {
+      head = -1;
+    }
+  }
+
+  ~CommandScheduler() { Stop(); }
+
+  CommandScheduler(const CommandScheduler&) = delete;
+  CommandScheduler& operator=(const CommandScheduler&) = delete;
+
+  static uint64_t NowMs() { return osp::SteadyNowUs() / 1000; }
+
+  /// Schedule @p cmdline every @p spec (period or cron expression), run
+  /// with @p roles.  @p file names the output file for kFile (no '/').
+  /// @return job id (> 0) or a kErr* code.
+  int32_t Add(const char* spec, const char* cmdline, ScheduleTarget target = ScheduleTarget::kSessions,
+              const char* file = nullptr, uint32_t roles = kRoleAll) {
+    if (spec == nullptr || cmdline == nullptr || std::strlen(cmdline) >= CommandRegistry::kMaxLineLen) {
+      return kErrSpec;
+    }
+    Job job;
+    job.is_cron = (std::strchr(spec, ' ') != nullptr);
+    if (job.is_cron ? !job.cron.Parse(spec) : !ParsePeriod(spec, &job.period_ms)) {
+      return kErrSpec;
+    }
+    char name[CommandRegistry::kMaxLineLen];
+    if (std::sscanf(cmdline, "%255s", name) != 1 || registry_.Resolve(name) == nullptr) {
+      return kErrCommand;
+    }
+    if (target == ScheduleTarget::kFile) {
+      if (config_.output_dir == nullptr || file == nullptr || *file == '\0' || *file == '.' ||
+          std::strchr(file, '/') != nullptr ||
+          std::snprintf(job.file, sizeof(job.file), "%s/%s", config_.output_dir, file) >=
+              static_cast<int>(sizeof(job.file))) {
+        return kErrOutput;
+      }
+    } else if (target == ScheduleTarget::kRecorder && config_.recorder == nullptr) {
+      return kErrOutput;
+    }
+    std::strcpy(job.line, cmdline);
+    std::snprintf(job.spec, sizeof(job.spec), "%s", spec);
+    job.target = target;
+    job.roles = roles;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint32_t i = 0; i < kMaxJobs; ++i) {
+      if (!jobs_[i].used) {
+        job.used = true;
+        job.id = next_id_++;
+        jobs_[i] = job;
+        Insert(i);
+        return static_cast<int32_t>(job.id);
+      }
+    }
+    return kErrFull;
+  }
+
+  /// Cancel job @p id.  A run in progress completes.
+  bool Remove(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (uint32_t i = 0; i < kMaxJobs; ++i) {
+      Job& job = jobs_[i];
+      if (!job.used || job.removed || job.id != id) {
+        continue;
+      }
+      if (job.running) {
+        job.removed = true;  // freed by Advance() after the run
+      } else {
+        Unlink(i);
+        job.used = false;
+      }
+      return true;
+    }
+    return false;
+  }
+
+  uint32_t JobCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t n = 0;
+    for (const Job& job : jobs_) {
+      n += (job.used && !job.removed) ? 1U : 0U;
+    }
+    return n;
+  }
+
+  /// One line per job: "  id  spec  runs  rc  target  command\r\n".
+  /// @return bytes written (clamped to @p size - 1).
+  uint32_t Format(char* buf, uint32_t size) {
+    if (size == 0) {
+      return 0;
+    }
+    uint32_t len = 0;
+    buf[0] = '\0';
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Job& job : jobs_) {
+      if (!job.used || job.removed || len + 1 >= size) {
+        continue;
+      }
+      const char* out = (job.target == ScheduleTarget::kSessions) ? "sessions"
+                        : (job.target == ScheduleTarget::kFile)   ? job.file
+                                                                  : "recorder";
+      int n = std::snprintf(buf + len, size - len, "  %-3u %-16s runs=%-5u rc=%-4d -> %s: %s\r\n", job.id, job.spec,
+                            job.runs, job.last_rc, out, job.line);
+      len = (n < 0) ? len : (len + static_cast<uint32_t>(n) < size) ? len + static_cast<uint32_t>(n) : size - 1;
+    }
+    return len;
+  }
+
+  /// Run the jobs due up to @p now_ms (steady clock, see NowMs()).
+  /// Called by the scheduler thread, or by the host loop when it drives
+  /// the scheduler itself.  @return jobs run.
+  uint32_t Advance(uint64_t now_ms) {
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    uint32_t due[kMaxJobs];
+    uint32_t n = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      while (last_tick_ms_ + kTickMs <= now_ms) {
+        last_tick_ms_ += kTickMs;
+        cursor_ = (cursor_ + 1) % kWheelSlots;
+        CollectDue(&due[0], &n);
+      }
+    }
+    for (uint32_t k = 0; k < n; ++k) {
+      RunJob(jobs_[due[k]]);
+      std::lock_guard<std::mutex> lock(mutex_);
+      Job& job = jobs_[due[k]];
+      job.running = false;
+      if (job.removed) {
+        job = Job{};
+      } else {
+        Insert(due[k]);
+      }
+    }
+    return n;
+  }
+
+  /// Start the scheduler thread (ticks every kTickMs).
+  bool Start() {
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    if (running_) {
+      return true;
+    }
+    running_ = true;
+    thread_ = std::thread([this]() { Loop(); });
+    return true;
+  }
+
+  /// Stop and join the scheduler thread (a job in progress completes).
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(thread_mutex_);
+      if (!running_) {
+        return;
+      }
+      running_ = false;
+    }
+    thread_cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+ private:
+  struct Job {
+    char line[CommandRegistry::kMaxLineLen] = {};
+    char spec[32] = {};
+    char file[kMaxFileName + 128] = {};  ///< output_dir + '/' + name
+    CronSpec cron;
+    uint32_t period_ms = 0;
+    uint32_t roles = kRoleAll;
+    uint32_t id = 0;
+    uint32_t runs = 0;
+    int32_t last_rc = 0;
+    int64_t cron_minute = -1;  ///< Wall-clock minute (time / 60) of the last cron run
+    uint32_t rounds = 0;  ///< Wheel revolutions left before expiry
+    int16_t next = -1;    ///< Next job in the same wheel slot
+    uint16_t slot = 0;
+    ScheduleTarget target = ScheduleTarget::kSessions;
+    bool is_cron = false;
+    bool used = false;
+    bool running = false;  ///< Out of the wheel, being run by Advance()
+    bool removed = false;
+  };
+
+  /// "250ms", "30s", "5m", "1h" or plain seconds; at least one tick.
+  static bool ParsePeriod(const char* spec, uint32_t* ms) {
+    char* end = nullptr;
+    const unsigned long v = std::strtoul(spec, &end, 10);
+    if (end == spec) {
+      return false;
+    }
+    unsigned long scale = 1000;
+    if (std::strcmp(end, "ms") == 0) {
+      scale = 1;
+    } else if (std::strcmp(end, "m") == 0) {
+      scale = 60000;
+    } else if (std::strcmp(end, "h") == 0) {
+      scale = 3600000;
+    } else if (*end != '\0' && std::strcmp(end, "s") != 0) {
+      return false;
+    }
+    if (v == 0 || v > 0xFFFFFFFFUL / scale || v * scale < kTickMs) {
+      return false;
+    }
+    *ms = static_cast<uint32_t>(v * scale);
+    return true;
+  }
+
+  /// Delay until the job's next expiry (cron: the next minute boundary).
+  static uint64_t DelayMs(const Job& job) {
+    if (!job.is_cron) {
+      return job.period_ms;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const uint64_t wall_ms = static_cast<uint64_t>(ts.tv_sec) * 1000 + static_cast<uint64_t>(ts.tv_nsec) / 1000000;
+    return 60000 - wall_ms % 60000;
+  }
+
+  /// Put job @p i into the slot of its next expiry; mutex_ held.
+  void Insert(uint32_t i) {
+    Job& job = jobs_[i];
+    const uint64_t ticks = (DelayMs(job) + kTickMs - 1) / kTickMs;
+    job.rounds = static_cast<uint32_t>((ticks - 1) / kWheelSlots);
+    job.slot = static_cast<uint16_t>((cursor_ + ticks) % kWheelSlots);
+    job.next = wheel_[job.slot];
+    wheel_[job.slot] = static_cast<int16_t>(i);
+  }
+
+  void Unlink(uint32_t i) {
+    int16_t* link = &wheel_[jobs_[i].slot];
+    while (*link >= 0 && *link != static_cast<int16_t>(i)) {
+      link = &jobs_[*link].next;
+    }
+    if (*link >= 0) {
+      *link = jobs_[i].next;
+    }
+  }
+
+  /// Expire the slot under the cursor into @p due; mutex_ held.
+  void CollectDue(uint32_t* due, uint32_t* n) {
+    int16_t i = wheel_[cursor_];
+    wheel_[cursor_] = -1;
+    while (i >= 0) {
+      const uint32_t idx = static_cast<uint32_t>(i);
+      Job& job = jobs_[idx];
+      i = job.next;
+      if (job.rounds > 0) {
+        --job.rounds;
+        job.next = wheel_[cursor_];
+        wheel_[cursor_] = static_cast<int16_t>(idx);
+      } else if (job.is_cron && !CronDue(job)) {
+        Insert(idx);
+      } else {
+        job.running = true;
+        due[(*n)++] = idx;
+      }
+    }
+  }
+
+  /// A cron job may run in the current minute if it matches and has not run
+  /// in it yet: wheel ticks trail the wall clock (and runs take time), so a
+  /// job can wake just before the next minute boundary and see the minute it
+  /// has just run in.  Records the minute when returning true.
+  static bool CronDue(Job& job) {
+    const time_t now = std::time(nullptr);
+    const int64_t minute = static_cast<int64_t>(now) / 60;
+    struct tm t;
+    localtime_r(&now, &t);
+    if (minute == job.cron_minute || !job.cron.Matches(t)) {
+      return false;
+    }
+    job.cron_minute = minute;
+    return true;
+  }
+
+  /// Execute @p job (not in the wheel, fields stable) and deliver its output.
+  void RunJob(Job& job) {
+    char out[kMaxOutput];
+    detail::CaptureBuffer capture{out, sizeof(out), 0};
+    char header[64];
+    int n = std::snprintf(header, sizeof(header), "[schedule %u] ", job.id);
+    detail::CaptureBuffer::Append(header, static_cast<uint32_t>(n), &capture);
+    detail::CaptureBuffer::Append(job.line, static_cast<uint32_t>(std::strlen(job.line)), &capture);
+    detail::CaptureBuffer::Append("\r\n", 2, &capture);
+    const int rc = registry_.ExecuteCapture(job.line, &detail::CaptureBuffer::Append, &capture, job.roles);
+    const uint32_t len = static_cast<uint32_t>((capture.len < sizeof(out)) ? capture.len : sizeof(out) - 1);
+    switch (job.target) {
+      case ScheduleTarget::kSessions:
+        TelnetServer::Publish(out, len);
+        break;
+      case ScheduleTarget::kFile: {
+        FileSink file;
+        if (file.Open(job.file)) {
+          FileSink::Write(out, len, &file);
+        }
+        break;
+      }
+      case ScheduleTarget::kRecorder:
+        RingSink::Write(out, len, config_.recorder);
+        break;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++job.runs;
+    job.last_rc = rc;
+  }
+
+  void Loop() {
+    std::unique_lock<std::mutex> lock(thread_mutex_);
+    while (running_) {
+      thread_cv_.wait_for(lock, std::chrono::milliseconds(kTickMs));
+      if (!running_) {
+        break;
+      }
+      lock.unlock();
+      Advance(NowMs());
+      lock.lock();
+    }
+  }
+
+  CommandRegistry& registry_;
+  SchedulerConfig config_;
+  Job jobs_[kMaxJobs];
+  int16_t wheel_[kWheelSlots];  ///< Head job index per slot, -1 = empty
+  uint32_t cursor_ = 0;
+  uint64_t last_tick_ms_;
+  uint32_t next_id_ = 1;
+  std::mutex mutex_;      ///< Jobs and wheel
+  std::mutex run_mutex_;  ///< One Advance() at a time
+
+  bool running_ = false;
+  std::mutex thread_mutex_;
+  std::condition_variable thread_cv_;
+  std::thread thread_;
+};
+
+// ---------------------------------------------------------------------------
+// schedule command
+// ---------------------------------------------------------------------------
+
+namespace detail {
+
+inline void ScheduleOut(const char* fmt, ...) {
+  ExecContext* ec = CurrentExec();
+  if (ec == nullptr || ec->output_fn == nullptr) {
+    return;
+  }
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n > 0) {
+    ec->output_fn(buf, (static_cast<uint32_t>(n) < sizeof(buf)) ? static_cast<uint32_t>(n) : sizeof(buf) - 1,
+                  ec->output_ctx);
+  }
+}
+
+inline int ScheduleAdd(CommandScheduler& sched, int argc, char* argv[], uint32_t roles) {
+  ScheduleTarget target = ScheduleTarget::kSessions;
+  const char* file = nullptr;
+  int i = 2;
+  if (i + 1 < argc && std::strcmp(argv[i], "-o") == 0) {
+    const char* out = argv[i + 1];
+    if (std::strcmp(out, "ring") == 0) {
+      target = ScheduleTarget::kRecorder;
+    } else if (std::strncmp(out, "file:", 5) == 0) {
+      target = ScheduleTarget::kFile;
+      file = out + 5;
+    } else if (std::strcmp(out, "tel") != 0) {
+      ScheduleOut("schedule: output must be tel, ring or file:<name>\r\n");
+      return -1;
+    }
+    i += 2;
+  }
+  if (i + 1 >= argc) {
+    ScheduleOut("Usage: schedule add [-o tel|ring|file:<name>] <period|\"cron\"> <command...>\r\n");
+    return -1;
+  }
+  const char* spec = argv[i++];
+  // Rejoin the command, re-quoting arguments with blanks
+  char line[CommandRegistry::kMaxLineLen];
+  uint32_t len = 0;
+  for (; i < argc; ++i) {
+    const bool quote = (std::strpbrk(argv[i], " \t") != nullptr);
+    int n = std::snprintf(line + len, sizeof(line) - len, "%s%s%s%s", (len > 0) ? " " : "", quote ? "\"" : "", argv[i],
+                          quote ? "\"" : "");
+    if (n < 0 || len + static_cast<uint32_t>(n) >= sizeof(line)) {
+      ScheduleOut("schedule: command too long\r\n");
+      return -1;
+    }
+    len += static_cast<uint32_t>(n);
+  }
+  const int32_t id = sched.Add(spec, line, target, file, roles);
+  switch (id) {
+    case CommandScheduler::kErrSpec:
+      ScheduleOut("schedule: bad period or cron expression: %s\r\n", spec);
+      return -1;
+    case CommandScheduler::kErrCommand:
+      ScheduleOut("schedule: unknown command: %s\r\n", line);
+      return -1;
+    case CommandScheduler::kErrOutput:
+      ScheduleOut("schedule: output not available\r\n");
+      return -1;
+    case CommandScheduler::kErrFull:
+      ScheduleOut("schedule: job table full\r\n");
+      return -1;
+    default:
+      ScheduleOut("Scheduled job %d.\r\n", id);
+      return 0;
+  }
+}
+
+inline int ScheduleCmd(int argc, char* argv[], void* ctx) {
+  auto& sched = *static_cast<CommandScheduler*>(ctx);
+  ExecContext* ec = CurrentExec();
+  if (argc >= 2 && std::strcmp(argv[1], "add") == 0) {
+    return ScheduleAdd(sched, argc, argv, (ec != nullptr) ? ec->roles : kRoleAll);
+  }
+  if (argc == 2 && std::strcmp(argv[1], "list") == 0) {
+    char buf[CommandScheduler::kMaxJobs * 160];
+    uint32_t n = sched.Format(buf, sizeof(buf));
+    if (n == 0) {
+      ScheduleOut("No scheduled jobs.\r\n");
+    } else if (ec != nullptr && ec->output_fn != nullptr) {
+      ec->output_fn(buf, n, ec->output_ctx);
+    }
+    return 0;
+  }
+  if (argc == 3 && std::strcmp(argv[1], "del") == 0) {
+    if (!sched.Remove(static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)))) {
+      ScheduleOut("schedule: no job %s\r\n", argv[2]);
+      return -1;
+    }
+    return 0;
+  }
+  ScheduleOut("Usage: schedule add|list|del\r\n");
+  return -1;
+}
+
+}  // namespace detail
+
+/// Register "schedule add|list|del" for @p sched (built on @p registry).
+/// Jobs run with the roles of the session that added them.
+inline bool RegisterScheduleCommands(CommandRegistry& registry, CommandScheduler& sched) {
+  return registry.Register("schedule", "Run commands periodically: schedule add|list|del", detail::ScheduleCmd,
+                           &sched);
+}
+
+}  // namespace telsh
@@ -0,0 +1,83 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::ScratchArena -- bump-pointer allocator for per-command scratch data.
+//
+// Design:
+//   - Carves allocations from a caller-owned block (per-session buffer)
+//   - O(1) Alloc, O(1) release of everything after a Mark()
+//   - No per-allocation free, no heap; exhaustion returns nullptr
+//   - Not thread-safe: owned by the thread executing the command
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace telsh {
+
+class ScratchArena {
+ public:
+  static constexpr uint32_t kDefaultAlign = alignof(std::max_align_t);
+
+  ScratchArena() = default;
+  ScratchArena(void* buf, uint32_t size) { Init(buf, size); }
+
+  ScratchArena(const ScratchArena&) = delete;
+  ScratchArena& operator=(const ScratchArena&) = delete;
+
+  void Init(void* buf, uint32_t size) {
+    base_ = static_cast<uint8_t*>(buf);
+    capacity_ = (buf != nullptr) ? size : 0;
+    used_ = 0;
+    high_water_ = 0;
+  }
+
+  /// Allocate @p size bytes aligned to @p align (power of two).
+  /// @return nullptr when the arena is exhausted.
+  void* Alloc(uint32_t size, uint32_t align = kDefaultAlign) {
+    if (base_ == nullptr || align == 0 || (align & (align - 1)) != 0) {
+      return nullptr;
+    }
+    uintptr_t cur = reinterpret_cast<uintptr_t>(base_) + used_;
+    uintptr_t aligned = (cur + (align - 1)) & ~static_cast<uintptr_t>(align - 1);
+    uint32_t offset = static_cast<uint32_t>(aligned - reinterpret_cast<uintptr_t>(base_));
+    if (offset > capacity_ || size > capacity_ - offset) {
+      return nullptr;
+    }
+    used_ = offset + size;
+    if (used_ > high_water_) {
+      high_water_ = used_;
+    }
+    return base_ + offset;
+  }
+
+  /// Typed array allocation (uninitialized storage for trivial types).
+  template <typename T>
+  T* AllocArray(uint32_t count) {
+    if (count > capacity_ / static_cast<uint32_t>(sizeof(T))) {
+      return nullptr;
+    }
+    return static_cast<T*>(Alloc(count * static_cast<uint32_t>(sizeof(T)), alignof(T)));
+  }
+
+  /// Current position; pass to Release() to free everything allocated since.
+  uint32_t Mark() const { return used_; }
+  void Release(uint32_t mark) {
+    if (mark <= used_) {
+      used_ = mark;
+    }
+  }
+  void Reset() { used_ = 0; }
+
+  uint32_t Used() const { return used_; }
+  uint32_t Capacity() const { return capacity_; }
+  uint32_t HighWater() const { return high_water_; }
+
+ private:
+  uint8_t* base_ = nullptr;
+  uint32_t capacity_ = 0;
+  uint32_t used_ = 0;
+  uint32_t high_water_ = 0;
+};
+
+}  // namespace telsh
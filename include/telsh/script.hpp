@@ -0,0 +1,862 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::ScriptEngine -- compiled command scripts ("source <file>").
+//
+// Design:
+//   - Line-oriented language on top of the registry: one command per line,
+//     "# comment", "set NAME value", "echo text", "repeat N [VAR] ... end",
+//     "if ok|fail|rc OP N ... [else ...] end" (OP: == != < >), "exit [rc]";
+//     $NAME / ${NAME} expand variables, $? the last return code, $1..$9
+//     the arguments of "source"
+//   - Compiled once into fixed-size bytecode: command names are resolved to
+//     CmdEntry pointers at compile time and lines without '$' are stored
+//     pre-split, so a run does no lookup and no parsing
+//   - Compile cache (TELSH_SCRIPT_CACHE_SLOTS) keyed by path, inode, size
+//     and mtime: an unchanged script costs one stat() per run
+//   - Runs use the caller's ExecContext (output, roles, session); commands
+//     are dispatched with the usual group and role checks
+//   - Zero heap allocation: bytecode, pool and variables are fixed arrays
+
+#pragma once
+
+#include "telsh/command_registry.hpp"
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef TELSH_SCRIPT_MAX_INSNS
+#define TELSH_SCRIPT_MAX_INSNS 1024
+#endif
+
+#ifndef TELSH_SCRIPT_POOL_SIZE
+#define TELSH_SCRIPT_POOL_SIZE (16U * 1024U)
+#endif
+
+#ifndef TELSH_SCRIPT_CACHE_SLOTS
+#define TELSH_SCRIPT_CACHE_SLOTS 2
+#endif
+
+namespace telsh {
+
+// ---------------------------------------------------------------------------
+// Bytecode
+// ---------------------------------------------------------------------------
+
+enum class ScriptOp : uint8_t {
+  kRun,     ///< Dispatch entry: pre-split args (argc > 0) or a template to expand and split
+  kExec,    ///< Expand template and hand it to CommandRegistry::Execute (help, $cmd)
+  kSet,     ///< text = "NAME\0template"
+  kEcho,    ///< Expand template, output it with CRLF
+  kJump,    ///< pc = target
+  kBranch,  ///< Unless cond(last rc, value) holds: pc = target
+  kLoop,    ///< Loop slot value := expanded count, VAR := 0; count <= 0: pc = target
+  kNext,    ///< ++index < count: VAR := index, pc = target
+  kExit,    ///< Stop with the expanded template (or the last rc)
+};
+
+enum class ScriptCond : uint8_t { kOk, kFail, kEq, kNe, kLt, kGt };
+
+struct ScriptInsn {
+  const CmdEntry* entry;  ///< kRun: resolved at compile time
+  uint32_t text;          ///< Pool offset of the operand
+  uint32_t aux;           ///< kLoop/kNext: pool offset of VAR, kNoText if none
+  int32_t target;         ///< Jump target
+  int32_t value;          ///< kBranch: compared value; kLoop/kNext: loop slot
+  uint16_t len;           ///< Operand bytes (pre-split args include their NULs)
+  uint16_t line;          ///< Source line, for messages
+  ScriptOp op;
+  ScriptCond cond;
+  uint8_t argc;  ///< kRun: pre-split argument count, 0 = expand at run time
+};
+
+// ---------------------------------------------------------------------------
+// ScriptEngine
+// ---------------------------------------------------------------------------
+
+class ScriptEngine {
+ public:
+  static constexpr uint32_t kMaxInsns = TELSH_SCRIPT_MAX_INSNS;
+  static constexpr uint32_t kPoolSize = TELSH_SCRIPT_POOL_SIZE;
+  static constexpr uint32_t kCacheSlots = TELSH_SCRIPT_CACHE_SLOTS;
+  static constexpr uint32_t kMaxLine = 256;
+  static constexpr uint32_t kMaxPathLen = 128;
+  static constexpr uint32_t kMaxBlocks = 8;  ///< Nesting of if/repeat
+  static constexpr uint32_t kMaxVars = 16;
+  static constexpr uint32_t kVarNameLen = 16;
+  static constexpr uint32_t kVarValueLen = 64;
+  static constexpr uint32_t kMaxNesting = 4;  ///< source inside source
+  static constexpr uint32_t kNoText = 0xFFFFFFFFU;
+
+  explicit ScriptEngine(CommandRegistry& registry) : registry_(registry) {}
+
+  ScriptEngine(const ScriptEngine&) = delete;
+  ScriptEngine& operator=(const ScriptEngine&) = delete;
+
+  /// Run the script file @p path with the caller's context.  It is compiled
+  /// on first use and again only when the file changes.  @p argv become
+  /// $1..$9.  @return the last command's return code or the exit code;
+  /// -2 if the file cannot be read or compiled (reason sent to @p ec).
+  int Source(const char* path, ExecContext& ec, int argc = 0, char* argv[] = nullptr) {
+    if (path == nullptr || std::strlen(path) >= kMaxPathLen) {
+      Say(ec, "source: bad path\r\n");
+      return -2;
+    }
+    struct stat st;
+    if (::stat(path, &st) != 0) {
+      Say(ec, "source: %s: %s\r\n", path, strerror(errno));
+      return -2;
+    }
+    NestingGuard nest;
+    if (nest.depth > kMaxNesting) {
+      Say(ec, "source: nested too deep\r\n");
+      return -2;
+    }
+
+    bool hit = false;
+    Slot* slot = Acquire(path, st, &hit);
+    if (slot == nullptr) {
+      Say(ec, "source: script cache busy\r\n");
+      return -2;
+    }
+    if (!hit) {
+      int32_t fd = ::open(path, O_RDONLY | O_CLOEXEC);
+      LineReader reader(fd, nullptr, 0);
+      const bool ok = (fd >= 0) && Compile(reader, slot->script, ec, path);
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      Publish(slot, ok ? path : nullptr, st);
+      if (!ok) {
+        Release(slot);
+        return -2;
+      }
+    }
+
+    Vars vars;
+    for (int i = 0; i < argc && i < 9; ++i) {
+      const char name[2] = {static_cast<char>('1' + i), '\0'};
+      vars.Set(name, argv[i], static_cast<uint32_t>(std::strlen(argv[i])));
+    }
+    int rc = Execute(slot->script, ec, vars);
+    Release(slot);
+    return rc;
+  }
+
+  /// Compile and run script text directly (not cached).
+  int Run(const char* text, ExecContext& ec) {
+    if (text == nullptr) {
+      return -2;
+    }
+    NestingGuard nest;
+    struct stat none = {};
+    bool hit = false;
+    Slot* slot = (nest.depth > kMaxNesting) ? nullptr : Acquire(nullptr, none, &hit);
+    if (slot == nullptr) {
+      Say(ec, "script: engine busy\r\n");
+      return -2;
+    }
+    LineReader reader(-1, text, static_cast<uint32_t>(std::strlen(text)));
+    const bool ok = Compile(reader, slot->script, ec, "script");
+    Publish(slot, nullptr, none);
+    int rc = -2;
+    if (ok) {
+      Vars vars;
+      rc = Execute(slot->script, ec, vars);
+    }
+    Release(slot);
+    return rc;
+  }
+
+  /// Statistics: scripts compiled / runs served from the cache.
+  uint32_t Compiles() const { return compiles_; }
+  uint32_t CacheHits() const { return cache_hits_; }
+
+ private:
+  // -----------------------------------------------------------------------
+  // Compiled script and cache
+  // -----------------------------------------------------------------------
+  struct CompiledScript {
+    ScriptInsn insns[kMaxInsns];
+    char pool[kPoolSize];
+    uint32_t insn_count;
+    uint32_t pool_used;
+  };
+
+  struct Slot {
+    CompiledScript script;
+    char path[kMaxPathLen];
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+    uint64_t last_use;
+    uint32_t users;  ///< Runs in progress; the slot is not evicted meanwhile
+    bool valid;
+  };
+
+  static int64_t MtimeNs(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+  }
+
+  /// Find the cached compile of @p path (@p hit = true) or claim the least
+  /// recently used idle slot for a new compile.  nullptr if all are busy.
+  Slot* Acquire(const char* path, const struct stat& st, bool* hit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++use_clock_;
+    Slot* victim = nullptr;
+    for (Slot& s : slots_) {
+      if (path != nullptr && s.valid && std::strcmp(s.path, path) == 0 && s.ino == st.st_ino &&
+          s.size == st.st_size && s.mtime_ns == MtimeNs(st)) {
+        ++s.users;
+        s.last_use = use_clock_;
+        ++cache_hits_;
+        *hit = true;
+        return &s;
+      }
+      if (s.users == 0 && (victim == nullptr || !s.valid || (victim->valid && s.last_use < victim->last_use))) {
+        victim = &s;
+      }
+    }
+    if (victim != nullptr) {
+      victim->valid = false;
+      victim->users = 1;
+      victim->last_use = use_clock_;
+    }
+    *hit = false;
+    return victim;
+  }
+
+  /// Record the key of a fresh compile (@p path nullptr: not cacheable).
+  void Publish(Slot* slot, const char* path, const struct stat& st) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++compiles_;
+    slot->valid = (path != nullptr);
+    if (slot->valid) {
+      std::strncpy(slot->path, path, kMaxPathLen - 1);
+      slot->path[kMaxPathLen - 1] = '\0';
+      slot->ino = st.st_ino;
+      slot->size = st.st_size;
+      slot->mtime_ns = MtimeNs(st);
+    }
+  }
+
+  void Release(Slot* slot) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --slot->users;
+  }
+
+  /// Per-thread source nesting depth.
+  struct NestingGuard {
+    uint32_t depth;
+    NestingGuard() : depth(++Depth()) {}
+    ~NestingGuard() { --Depth(); }
+    static uint32_t& Depth() {
+      static thread_local uint32_t depth = 0;
+      return depth;
+    }
+  };
+
+  // -----------------------------------------------------------------------
+  // Source lines (file read in chunks, or a string)
+  // -----------------------------------------------------------------------
+  class LineReader {
+   public:
+    LineReader(int32_t fd, const char* text, uint32_t len) : fd_(fd), text_(text), text_len_(len) {}
+
+    /// Next line without its newline.  @return false at end of input;
+    /// @p too_long is set for lines that do not fit @p cap - 1 bytes.
+    bool Next(char* out, uint32_t cap, bool* too_long) {
+      uint32_t n = 0;
+      *too_long = false;
+      bool any = false;
+      int c;
+      while ((c = Get()) >= 0) {
+        any = true;
+        if (c == '\n') {
+          break;
+        }
+        if (n + 1 < cap) {
+          out[n++] = static_cast<char>(c);
+        } else {
+          *too_long = true;
+        }
+      }
+      out[n] = '\0';
+      return any;
+    }
+
+   private:
+    int Get() {
+      if (text_ != nullptr) {
+        return (pos_ < text_len_) ? static_cast<unsigned char>(text_[pos_++]) : -1;
+      }
+      if (pos_ == len_) {
+        ssize_t n = (fd_ >= 0) ? ::read(fd_, buf_, sizeof(buf_)) : -1;
+        if (n <= 0) {
+          return -1;
+        }
+        len_ = static_cast<uint32_t>(n);
+        pos_ = 0;
+      }
+      return static_cast<unsigned char>(buf_[pos_++]);
+    }
+
+    int32_t fd_;
+    const char* text_;
+    uint32_t text_len_;
+    char buf_[512];
+    uint32_t pos_ = 0;
+    uint32_t len_ = 0;
+  };
+
+  // -----------------------------------------------------------------------
+  // Compiler
+  // -----------------------------------------------------------------------
+  enum class BlockKind : uint8_t { kIf, kElse, kRepeat };
+
+  struct Block {
+    BlockKind kind;
+    uint32_t pc;  ///< kIf: the branch, kElse: the jump over the else part, kRepeat: the loop
+  };
+
+  struct Compiler {
+    CompiledScript& s;
+    ExecContext& ec;
+    const char* name;
+    uint32_t line;
+    Block blocks[kMaxBlocks];
+    uint32_t depth;
+    uint32_t loops;  ///< Open repeat blocks (= next loop slot)
+  };
+
+  bool Compile(LineReader& reader, CompiledScript& s, ExecContext& ec, const char* name) {
+    s.insn_count = 0;
+    s.pool_used = 0;
+    Compiler c{s, ec, name, 0, {}, 0, 0};
+    char raw[kMaxLine];
+    bool too_long = false;
+    while (reader.Next(raw, sizeof(raw), &too_long)) {
+      ++c.line;
+      if (too_long) {
+        return Fail(c, "line too long");
+      }
+      char* text = Trim(raw);
+      if (*text == '\0' || *text == '#') {
+        continue;
+      }
+      if (!CompileLine(c, text)) {
+        return false;
+      }
+    }
+    if (c.depth > 0) {
+      return Fail(c, "missing 'end'");
+    }
+    return true;
+  }
+
+  bool CompileLine(Compiler& c, char* text) {
+    char* rest = text;
+    while (*rest != '\0' && *rest != ' ' && *rest != '\t') {
+      ++rest;
+    }
+    const uint32_t word_len = static_cast<uint32_t>(rest - text);
+    rest = Trim(rest);
+    auto is = [&](const char* kw) { return std::strlen(kw) == word_len && std::strncmp(text, kw, word_len) == 0; };
+
+    if (is("set")) {
+      char* value = rest;
+      while (*value != '\0' && *value != ' ' && *value != '\t') {
+        ++value;
+      }
+      const uint32_t name_len = static_cast<uint32_t>(value - rest);
+      if (!ValidName(rest, name_len)) {
+        return Fail(c, "set: bad variable name");
+      }
+      value = Trim(value);
+      ScriptInsn* in = Emit(c, ScriptOp::kSet);
+      uint32_t off = 0;
+      if (in == nullptr || !Store(c, rest, name_len, true, &off) || !Store(c, value, Len(value), false, nullptr)) {
+        return Fail(c, "script too large");
+      }
+      in->text = off;
+      in->len = static_cast<uint16_t>(c.s.pool_used - off);
+      return true;
+    }
+    if (is("echo") || is("exit")) {
+      ScriptInsn* in = Emit(c, is("echo") ? ScriptOp::kEcho : ScriptOp::kExit);
+      return in != nullptr && StoreOperand(c, in, rest);
+    }
+    if (is("repeat")) {
+      char* var = rest;
+      while (*var != '\0' && *var != ' ' && *var != '\t') {
+        ++var;
+      }
+      const uint32_t count_len = static_cast<uint32_t>(var - rest);
+      var = Trim(var);
+      if (count_len == 0 || (*var != '\0' && !ValidName(var, Len(var)))) {
+        return Fail(c, "usage: repeat <count> [var]");
+      }
+      if (c.depth >= kMaxBlocks) {
+        return Fail(c, "blocks nested too deep");
+      }
+      ScriptInsn* in = Emit(c, ScriptOp::kLoop);
+      uint32_t off = 0;
+      if (in == nullptr || !Store(c, rest, count_len, true, &off)) {
+        return Fail(c, "script too large");
+      }
+      in->text = off;
+      in->len = static_cast<uint16_t>(count_len);
+      in->value = static_cast<int32_t>(c.loops++);
+      if (*var != '\0' && !Store(c, var, Len(var), true, &in->aux)) {
+        return Fail(c, "script too large");
+      }
+      c.blocks[c.depth++] = {BlockKind::kRepeat, c.s.insn_count - 1};
+      return true;
+    }
+    if (is("if")) {
+      if (c.depth >= kMaxBlocks) {
+        return Fail(c, "blocks nested too deep");
+      }
+      ScriptInsn* in = Emit(c, ScriptOp::kBranch);
+      if (in == nullptr || !ParseCond(rest, in)) {
+        return Fail(c, "usage: if ok | if fail | if rc <==|!=|<|>> <n>");
+      }
+      c.blocks[c.depth++] = {BlockKind::kIf, c.s.insn_count - 1};
+      return true;
+    }
+    if (is("else")) {
+      if (c.depth == 0 || c.blocks[c.depth - 1].kind != BlockKind::kIf) {
+        return Fail(c, "'else' without 'if'");
+      }
+      ScriptInsn* jump = Emit(c, ScriptOp::kJump);
+      if (jump == nullptr) {
+        return Fail(c, "script too large");
+      }
+      Block& b = c.blocks[c.depth - 1];
+      c.s.insns[b.pc].target = static_cast<int32_t>(c.s.insn_count);
+      b = {BlockKind::kElse, c.s.insn_count - 1};
+      return true;
+    }
+    if (is("end")) {
+      if (c.depth == 0) {
+        return Fail(c, "'end' without block");
+      }
+      const Block b = c.blocks[--c.depth];
+      if (b.kind == BlockKind::kRepeat) {
+        const ScriptInsn loop = c.s.insns[b.pc];
+        ScriptInsn* next = Emit(c, ScriptOp::kNext);
+        if (next == nullptr) {
+          return Fail(c, "script too large");
+        }
+        next->target = static_cast<int32_t>(b.pc + 1);
+        next->value = loop.value;
+        next->aux = loop.aux;
+        --c.loops;
+      }
+      c.s.insns[b.pc].target = static_cast<int32_t>(c.s.insn_count);
+      return true;
+    }
+    return CompileCommand(c, text, word_len);
+  }
+
+  /// A command line: resolve the name now, pre-split if nothing expands.
+  bool CompileCommand(Compiler& c, char* text, uint32_t word_len) {
+    char name[kMaxLine];
+    std::memcpy(name, text, word_len);
+    name[word_len] = '\0';
+    const CmdEntry* entry = (std::strchr(name, '$') == nullptr) ? registry_.Resolve(name) : nullptr;
+    if (entry == nullptr && std::strchr(name, '$') == nullptr && std::strcmp(name, "help") != 0) {
+      return Fail(c, "unknown command");
+    }
+    ScriptInsn* in = Emit(c, (entry != nullptr) ? ScriptOp::kRun : ScriptOp::kExec);
+    if (in == nullptr) {
+      return Fail(c, "script too large");
+    }
+    in->entry = entry;
+    if (entry == nullptr || std::strchr(text, '$') != nullptr) {
+      return StoreOperand(c, in, text);  // expanded (and split) per run
+    }
+    char split[kMaxLine];
+    std::strcpy(split, text);
+    char* argv[CommandRegistry::kMaxArgs];
+    const int argc = ShellSplit(split, argv, CommandRegistry::kMaxArgs);
+    if (argc <= 0 || argc > 255) {
+      return Fail(c, "bad arguments");
+    }
+    in->argc = static_cast<uint8_t>(argc);
+    in->text = c.s.pool_used;
+    for (int i = 0; i < argc; ++i) {
+      if (!Store(c, argv[i], Len(argv[i]), true, nullptr)) {
+        return Fail(c, "script too large");
+      }
+    }
+    in->len = static_cast<uint16_t>(c.s.pool_used - in->text);
+    return true;
+  }
+
+  static bool ParseCond(const char* rest, ScriptInsn* in) {
+    if (std::strcmp(rest, "ok") == 0 || std::strcmp(rest, "fail") == 0) {
+      in->cond = (rest[0] == 'o') ? ScriptCond::kOk : ScriptCond::kFail;
+      return true;
+    }
+    char op[3] = {};
+    char* end = nullptr;
+    if (std::sscanf(rest, "rc %2[=!<>]", op) != 1) {
+      return false;
+    }
+    const char* num = std::strstr(rest, op) + std::strlen(op);
+    long v = std::strtol(num, &end, 0);
+    if (end == num || *Trim(end) != '\0') {
+      return false;
+    }
+    in->value = static_cast<int32_t>(v);
+    if (std::strcmp(op, "==") == 0) {
+      in->cond = ScriptCond::kEq;
+    } else if (std::strcmp(op, "!=") == 0) {
+      in->cond = ScriptCond::kNe;
+    } else if (std::strcmp(op, "<") == 0) {
+      in->cond = ScriptCond::kLt;
+    } else if (std::strcmp(op, ">") == 0) {
+      in->cond = ScriptCond::kGt;
+    } else {
+      return false;
+    }
+    return true;
+  }
+
+  ScriptInsn* Emit(Compiler& c, ScriptOp op) {
+    if (c.s.insn_count >= kMaxInsns) {
+      return nullptr;
+    }
+    ScriptInsn& in = c.s.insns[c.s.insn_count++];
+    in = {};
+    in.op = op;
+    in.aux = kNoText;
+    in.line = static_cast<uint16_t>(c.line);
+    return &in;
+  }
+
+  /// Append @p len bytes (plus a NUL if @p nul) to the pool.
+  static bool Store(Compiler& c, const char* src, uint32_t len, bool nul, uint32_t* off) {
+    const uint32_t need = len + (nul ? 1U : 0U);
+    if (need > kPoolSize - c.s.pool_used) {
+      return false;
+    }
+    if (off != nullptr) {
+      *off = c.s.pool_used;
+    }
+    std::memcpy(c.s.pool + c.s.pool_used, src, len);
+    if (nul) {
+      c.s.pool[c.s.pool_used + len] = '\0';
+    }
+    c.s.pool_used += need;
+    return true;
+  }
+
+  bool StoreOperand(Compiler& c, ScriptInsn* in, const char* text) {
+    const uint32_t len = Len(text);
+    if (!Store(c, text, len, true, &in->text)) {
+      return Fail(c, "script too large");
+    }
+    in->len = static_cast<uint16_t>(len);
+    return true;
+  }
+
+  bool Fail(const Compiler& c, const char* why) {
+    Say(c.ec, "%s:%u: %s\r\n", c.name, c.line, why);
+    return false;
+  }
+
+  static bool ValidName(const char* s, uint32_t len) {
+    if (len == 0 || len >= kVarNameLen || !(IsAlpha(s[0]) || s[0] == '_')) {
+      return false;
+    }
+    for (uint32_t i = 1; i < len; ++i) {
+      if (!IsNameChar(s[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static bool IsAlpha(char ch) { return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z'); }
+  static bool IsNameChar(char ch) { return IsAlpha(ch) || (ch >= '0' && ch <= '9') || ch == '_'; }
+  static uint32_t Len(const char* s) { return static_cast<uint32_t>(std::strlen(s)); }
+
+  static char* Trim(char* s) {
+    while (*s == ' ' || *s == '\t') {
+      ++s;
+    }
+    char* end = s + std::strlen(s);
+    while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+      *--end = '\0';
+    }
+    return s;
+  }
+
+  // -----------------------------------------------------------------------
+  // Interpreter
+  // -----------------------------------------------------------------------
+  struct Vars {
+    char names[kMaxVars][kVarNameLen] = {};
+    char values[kMaxVars][kVarValueLen] = {};
+    uint32_t count = 0;
+
+    const char* Get(const char* name, uint32_t len) const {
+      for (uint32_t i = 0; i < count; ++i) {
+        if (std::strncmp(names[i], name, len) == 0 && names[i][len] == '\0') {
+          return values[i];
+        }
+      }
+      return nullptr;
+    }
+
+    bool Set(const char* name, const char* value, uint32_t len) {
+      uint32_t i = 0;
+      while (i < count && std::strcmp(names[i], name) != 0) {
+        ++i;
+      }
+      if (i == count) {
+        if (count >= kMaxVars) {
+          return false;
+        }
+        std::strncpy(names[i], name, kVarNameLen - 1);
+        ++count;
+      }
+      len = (len < kVarValueLen - 1) ? len : kVarValueLen - 1;
+      std::memcpy(values[i], value, len);
+      values[i][len] = '\0';
+      return true;
+    }
+  };
+
+  int Execute(const CompiledScript& s, ExecContext& ec, Vars& vars) {
+    int32_t loop_count[kMaxBlocks] = {};
+    int32_t loop_index[kMaxBlocks] = {};
+    char line[kMaxLine];
+    char* argv[CommandRegistry::kMaxArgs];
+    int rc = 0;
+    uint32_t pc = 0;
+    while (pc < s.insn_count) {
+      const ScriptInsn& in = s.insns[pc++];
+      switch (in.op) {
+        case ScriptOp::kRun: {
+          int argc = in.argc;
+          if (argc > 0) {
+            std::memcpy(line, s.pool + in.text, in.len);
+            char* p = line;
+            for (int i = 0; i < argc; ++i) {
+              argv[i] = p;
+              p += std::strlen(p) + 1;
+            }
+          } else {
+            if (!Expand(s, in, vars, rc, line, ec)) {
+              return -2;
+            }
+            argc = ShellSplit(line, argv, CommandRegistry::kMaxArgs);
+            if (argc <= 0) {
+              rc = -2;
+              break;
+            }
+          }
+          rc = registry_.Dispatch(*in.entry, argc, argv, ec);
+          break;
+        }
+        case ScriptOp::kExec:
+          if (!Expand(s, in, vars, rc, line, ec)) {
+            return -2;
+          }
+          rc = registry_.Execute(line, ec);
+          break;
+        case ScriptOp::kSet: {
+          const char* name = s.pool + in.text;
+          ScriptInsn value = in;
+          value.text = in.text + Len(name) + 1;
+          value.len = static_cast<uint16_t>(in.len - Len(name) - 1);
+          if (!Expand(s, value, vars, rc, line, ec)) {
+            return -2;
+          }
+          if (!vars.Set(name, line, Len(line))) {
+            Say(ec, "script:%u: too many variables\r\n", in.line);
+            return -2;
+          }
+          break;
+        }
+        case ScriptOp::kEcho:
+          if (!Expand(s, in, vars, rc, line, ec)) {
+            return -2;
+          }
+          Say(ec, "%s\r\n", line);
+          break;
+        case ScriptOp::kJump:
+          pc = static_cast<uint32_t>(in.target);
+          break;
+        case ScriptOp::kBranch:
+          if (!Holds(in.cond, rc, in.value)) {
+            pc = static_cast<uint32_t>(in.target);
+          }
+          break;
+        case ScriptOp::kLoop:
+          if (!Expand(s, in, vars, rc, line, ec)) {
+            return -2;
+          }
+          loop_count[in.value] = static_cast<int32_t>(std::strtol(line, nullptr, 0));
+          loop_index[in.value] = 0;
+          if (loop_count[in.value] <= 0) {
+            pc = static_cast<uint32_t>(in.target);
+          } else if (in.aux != kNoText) {
+            vars.Set(s.pool + in.aux, "0", 1);
+          }
+          break;
+        case ScriptOp::kNext:
+          if (++loop_index[in.value] < loop_count[in.value]) {
+            if (in.aux != kNoText) {
+              char num[16];
+              int n = std::snprintf(num, sizeof(num), "%d", loop_index[in.value]);
+              vars.Set(s.pool + in.aux, num, static_cast<uint32_t>(n));
+            }
+            pc = static_cast<uint32_t>(in.target);
+          }
+          break;
+        case ScriptOp::kExit:
+          if (in.len == 0) {
+            return rc;
+          }
+          if (!Expand(s, in, vars, rc, line, ec)) {
+            return -2;
+          }
+          return static_cast<int>(std::strtol(line, nullptr, 0));
+      }
+    }
+    return rc;
+  }
+
+  static bool Holds(ScriptCond cond, int rc, int32_t value) {
+    switch (cond) {
+      case ScriptCond::kOk:
+        return rc == 0;
+      case ScriptCond::kFail:
+        return rc != 0;
+      case ScriptCond::kEq:
+        return rc == value;
+      case ScriptCond::kNe:
+        return rc != value;
+      case ScriptCond::kLt:
+        return rc < value;
+      case ScriptCond::kGt:
+        return rc > value;
+    }
+    return false;
+  }
+
+  /// Expand $NAME, ${NAME}, $? and $$ of @p in's operand into @p out
+  /// (kMaxLine bytes).  @return false (reported) on overflow.
+  static bool Expand(const CompiledScript& s, const ScriptInsn& in, const Vars& vars, int rc, char* out,
+                     ExecContext& ec) {
+    const char* p = s.pool + in.text;
+    const char* end = p + in.len;
+    uint32_t n = 0;
+    auto put = [&](const char* src, uint32_t len) {
+      if (len >= kMaxLine - n) {
+        return false;
+      }
+      std::memcpy(out + n, src, len);
+      n += len;
+      return true;
+    };
+    bool ok = true;
+    while (p < end && ok) {
+      if (*p != '$' || p + 1 >= end) {
+        ok = put(p++, 1);
+        continue;
+      }
+      ++p;
+      if (*p == '?') {
+        char num[16];
+        int len = std::snprintf(num, sizeof(num), "%d", rc);
+        ok = put(num, static_cast<uint32_t>(len));
+        ++p;
+        continue;
+      }
+      if (*p == '$') {
+        ok = put(p++, 1);
+        continue;
+      }
+      const bool braced = (*p == '{');
+      const char* name = braced ? p + 1 : p;
+      const char* q = name;
+      while (q < end && IsNameChar(*q)) {
+        ++q;
+      }
+      if (q == name || (braced && (q >= end || *q != '}'))) {
+        ok = put("$", 1);  // not a reference, keep literally
+        continue;
+      }
+      const char* value = vars.Get(name, static_cast<uint32_t>(q - name));
+      ok = (value == nullptr) || put(value, Len(value));
+      p = braced ? q + 1 : q;
+    }
+    out[n] = '\0';
+    if (!ok) {
+      Say(ec, "script:%u: expanded line too long\r\n", in.line);
+    }
+    return ok;
+  }
+
+  static void Say(ExecContext& ec, const char* fmt, ...) {
+    if (ec.output_fn == nullptr) {
+      return;
+    }
+    char buf[kMaxLine + 32];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+      ec.output_fn(buf, (static_cast<uint32_t>(n) < sizeof(buf)) ? static_cast<uint32_t>(n) : sizeof(buf) - 1,
+                   ec.output_ctx);
+    }
+  }
+
+  CommandRegistry& registry_;
+  Slot slots_[kCacheSlots] = {};
+  std::mutex mutex_;
+  uint64_t use_clock_ = 0;
+  uint32_t compiles_ = 0;
+  uint32_t cache_hits_ = 0;
+};
+
+// ---------------------------------------------------------------------------
+// source command
+// ---------------------------------------------------------------------------
+
+namespace detail {
+
+inline int SourceCmd(int argc, char* argv[], void* ctx) {
+  ExecContext* ec = CurrentExec();
+  if (argc < 2) {
+    if (ec->output_fn != nullptr) {
+      ec->output_fn("Usage: source <file> [args...]\r\n", 32, ec->output_ctx);
+    }
+    return -1;
+  }
+  return static_cast<ScriptEngine*>(ctx)->Source(argv[1], *ec, argc - 2, argv + 2);
+}
+
+}  // namespace detail
+
+/// Register "source <file> [args...]" running scripts through @p engine
+/// (which must be built on the same @p registry).
+inline bool RegisterScriptCommands(CommandRegistry& registry, ScriptEngine& engine) {
+  return registry.Register("source", "Run a script file: source <file> [args...]", detail::SourceCmd, &engine);
+}
+
+}  // namespace telsh
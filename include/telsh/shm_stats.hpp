@@ -0,0 +1,446 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::ShmStatsPublisher -- shell counters and registered variables
+// mirrored into a POSIX shared-memory region for out-of-process readers
+// (tools/telsh_shmstat).
+//
+// Design:
+//   - One fixed, versioned layout (ShmStatsRegion, documented below and in
+//     the README); a reader checks magic, version and size before use
+//   - Single writer, seqlock protocol: seq is odd while the payload is
+//     rewritten, readers copy the payload and retry on a changed or odd
+//     seq -- readers never block the writer and never take a lock
+//   - Payload: session counts, accept/reject totals, output drop counters
+//     (sinks, signal ring, session post queues), per-command CmdStats and
+//     the current value of every VarRegistry variable
+//   - Refreshed by Update() from the host loop or by a Start(period_ms)
+//     thread; the application's hot paths only bump the relaxed atomics
+//     they already maintain
+//   - Ownership is an flock() on the region's descriptor, held until
+//     Close(): a second publisher cannot take the lock and is refused, and
+//     a region left behind (its owner exited, so the lock went with it) is
+//     reinitialized in place.  Two publishers never write the same region
+//   - Zero heap allocation
+
+#pragma once
+
+#include "osp/log.hpp"
+#include "telsh/command_registry.hpp"
+#include "telsh/output_sinks.hpp"
+#include "telsh/signal_ring.hpp"
+#include "telsh/telnet_server.hpp"
+#include "telsh/telnet_session.hpp"
+#include "telsh/vars.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+
+namespace telsh {
+
+// ---------------------------------------------------------------------------
+// Layout (version 1)
+// ---------------------------------------------------------------------------
+//
+//   offset  size  field
+//   0       4     magic "TLSH"
+//   4       4     version (kShmStatsVersion)
+//   8       4     size of the whole region in bytes
+//   12      4     seq: odd while the payload is being written
+//   16      ...   ShmStats payload (little/host endian, naturally aligned)
+//
+// Readers: load seq (acquire), copy the payload, fence (acquire), reload
+// seq; keep the copy only if both loads are equal and even.
+
+constexpr uint32_t kShmStatsVersion = 1;
+constexpr uint32_t kShmNameLen = 32;
+constexpr uint32_t kShmMaxCmds = 64;
+constexpr uint32_t kShmMaxVars = 32;
+constexpr const char* kShmStatsDefaultName = "/telsh_stats";
+
+struct ShmCmdStat {
+  char name[kShmNameLen];  ///< NUL-terminated, truncated
+  uint64_t calls;
+  uint64_t failures;
+  uint64_t total_us;
+};
+
+struct ShmVarStat {
+  char name[kShmNameLen];
+  double value;
+};
+
+struct ShmStats {
+  uint64_t updates;            ///< Completed Update() calls
+  uint64_t update_ns;          ///< CLOCK_REALTIME of the last update
+  uint32_t pid;                ///< Writer process
+  uint32_t period_ms;          ///< Refresh period, 0 = host driven
+  uint32_t sessions_active;    ///< Connected sessions
+  uint32_t sessions_detached;  ///< Detached sessions waiting for "attach"
+  uint64_t accepted;           ///< Connections accepted
+  uint64_t rejected;           ///< Connections refused (server full)
+  uint64_t sink_dropped;       ///< SinkFanout records dropped
+  uint64_t signal_dropped;     ///< tel_printf_signal_safe messages dropped
+  uint64_t post_dropped;       ///< Session Post() records dropped
+  uint32_t cmd_count;          ///< Valid entries in cmds
+  uint32_t var_count;          ///< Valid entries in vars
+  ShmCmdStat cmds[kShmMaxCmds];
+  ShmVarStat vars[kShmMaxVars];
+};
+
+struct ShmStatsRegion {
+  char magic[4];
+  uint32_t version;
+  uint32_t size;
+  std::atomic<uint32_t> seq;
+  ShmStats stats;
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seq must be lock-free to be shared between processes");
+static_assert(std::is_trivially_copyable<ShmStats>::value, "payload is copied word by word");
+static_assert(offsetof(ShmStatsRegion, seq) == 12, "layout v1: seq at offset 12");
+static_assert(offsetof(ShmStatsRegion, stats) == 16, "layout v1: payload at offset 16");
+static_assert(sizeof(ShmCmdStat) == 56 && sizeof(ShmVarStat) == 40, "layout v1: entry sizes");
+static_assert(offsetof(ShmStats, cmds) == 80, "layout v1: command table at payload offset 80");
+static_assert(sizeof(ShmStats) % 8 == 0, "payload is copied in 64-bit words");
+
+namespace detail {
+
+inline void ShmCopyName(char (&dst)[kShmNameLen], const char* src) {
+  std::strncpy(dst, (src != nullptr) ? src : "", kShmNameLen - 1);
+  dst[kShmNameLen - 1] = '\0';
+}
+
+/// Copy the payload as relaxed 64-bit atomic words, so a copy that
+/// overlaps a write is a retry for the seqlock, not a data race.
+inline void ShmCopyPayload(ShmStats* dst, const ShmStats* src) {
+  auto* d = reinterpret_cast<uint64_t*>(dst);
+  const auto* s = reinterpret_cast<const uint64_t*>(src);
+  for (size_t i = 0; i < sizeof(ShmStats) / 8; ++i) {
+    __atomic_store_n(&d[i], __atomic_load_n(&s[i], __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+  }
+}
+
+}  // namespace detail
+
+// ---------------------------------------------------------------------------
+// ShmStatsReader -- maps an existing region read-only
+// ---------------------------------------------------------------------------
+
+class ShmStatsReader {
+ public:
+  ShmStatsReader() = default;
+  ShmStatsReader(const ShmStatsReader&) = delete;
+  ShmStatsReader& operator=(const ShmStatsReader&) = delete;
+  ~ShmStatsReader() { Close(); }
+
+  /// Map @p name; fails on a missing region or a foreign / newer layout.
+  bool Open(const char* name = kShmStatsDefaultName) {
+    Close();
+    int fd = ::shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    bool ok = ::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(ShmStatsRegion);
+    void* p = ok ? ::mmap(nullptr, sizeof(ShmStatsRegion), PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    region_ = static_cast<const ShmStatsRegion*>(p);
+    if (std::memcmp(region_->magic, "TLSH", 4) != 0 || region_->version != kShmStatsVersion ||
+        region_->size != sizeof(ShmStatsRegion)) {
+      Close();
+      return false;
+    }
+    return true;
+  }
+
+  void Close() {
+    if (region_ != nullptr) {
+      ::munmap(const_cast<ShmStatsRegion*>(region_), sizeof(ShmStatsRegion));
+      region_ = nullptr;
+    }
+  }
+
+  bool IsOpen() const { return region_ != nullptr; }
+
+  /// Consistent copy of the payload.  Never blocks the writer.
+  /// @return false if no stable copy was seen within @p max_retries.
+  bool Snapshot(ShmStats* out, uint32_t max_retries = 1000) const {
+    return (region_ != nullptr) && Read(*region_, out, max_retries);
+  }
+
+  /// Seqlock read of @p region (also used on an in-process region).
+  static bool Read(const ShmStatsRegion& region, ShmStats* out, uint32_t max_retries = 1000) {
+    for (uint32_t i = 0; i <= max_retries; ++i) {
+      const uint32_t before = region.seq.load(std::memory_order_acquire);
+      if ((before & 1U) != 0) {
+        continue;
+      }
+      detail::ShmCopyPayload(out, &region.stats);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (region.seq.load(std::memory_order_relaxed) == before) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+ private:
+  const ShmStatsRegion* region_ = nullptr;
+};
+
+// ---------------------------------------------------------------------------
+// ShmStatsPublisher -- owns and refreshes the region
+// ---------------------------------------------------------------------------
+
+class ShmStatsPublisher {
+ public:
+  /// @p server may be null (session counters stay 0).
+  explicit ShmStatsPublisher(TelnetServer* server = nullptr,
+                             const CommandRegistry& registry = CommandRegistry::Instance(),
+                             const VarRegistry& vars = VarRegistry::Instance())
+      : server_(server), registry_(registry), vars_(vars) {}
+
+  ShmStatsPublisher(const ShmStatsPublisher&) = delete;
+  ShmStatsPublisher& operator=(const ShmStatsPublisher&) = delete;
+
+  ~ShmStatsPublisher() {
+    Stop();
+    Close();
+  }
+
+  /// Create region @p name and publish a first snapshot.  A region whose
+  /// publisher has exited is taken over; one whose publisher is alive (or
+  /// that is not a telsh region) is refused.
+  bool Open(const char* name = kShmStatsDefaultName) {
+    Close();
+    if (name == nullptr || std::strlen(name) >= sizeof(name_)) {
+      OSP_LOG_ERROR("TELSH", "shm stats region name too long (max %u)", static_cast<uint32_t>(sizeof(name_) - 1));
+      return false;
+    }
+    const int fd = LockRegion(name);
+    if (fd < 0) {
+      return false;
+    }
+    // Empty: just created (or abandoned before its size was set)
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && (st.st_size == 0 || static_cast<size_t>(st.st_size) == sizeof(ShmStatsRegion)) &&
+        (st.st_size != 0 || ::ftruncate(fd, sizeof(ShmStatsRegion)) == 0)) {
+      p = ::mmap(nullptr, sizeof(ShmStatsRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    static const char kNoMagic[4] = {};
+    const auto* r = static_cast<const ShmStatsRegion*>(p);
+    if (p == MAP_FAILED || (std::memcmp(r->magic, "TLSH", 4) != 0 && std::memcmp(r->magic, kNoMagic, 4) != 0)) {
+      OSP_LOG_ERROR("TELSH", "shm stats region %s: not a telsh region or not mappable", name);
+      if (p != MAP_FAILED) {
+        ::munmap(p, sizeof(ShmStatsRegion));
+      }
+      ::close(fd);  // leave a foreign object alone
+      return false;
+    }
+    if (st.st_size != 0) {
+      OSP_LOG_WARN("TELSH", "reclaiming stale shm stats region %s", name);
+    }
+    lock_fd_ = fd;
+    region_ = static_cast<ShmStatsRegion*>(p);
+    // (Re)initialize: hide the header first and publish it last so readers
+    // reject the region until it is complete.
+    std::memset(region_->magic, 0, sizeof(region_->magic));
+    std::atomic_thread_fence(std::memory_order_release);
+    region_->seq.store(0, std::memory_order_relaxed);
+    std::memset(&scratch_, 0, sizeof(scratch_));
+    detail::ShmCopyPayload(&region_->stats, &scratch_);
+    region_->version = kShmStatsVersion;
+    region_->size = sizeof(ShmStatsRegion);
+    std::memcpy(name_, name, std::strlen(name) + 1);
+    Update();
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(region_->magic, "TLSH", 4);
+    return true;
+  }
+
+  /// Unmap and unlink the region, then give up ownership.
+  void Close() {
+    if (region_ == nullptr) {
+      return;
+    }
+    ::munmap(region_, sizeof(ShmStatsRegion));
+    ::shm_unlink(name_);  // still locked: nobody can have claimed it meanwhile
+    ::close(lock_fd_);
+    lock_fd_ = -1;
+    region_ = nullptr;
+    name_[0] = '\0';
+  }
+
+  bool IsOpen() const { return region_ != nullptr; }
+
+  /// Mapped region (nullptr before Open), e.g. for ShmStatsReader::Read().
+  const ShmStatsRegion* Region() const { return region_; }
+
+  /// Collect all counters and publish them as one seqlock write.
+  /// Single writer: call from one thread, or let Start() do it.
+  void Update() {
+    if (region_ == nullptr) {
+      return;
+    }
+    Collect(&scratch_);
+    const uint32_t seq = region_->seq.load(std::memory_order_relaxed);
+    region_->seq.store(seq + 1, std::memory_order_relaxed);  // odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    detail::ShmCopyPayload(&region_->stats, &scratch_);
+    region_->seq.store(seq + 2, std::memory_order_release);
+  }
+
+  /// Refresh every @p period_ms on a background thread.
+  bool Start(uint32_t period_ms = 100) {
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    if (running_ || region_ == nullptr || period_ms == 0) {
+      return running_;
+    }
+    period_ms_ = period_ms;
+    running_ = true;
+    thread_ = std::thread([this]() { Loop(); });
+    return true;
+  }
+
+  /// Stop and join the refresh thread.
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(thread_mutex_);
+      if (!running_) {
+        return;
+      }
+      running_ = false;
+    }
+    thread_cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    period_ms_ = 0;
+  }
+
+ private:
+  /// Open (or create) region @p name and take its exclusive flock.  The
+  /// lock dies with its holder, so it alone tells a live publisher from
+  /// one that has exited -- also while a new one is still setting up.
+  /// @return the locked descriptor, or -1 if another publisher holds it.
+  static int LockRegion(const char* name) {
+    for (int attempt = 0; attempt < 8; ++attempt) {
+      const int fd = ::shm_open(name, O_RDWR | O_CREAT, 0644);
+      if (fd < 0) {
+        OSP_LOG_ERROR("TELSH", "shm_open(%s) failed: %s", name, std::strerror(errno));
+        return -1;
+      }
+      if (::flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        const int err = errno;
+        ::close(fd);
+        if (err == EINTR) {
+          continue;
+        }
+        OSP_LOG_ERROR("TELSH", "shm stats region %s is in use: %s", name, std::strerror(err));
+        return -1;
+      }
+      // The previous owner may have unlinked the object between our open
+      // and lock; only the object still under @p name counts.
+      struct stat locked;
+      struct stat current;
+      const int check = ::shm_open(name, O_RDONLY, 0);
+      const bool same = check >= 0 && ::fstat(fd, &locked) == 0 && ::fstat(check, &current) == 0 &&
+                        locked.st_dev == current.st_dev && locked.st_ino == current.st_ino;
+      if (check >= 0) {
+        ::close(check);
+      }
+      if (same) {
+        return fd;
+      }
+      ::close(fd);
+    }
+    OSP_LOG_ERROR("TELSH", "shm stats region %s keeps being replaced", name);
+    return -1;
+  }
+
+  void Collect(ShmStats* s) {
+    std::memset(s, 0, sizeof(*s));
+    s->updates = region_->stats.updates + 1;
+    struct timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    s->update_ns = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    s->pid = static_cast<uint32_t>(::getpid());
+    s->period_ms = period_ms_;
+    if (server_ != nullptr) {
+      s->sessions_active = server_->ActiveCount();
+      s->sessions_detached = server_->DetachedCount();
+      s->accepted = server_->AcceptedCount();
+      s->rejected = server_->RejectedCount();
+    }
+    s->sink_dropped = SinkFanout::Instance().Dropped();
+    s->signal_dropped = SignalRing::Instance().Dropped();
+    s->post_dropped = TelnetSession::PostDroppedTotal();
+
+    registry_.ForEach([s](const CmdEntry& e) {
+      if (s->cmd_count >= kShmMaxCmds || e.stats == nullptr) {
+        return;
+      }
+      ShmCmdStat& out = s->cmds[s->cmd_count++];
+      detail::ShmCopyName(out.name, e.name);
+      out.calls = e.stats->calls.load(std::memory_order_relaxed);
+      out.failures = e.stats->failures.load(std::memory_order_relaxed);
+      out.total_us = e.stats->total_us.load(std::memory_order_relaxed);
+    });
+
+    const uint32_t nvars = vars_.Count();
+    for (uint32_t i = 0; i < nvars && s->var_count < kShmMaxVars; ++i) {
+      const VarEntry* e = vars_.At(i);
+      ShmVarStat& out = s->vars[s->var_count++];
+      detail::ShmCopyName(out.name, e->name);
+      out.value = e->Read();
+    }
+  }
+
+  void Loop() {
+    std::unique_lock<std::mutex> lock(thread_mutex_);
+    while (running_) {
+      thread_cv_.wait_for(lock, std::chrono::milliseconds(period_ms_));
+      if (!running_) {
+        break;
+      }
+      lock.unlock();
+      Update();
+      lock.lock();
+    }
+  }
+
+  TelnetServer* server_;
+  const CommandRegistry& registry_;
+  const VarRegistry& vars_;
+  ShmStatsRegion* region_ = nullptr;
+  int lock_fd_ = -1;       ///< Holds the flock that makes this the region's writer
+  ShmStats scratch_ = {};  ///< Collected outside the seqlock write
+  char name_[64] = {};
+  uint32_t period_ms_ = 0;
+
+  bool running_ = false;
+  std::mutex thread_mutex_;
+  std::condition_variable thread_cv_;
+  std::thread thread_;
+};
+
+}  // namespace telsh
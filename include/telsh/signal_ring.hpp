@@ -0,0 +1,298 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::SignalRing -- async-signal-safe message ring behind
+// tel_printf_signal_safe().
+//
+// Design:
+//   - kSlots fixed slots of kSlotSize bytes; a producer claims the slot of
+//     its ticket with one compare-exchange (wait-free); if that slot is
+//     still unread the message is dropped and counted, never waited for
+//   - Minimal formatter (%s %c %d %i %u %x %X %p %%, width, '0', l/ll/z)
+//     writing straight into the slot: no locale, stdio or malloc
+//   - Optional non-blocking wake pipe; producers write() one byte
+//   - Single consumer (the server) drains ready slots in claim order
+//   - Only lock-free atomics, read/write and errno are touched from the
+//     producer side, so it may run in a signal handler
+//   - Zero heap allocation
+
+#pragma once
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <atomic>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace telsh {
+
+namespace detail {
+
+/// Bounded output cursor for the signal-safe formatter.
+struct SafeOut {
+  char* buf;
+  uint32_t cap;
+  uint32_t len;
+
+  void Put(char c) {
+    if (len < cap) {
+      buf[len++] = c;
+    }
+  }
+};
+
+inline void SafePutUnsigned(SafeOut& out, unsigned long long v, uint32_t base, bool upper, uint32_t width,
+                            char pad) {
+  const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  char tmp[24];
+  uint32_t n = 0;
+  do {
+    tmp[n++] = digits[v % base];
+    v /= base;
+  } while (v != 0 && n < sizeof(tmp));
+  while (width > n) {
+    out.Put(pad);
+    --width;
+  }
+  while (n > 0) {
+    out.Put(tmp[--n]);
+  }
+}
+
+/// vsnprintf subset that is async-signal-safe.  Output is truncated to
+/// @p cap bytes and not NUL-terminated.  @return bytes written.
+inline uint32_t SafeFormat(char* buf, uint32_t cap, const char* fmt, va_list ap) {
+  SafeOut out{buf, cap, 0};
+  for (const char* p = fmt; *p != '\0'; ++p) {
+    if (*p != '%') {
+      out.Put(*p);
+      continue;
+    }
+    ++p;
+    char pad = ' ';
+    if (*p == '0') {
+      pad = '0';
+      ++p;
+    }
+    uint32_t width = 0;
+    while (*p >= '0' && *p <= '9') {
+      width = width * 10 + static_cast<uint32_t>(*p - '0');
+      ++p;
+    }
+    int32_t longs = 0;  // 0 = int, 1 = long, 2 = long long, 3 = size_t
+    while (*p == 'l') {
+      ++longs;
+      ++p;
+    }
+    if (*p == 'z') {
+      longs = 3;
+      ++p;
+    }
+    switch (*p) {
+      case 'd':
+      case 'i': {
+        long long v = (longs == 0)   ? va_arg(ap, int)
+                      : (longs == 1) ? va_arg(ap, long)
+                      : (longs == 2) ? va_arg(ap, long long)
+                                     : static_cast<long long>(va_arg(ap, ptrdiff_t));
+        unsigned long long mag = static_cast<unsigned long long>(v);
+        if (v < 0) {
+          out.Put('-');
+          mag = 0ULL - mag;
+          width = (width > 0) ? width - 1 : 0;
+        }
+        SafePutUnsigned(out, mag, 10, false, width, pad);
+        break;
+      }
+      case 'u':
+      case 'x':
+      case 'X': {
+        unsigned long long v = (longs == 0)   ? va_arg(ap, unsigned int)
+                               : (longs == 1) ? va_arg(ap, unsigned long)
+                               : (longs == 2) ? va_arg(ap, unsigned long long)
+                                              : va_arg(ap, size_t);
+        SafePutUnsigned(out, v, (*p == 'u') ? 10 : 16, *p == 'X', width, pad);
+        break;
+      }
+      case 'p':
+        out.Put('0');
+        out.Put('x');
+        SafePutUnsigned(out, reinterpret_cast<uintptr_t>(va_arg(ap, void*)), 16, false, 0, ' ');
+        break;
+      case 'c':
+        out.Put(static_cast<char>(va_arg(ap, int)));
+        break;
+      case 's': {
+        const char* s = va_arg(ap, const char*);
+        for (s = (s != nullptr) ? s : "(null)"; *s != '\0'; ++s) {
+          out.Put(*s);
+        }
+        break;
+      }
+      case '%':
+        out.Put('%');
+        break;
+      case '\0':
+        return out.len;
+      default:  // unsupported conversion: show it verbatim
+        out.Put('%');
+        out.Put(*p);
+        break;
+    }
+  }
+  return out.len;
+}
+
+}  // namespace detail
+
+// ---------------------------------------------------------------------------
+// SignalRing
+// ---------------------------------------------------------------------------
+
+class SignalRing {
+ public:
+  static constexpr uint32_t kSlots = 32;
+  static constexpr uint32_t kSlotSize = 128;
+
+  static_assert(std::atomic<uint32_t>::is_always_lock_free, "signal safety needs lock-free atomics");
+
+  /// Receives one drained message (not NUL-terminated).
+  using DrainFn = void (*)(const char* text, uint32_t len, void* ctx);
+
+  /// Process-wide ring used by tel_printf_signal_safe().
+  static SignalRing& Instance() {
+    static SignalRing inst;
+    return inst;
+  }
+
+  /// Create the wake pipe (idempotent).  Not signal-safe: call at setup.
+  bool OpenWakePipe() {
+    if (wake_fd_[0] >= 0) {
+      return true;
+    }
+    int32_t fds[2];
+    if (::pipe2(fds, O_NONBLOCK | O_CLOEXEC) != 0) {
+      return false;
+    }
+    wake_fd_[1] = fds[1];
+    wake_fd_[0] = fds[0];
+    return true;
+  }
+
+  /// Readable after a message was written (-1 until OpenWakePipe()).
+  int32_t WakeFd() const { return wake_fd_[0]; }
+
+  /// Copy @p len bytes (truncated to kSlotSize) as one message.
+  /// Async-signal-safe.  @return false if the message was dropped.
+  bool Write(const char* text, uint32_t len) {
+    Slot* slot = Claim();
+    if (slot == nullptr) {
+      return false;
+    }
+    slot->len = (len < kSlotSize) ? len : kSlotSize;
+    std::memcpy(slot->text, text, slot->len);
+    Publish(slot);
+    return true;
+  }
+
+  /// Format into a slot with detail::SafeFormat.  Async-signal-safe.
+  bool VPrintf(const char* fmt, va_list ap) {
+    Slot* slot = Claim();
+    if (slot == nullptr) {
+      return false;
+    }
+    slot->len = detail::SafeFormat(slot->text, kSlotSize, fmt, ap);
+    Publish(slot);
+    return true;
+  }
+
+  /// Hand every ready message to @p fn in the order they were written and
+  /// free the slots.  Single consumer.  @return messages drained.
+  uint32_t Drain(DrainFn fn, void* ctx) {
+    if (wake_fd_[0] >= 0) {
+      char sink[64];
+      while (::read(wake_fd_[0], sink, sizeof(sink)) > 0) {
+      }
+    }
+    // Ready slots sorted by ticket (tickets wrap, compare by difference)
+    uint32_t order[kSlots];
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < kSlots; ++i) {
+      if (slots_[i].state.load(std::memory_order_acquire) != kReady) {
+        continue;
+      }
+      uint32_t j = n++;
+      while (j > 0 && static_cast<int32_t>(slots_[order[j - 1]].ticket - slots_[i].ticket) > 0) {
+        order[j] = order[j - 1];
+        --j;
+      }
+      order[j] = i;
+    }
+    for (uint32_t k = 0; k < n; ++k) {
+      Slot& s = slots_[order[k]];
+      fn(s.text, s.len, ctx);
+      s.state.store(kFree, std::memory_order_release);
+    }
+    return n;
+  }
+
+  /// Messages lost because their slot was still unread.
+  uint32_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+ private:
+  static constexpr uint32_t kFree = 0;
+  static constexpr uint32_t kWriting = 1;
+  static constexpr uint32_t kReady = 2;
+
+  struct Slot {
+    std::atomic<uint32_t> state{kFree};
+    uint32_t ticket = 0;
+    uint32_t len = 0;
+    char text[kSlotSize] = {};
+  };
+
+  Slot* Claim() {
+    const uint32_t ticket = next_ticket_.fetch_add(1, std::memory_order_relaxed);
+    Slot& slot = slots_[ticket % kSlots];
+    uint32_t expected = kFree;
+    if (!slot.state.compare_exchange_strong(expected, kWriting, std::memory_order_acquire)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    slot.ticket = ticket;
+    return &slot;
+  }
+
+  void Publish(Slot* slot) {
+    slot->state.store(kReady, std::memory_order_release);
+    if (wake_fd_[1] >= 0) {
+      const int saved = errno;  // a handler must not clobber errno
+      const char c = 0;
+      (void)::write(wake_fd_[1], &c, 1);
+      errno = saved;
+    }
+  }
+
+  Slot slots_[kSlots];
+  std::atomic<uint32_t> next_ticket_{0};
+  std::atomic<uint32_t> dropped_{0};
+  int32_t wake_fd_[2] = {-1, -1};
+};
+
+/// printf subset (see detail::SafeFormat) into SignalRing::Instance().
+/// Async-signal-safe; the server broadcasts the message later.
+inline bool tel_printf_signal_safe(const char* fmt, ...) {
+  if (fmt == nullptr) {
+    return false;
+  }
+  va_list ap;
+  va_start(ap, fmt);
+  bool ok = SignalRing::Instance().VPrintf(fmt, ap);
+  va_end(ap);
+  return ok;
+}
+
+}  // namespace telsh
@@ -5,9 +5,23 @@
 // Design:
 //   - Pure POSIX sockets (no boost)
 //   - Fixed session pool (kMaxSessions = 8), zero heap allocation
-//   - Each session runs in a joinable std::thread (not detached)
-//   - Broadcast to all active sessions
-//   - Global tel_printf() for broadcasting from anywhere
+//   - Up to kMaxListeners listeners (port + registry + auth/prompt) share
+//     one accept thread and the session pool
+//   - Each session runs in a joinable std::thread (not detached), or
+//     polled mode: no internal threads, the host event loop drives
+//     accept/read via Poll() / OnReadable()
+//   - Broadcast to all active sessions or to one listener's sessions
+//     (detached ones record it for replay); a per-slot mutex keeps a
+//     broadcast from reaching a slot while it is re-initialized for a new
+//     connection
+//   - Optional session detach: a dropped connection keeps its slot for
+//     detach_grace_ms and can be resumed with "attach <id>" by the same user
+//     (listeners with a login only)
+//   - Global tel_printf() for broadcasting from anywhere, and
+//     tel_printf_signal_safe() (SignalRing) for signal handlers: the global
+//     server drains the ring from its accept thread or polled loop
+//   - Global output is formatted once and also fanned out to the sinks of
+//     SinkFanout::Instance() (file, OSP_LOG, flight recorder, syslog)
 //   - Graceful shutdown: Stop() closes listen fd, stops sessions, joins threads
 
 #pragma once
@@ -15,8 +29,11 @@
 #include "osp/log.hpp"
 #include "osp/platform.hpp"
 #include "telsh/command_registry.hpp"
+#include "telsh/output_sinks.hpp"
+#include "telsh/signal_ring.hpp"
 #include "telsh/telnet_session.hpp"
 
+#include <cerrno>
 #include <cstdarg>
 #include <cstdint>
 #include <cstdio>
@@ -24,7 +41,10 @@
 
 #include <arpa/inet.h>
 #include <atomic>
+#include <fcntl.h>
+#include <mutex>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <thread>
 #include <unistd.h>
@@ -35,13 +55,28 @@ namespace telsh {
 // ServerConfig
 // ---------------------------------------------------------------------------
 
+/// How the server runs its I/O.
+enum class IoMode : uint8_t {
+  kThreads,  ///< Accept thread + one thread per session (default)
+  kPolled    ///< No internal threads; the host calls Poll() / OnReadable()
+};
+
+/// Server (engine) configuration; also describes each additional listener,
+/// for which max_sessions and io_mode are ignored.
 struct ServerConfig {
   uint16_t port = 2500;
   const char* username = nullptr;  ///< nullptr = no auth
   const char* password = nullptr;
+  uint32_t roles = kRoleAll;           ///< Roles of username/password (or everyone without auth)
+  const UserAccount* users = nullptr;  ///< Optional account table with per-user roles
+  uint32_t user_count = 0;
   const char* prompt = "telsh> ";
   const char* banner = nullptr;  ///< nullptr = use default banner
   uint32_t max_sessions = 4;
+  IoMode io_mode = IoMode::kThreads;
+  uint32_t detach_grace_ms = 0;  ///< 0 = sessions end on disconnect; ignored without a login
+  SocketPolicy socket_policy;    ///< TCP options for accepted connections
+  uint32_t rtt_probe_ms = 0;     ///< TIMING-MARK RTT probe period, 0 = off
 };
 
 // ---------------------------------------------------------------------------
@@ -51,10 +86,15 @@ struct ServerConfig {
 class TelnetServer {
  public:
   static constexpr uint32_t kMaxSessions = 8;
+  static constexpr uint32_t kMaxListeners = 4;
 
-  explicit TelnetServer(CommandRegistry& registry, const ServerConfig& config = {})
-      : registry_(&registry), config_(config) {
+  /// @p registry / @p config form listener 0 and set the engine-wide
+  /// max_sessions and io_mode.
+  explicit TelnetServer(CommandRegistry& registry, const ServerConfig& config = {}) : config_(config) {
     OSP_ASSERT(config_.max_sessions <= kMaxSessions);
+    listeners_[0].registry = &registry;
+    listeners_[0].config = config;
+    listener_count_ = 1;
     g_instance_ = this;
   }
 
@@ -71,6 +111,22 @@ class TelnetServer {
   TelnetServer(TelnetServer&&) = delete;
   TelnetServer& operator=(TelnetServer&&) = delete;
 
+  /// Serve @p registry on another port with its own auth/prompt/banner
+  /// (@p config.max_sessions and io_mode are ignored).  Call before Start().
+  /// @return listener id for Port() / BroadcastTo(), or -1 if full/running.
+  int32_t AddListener(CommandRegistry& registry, const ServerConfig& config) {
+    if (running_.load(std::memory_order_acquire) || listener_count_ >= kMaxListeners) {
+      OSP_LOG_WARN("TELSH", "AddListener(%u) rejected", config.port);
+      return -1;
+    }
+    Listener& l = listeners_[listener_count_];
+    l.registry = &registry;
+    l.config = config;
+    return static_cast<int32_t>(listener_count_++);
+  }
+
+  uint32_t ListenerCount() const { return listener_count_; }
+
   /// Start the server.  Returns true on success.
   bool Start() {
     if (running_.load(std::memory_order_acquire)) {
@@ -78,39 +134,36 @@ class TelnetServer {
       return false;
     }
 
-    listen_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd_ < 0) {
-      OSP_LOG_ERROR("TELSH", "socket() failed: %s", strerror(errno));
-      return false;
-    }
-
-    int32_t opt = 1;
-    ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    struct sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(config_.port);
-
-    if (::bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
-      OSP_LOG_ERROR("TELSH", "bind(%u) failed: %s", config_.port, strerror(errno));
-      ::close(listen_fd_);
-      listen_fd_ = -1;
-      return false;
+    for (uint32_t i = 0; i < listener_count_; ++i) {
+      if (!OpenListener(listeners_[i])) {
+        CloseListeners();
+        return false;
+      }
     }
 
-    if (::listen(listen_fd_, static_cast<int>(config_.max_sessions)) < 0) {
-      OSP_LOG_ERROR("TELSH", "listen() failed: %s", strerror(errno));
-      ::close(listen_fd_);
-      listen_fd_ = -1;
-      return false;
+    if (!SignalRing::Instance().OpenWakePipe()) {
+      OSP_LOG_WARN("TELSH", "signal ring wake pipe unavailable: %s", strerror(errno));
     }
 
     running_.store(true, std::memory_order_release);
-    accept_thread_ = std::thread([this]() { AcceptLoop(); });
+    if (config_.io_mode == IoMode::kThreads) {
+      if (::pipe(wake_fd_) < 0) {
+        OSP_LOG_ERROR("TELSH", "pipe() failed: %s", strerror(errno));
+        running_.store(false, std::memory_order_release);
+        CloseListeners();
+        return false;
+      }
+      accept_thread_ = std::thread([this]() { AcceptLoop(); });
+    }
 
-    OSP_LOG_INFO("TELSH", "Listening on port %u (max %u sessions)", config_.port, config_.max_sessions);
+    for (uint32_t i = 0; i < listener_count_; ++i) {
+      OSP_LOG_INFO("TELSH", "Listening on port %u (max %u sessions%s)", listeners_[i].bound_port,
+                   config_.max_sessions, config_.io_mode == IoMode::kPolled ? ", polled" : "");
+      if (listeners_[i].config.detach_grace_ms > 0 && !HasLogin(listeners_[i].config)) {
+        OSP_LOG_WARN("TELSH", "Port %u: detach_grace_ms ignored, sessions without a login are not detachable",
+                     listeners_[i].bound_port);
+      }
+    }
     return true;
   }
 
@@ -123,25 +176,35 @@ class TelnetServer {
     OSP_LOG_INFO("TELSH", "Stopping server...");
     running_.store(false, std::memory_order_release);
 
-    // Close listen socket to unblock accept()
-    if (listen_fd_ >= 0) {
-      ::close(listen_fd_);
-      listen_fd_ = -1;
+    // Wake the accept thread out of poll()
+    if (wake_fd_[1] >= 0) {
+      const char c = 0;
+      (void)::write(wake_fd_[1], &c, 1);
     }
-
     if (accept_thread_.joinable()) {
       accept_thread_.join();
     }
+    for (int32_t& fd : wake_fd_) {
+      if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+      }
+    }
+    CloseListeners();
 
     // Stop all active sessions
     for (uint32_t i = 0; i < kMaxSessions; ++i) {
       if (slots_[i].active.load(std::memory_order_acquire)) {
         slots_[i].session.Stop();
+        if (config_.io_mode == IoMode::kPolled) {
+          slots_[i].session.Close();
+        }
       }
       if (slots_[i].thread.joinable()) {
         slots_[i].thread.join();
       }
       slots_[i].active.store(false, std::memory_order_release);
+      slots_[i].detached.store(false, std::memory_order_release);
     }
 
     OSP_LOG_INFO("TELSH", "Server stopped");
@@ -149,15 +212,166 @@ class TelnetServer {
 
   bool IsRunning() const { return running_.load(std::memory_order_acquire); }
 
-  /// Broadcast raw data to all active sessions.
+  /// Port actually bound by Start() (useful when ServerConfig::port is 0).
+  uint16_t Port(uint32_t listener = 0) const {
+    return (listener < listener_count_) ? listeners_[listener].bound_port : 0;
+  }
+
+  // -----------------------------------------------------------------------
+  // Polled mode (IoMode::kPolled) -- all calls from the host loop thread
+  // -----------------------------------------------------------------------
+
+  int32_t ListenFd(uint32_t listener = 0) const {
+    return (listener < listener_count_) ? listeners_[listener].fd : -1;
+  }
+
+  /// Fill @p fds with the listen sockets, per active session its socket
+  /// and its output wake fd, and (global server only) the SignalRing wake
+  /// fd (events = POLLIN, plus POLLOUT on a session socket with queued
+  /// output).  @return number of entries written.
+  uint32_t GetPollFds(struct pollfd* fds, uint32_t max_fds) const {
+    if (fds == nullptr || !running_.load(std::memory_order_acquire)) {
+      return 0;
+    }
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < listener_count_ && n < max_fds; ++i) {
+      fds[n++] = {listeners_[i].fd, POLLIN, 0};
+    }
+    for (uint32_t i = 0; i < kMaxSessions && n < max_fds; ++i) {
+      if (slots_[i].active.load(std::memory_order_acquire)) {
+        const int16_t events = slots_[i].session.HasPendingOutput() ? (POLLIN | POLLOUT) : POLLIN;
+        fds[n++] = {slots_[i].session.Fd(), events, 0};
+        if (n < max_fds && slots_[i].session.WakeFd() >= 0) {
+          fds[n++] = {slots_[i].session.WakeFd(), POLLIN, 0};
+        }
+      }
+    }
+    if (n < max_fds && g_instance_ == this && SignalRing::Instance().WakeFd() >= 0) {
+      fds[n++] = {SignalRing::Instance().WakeFd(), POLLIN, 0};
+    }
+    return n;
+  }
+
+  /// Handle readiness of @p fd reported by the host's own poll/epoll
+  /// (readable, or writable for a session with queued output).  Accepts on
+  /// the listen socket, otherwise flushes and reads the owning session or
+  /// writes its posted output.
+  void OnReadable(int32_t fd) {
+    if (fd < 0 || !running_.load(std::memory_order_acquire)) {
+      return;
+    }
+    for (uint32_t i = 0; i < listener_count_; ++i) {
+      if (fd == listeners_[i].fd) {
+        AcceptOne(i);
+        return;
+      }
+    }
+    if (fd == SignalRing::Instance().WakeFd()) {
+      DrainSignalOutput();
+      return;
+    }
+    for (uint32_t i = 0; i < kMaxSessions; ++i) {
+      if (!slots_[i].active.load(std::memory_order_acquire)) {
+        continue;
+      }
+      if (slots_[i].session.WakeFd() == fd) {
+        slots_[i].session.DrainPosted();
+        if (!slots_[i].session.IsRunning()) {  // dropped: output queue overflowed
+          slots_[i].session.Disconnected();
+          SessionEnded(i);
+        }
+        return;
+      }
+      if (slots_[i].session.Fd() == fd) {
+        if (!slots_[i].session.OnReadable()) {
+          slots_[i].session.Disconnected();
+          SessionEnded(i);
+        }
+        return;
+      }
+    }
+  }
+
+  /// Convenience loop step: poll() all server fds for up to @p timeout_ms
+  /// and dispatch every ready one to OnReadable().
+  /// @return number of fds handled, 0 on timeout, -1 on error.
+  int32_t Poll(int32_t timeout_ms) {
+    struct pollfd fds[kMaxSessions * 2 + kMaxListeners + 1];
+    uint32_t nfds = GetPollFds(fds, kMaxSessions * 2 + kMaxListeners + 1);
+    if (nfds == 0) {
+      return -1;
+    }
+    int32_t ready = ::poll(fds, nfds, timeout_ms);
+    if (ready <= 0) {
+      return (ready < 0 && errno != EINTR) ? -1 : 0;
+    }
+    int32_t handled = 0;
+    for (uint32_t i = 0; i < nfds; ++i) {
+      if ((fds[i].revents & (POLLIN | POLLOUT | POLLHUP | POLLERR)) != 0) {
+        OnReadable(fds[i].fd);
+        ++handled;
+      }
+    }
+    return handled;
+  }
+
+  /// Number of sessions with a live connection.
+  uint32_t ActiveCount() const {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < kMaxSessions; ++i) {
+      n += slots_[i].active.load(std::memory_order_acquire) ? 1U : 0U;
+    }
+    return n;
+  }
+
+  /// Connections accepted / turned away ("Server full") since construction.
+  uint64_t AcceptedCount() const { return accepted_.load(std::memory_order_relaxed); }
+  uint64_t RejectedCount() const { return rejected_.load(std::memory_order_relaxed); }
+
+  /// Number of sessions currently detached and waiting for "attach".
+  uint32_t DetachedCount() const {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < kMaxSessions; ++i) {
+      n += slots_[i].detached.load(std::memory_order_acquire) ? 1U : 0U;
+    }
+    return n;
+  }
+
+  /// Broadcast raw data to all active sessions.  Detached sessions only
+  /// record it in their backlog.  Each call is one record: it reaches a
+  /// session's client whole, never interleaved with typed input (see
+  /// TelnetSession::Post).  In polled mode it is written by the next Poll().
   void Broadcast(const char* data, uint32_t len) {
     if (data == nullptr || len == 0) {
       return;
     }
     for (uint32_t i = 0; i < kMaxSessions; ++i) {
-      if (slots_[i].active.load(std::memory_order_acquire)) {
-        slots_[i].session.Send(data, len);
-      }
+      PostToSlot(i, kAnyListener, data, len);
+    }
+  }
+
+  /// Broadcast raw data to the sessions accepted on @p listener only.
+  void BroadcastTo(uint32_t listener, const char* data, uint32_t len) {
+    if (data == nullptr || len == 0) {
+      return;
+    }
+    for (uint32_t i = 0; i < kMaxSessions; ++i) {
+      PostToSlot(i, listener, data, len);
+    }
+  }
+
+  /// Printf to the sessions accepted on @p listener only.
+  void BroadcastPrintfTo(uint32_t listener, const char* fmt, ...) {
+    if (fmt == nullptr) {
+      return;
+    }
+    char buf[512];
+    va_list ap;
+    va_start(ap, fmt);
+    int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+      BroadcastTo(listener, buf, static_cast<uint32_t>(n));
     }
   }
 
@@ -176,9 +390,37 @@ class TelnetServer {
     }
   }
 
-  /// Global printf (broadcasts via the singleton instance).
+  /// Broadcast everything tel_printf_signal_safe() queued.  Called by the
+  /// accept thread / OnReadable(); the global server only.
+  void DrainSignalOutput() {
+    if (g_instance_ != this) {
+      return;
+    }
+    SignalRing::Instance().Drain([](const char* text, uint32_t len, void*) { Publish(text, len); }, nullptr);
+  }
+
+  /// Global output: broadcast @p data via the singleton instance (if any)
+  /// and queue it for the SinkFanout sinks (if started).  Inside a command
+  /// run by CommandRegistry::ExecuteCapture() it goes to the capture only.
+  static void Publish(const char* data, uint32_t len) {
+    if (data == nullptr || len == 0) {
+      return;
+    }
+    ExecContext* ec = CurrentExec();
+    if (ec != nullptr && ec->capture_printf && ec->output_fn != nullptr) {
+      ec->output_fn(data, len, ec->output_ctx);
+      return;
+    }
+    if (g_instance_ != nullptr) {
+      g_instance_->Broadcast(data, len);
+    }
+    (void)SinkFanout::Instance().Publish(data, len);
+  }
+
+  /// Global printf (broadcasts via the singleton instance, fans out to
+  /// the output sinks).
   static void Printf(const char* fmt, ...) {
-    if (g_instance_ == nullptr || fmt == nullptr) {
+    if (fmt == nullptr) {
       return;
     }
     char buf[512];
@@ -187,60 +429,216 @@ class TelnetServer {
     int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
     va_end(ap);
     if (n > 0) {
-      g_instance_->Broadcast(buf, static_cast<uint32_t>(n));
+      Publish(buf, (static_cast<uint32_t>(n) < sizeof(buf)) ? static_cast<uint32_t>(n) : sizeof(buf) - 1);
     }
   }
 
  private:
+  static constexpr uint32_t kAnyListener = UINT32_MAX;
+
   struct SessionSlot {
     TelnetSession session;
     std::thread thread;
     std::atomic<bool> active{false};
+    std::atomic<bool> detached{false};  ///< Connection gone, state kept for attach
+    uint32_t listener = 0;              ///< Index into listeners_
+    std::mutex mutex;                   ///< Posting vs Init() / AdoptFrom() of the slot
+  };
+
+  /// Post to slot @p idx if it holds a live or detached session accepted on
+  /// @p listener (or any).  Without the slot lock a broadcaster that saw
+  /// the old session could still be posting (detached: sending) while
+  /// AcceptOne() re-initializes the slot for a new client.
+  void PostToSlot(uint32_t idx, uint32_t listener, const char* data, uint32_t len) {
+    SessionSlot& s = slots_[idx];
+    if (!s.active.load(std::memory_order_acquire) && !s.detached.load(std::memory_order_acquire)) {
+      return;  // common case for unused slots: no lock
+    }
+    ExecContext* ec = CurrentExec();
+    if (ec != nullptr && ec->session == &s.session) {
+      // The slot's own thread, inside a command: the slot cannot be reused
+      // under us, and the direct send must not hold up other broadcasters
+      if (listener == kAnyListener || s.listener == listener) {
+        s.session.Post(data, len);
+      }
+      return;
+    }
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if ((s.active.load(std::memory_order_acquire) || s.detached.load(std::memory_order_acquire)) &&
+        (listener == kAnyListener || s.listener == listener)) {
+      s.session.Post(data, len);
+    }
+  }
+
+  struct Listener {
+    CommandRegistry* registry = nullptr;
+    ServerConfig config;
+    int32_t fd = -1;
+    uint16_t bound_port = 0;
   };
 
+  // -----------------------------------------------------------------------
+  // Listen sockets
+  // -----------------------------------------------------------------------
+  bool OpenListener(Listener& l) {
+    l.fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (l.fd < 0) {
+      OSP_LOG_ERROR("TELSH", "socket() failed: %s", strerror(errno));
+      return false;
+    }
+
+    int32_t opt = 1;
+    ::setsockopt(l.fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(l.config.port);
+
+    if (::bind(l.fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+      OSP_LOG_ERROR("TELSH", "bind(%u) failed: %s", l.config.port, strerror(errno));
+      ::close(l.fd);
+      l.fd = -1;
+      return false;
+    }
+
+    // Backlog beyond max_sessions: surplus connections must reach accept()
+    // to be told "Server full", not sit unacknowledged in a full queue
+    if (::listen(l.fd, SOMAXCONN) < 0) {
+      OSP_LOG_ERROR("TELSH", "listen() failed: %s", strerror(errno));
+      ::close(l.fd);
+      l.fd = -1;
+      return false;
+    }
+
+    // Resolve the actual port (config.port may be 0 = ephemeral)
+    socklen_t addr_len = sizeof(addr);
+    ::getsockname(l.fd, reinterpret_cast<struct sockaddr*>(&addr), &addr_len);
+    l.bound_port = ntohs(addr.sin_port);
+
+    // A spurious readiness report must not block the loop in accept()
+    ::fcntl(l.fd, F_SETFL, ::fcntl(l.fd, F_GETFL, 0) | O_NONBLOCK);
+    return true;
+  }
+
+  void CloseListeners() {
+    for (uint32_t i = 0; i < listener_count_; ++i) {
+      if (listeners_[i].fd >= 0) {
+        ::close(listeners_[i].fd);
+        listeners_[i].fd = -1;
+      }
+    }
+  }
+
   // -----------------------------------------------------------------------
   // Accept loop
   // -----------------------------------------------------------------------
+  /// Waits on every listen socket plus the wake pipe written by Stop().
   void AcceptLoop() {
+    struct pollfd fds[kMaxListeners + 2];
     while (running_.load(std::memory_order_acquire)) {
-      struct sockaddr_in client_addr;
-      socklen_t addr_len = sizeof(client_addr);
-
-      int32_t fd = ::accept(listen_fd_, reinterpret_cast<struct sockaddr*>(&client_addr), &addr_len);
-      if (fd < 0) {
-        if (running_.load(std::memory_order_acquire)) {
-          OSP_LOG_WARN("TELSH", "accept() failed: %s", strerror(errno));
+      for (uint32_t i = 0; i < listener_count_; ++i) {
+        fds[i] = {listeners_[i].fd, POLLIN, 0};
+      }
+      fds[listener_count_] = {wake_fd_[0], POLLIN, 0};
+      fds[listener_count_ + 1] = {SignalRing::Instance().WakeFd(), POLLIN, 0};  // -1 is ignored by poll()
+      int32_t ready = ::poll(fds, listener_count_ + 2, -1);
+      if (ready < 0) {
+        if (errno == EINTR) {
+          continue;
         }
+        OSP_LOG_WARN("TELSH", "poll() failed: %s", strerror(errno));
         break;
       }
-
-      int32_t slot = FindFreeSlot();
-      if (slot < 0) {
-        const char* msg = "Server full.\r\n";
-        ::send(fd, msg, std::strlen(msg), MSG_NOSIGNAL);
-        ::close(fd);
-        OSP_LOG_WARN("TELSH", "No free slots, rejected connection");
-        continue;
+      if (fds[listener_count_].revents != 0) {
+        break;
       }
+      if (fds[listener_count_ + 1].revents != 0) {
+        DrainSignalOutput();
+      }
+      for (uint32_t i = 0; i < listener_count_; ++i) {
+        if (fds[i].revents != 0 && !AcceptOne(i)) {
+          return;
+        }
+      }
+    }
+  }
 
-      char ip[INET_ADDRSTRLEN];
-      inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
-      OSP_LOG_INFO("TELSH", "Connection from %s:%u -> slot %d", ip, ntohs(client_addr.sin_port), slot);
-
-      // Build session config
-      SessionConfig scfg;
-      scfg.username = config_.username;
-      scfg.password = config_.password;
-      scfg.prompt = config_.prompt;
-      if (config_.banner != nullptr) {
-        scfg.banner = config_.banner;
+  /// Accept one connection on @p listener and hand it to a free slot.
+  /// @return false if accept() failed (listen socket closed or error).
+  bool AcceptOne(uint32_t listener) {
+    const Listener& l = listeners_[listener];
+    struct sockaddr_in client_addr;
+    socklen_t addr_len = sizeof(client_addr);
+
+    int32_t fd = ::accept(l.fd, reinterpret_cast<struct sockaddr*>(&client_addr), &addr_len);
+    if (fd < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+        return true;
+      }
+      if (running_.load(std::memory_order_acquire)) {
+        OSP_LOG_WARN("TELSH", "accept() failed: %s", strerror(errno));
       }
+      return false;
+    }
+
+    int32_t slot = FindFreeSlot();
+    if (slot < 0) {
+      const char* msg = "Server full.\r\n";
+      ::send(fd, msg, std::strlen(msg), MSG_NOSIGNAL);
+      ::close(fd);
+      rejected_.fetch_add(1, std::memory_order_relaxed);
+      OSP_LOG_WARN("TELSH", "No free slots, rejected connection");
+      return true;
+    }
+    accepted_.fetch_add(1, std::memory_order_relaxed);
+
+    ApplySocketPolicy(fd, l.config.socket_policy);
+    if (config_.io_mode == IoMode::kPolled) {
+      // never block the host loop on a slow client; the session queues the rest
+      ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client_addr.sin_addr, ip, sizeof(ip));
+    OSP_LOG_INFO("TELSH", "Connection from %s:%u (port %u) -> slot %d", ip, ntohs(client_addr.sin_port),
+                 l.bound_port, slot);
+
+    // Build session config
+    SessionConfig scfg;
+    scfg.username = l.config.username;
+    scfg.password = l.config.password;
+    scfg.roles = l.config.roles;
+    scfg.users = l.config.users;
+    scfg.user_count = l.config.user_count;
+    scfg.prompt = l.config.prompt;
+    if (l.config.banner != nullptr) {
+      scfg.banner = l.config.banner;
+    }
+    scfg.blocking_commands = (config_.io_mode == IoMode::kThreads);
+    scfg.socket_policy = l.config.socket_policy;
+    scfg.rtt_probe_ms = l.config.rtt_probe_ms;
+    scfg.detach_grace_ms = l.config.detach_grace_ms;
+    scfg.session_id = next_session_id_++;
+    if (l.config.detach_grace_ms > 0 && HasLogin(l.config)) {
+      scfg.attach_fn = &TelnetServer::AttachHook;
+      scfg.attach_ctx = this;
+    }
 
-      uint32_t idx = static_cast<uint32_t>(slot);
-      slots_[idx].session.Init(fd, *registry_, scfg);
+    uint32_t idx = static_cast<uint32_t>(slot);
+    {
+      std::lock_guard<std::mutex> lock(slots_[idx].mutex);
+      slots_[idx].listener = listener;
+      slots_[idx].session.Init(fd, *l.registry, scfg);
       slots_[idx].active.store(true, std::memory_order_release);
+    }
+    if (config_.io_mode == IoMode::kPolled) {
+      slots_[idx].session.Begin();
+    } else {
       slots_[idx].thread = std::thread([this, idx]() { SessionLoop(idx); });
     }
+    return true;
   }
 
   // -----------------------------------------------------------------------
@@ -249,21 +647,120 @@ class TelnetServer {
   void SessionLoop(uint32_t idx) {
     OSP_ASSERT(idx < kMaxSessions);
     slots_[idx].session.Run();
+    SessionEnded(idx);
+  }
+
+  /// Release a slot whose connection is gone, or park it as detached.
+  void SessionEnded(uint32_t idx) {
+    if (slots_[idx].session.IsDetached()) {
+      slots_[idx].detached.store(true, std::memory_order_release);
+      OSP_LOG_INFO("TELSH", "Slot %u session %u detached", idx, slots_[idx].session.Id());
+    } else {
+      OSP_LOG_INFO("TELSH", "Slot %u session ended", idx);
+    }
     slots_[idx].active.store(false, std::memory_order_release);
-    OSP_LOG_INFO("TELSH", "Slot %u session ended", idx);
+  }
+
+  // -----------------------------------------------------------------------
+  // Attach (built-in "attach [id]" of a session)
+  // -----------------------------------------------------------------------
+  /// Attach matches sessions by user name, which is only meaningful with a login.
+  static bool HasLogin(const ServerConfig& cfg) {
+    return (cfg.username != nullptr && cfg.password != nullptr) || (cfg.users != nullptr && cfg.user_count > 0);
+  }
+
+  static bool AttachHook(TelnetSession& self, int32_t id, void* ctx) {
+    return static_cast<TelnetServer*>(ctx)->AttachDetached(self, id);
+  }
+
+  /// Move detached session @p id (same user and listener) into @p self.
+  /// @p id < 0 lists candidates.  detach_mutex_ (which the accept path
+  /// also takes) only covers claiming the slot and copying its state;
+  /// anything sent to the attaching client goes out after it is released.
+  bool AttachDetached(TelnetSession& self, int32_t id) {
+    const uint64_t now_ms = osp::SteadyNowUs() / 1000;
+    uint32_t listener = 0;
+    for (uint32_t i = 0; i < kMaxSessions; ++i) {
+      if (&slots_[i].session == &self) {
+        listener = slots_[i].listener;
+      }
+    }
+    if (id < 0) {
+      uint32_t ids[kMaxSessions];
+      uint32_t ages[kMaxSessions];
+      uint32_t shown = 0;
+      {
+        std::lock_guard<std::mutex> lock(detach_mutex_);
+        for (uint32_t i = 0; i < kMaxSessions; ++i) {
+          TelnetSession& s = slots_[i].session;
+          if (slots_[i].detached.load(std::memory_order_acquire) && slots_[i].listener == listener &&
+              !s.DetachExpired(now_ms) && std::strcmp(s.User(), self.User()) == 0) {
+            ids[shown] = s.Id();
+            ages[shown++] = static_cast<uint32_t>((now_ms - s.DetachedAtMs()) / 1000);
+          }
+        }
+      }
+      for (uint32_t i = 0; i < shown; ++i) {
+        self.Printf("  session %-4u detached %u s ago\r\n", ids[i], ages[i]);
+      }
+      if (shown == 0) {
+        self.SendStr("No detached sessions.\r\n");
+      }
+      return shown > 0;
+    }
+
+    char replay[TelnetSession::kBacklogSize];
+    uint32_t len = 0;
+    bool adopted = false;
+    {
+      std::lock_guard<std::mutex> lock(detach_mutex_);
+      for (uint32_t i = 0; i < kMaxSessions; ++i) {
+        TelnetSession& s = slots_[i].session;
+        if (!slots_[i].detached.load(std::memory_order_acquire) || s.Id() != static_cast<uint32_t>(id)) {
+          continue;
+        }
+        if (slots_[i].listener != listener || s.DetachExpired(now_ms) || std::strcmp(s.User(), self.User()) != 0) {
+          break;
+        }
+        // Everything is copied out, so the slot can be reused right away
+        std::lock_guard<std::mutex> slot_lock(slots_[i].mutex);
+        len = self.AdoptFrom(s, replay);
+        slots_[i].detached.store(false, std::memory_order_release);
+        adopted = true;
+        break;
+      }
+    }
+    if (!adopted) {
+      self.Printf("No detached session %d.\r\n", id);
+      return false;
+    }
+    OSP_LOG_INFO("TELSH", "Session %d attached by session %u", id, self.Id());
+    self.Printf("--- attached to session %d, replaying %u bytes ---\r\n", id, len);
+    self.Send(replay, len);
+    return true;
   }
 
   // -----------------------------------------------------------------------
   // Find free slot (join stale thread if needed)
   // -----------------------------------------------------------------------
   int32_t FindFreeSlot() {
+    const uint64_t now_ms = osp::SteadyNowUs() / 1000;
+    std::lock_guard<std::mutex> lock(detach_mutex_);
     for (uint32_t i = 0; i < config_.max_sessions && i < kMaxSessions; ++i) {
-      if (!slots_[i].active.load(std::memory_order_acquire)) {
-        if (slots_[i].thread.joinable()) {
-          slots_[i].thread.join();
+      if (slots_[i].active.load(std::memory_order_acquire)) {
+        continue;
+      }
+      if (slots_[i].detached.load(std::memory_order_acquire)) {
+        if (!slots_[i].session.DetachExpired(now_ms)) {
+          continue;
         }
-        return static_cast<int32_t>(i);
+        OSP_LOG_INFO("TELSH", "Slot %u detached session %u expired", i, slots_[i].session.Id());
+        slots_[i].detached.store(false, std::memory_order_release);
+      }
+      if (slots_[i].thread.joinable()) {
+        slots_[i].thread.join();
       }
+      return static_cast<int32_t>(i);
     }
     return -1;
   }
@@ -271,12 +768,17 @@ class TelnetServer {
   // -----------------------------------------------------------------------
   // Member data
   // -----------------------------------------------------------------------
-  int32_t listen_fd_ = -1;
+  Listener listeners_[kMaxListeners];
+  uint32_t listener_count_ = 0;
+  int32_t wake_fd_[2] = {-1, -1};
   std::atomic<bool> running_{false};
   std::thread accept_thread_;
-  CommandRegistry* registry_;
   ServerConfig config_;
   SessionSlot slots_[kMaxSessions];
+  uint32_t next_session_id_ = 1;  ///< Only touched by the accepting thread
+  std::mutex detach_mutex_;       ///< Serializes slot reuse against attach
+  std::atomic<uint64_t> accepted_{0};
+  std::atomic<uint64_t> rejected_{0};
 
   static inline TelnetServer* g_instance_ = nullptr;
 };
@@ -287,7 +789,7 @@ class TelnetServer {
 
 /// Printf to all connected telnet sessions.
 inline void tel_printf(const char* fmt, ...) {
-  if (TelnetServer::Printf == nullptr || fmt == nullptr) {
+  if (fmt == nullptr) {
     return;
   }
   char buf[512];
@@ -296,7 +798,7 @@ inline void tel_printf(const char* fmt, ...) {
   int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
   va_end(ap);
   if (n > 0) {
-    TelnetServer::Printf("%s", buf);
+    TelnetServer::Publish(buf, (static_cast<uint32_t>(n) < sizeof(buf)) ? static_cast<uint32_t>(n) : sizeof(buf) - 1);
   }
 }
 
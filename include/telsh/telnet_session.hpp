@@ -4,25 +4,65 @@
 //
 // Design:
 //   - Per-session IAC state machine (no global state)
-//   - Per-session authentication (optional username/password)
+//   - Per-session authentication (optional username/password or account
+//     table) yielding the session's role mask
 //   - Command history ring buffer (fixed capacity, up/down arrow)
 //   - Telnet protocol: IAC negotiation, echo suppression, SGA
 //   - Arrow key ESC sequence handling
 //   - Ctrl+S/Ctrl+Q flow control
+//   - TRANSMIT-BINARY (RFC 856) negotiated on demand by commands, with bulk
+//     IAC doubling on send (sendmsg over the caller's buffer) and in-place
+//     IAC unescaping on receive
+//   - SocketPolicy: optional TCP_CORK around each command's response and
+//     TCP_QUICKACK re-armed after every read
+//   - Optional MCCP2 output compression (TELSH_ENABLE_MCCP): offered at
+//     connect, flushed after each input batch (i.e. at the prompt)
+//   - Blocking Run() loop or non-blocking OnReadable() step (polled mode);
+//     on a non-blocking socket output the kernel will not take is kept in a
+//     bounded queue (HasPendingOutput / FlushPending) and a client that
+//     lets it overflow is dropped
+//   - Latency histograms (per session and global): input arrival to echo,
+//     and to command output + prompt, stamped when the batch is flushed;
+//     TIMING-MARK (RFC 860) answered in stream order so clients can measure
+//     network RTT, and optionally probed by the server with the prompt
+//   - Detachable: on disconnect an authorized session can persist with a
+//     bounded output backlog ring and be resumed with "attach <id>"
+//   - Single writer: only the session thread writes to the socket; other
+//     threads Post() complete records to a queue and wake it via eventfd.
+//     Queued output is written between input batches on its own line, then
+//     the prompt and partially typed input are redrawn
+//   - Per-session scratch arena handed to commands via ExecContext
+//   - Socket calls go through a compile-time Transport policy
+//     (transport.hpp): TelnetSession uses kernel sockets, while
+//     BasicTelnetSession<MemoryTransport> runs in-process for tests/benches
 //   - Zero heap allocation
 
 #pragma once
 
 #include "osp/log.hpp"
+#include "osp/platform.hpp"
 #include "telsh/command_registry.hpp"
+#include "telsh/latency.hpp"
+#include "telsh/mccp.hpp"
+#include "telsh/transport.hpp"
 
+#include <cerrno>
 #include <cstdarg>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 
 #include <atomic>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <type_traits>
 #include <unistd.h>
 
 namespace telsh {
@@ -40,41 +80,135 @@ constexpr uint8_t kDO = 253;
 constexpr uint8_t kDONT = 254;
 constexpr uint8_t kIAC = 255;
 
+constexpr uint8_t kOptBinary = 0;
 constexpr uint8_t kOptEcho = 1;
 constexpr uint8_t kOptSGA = 3;
+constexpr uint8_t kOptTimingMark = 6;
 constexpr uint8_t kOptNAWS = 31;
 constexpr uint8_t kOptLFLOW = 33;
+constexpr uint8_t kOptCompress2 = 86;
 }  // namespace tel
 
+// ---------------------------------------------------------------------------
+// SocketPolicy
+// ---------------------------------------------------------------------------
+
+/// TCP tuning for accepted connections.  The server applies the socket
+/// options at accept; the session handles cork and quickack per exchange.
+/// Options that do not apply (e.g. on a UNIX socket) are ignored.
+struct SocketPolicy {
+  bool nodelay = true;          ///< TCP_NODELAY: echoes and prompts never wait behind Nagle
+  bool cork_responses = false;  ///< TCP_CORK from command start until the prompt is written
+  bool quickack = false;        ///< Re-arm TCP_QUICKACK after every read
+  uint32_t notsent_lowat = 0;   ///< TCP_NOTSENT_LOWAT bytes (0 = kernel default)
+  uint32_t sndbuf = 0;          ///< SO_SNDBUF bytes (0 = kernel default)
+  uint32_t rcvbuf = 0;          ///< SO_RCVBUF bytes (0 = kernel default)
+
+  /// Kernel defaults (Nagle on, no tuning).
+  static SocketPolicy KernelDefault() {
+    SocketPolicy p;
+    p.nodelay = false;
+    return p;
+  }
+
+  /// Lowest keystroke latency: no Nagle, immediate ACKs, small unsent queue.
+  static SocketPolicy Interactive() {
+    SocketPolicy p;
+    p.quickack = true;
+    p.notsent_lowat = 16U * 1024U;
+    return p;
+  }
+
+  /// Large dumps: full-sized segments per response, bigger send buffer.
+  static SocketPolicy Bulk() {
+    SocketPolicy p;
+    p.cork_responses = true;
+    p.sndbuf = 256U * 1024U;
+    return p;
+  }
+};
+
+/// Apply the socket options of @p policy to a connected socket.
+inline void ApplySocketPolicy(int32_t fd, const SocketPolicy& policy) {
+  int32_t on = policy.nodelay ? 1 : 0;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  if (policy.notsent_lowat > 0) {
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &policy.notsent_lowat, sizeof(policy.notsent_lowat));
+  }
+  if (policy.sndbuf > 0) {
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &policy.sndbuf, sizeof(policy.sndbuf));
+  }
+  if (policy.rcvbuf > 0) {
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &policy.rcvbuf, sizeof(policy.rcvbuf));
+  }
+}
+
 // ---------------------------------------------------------------------------
 // SessionConfig
 // ---------------------------------------------------------------------------
 
+/// "attach [id]" handler supplied by the owner (TelnetServer).  @p id < 0
+/// asks for a listing of attachable sessions.  @return true on success.
+using AttachFn = bool (*)(TelnetSession& self, int32_t id, void* ctx);
+
+/// One login with its role mask (see CmdEntry::roles).
+struct UserAccount {
+  const char* username;
+  const char* password;
+  uint32_t roles;
+};
+
 struct SessionConfig {
   const char* username = nullptr;  ///< nullptr = no auth required
   const char* password = nullptr;
+  uint32_t roles = kRoleAll;           ///< Roles of username/password, or of everyone without auth
+  const UserAccount* users = nullptr;  ///< Optional account table (static storage)
+  uint32_t user_count = 0;
   const char* prompt = "telsh> ";
   const char* banner =
       "*===========================================================*\r\n"
       "  telsh v1.0 -- Embedded Debug Shell\r\n"
       "*===========================================================*\r\n";
+  bool blocking_commands = true;  ///< Commands may block (false when a host loop drives I/O)
+  bool compress = true;           ///< Offer MCCP2 (only with TELSH_ENABLE_MCCP)
+  SocketPolicy socket_policy;     ///< Cork/quickack behaviour (options applied by the server)
+  uint32_t rtt_probe_ms = 0;      ///< Probe RTT (IAC DO TIMING-MARK) with the prompt at most this often, 0 = off
+  uint32_t detach_grace_ms = 0;   ///< 0 = close on disconnect, else keep detached (needs a login)
+  uint32_t session_id = 0;        ///< Set by the owner, shown at login when detachable
+  AttachFn attach_fn = nullptr;
+  void* attach_ctx = nullptr;
 };
 
 // ---------------------------------------------------------------------------
-// TelnetSession
+// BasicTelnetSession (TelnetSession = BasicTelnetSession<PosixTransport>)
 // ---------------------------------------------------------------------------
 
-class TelnetSession {
+/// Session over @p Transport.  Only TelnetSession is handed to commands as
+/// ExecContext::session and offers "attach"; other transports run the same
+/// state machine with ExecContext::session == nullptr and sock_fd == -1.
+template <typename Transport>
+class BasicTelnetSession {
  public:
   static constexpr uint32_t kMaxCmdLen = 256;
   static constexpr uint32_t kHistorySize = 16;
-
-  TelnetSession() = default;
-  ~TelnetSession() { Close(); }
+  static constexpr uint32_t kRecvChunk = 64;
+  static constexpr uint32_t kScratchSize = 4096;
+  static constexpr uint32_t kBacklogSize = 4096;
+  static constexpr uint32_t kPostQueueSize = 4096;
+  static constexpr uint32_t kTxQueueSize = 16384;
+  static constexpr uint64_t kRttProbeTimeoutUs = 10U * 1000U * 1000U;  ///< Unanswered probe is dropped after this
+
+  BasicTelnetSession() = default;
+  ~BasicTelnetSession() {
+    Close();
+    if (wake_fd_ >= 0) {
+      ::close(wake_fd_);
+    }
+  }
 
   // Non-copyable
-  TelnetSession(const TelnetSession&) = delete;
-  TelnetSession& operator=(const TelnetSession&) = delete;
+  BasicTelnetSession(const BasicTelnetSession&) = delete;
+  BasicTelnetSession& operator=(const BasicTelnetSession&) = delete;
 
   /// Initialize session.  Called by TelnetServer before Run().
   void Init(int32_t fd, CommandRegistry& registry, const SessionConfig& cfg) {
@@ -86,6 +220,7 @@ class TelnetSession {
     // Reset all state
     cmd_len_ = 0;
     std::memset(cmd_buf_, 0, sizeof(cmd_buf_));
+    typeahead_len_ = 0;
     std::memset(user_buf_, 0, sizeof(user_buf_));
     std::memset(history_, 0, sizeof(history_));
     history_count_ = 0;
@@ -93,14 +228,59 @@ class TelnetSession {
     history_nav_ = -1;
     output_paused_ = false;
     iac_ = {};
+    term_width_ = 0;
+    term_height_ = 0;
     arrow_ = ArrowPhase::kNone;
+    scratch_.Init(scratch_buf_, kScratchSize);
+    binary_tx_ = false;
+    binary_rx_ = false;
+    binary_want_ = false;
+    binary_wait_ = 0;
+    defer_flush_.store(false, std::memory_order_relaxed);
+    corked_ = false;
+    tx_len_ = 0;
+    latency_.Reset();
+    input_us_ = 0;
+    batch_echoed_ = false;
+    batch_executed_ = false;
+    tm_sent_us_ = 0;
+    tm_last_us_ = 0;
+    if (wake_fd_ < 0) {
+      wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    {
+      std::lock_guard<std::mutex> lock(post_mutex_);
+      post_len_ = 0;
+      post_dropped_ = 0;
+    }
+#if defined(TELSH_ENABLE_MCCP) && TELSH_ENABLE_MCCP
+    {
+      std::lock_guard<std::mutex> lock(tx_mutex_);
+      mccp_.End(nullptr, nullptr);
+    }
+#endif
+    detached_.store(false, std::memory_order_release);
+    detached_at_ms_ = 0;
+    {
+      std::lock_guard<std::mutex> lock(backlog_mutex_);
+      backlog_head_ = 0;
+      backlog_len_ = 0;
+    }
 
-    auth_ = (config_.username != nullptr && config_.password != nullptr) ? Auth::kNeedUser : Auth::kAuthorized;
+    const bool need_auth =
+        (config_.username != nullptr && config_.password != nullptr) || (config_.users != nullptr && config_.user_count > 0);
+    auth_ = need_auth ? Auth::kNeedUser : Auth::kAuthorized;
+    roles_ = need_auth ? 0 : config_.roles;
+    if (!need_auth) {
+      // Without a login every user is "": anyone could attach anyone's session
+      config_.detach_grace_ms = 0;
+      config_.attach_fn = nullptr;
+    }
   }
 
-  /// Main session loop (blocking).  Returns when client disconnects or
-  /// Stop() is called.
-  void Run() {
+  /// Send telnet negotiations, banner and the first prompt.  Run() calls
+  /// this itself; in polled mode the server calls it right after Init().
+  void Begin() {
     if (sock_fd_ < 0 || registry_ == nullptr) {
       return;
     }
@@ -110,6 +290,11 @@ class TelnetSession {
     SendIac(tel::kDO, tel::kOptNAWS);
     SendIac(tel::kWILL, tel::kOptEcho);
     SendIac(tel::kWILL, tel::kOptSGA);
+#if defined(TELSH_ENABLE_MCCP) && TELSH_ENABLE_MCCP
+    if (config_.compress) {
+      SendIac(tel::kWILL, tel::kOptCompress2);
+    }
+#endif
 
     // Welcome banner
     if (config_.banner != nullptr) {
@@ -118,52 +303,277 @@ class TelnetSession {
 
     // Initial prompt
     ShowPrompt();
+  }
 
-    // Read loop -- one byte at a time (telnet character mode)
-    uint8_t byte = 0;
+  /// Main session loop (blocking).  Returns when client disconnects or
+  /// Stop() is called.
+  void Run() {
+    if (sock_fd_ < 0 || registry_ == nullptr) {
+      return;
+    }
+
+    Begin();
+
+    uint8_t buf[kRecvChunk];
+    struct pollfd pfds[2] = {{sock_fd_, POLLIN, 0}, {wake_fd_, POLLIN, 0}};
+    const nfds_t nfds = (wake_fd_ >= 0) ? 2 : 1;
     while (running_.load(std::memory_order_acquire)) {
-      ssize_t n = ::recv(sock_fd_, &byte, 1, 0);
-      if (n <= 0) {
+      if (transport_.Poll(pfds, nfds, -1) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
         break;
       }
+      if (pfds[0].revents != 0) {
+        ssize_t n = transport_.Recv(sock_fd_, buf, sizeof(buf), 0);
+        if (n <= 0) {
+          break;
+        }
+        ProcessInput(buf, static_cast<uint32_t>(n));
+      }
+      if (nfds == 2 && pfds[1].revents != 0) {
+        DrainPosted();
+      }
+    }
 
-      char c = FilterIac(byte);
-      if (c == '\0') {
+    Disconnected();
+  }
+
+  /// Non-blocking read step for polled mode: consume whatever is pending on
+  /// the socket.  Does not close the socket; call Disconnected() on false.
+  /// @return false when the peer closed, a read error occurred or the
+  ///         session was stopped (e.g. by "exit").
+  bool OnReadable() {
+    if (sock_fd_ < 0 || !running_.load(std::memory_order_acquire) || !FlushPending()) {
+      return false;
+    }
+
+    uint8_t buf[kRecvChunk];
+    ssize_t n = transport_.Recv(sock_fd_, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n == 0) {
+      return false;
+    }
+    if (n < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    ProcessInput(buf, static_cast<uint32_t>(n));
+    DrainPosted();
+    return running_.load(std::memory_order_acquire);
+  }
+
+  /// Output queued because the (non-blocking) socket was full; polled-mode
+  /// owners add POLLOUT for Fd() while this is true.
+  bool HasPendingOutput() const { return tx_len_ > 0; }
+
+  /// Write queued output as far as the socket takes it.  OnReadable() does
+  /// this first, so owners may route POLLOUT readiness there.
+  /// @return false if the connection failed.
+  bool FlushPending() {
+    uint32_t off = 0;
+    while (off < tx_len_) {
+      ssize_t n = transport_.Send(sock_fd_, tx_queue_ + off, tx_len_ - off);
+      if (n < 0 && errno == EINTR) {
         continue;
       }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+      if (n <= 0) {
+        tx_len_ = 0;
+        return false;
+      }
+      off += static_cast<uint32_t>(n);
+    }
+    std::memmove(tx_queue_, tx_queue_ + off, tx_len_ - off);
+    tx_len_ -= off;
+    return true;
+  }
 
-      ProcessChar(c);
+  /// Readable when Post() queued output; polled-mode owners watch it and
+  /// call DrainPosted().
+  int32_t WakeFd() const { return wake_fd_; }
+
+  /// Queue a complete record (e.g. a broadcast line) from any thread.  The
+  /// session thread writes it whole between input batches; a record that
+  /// does not end in a newline gets one.  Inside a command on this
+  /// session's own thread, and for detached sessions, it is sent directly.
+  /// @return false if the queue is full (the record is dropped and counted).
+  bool Post(const char* data, uint32_t len) {
+    if (data == nullptr || len == 0) {
+      return true;
+    }
+    ExecContext* ec = CurrentExec();
+    if ((ec != nullptr && static_cast<const void*>(ec->session) == this) || IsDetached()) {
+      Send(data, len);
+      return true;
+    }
+    const bool add_newline = (data[len - 1] != '\n');
+    const uint32_t need = len + (add_newline ? 2U : 0U);
+    {
+      std::lock_guard<std::mutex> lock(post_mutex_);
+      if (need > kPostQueueSize - post_len_) {
+        ++post_dropped_;
+        PostDroppedCounter().fetch_add(1, std::memory_order_relaxed);
+        return false;
+      }
+      std::memcpy(post_buf_ + post_len_, data, len);
+      if (add_newline) {
+        std::memcpy(post_buf_ + post_len_ + len, "\r\n", 2);
+      }
+      post_len_ += need;
     }
+    if (wake_fd_ >= 0) {
+      const uint64_t one = 1;
+      (void)::write(wake_fd_, &one, sizeof(one));
+    }
+    return true;
+  }
 
+  /// Records dropped by Post() in all sessions since process start.
+  static uint64_t PostDroppedTotal() { return PostDroppedCounter().load(std::memory_order_relaxed); }
+
+  /// Write output queued by Post().  Session thread only (Run() and
+  /// OnReadable() call it).  Clears the input line, writes the records and
+  /// redraws the prompt with the partially typed input.
+  void DrainPosted() {
+    if (wake_fd_ >= 0) {
+      uint64_t count = 0;  // reset before taking the queue: no lost wakeups
+      (void)::read(wake_fd_, &count, sizeof(count));
+    }
+    char out[kPostQueueSize];
+    uint32_t len = 0;
+    uint32_t dropped = 0;
+    {
+      std::lock_guard<std::mutex> lock(post_mutex_);
+      len = post_len_;
+      dropped = post_dropped_;
+      std::memcpy(out, post_buf_, len);
+      post_len_ = 0;
+      post_dropped_ = 0;
+    }
+    if ((len == 0 && dropped == 0) || sock_fd_ < 0) {
+      return;
+    }
+    defer_flush_.store(true, std::memory_order_relaxed);
+    WriteRaw("\r\x1b[K", 4);  // erase the prompt line
+    Send(out, len);
+    if (dropped > 0) {
+      Printf("[%u messages dropped]\r\n", dropped);
+    }
+    SendStr(PromptText());
+    if (auth_ == Auth::kNeedPass) {
+      for (uint32_t i = 0; i < cmd_len_; ++i) {
+        Send("*", 1);
+      }
+    } else {
+      Send(cmd_buf_, cmd_len_);
+    }
+    defer_flush_.store(false, std::memory_order_relaxed);
+    FlushOutput();
+  }
+
+  /// The connection is gone (peer closed, read error or Stop()).  Detaches
+  /// if the peer vanished from an authorized, detachable session; otherwise
+  /// closes the socket.
+  void Disconnected() {
+    const bool lost = running_.load(std::memory_order_acquire);
     Close();
+    if (lost && config_.detach_grace_ms > 0 && auth_ == Auth::kAuthorized) {
+      detached_at_ms_ = osp::SteadyNowUs() / 1000;
+      detached_.store(true, std::memory_order_release);
+    }
+  }
+
+  int32_t Fd() const { return sock_fd_; }
+  Transport& GetTransport() { return transport_; }  ///< E.g. the MemoryTransport peer side
+  bool IsRunning() const { return running_.load(std::memory_order_acquire); }
+  uint32_t Id() const { return config_.session_id; }
+
+  /// Detached sessions keep history and backlog; output sent to them is
+  /// only recorded.
+  bool IsDetached() const { return detached_.load(std::memory_order_acquire); }
+  uint64_t DetachedAtMs() const { return detached_at_ms_; }
+  bool DetachExpired(uint64_t now_ms) const {
+    return IsDetached() && now_ms - detached_at_ms_ >= config_.detach_grace_ms;
+  }
+
+  /// Logged-in user ("" without authentication).
+  const char* User() const { return user_buf_; }
+
+  /// Client window size reported with NAWS, 0 until the client sends it.
+  /// Session thread (e.g. a running command).
+  uint16_t TermWidth() const { return term_width_; }
+  uint16_t TermHeight() const { return term_height_; }
+
+  /// Whether commands may wait on the client (ExecContext::may_block).  A
+  /// driver that multiplexes sessions on one thread must turn it off.
+  void SetBlockingCommands(bool on) { config_.blocking_commands = on; }
+
+  /// Echo / command / RTT histograms of this session (global totals are in
+  /// SessionLatency::Global()).
+  const SessionLatency& Latency() const { return latency_; }
+  void ResetLatency() { latency_.Reset(); }
+
+  /// Send IAC DO TIMING-MARK; the client's answer is recorded as an RTT
+  /// sample.  No-op while a probe is outstanding.  Session thread only.
+  void ProbeRtt() {
+    const uint64_t now = osp::SteadyNowUs();
+    if (tm_sent_us_ != 0 && now - tm_sent_us_ < kRttProbeTimeoutUs) {
+      return;
+    }
+    SendIac(tel::kDO, tel::kOptTimingMark);
+    tm_sent_us_ = now;
+    tm_last_us_ = now;
+  }
+
+  /// Take over @p other's history (attach) and copy its backlog into
+  /// @p replay (kBacklogSize bytes).  Only memory is touched, so callers
+  /// can hold locks; send the replay after releasing them.  @p other must
+  /// be detached.  @return backlog bytes copied.
+  uint32_t AdoptFrom(BasicTelnetSession& other, char* replay) {
+    std::memcpy(history_, other.history_, sizeof(history_));
+    history_count_ = other.history_count_;
+    history_write_ = other.history_write_;
+    history_nav_ = -1;
+    return other.CopyBacklog(replay);
   }
 
   /// Signal session to stop (called from another thread).
   void Stop() {
     running_.store(false, std::memory_order_release);
-    // Shutdown socket to unblock recv()
+    // Shutdown socket to unblock recv().  The session thread may be closing
+    // it right now; never touch a descriptor number it already released.
+    std::lock_guard<std::mutex> lock(fd_mutex_);
     if (sock_fd_ >= 0) {
-      ::shutdown(sock_fd_, SHUT_RDWR);
+      transport_.Shutdown(sock_fd_);
     }
   }
 
   /// Close the socket.
   void Close() {
+#if defined(TELSH_ENABLE_MCCP) && TELSH_ENABLE_MCCP
+    {
+      std::lock_guard<std::mutex> lock(tx_mutex_);
+      mccp_.End(nullptr, nullptr);
+    }
+#endif
+    std::lock_guard<std::mutex> lock(fd_mutex_);
     if (sock_fd_ >= 0) {
-      ::close(sock_fd_);
+      transport_.Close(sock_fd_);
       sock_fd_ = -1;
     }
   }
 
-  /// Send raw bytes (used by TelnetServer::Broadcast).
+  /// Send raw bytes (used by TelnetServer::Broadcast).  Output of an
+  /// authorized detachable session is also kept in the backlog ring.
   void Send(const char* data, uint32_t len) {
-    if (data == nullptr || len == 0 || sock_fd_ < 0) {
+    if (data == nullptr || len == 0) {
       return;
     }
-    if (output_paused_) {
-      return;
+    if (config_.detach_grace_ms > 0 && auth_ == Auth::kAuthorized) {
+      RecordBacklog(data, len);
     }
-    ::send(sock_fd_, data, len, MSG_NOSIGNAL);
+    WriteRaw(data, len);
   }
 
   /// Send null-terminated string.
@@ -173,9 +583,177 @@ class TelnetSession {
     }
   }
 
+  /// True while MCCP2 compression is on.
+  bool IsCompressing() {
+#if defined(TELSH_ENABLE_MCCP) && TELSH_ENABLE_MCCP
+    std::lock_guard<std::mutex> lock(tx_mutex_);
+    return mccp_.Active();
+#else
+    return false;
+#endif
+  }
+
+  /// Make compressed output sent so far decodable by the client.  Commands
+  /// that wait on the client or trickle output should call it; otherwise
+  /// it happens after each input batch.  No-op without compression.
+  void FlushOutput() {
+#if defined(TELSH_ENABLE_MCCP) && TELSH_ENABLE_MCCP
+    {
+      std::lock_guard<std::mutex> lock(tx_mutex_);
+      if (mccp_.Active() && sock_fd_ >= 0) {
+        (void)mccp_.Flush(CompressedSink, this);
+      }
+    }
+#endif
+    if (corked_) {
+      SetCork(false);  // pushes out the pending partial segment
+      SetCork(true);
+    }
+  }
+
+  // -----------------------------------------------------------------------
+  // Binary transfers (RFC 856) -- session thread only, i.e. from a command
+  // -----------------------------------------------------------------------
+
+  /// Receives chunks of unescaped binary input; return false to abort.
+  using BinarySink = bool (*)(const uint8_t* data, uint32_t len, void* ctx);
+
+  /// Negotiate TRANSMIT-BINARY in both directions (@p on) or back to NVT.
+  /// Reads the socket until the client answers or @p timeout_ms elapses;
+  /// data bytes typed meanwhile are discarded.  Refused without blocking
+  /// commands, as the wait would stall the host loop.
+  /// @return true if the requested mode is in effect both ways.
+  bool SetBinary(bool on, uint32_t timeout_ms = 2000) {
+    if (sock_fd_ < 0 || !config_.blocking_commands) {
+      return false;
+    }
+    binary_want_ = on;
+    binary_wait_ = 0;
+    if (binary_tx_ != on) {
+      SendIac(on ? tel::kWILL : tel::kWONT, tel::kOptBinary);
+      binary_wait_ |= kWaitTx;
+    }
+    if (binary_rx_ != on) {
+      SendIac(on ? tel::kDO : tel::kDONT, tel::kOptBinary);
+      binary_wait_ |= kWaitRx;
+    }
+    FlushOutput();
+
+    const uint64_t deadline_ms = osp::SteadyNowUs() / 1000 + timeout_ms;
+    while (binary_wait_ != 0) {
+      const uint64_t now_ms = osp::SteadyNowUs() / 1000;
+      if (now_ms >= deadline_ms || !WaitReadable(static_cast<int32_t>(deadline_ms - now_ms))) {
+        break;
+      }
+      // One byte at a time so nothing after the replies is consumed
+      uint8_t byte;
+      if (transport_.Recv(sock_fd_, &byte, 1, 0) <= 0) {
+        break;
+      }
+      (void)FilterIac(byte);
+    }
+    binary_wait_ = 0;
+    return binary_tx_ == on && binary_rx_ == on;
+  }
+
+  bool IsBinary() const { return binary_tx_ && binary_rx_; }
+
+  /// Send @p len bytes with IAC doubling.  Runs between 0xFF bytes go out
+  /// straight from @p data (sendmsg), so nothing is copied.
+  bool SendBinary(const void* data, uint32_t len) {
+    static const uint8_t kIacByte = tel::kIAC;
+    constexpr uint32_t kMaxIov = 64;
+    struct iovec iov[kMaxIov];
+    uint32_t cnt = 0;
+    const auto* p = static_cast<const uint8_t*>(data);
+    const uint8_t* end = p + len;
+    while (p < end) {
+      const auto* ff = static_cast<const uint8_t*>(std::memchr(p, tel::kIAC, static_cast<size_t>(end - p)));
+      const uint8_t* run_end = (ff != nullptr) ? ff + 1 : end;
+      iov[cnt++] = {const_cast<uint8_t*>(p), static_cast<size_t>(run_end - p)};
+      if (ff != nullptr) {
+        iov[cnt++] = {const_cast<uint8_t*>(&kIacByte), 1};
+      }
+      p = run_end;
+      if (cnt >= kMaxIov - 1 || p >= end) {
+        if (IsCompressing()) {
+          for (uint32_t i = 0; i < cnt; ++i) {
+            WriteRaw(static_cast<const char*>(iov[i].iov_base), static_cast<uint32_t>(iov[i].iov_len));
+          }
+        } else if (!SendVec(iov, cnt)) {
+          return false;
+        }
+        cnt = 0;
+      }
+    }
+    return true;
+  }
+
+  /// Receive exactly @p len unescaped payload bytes and hand them to
+  /// @p sink in chunks.  Never reads past the end of the payload.
+  /// @return bytes delivered; less than @p len on idle timeout,
+  ///         disconnect or sink abort (0 without blocking commands).
+  uint64_t ReceiveBinary(uint64_t len, BinarySink sink, void* ctx, uint32_t idle_timeout_ms = 5000) {
+    uint8_t buf[kBinaryChunk];
+    uint64_t got = 0;
+    if (!config_.blocking_commands) {
+      return 0;
+    }
+    FlushOutput();
+    while (got < len && sock_fd_ >= 0) {
+      if (!WaitReadable(static_cast<int32_t>(idle_timeout_ms))) {
+        break;
+      }
+      // Escaped data is never shorter than the payload, so asking for at
+      // most the remaining payload cannot swallow the next command line.
+      const uint64_t want = (len - got < kBinaryChunk) ? len - got : kBinaryChunk;
+      ssize_t n = transport_.Recv(sock_fd_, buf, static_cast<size_t>(want), 0);
+      if (n <= 0) {
+        break;
+      }
+      uint32_t w = UnescapeInPlace(buf, static_cast<uint32_t>(n));
+      if (w > 0 && sink != nullptr && !sink(buf, w, ctx)) {
+        break;
+      }
+      got += w;
+    }
+    return got;
+  }
+
+  /// For a command that runs until the client stops it (tail -f): consume
+  /// the input that is ready without blocking.  Telnet commands in it take
+  /// effect (negotiation, NAWS); Ctrl-C or 'q' asks to stop; other keys are
+  /// kept and processed as input once the command has returned.
+  /// @return true on Ctrl-C / 'q', disconnect or socket error.
+  bool TakeInterrupt() {
+    uint8_t buf[kRecvChunk];
+    bool stop = false;
+    while (!stop) {
+      ssize_t n = transport_.Recv(sock_fd_, buf, sizeof(buf), MSG_DONTWAIT);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+      if (n <= 0) {
+        return true;
+      }
+      for (ssize_t i = 0; i < n; ++i) {
+        const char c = FilterIac(buf[i]);
+        if (!stop && (c == 3 || c == 'q')) {
+          stop = true;  // the stop key itself is used up
+        } else if (c != '\0' && typeahead_len_ < sizeof(typeahead_)) {
+          typeahead_[typeahead_len_++] = c;
+        }
+      }
+    }
+    return stop;
+  }
+
   /// Printf to this session.
   void Printf(const char* fmt, ...) {
-    if (fmt == nullptr || sock_fd_ < 0) {
+    if (fmt == nullptr) {
       return;
     }
     char buf[512];
@@ -189,14 +767,27 @@ class TelnetSession {
   }
 
  private:
+  static std::atomic<uint64_t>& PostDroppedCounter() {
+    static std::atomic<uint64_t> dropped{0};
+    return dropped;
+  }
+
   // --- IAC state machine (per-session) ---
   enum class IacPhase : uint8_t { kNormal, kIac, kNego, kSub };
 
   struct IacState {
     IacPhase phase = IacPhase::kNormal;
     uint8_t prev_byte = 0;
+    uint8_t verb = 0;    // WILL/WONT/DO/DONT being negotiated
+    uint8_t sb[8] = {};  // Subnegotiation option + data (IAC IAC unescaped), truncated
+    uint8_t sb_len = 0;
   };
 
+  // --- Binary negotiation replies still expected ---
+  static constexpr uint8_t kWaitTx = 1;  // DO/DONT for our WILL/WONT
+  static constexpr uint8_t kWaitRx = 2;  // WILL/WONT for our DO/DONT
+  static constexpr uint32_t kBinaryChunk = 4096;
+
   // --- Authentication ---
   enum class Auth : uint8_t { kNeedUser, kNeedPass, kAuthorized };
 
@@ -222,11 +813,13 @@ class TelnetSession {
         }
         if (byte >= tel::kWILL && byte <= tel::kDONT) {
           iac_.phase = IacPhase::kNego;
+          iac_.verb = byte;
           return '\0';
         }
         if (byte == tel::kSB) {
           iac_.phase = IacPhase::kSub;
           iac_.prev_byte = 0;
+          iac_.sb_len = 0;
           return '\0';
         }
         iac_.phase = IacPhase::kNormal;
@@ -234,13 +827,25 @@ class TelnetSession {
 
       case IacPhase::kNego:
         iac_.phase = IacPhase::kNormal;
+        OnNegotiation(iac_.verb, byte);
         return '\0';
 
       case IacPhase::kSub:
-        if (iac_.prev_byte == tel::kIAC && byte == tel::kSE) {
-          iac_.phase = IacPhase::kNormal;
+        if (iac_.prev_byte == tel::kIAC) {
+          iac_.prev_byte = 0;
+          if (byte == tel::kSE) {
+            iac_.phase = IacPhase::kNormal;
+            OnSubnegotiation();
+            return '\0';
+          }
+          // IAC IAC: data byte 0xFF
+        } else if (byte == tel::kIAC) {
+          iac_.prev_byte = byte;
+          return '\0';
+        }
+        if (iac_.sb_len < sizeof(iac_.sb)) {
+          iac_.sb[iac_.sb_len++] = byte;
         }
-        iac_.prev_byte = byte;
         return '\0';
 
       default:
@@ -249,28 +854,332 @@ class TelnetSession {
     }
   }
 
+  /// Completed IAC SB ... IAC SE.  Only NAWS (window size) is used.
+  void OnSubnegotiation() {
+    if (iac_.sb_len >= 5 && iac_.sb[0] == tel::kOptNAWS) {
+      term_width_ = static_cast<uint16_t>((iac_.sb[1] << 8) | iac_.sb[2]);
+      term_height_ = static_cast<uint16_t>((iac_.sb[3] << 8) | iac_.sb[4]);
+    }
+  }
+
+  /// Option replies.  Only BINARY is tracked; it is enabled on demand
+  /// only, so unsolicited requests to turn it on are refused.
+  void OnNegotiation(uint8_t verb, uint8_t opt) {
+    if (opt == tel::kOptTimingMark) {
+      OnTimingMark(verb);
+      return;
+    }
+#if defined(TELSH_ENABLE_MCCP) && TELSH_ENABLE_MCCP
+    if (opt == tel::kOptCompress2 && config_.compress) {
+      if (verb == tel::kDO) {
+        StartCompression();
+      } else if (verb == tel::kDONT) {
+        std::lock_guard<std::mutex> lock(tx_mutex_);
+        mccp_.End(CompressedSink, this);
+      }
+      return;
+    }
+#endif
+    if (opt != tel::kOptBinary) {
+      return;
+    }
+    const bool on = (verb == tel::kDO || verb == tel::kWILL);
+    const bool tx = (verb == tel::kDO || verb == tel::kDONT);
+    bool& state = tx ? binary_tx_ : binary_rx_;
+    const uint8_t wait = tx ? kWaitTx : kWaitRx;
+    if ((binary_wait_ & wait) != 0) {
+      binary_wait_ = static_cast<uint8_t>(binary_wait_ & ~wait);
+      state = on && binary_want_;
+    } else if (on != state) {
+      state = false;
+      SendIac(tx ? tel::kWONT : tel::kDONT, tel::kOptBinary);
+    }
+  }
+
+  /// TIMING-MARK: a DO is answered right away, i.e. after the output of all
+  /// input that preceded it; a WILL/WONT answers our probe.
+  void OnTimingMark(uint8_t verb) {
+    if (verb == tel::kDO) {
+      SendIac(tel::kWILL, tel::kOptTimingMark);
+    } else if (verb == tel::kWILL || verb == tel::kWONT) {
+      if (tm_sent_us_ != 0) {
+        const uint64_t rtt = osp::SteadyNowUs() - tm_sent_us_;
+        latency_.rtt.Record(rtt);
+        SessionLatency::Global().rtt.Record(rtt);
+        tm_sent_us_ = 0;
+      } else if (verb == tel::kWILL) {
+        SendIac(tel::kDONT, tel::kOptTimingMark);
+      }
+    }
+  }
+
+  /// Strip telnet commands from a received binary block, keeping escaped
+  /// 0xFF as data.  @return payload bytes now at the start of @p buf.
+  uint32_t UnescapeInPlace(uint8_t* buf, uint32_t n) {
+    uint32_t r = 0;
+    uint32_t w = 0;
+    while (r < n) {
+      if (iac_.phase == IacPhase::kNormal) {
+        const auto* ff = static_cast<const uint8_t*>(std::memchr(buf + r, tel::kIAC, n - r));
+        const uint32_t run_end = (ff != nullptr) ? static_cast<uint32_t>(ff - buf) : n;
+        if (w != r) {
+          std::memmove(buf + w, buf + r, run_end - r);
+        }
+        w += run_end - r;
+        r = run_end;
+        if (r < n) {
+          iac_.phase = IacPhase::kIac;
+          ++r;
+        }
+      } else if (iac_.phase == IacPhase::kIac && buf[r] == tel::kIAC) {
+        buf[w++] = tel::kIAC;
+        iac_.phase = IacPhase::kNormal;
+        ++r;
+      } else {
+        (void)FilterIac(buf[r++]);
+      }
+    }
+    return w;
+  }
+
+  bool WaitReadable(int32_t timeout_ms) {
+    struct pollfd pfd = {sock_fd_, POLLIN, 0};
+    int32_t rc;
+    do {
+      rc = transport_.Poll(&pfd, 1, timeout_ms);
+    } while (rc < 0 && errno == EINTR);
+    return rc > 0;
+  }
+
+  bool SendVec(struct iovec* iov, uint32_t cnt) {
+    while (cnt > 0) {
+      if (tx_len_ > 0) {
+        return QueueVec(iov, cnt);  // keep the byte order
+      }
+      struct msghdr msg = {};
+      msg.msg_iov = iov;
+      msg.msg_iovlen = cnt;
+      ssize_t n = transport_.SendMsg(sock_fd_, &msg);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+          return QueueVec(iov, cnt);
+        }
+        return false;
+      }
+      // Skip fully written entries, trim a partially written one
+      size_t left = static_cast<size_t>(n);
+      while (cnt > 0 && left >= iov->iov_len) {
+        left -= iov->iov_len;
+        ++iov;
+        --cnt;
+      }
+      if (cnt > 0) {
+        iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + left;
+        iov->iov_len -= left;
+      }
+    }
+    return true;
+  }
+
+  bool QueueVec(const struct iovec* iov, uint32_t cnt) {
+    for (uint32_t i = 0; i < cnt; ++i) {
+      if (!SendAll(iov[i].iov_base, static_cast<uint32_t>(iov[i].iov_len))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// Send all of @p data.  What a non-blocking socket does not take goes to
+  /// tx_queue_ (after anything already queued); a client that lets the
+  /// queue overflow is not reading and gets dropped.
+  bool SendAll(const void* data, uint32_t len) {
+    const auto* p = static_cast<const char*>(data);
+    while (len > 0 && tx_len_ == 0) {
+      ssize_t n = transport_.Send(sock_fd_, p, len);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        break;
+      }
+      if (n <= 0) {
+        return false;
+      }
+      p += n;
+      len -= static_cast<uint32_t>(n);
+    }
+    if (len == 0) {
+      return true;
+    }
+    if (len > kTxQueueSize - tx_len_) {
+      OSP_LOG_WARN("TELSH", "Session %u: client not reading, %u bytes unsent, dropping", config_.session_id,
+                   tx_len_ + len);
+      tx_len_ = 0;
+      Stop();
+      return false;
+    }
+    std::memcpy(tx_queue_ + tx_len_, p, len);
+    tx_len_ += len;
+    return true;
+  }
+
+  // -----------------------------------------------------------------------
+  // Input dispatch (shared by Run and OnReadable)
+  // -----------------------------------------------------------------------
+  void ProcessInput(const uint8_t* data, uint32_t len) {
+    input_us_ = osp::SteadyNowUs();
+    batch_echoed_ = false;
+    batch_executed_ = false;
+    if (config_.socket_policy.quickack) {
+      // the kernel drops back to delayed ACKs, re-arm per read
+      transport_.SetOption(sock_fd_, IPPROTO_TCP, TCP_QUICKACK, 1);
+    }
+    // Echo and command output of one batch share a compressed flush
+    defer_flush_.store(true, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < len && running_.load(std::memory_order_acquire); ++i) {
+      char c = FilterIac(data[i]);
+      if (c != '\0') {
+        ProcessChar(c);
+      }
+    }
+    // Keys a command set aside (TakeInterrupt) arrived after this batch
+    while (typeahead_len_ > 0 && running_.load(std::memory_order_acquire)) {
+      char keys[sizeof(typeahead_)];
+      const uint32_t count = typeahead_len_;
+      std::memcpy(keys, typeahead_, count);
+      typeahead_len_ = 0;
+      for (uint32_t i = 0; i < count; ++i) {
+        ProcessChar(keys[i]);
+      }
+    }
+    defer_flush_.store(false, std::memory_order_relaxed);
+    if (corked_) {
+      corked_ = false;
+      FlushOutput();
+      SetCork(false);  // response and prompt leave as full segments
+    } else {
+      FlushOutput();
+    }
+    RecordLatency();
+  }
+
+  /// Everything the batch produced has been handed to the kernel.
+  void RecordLatency() {
+    if (!batch_executed_ && !batch_echoed_) {
+      return;
+    }
+    const uint64_t us = osp::SteadyNowUs() - input_us_;
+    LatencyHistogram& mine = batch_executed_ ? latency_.command : latency_.echo;
+    LatencyHistogram& all = batch_executed_ ? SessionLatency::Global().command : SessionLatency::Global().echo;
+    mine.Record(us);
+    all.Record(us);
+  }
+
+  void SetCork(bool on) {
+    transport_.SetOption(sock_fd_, IPPROTO_TCP, TCP_CORK, on ? 1 : 0);
+  }
+
   // -----------------------------------------------------------------------
   // Send IAC command
   // -----------------------------------------------------------------------
   void SendIac(uint8_t cmd, uint8_t opt) {
     uint8_t buf[3] = {tel::kIAC, cmd, opt};
-    Send(reinterpret_cast<const char*>(buf), 3);
+    WriteRaw(reinterpret_cast<const char*>(buf), 3);
+  }
+
+  void WriteRaw(const char* data, uint32_t len) {
+    if (sock_fd_ < 0 || output_paused_) {
+      return;
+    }
+#if defined(TELSH_ENABLE_MCCP) && TELSH_ENABLE_MCCP
+    std::lock_guard<std::mutex> lock(tx_mutex_);
+    if (mccp_.Active()) {
+      const bool defer = defer_flush_.load(std::memory_order_relaxed);
+      (void)mccp_.Write(data, len, defer ? Z_NO_FLUSH : Z_SYNC_FLUSH, CompressedSink, this);
+      return;
+    }
+#endif
+    (void)SendAll(data, len);
+  }
+
+#if defined(TELSH_ENABLE_MCCP) && TELSH_ENABLE_MCCP
+  // -----------------------------------------------------------------------
+  // MCCP2 -- tx_mutex_ serializes use of the deflate stream
+  // -----------------------------------------------------------------------
+  void StartCompression() {
+    std::lock_guard<std::mutex> lock(tx_mutex_);
+    if (mccp_.Active() || sock_fd_ < 0) {
+      return;
+    }
+    if (!mccp_.Start()) {
+      OSP_LOG_WARN("TELSH", "MCCP2 state does not fit the pool, compression refused");
+      const uint8_t wont[3] = {tel::kIAC, tel::kWONT, tel::kOptCompress2};
+      (void)SendAll(wont, sizeof(wont));
+      return;
+    }
+    // Everything after IAC SE is compressed
+    const uint8_t sb[5] = {tel::kIAC, tel::kSB, tel::kOptCompress2, tel::kIAC, tel::kSE};
+    (void)SendAll(sb, sizeof(sb));
+  }
+
+  static bool CompressedSink(const uint8_t* data, uint32_t len, void* ctx) {
+    return static_cast<BasicTelnetSession*>(ctx)->SendAll(data, len);
+  }
+#endif
+
+  // -----------------------------------------------------------------------
+  // Output backlog ring (for reattach)
+  // -----------------------------------------------------------------------
+  void RecordBacklog(const char* data, uint32_t len) {
+    if (len > kBacklogSize) {
+      data += len - kBacklogSize;
+      len = kBacklogSize;
+    }
+    std::lock_guard<std::mutex> lock(backlog_mutex_);
+    uint32_t tail = (backlog_head_ + backlog_len_) % kBacklogSize;
+    uint32_t first = (len < kBacklogSize - tail) ? len : kBacklogSize - tail;
+    std::memcpy(backlog_ + tail, data, first);
+    std::memcpy(backlog_, data + first, len - first);
+    backlog_len_ += len;
+    if (backlog_len_ > kBacklogSize) {
+      backlog_head_ = (backlog_head_ + backlog_len_ - kBacklogSize) % kBacklogSize;
+      backlog_len_ = kBacklogSize;
+    }
+  }
+
+  /// Copy the backlog (oldest first) into @p out (kBacklogSize bytes).
+  uint32_t CopyBacklog(char* out) {
+    std::lock_guard<std::mutex> lock(backlog_mutex_);
+    uint32_t first = (backlog_len_ < kBacklogSize - backlog_head_) ? backlog_len_ : kBacklogSize - backlog_head_;
+    std::memcpy(out, backlog_ + backlog_head_, first);
+    std::memcpy(out + first, backlog_, backlog_len_ - first);
+    return backlog_len_;
   }
 
   // -----------------------------------------------------------------------
   // Prompt
   // -----------------------------------------------------------------------
-  void ShowPrompt() {
+  const char* PromptText() const {
     switch (auth_) {
       case Auth::kNeedUser:
-        SendStr("username: ");
-        break;
+        return "username: ";
       case Auth::kNeedPass:
-        SendStr("password: ");
-        break;
+        return "password: ";
       case Auth::kAuthorized:
-        SendStr(config_.prompt);
-        break;
+      default:
+        return config_.prompt;
+    }
+  }
+
+  void ShowPrompt() {
+    SendStr(PromptText());
+    if (auth_ == Auth::kAuthorized && config_.rtt_probe_ms > 0 &&
+        osp::SteadyNowUs() - tm_last_us_ >= config_.rtt_probe_ms * 1000ULL) {
+      ProbeRtt();
     }
   }
 
@@ -305,6 +1214,7 @@ class TelnetSession {
         cmd_buf_[cmd_len_] = '\0';
         if (auth_ != Auth::kNeedPass) {
           Send("\b \b", 3);
+          batch_echoed_ = true;
         }
       }
       return;
@@ -313,6 +1223,7 @@ class TelnetSession {
     // Enter
     if (c == '\r') {
       Send("\r\n", 2);
+      batch_echoed_ = true;
       cmd_buf_[cmd_len_] = '\0';
 
       if (auth_ != Auth::kAuthorized) {
@@ -343,6 +1254,7 @@ class TelnetSession {
       } else {
         Send(&c, 1);
       }
+      batch_echoed_ = true;
     }
   }
 
@@ -404,9 +1316,12 @@ class TelnetSession {
       user_buf_[sizeof(user_buf_) - 1] = '\0';
       auth_ = Auth::kNeedPass;
     } else if (auth_ == Auth::kNeedPass) {
-      if (std::strcmp(user_buf_, config_.username) == 0 && std::strcmp(cmd_buf_, config_.password) == 0) {
+      if (Authenticate(user_buf_, cmd_buf_)) {
         auth_ = Auth::kAuthorized;
         SendStr("Login OK.\r\n");
+        if (config_.detach_grace_ms > 0) {
+          Printf("Session id %u (detachable for %u s).\r\n", config_.session_id, config_.detach_grace_ms / 1000);
+        }
       } else {
         SendStr("Login failed.\r\n");
         auth_ = Auth::kNeedUser;
@@ -415,13 +1330,42 @@ class TelnetSession {
     }
   }
 
+  /// Check credentials against the account table, then the single
+  /// username/password pair; sets roles_ on success.
+  bool Authenticate(const char* user, const char* pass) {
+    for (uint32_t i = 0; config_.users != nullptr && i < config_.user_count; ++i) {
+      const UserAccount& acct = config_.users[i];
+      if (acct.username != nullptr && acct.password != nullptr && std::strcmp(user, acct.username) == 0 &&
+          std::strcmp(pass, acct.password) == 0) {
+        roles_ = acct.roles;
+        return true;
+      }
+    }
+    if (config_.username != nullptr && config_.password != nullptr && std::strcmp(user, config_.username) == 0 &&
+        std::strcmp(pass, config_.password) == 0) {
+      roles_ = config_.roles;
+      return true;
+    }
+    return false;
+  }
+
   // -----------------------------------------------------------------------
   // Command execution
   // -----------------------------------------------------------------------
 
+  /// This session as ExecContext::session / for "attach", or nullptr when
+  /// it runs over another transport.
+  TelnetSession* AsTelnetSession() {
+    if constexpr (std::is_same<Transport, PosixTransport>::value) {
+      return this;
+    } else {
+      return nullptr;
+    }
+  }
+
   /// OutputFn adapter: sends text to this session's socket.
   static void SessionOutput(const char* str, uint32_t len, void* ctx) {
-    auto* self = static_cast<TelnetSession*>(ctx);
+    auto* self = static_cast<BasicTelnetSession*>(ctx);
     if (self != nullptr) {
       self->Send(str, len);
     }
@@ -429,6 +1373,7 @@ class TelnetSession {
 
   void ExecuteCommand() {
     PushHistory(cmd_buf_);
+    batch_executed_ = true;
 
     // Built-in: exit
     if (std::strcmp(cmd_buf_, "exit") == 0 || std::strcmp(cmd_buf_, "quit") == 0) {
@@ -437,12 +1382,37 @@ class TelnetSession {
       return;
     }
 
+    // Built-in: attach [id]
+    TelnetSession* self = AsTelnetSession();
+    if (self != nullptr && config_.attach_fn != nullptr && std::strncmp(cmd_buf_, "attach", 6) == 0 &&
+        (cmd_buf_[6] == '\0' || cmd_buf_[6] == ' ')) {
+      const char* arg = cmd_buf_ + 6;
+      while (*arg == ' ') {
+        ++arg;
+      }
+      int32_t id = (*arg == '\0') ? -1 : std::atoi(arg);
+      config_.attach_fn(*self, id, config_.attach_ctx);
+      return;
+    }
+
     // Copy cmd_buf_ because Execute modifies it in-place
     char exec_buf[kMaxCmdLen];
     std::strncpy(exec_buf, cmd_buf_, kMaxCmdLen - 1);
     exec_buf[kMaxCmdLen - 1] = '\0';
 
-    registry_->Execute(exec_buf, SessionOutput, this);
+    ExecContext ec;
+    ec.output_fn = SessionOutput;
+    ec.output_ctx = this;
+    ec.arena = &scratch_;
+    ec.roles = roles_;
+    ec.sock_fd = Transport::kKernelSocket ? sock_fd_ : -1;
+    ec.may_block = config_.blocking_commands;
+    ec.session = self;
+    if (config_.socket_policy.cork_responses && !corked_) {
+      SetCork(true);  // released in ProcessInput after the prompt
+      corked_ = true;
+    }
+    registry_->Execute(exec_buf, ec);
   }
 
   // -----------------------------------------------------------------------
@@ -482,6 +1452,8 @@ class TelnetSession {
   // Member data
   // -----------------------------------------------------------------------
   int32_t sock_fd_ = -1;
+  Transport transport_;
+  std::mutex fd_mutex_;  ///< Stop() (any thread) vs Close() (session thread)
   std::atomic<bool> running_{false};
   CommandRegistry* registry_ = nullptr;
   SessionConfig config_;
@@ -492,6 +1464,7 @@ class TelnetSession {
   // Auth
   Auth auth_ = Auth::kAuthorized;
   char user_buf_[64] = {};
+  uint32_t roles_ = 0;  ///< Granted at login, passed to every Execute
 
   // Arrow
   ArrowPhase arrow_ = ArrowPhase::kNone;
@@ -500,6 +1473,10 @@ class TelnetSession {
   char cmd_buf_[kMaxCmdLen] = {};
   uint32_t cmd_len_ = 0;
 
+  // Keys typed while a command waited on the client (see TakeInterrupt)
+  char typeahead_[kMaxCmdLen] = {};
+  uint32_t typeahead_len_ = 0;
+
   // History
   char history_[kHistorySize][kMaxCmdLen] = {};
   uint32_t history_count_ = 0;
@@ -508,6 +1485,112 @@ class TelnetSession {
 
   // Flow control
   bool output_paused_ = false;
+
+  // TRANSMIT-BINARY state per direction
+  bool binary_tx_ = false;
+  bool binary_rx_ = false;
+  bool binary_want_ = false;
+  uint8_t binary_wait_ = 0;
+
+  // TCP_CORK held for the current response
+  bool corked_ = false;
+
+  // Output a non-blocking socket did not take yet (see SendAll)
+  char tx_queue_[kTxQueueSize] = {};
+  uint32_t tx_len_ = 0;
+
+  // Output compression (MCCP2)
+  std::atomic<bool> defer_flush_{false};
+#if defined(TELSH_ENABLE_MCCP) && TELSH_ENABLE_MCCP
+  MccpStream mccp_;
+  std::mutex tx_mutex_;
+#endif
+
+  // Latency: arrival of the current input batch, what it produced, and the
+  // outstanding TIMING-MARK probe (0 = none)
+  SessionLatency latency_;
+  uint64_t input_us_ = 0;
+  bool batch_echoed_ = false;
+  bool batch_executed_ = false;
+  uint64_t tm_sent_us_ = 0;
+  uint64_t tm_last_us_ = 0;
+
+  // Window size (NAWS), 0 = unknown
+  uint16_t term_width_ = 0;
+  uint16_t term_height_ = 0;
+
+  // Detach / backlog
+  std::atomic<bool> detached_{false};
+  uint64_t detached_at_ms_ = 0;
+  char backlog_[kBacklogSize] = {};
+  uint32_t backlog_head_ = 0;
+  uint32_t backlog_len_ = 0;
+  std::mutex backlog_mutex_;
+
+  // Output posted by other threads (see Post)
+  int32_t wake_fd_ = -1;
+  char post_buf_[kPostQueueSize] = {};
+  uint32_t post_len_ = 0;
+  uint32_t post_dropped_ = 0;
+  std::mutex post_mutex_;
+
+  // Per-command scratch memory (see ScratchAlloc)
+  alignas(std::max_align_t) uint8_t scratch_buf_[kScratchSize] = {};
+  ScratchArena scratch_;
 };
 
+// ---------------------------------------------------------------------------
+// latency command
+// ---------------------------------------------------------------------------
+
+namespace detail {
+
+inline int LatencyCmd(int argc, char* argv[], void* ctx) {
+  (void)ctx;
+  ExecContext* ec = CurrentExec();
+  if (ec == nullptr || ec->output_fn == nullptr) {
+    return -1;
+  }
+  const bool reset = (argc > 1 && std::strcmp(argv[1], "reset") == 0);
+  if (argc > 1 && !reset) {
+    ec->output_fn("Usage: latency [reset]\r\n", 24, ec->output_ctx);
+    return -1;
+  }
+  char line[160];
+  const SessionLatency* scopes[2] = {ec->session != nullptr ? &ec->session->Latency() : nullptr,
+                                     &SessionLatency::Global()};
+  const char* titles[2] = {"this session:\r\n", "all sessions:\r\n"};
+  for (uint32_t s = 0; s < 2; ++s) {
+    if (scopes[s] == nullptr) {
+      continue;
+    }
+    ec->output_fn(titles[s], static_cast<uint32_t>(std::strlen(titles[s])), ec->output_ctx);
+    uint32_t n = scopes[s]->echo.Format("  echo", line, sizeof(line));
+    ec->output_fn(line, n, ec->output_ctx);
+    n = scopes[s]->command.Format("  command", line, sizeof(line));
+    ec->output_fn(line, n, ec->output_ctx);
+    n = scopes[s]->rtt.Format("  rtt", line, sizeof(line));
+    ec->output_fn(line, n, ec->output_ctx);
+  }
+  if (reset) {
+    if (ec->session != nullptr) {
+      ec->session->ResetLatency();
+    }
+    SessionLatency::Global().Reset();
+  }
+  if (ec->session != nullptr) {
+    ec->session->ProbeRtt();  // fresh RTT sample for the next call
+  }
+  return 0;
+}
+
+}  // namespace detail
+
+/// Register "latency [reset]": echo, command round-trip and RTT histograms
+/// of the calling session and of all sessions.  Each call also sends an
+/// RTT probe.
+inline bool RegisterLatencyCommand(CommandRegistry& registry) {
+  return registry.Register("latency", "Show echo/command/RTT latency: latency [reset]", detail::LatencyCmd);
+}
+
 }  // namespace telsh
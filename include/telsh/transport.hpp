@@ -0,0 +1,264 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh transports -- the socket calls of BasicTelnetSession as a
+// compile-time policy.
+//
+// Design:
+//   - A transport is a plain class with the members below, called with the
+//     session's descriptor; the session holds one by value, so the default
+//     PosixTransport inlines to the bare syscalls (no virtual dispatch)
+//   - PosixTransport: recv/send/sendmsg/poll/setsockopt/shutdown/close
+//   - MemoryTransport: in-memory fake for tests and benchmarks; input is
+//     fed by the caller, output collected in a fixed buffer (counted past
+//     its end), no kernel socket involved.  Poll() sleeps on a condition
+//     variable signalled by Feed() / CloseInput() / Shutdown(), so an idle
+//     Run() does not spin
+//   - Only the connection goes through the transport; the session's
+//     eventfd wakeup for Post() stays a real descriptor
+//   - Zero heap allocation
+//
+// Transport members (return values and errno as for the syscalls):
+//   static constexpr bool kKernelSocket;  // fd is a real socket
+//   ssize_t Recv(int32_t fd, void* buf, size_t len, int flags);
+//   ssize_t Send(int32_t fd, const void* data, size_t len);
+//   ssize_t SendMsg(int32_t fd, const struct msghdr* msg);
+//   int Poll(struct pollfd* fds, nfds_t n, int32_t timeout_ms);
+//   void SetOption(int32_t fd, int level, int name, int32_t value);
+//   void Shutdown(int32_t fd);
+//   void Close(int32_t fd);
+
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace telsh {
+
+// ---------------------------------------------------------------------------
+// PosixTransport -- kernel sockets (default)
+// ---------------------------------------------------------------------------
+
+struct PosixTransport {
+  static constexpr bool kKernelSocket = true;
+
+  ssize_t Recv(int32_t fd, void* buf, size_t len, int flags) { return ::recv(fd, buf, len, flags); }
+  ssize_t Send(int32_t fd, const void* data, size_t len) { return ::send(fd, data, len, MSG_NOSIGNAL); }
+  ssize_t SendMsg(int32_t fd, const struct msghdr* msg) { return ::sendmsg(fd, msg, MSG_NOSIGNAL); }
+  int Poll(struct pollfd* fds, nfds_t n, int32_t timeout_ms) { return ::poll(fds, n, timeout_ms); }
+  void SetOption(int32_t fd, int level, int name, int32_t value) {
+    ::setsockopt(fd, level, name, &value, sizeof(value));
+  }
+  void Shutdown(int32_t fd) { ::shutdown(fd, SHUT_RDWR); }
+  void Close(int32_t fd) { ::close(fd); }
+};
+
+// ---------------------------------------------------------------------------
+// MemoryTransport -- in-memory connection for tests and benchmarks
+// ---------------------------------------------------------------------------
+
+/// The session side reads what Feed() queued and writes into an output
+/// buffer.  Any descriptor number >= 0 may be passed to Init(); it is never
+/// used.  Drive the session with Begin() / OnReadable(), or with Run(),
+/// which returns once the input is closed and drained.  Calls are
+/// serialized, so another thread may feed or collect while Run() waits.
+class MemoryTransport {
+ public:
+  static constexpr bool kKernelSocket = false;
+  static constexpr uint32_t kInputSize = 64 * 1024;
+  static constexpr uint32_t kOutputSize = 64 * 1024;
+  static constexpr int32_t kRealFdSliceMs = 2;  ///< Poll(): re-check of real fds (e.g. the wake eventfd)
+
+  // --- Peer (test) side ---
+
+  /// Queue client input.  @return false if it does not fit.
+  bool Feed(const void* data, uint32_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (in_pos_ == in_len_) {
+      in_pos_ = in_len_ = 0;
+    }
+    if (len > kInputSize - in_len_) {
+      return false;
+    }
+    std::memcpy(in_ + in_len_, data, len);
+    in_len_ += len;
+    cv_.notify_all();
+    return true;
+  }
+
+  bool Feed(const char* str) { return Feed(str, static_cast<uint32_t>(std::strlen(str))); }
+
+  /// Queued input the session has not read yet.
+  uint32_t InputPending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_len_ - in_pos_;
+  }
+
+  /// Peer closed: Recv() returns 0 once the queued input is consumed.
+  void CloseInput() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    cv_.notify_all();
+  }
+
+  /// Copy the collected output into @p buf (NUL-terminated, truncated to
+  /// @p size - 1; bytes past kOutputSize are only counted in BytesSent()).
+  /// @return bytes copied.
+  uint32_t Output(char* buf, uint32_t size) const {
+    if (buf == nullptr || size == 0) {
+      return 0;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint32_t n = (out_len_ < size - 1) ? out_len_ : size - 1;
+    std::memcpy(buf, out_, n);
+    buf[n] = '\0';
+    return n;
+  }
+
+  uint32_t OutputLen() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return out_len_;
+  }
+  void ClearOutput() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    out_len_ = 0;
+  }
+
+  uint64_t BytesSent() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sent_;
+  }
+
+  bool IsShutdown() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return shutdown_;
+  }
+
+  /// Forget all state (new connection).
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    in_pos_ = in_len_ = out_len_ = 0;
+    sent_ = 0;
+    closed_ = shutdown_ = false;
+  }
+
+  // --- Transport policy (session side) ---
+
+  ssize_t Recv(int32_t, void* buf, size_t len, int) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint32_t avail = in_len_ - in_pos_;
+    if (avail == 0) {
+      if (closed_ || shutdown_) {
+        return 0;
+      }
+      errno = EAGAIN;
+      return -1;
+    }
+    const uint32_t n = (len < avail) ? static_cast<uint32_t>(len) : avail;
+    std::memcpy(buf, in_ + in_pos_, n);
+    in_pos_ += n;
+    return static_cast<ssize_t>(n);
+  }
+
+  ssize_t Send(int32_t, const void* data, size_t len) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutdown_) {
+      errno = EPIPE;
+      return -1;
+    }
+    AppendLocked(data, len);
+    return static_cast<ssize_t>(len);
+  }
+
+  ssize_t SendMsg(int32_t, const struct msghdr* msg) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutdown_) {
+      errno = EPIPE;
+      return -1;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < static_cast<size_t>(msg->msg_iovlen); ++i) {
+      AppendLocked(msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      total += msg->msg_iov[i].iov_len;
+    }
+    return static_cast<ssize_t>(total);
+  }
+
+  /// fds[0] is the connection (the session always passes it first): it is
+  /// readable while input is queued or after CloseInput().  Waits up to
+  /// @p timeout_ms (-1 = forever) on the condition variable; other entries
+  /// are real descriptors, re-checked every kRealFdSliceMs while waiting.
+  int Poll(struct pollfd* fds, nfds_t n, int32_t timeout_ms) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+      int ready = 0;
+      fds[0].revents = ReadableLocked() ? POLLIN : 0;
+      ready += (fds[0].revents != 0) ? 1 : 0;
+      for (nfds_t i = 1; i < n; ++i) {
+        fds[i].revents = 0;
+        if (fds[i].fd >= 0) {
+          (void)::poll(&fds[i], 1, 0);
+        }
+        ready += (fds[i].revents != 0) ? 1 : 0;
+      }
+      const auto now = std::chrono::steady_clock::now();
+      if (ready > 0 || timeout_ms == 0 || (timeout_ms > 0 && now >= deadline)) {
+        return ready;
+      }
+      if (n > 1) {
+        const auto slice = now + std::chrono::milliseconds(kRealFdSliceMs);
+        cv_.wait_until(lock, (timeout_ms > 0 && deadline < slice) ? deadline : slice,
+                       [this]() { return ReadableLocked(); });
+      } else if (timeout_ms > 0) {
+        cv_.wait_until(lock, deadline, [this]() { return ReadableLocked(); });
+      } else {
+        cv_.wait(lock, [this]() { return ReadableLocked(); });
+      }
+    }
+  }
+
+  void SetOption(int32_t, int, int, int32_t) {}
+
+  void Shutdown(int32_t) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    shutdown_ = true;
+    cv_.notify_all();
+  }
+
+  void Close(int32_t) { Shutdown(-1); }
+
+ private:
+  bool ReadableLocked() const { return in_pos_ < in_len_ || closed_ || shutdown_; }
+
+  void AppendLocked(const void* data, size_t len) {
+    const size_t room = kOutputSize - out_len_;
+    const size_t take = (len < room) ? len : room;
+    std::memcpy(out_ + out_len_, data, take);
+    out_len_ += static_cast<uint32_t>(take);
+    sent_ += len;
+  }
+
+  uint8_t in_[kInputSize];
+  uint32_t in_len_ = 0;
+  uint32_t in_pos_ = 0;
+  char out_[kOutputSize];
+  uint32_t out_len_ = 0;
+  uint64_t sent_ = 0;
+  bool closed_ = false;    ///< Peer closed its side
+  bool shutdown_ = false;  ///< Session side shut down / closed
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+};
+
+}  // namespace telsh
@@ -0,0 +1,409 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::TriggerEngine -- threshold triggers on registered variables
+// ("trigger <var> > <value> [command]").
+//
+// Design:
+//   - A sampler thread reads the VarRegistry variables named by the
+//     triggers at a fixed rate with their registered readers (relaxed
+//     atomic / seqlock loads): the observed code takes no lock and is
+//     never called back
+//   - The sampler runs with SCHED_IDLE where available, so it only uses
+//     CPU time nothing else wants
+//   - Debounce: a trigger fires after the condition held for N consecutive
+//     samples and re-arms after it was false for N samples, so a value
+//     hovering at the threshold fires once
+//   - Firing runs the command in-process with the roles of the session
+//     that added it (CommandRegistry::ExecuteCapture) or, without one,
+//     snapshots every variable; the output goes to all sessions and sinks
+//   - Zero heap allocation: fixed trigger table
+
+#pragma once
+
+#include "telsh/command_registry.hpp"
+#include "telsh/telnet_server.hpp"
+#include "telsh/vars.hpp"
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+
+namespace telsh {
+
+enum class TriggerOp : uint8_t { kGt, kLt, kGe, kLe, kEq, kNe };
+
+class TriggerEngine {
+ public:
+  static constexpr uint32_t kMaxTriggers = 8;
+  static constexpr uint32_t kMaxOutput = 2048;  ///< Per firing, the rest is cut
+
+  /// Add() errors.
+  static constexpr int32_t kErrVar = -1;      ///< Unknown variable
+  static constexpr int32_t kErrCommand = -2;  ///< Unknown command
+  static constexpr int32_t kErrFull = -3;     ///< Trigger table full
+
+  explicit TriggerEngine(CommandRegistry& registry, const VarRegistry& vars = VarRegistry::Instance())
+      : registry_(registry), vars_(vars) {}
+
+  ~TriggerEngine() { Stop(); }
+
+  TriggerEngine(const TriggerEngine&) = delete;
+  TriggerEngine& operator=(const TriggerEngine&) = delete;
+
+  /// Parse "> < >= <= == !=".
+  static bool ParseOp(const char* s, TriggerOp* op) {
+    static const char* const kOps[] = {">", "<", ">=", "<=", "==", "!="};
+    for (uint32_t i = 0; i < 6; ++i) {
+      if (std::strcmp(s, kOps[i]) == 0) {
+        *op = static_cast<TriggerOp>(i);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static const char* OpName(TriggerOp op) {
+    static const char* const kOps[] = {">", "<", ">=", "<=", "==", "!="};
+    return kOps[static_cast<uint32_t>(op)];
+  }
+
+  /// Fire when @p var @p op @p threshold holds for @p debounce samples.
+  /// @p cmdline nullptr or "" = snapshot all variables instead.
+  /// @return trigger id (> 0) or a kErr* code.
+  int32_t Add(const char* var, TriggerOp op, double threshold, const char* cmdline = nullptr, uint32_t debounce = 1,
+              uint32_t roles = kRoleAll) {
+    const VarEntry* entry = (var != nullptr) ? vars_.Find(var) : nullptr;
+    if (entry == nullptr) {
+      return kErrVar;
+    }
+    Trigger t;
+    if (cmdline != nullptr && *cmdline != '\0') {
+      char name[CommandRegistry::kMaxLineLen];
+      if (std::strlen(cmdline) >= sizeof(t.line) || std::sscanf(cmdline, "%255s", name) != 1 ||
+          registry_.Resolve(name) == nullptr) {
+        return kErrCommand;
+      }
+      std::strcpy(t.line, cmdline);
+    }
+    t.var = entry;
+    t.op = op;
+    t.threshold = threshold;
+    t.debounce = (debounce > 0) ? debounce : 1;
+    t.roles = roles;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Trigger& slot : triggers_) {
+      if (!slot.used) {
+        t.used = true;
+        t.id = next_id_++;
+        slot = t;
+        return static_cast<int32_t>(t.id);
+      }
+    }
+    return kErrFull;
+  }
+
+  bool Remove(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Trigger& t : triggers_) {
+      if (t.used && t.id == id) {
+        t = Trigger{};
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint32_t TriggerCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint32_t n = 0;
+    for (const Trigger& t : triggers_) {
+      n += t.used ? 1U : 0U;
+    }
+    return n;
+  }
+
+  /// One line per trigger.  @return bytes written (clamped to @p size - 1).
+  uint32_t Format(char* buf, uint32_t size) {
+    if (size == 0) {
+      return 0;
+    }
+    buf[0] = '\0';
+    uint32_t len = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Trigger& t : triggers_) {
+      if (!t.used || len + 1 >= size) {
+        continue;
+      }
+      int n = std::snprintf(buf + len, size - len, "  %-3u %s %s %.15g x%u fired=%u%s -> %s\r\n", t.id, t.var->name,
+                            OpName(t.op), t.threshold, t.debounce, t.fired, t.armed ? "" : " (holding)",
+                            (t.line[0] != '\0') ? t.line : "snapshot");
+      len = (n < 0) ? len : (len + static_cast<uint32_t>(n) < size) ? len + static_cast<uint32_t>(n) : size - 1;
+    }
+    return len;
+  }
+
+  /// Sample every trigger's variable once and run the actions of those
+  /// that fire.  Called by the sampler thread (or by hand / a host loop).
+  /// @return triggers fired.
+  uint32_t Sample() {
+    std::lock_guard<std::mutex> run_lock(run_mutex_);
+    Firing due[kMaxTriggers];
+    uint32_t n = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (Trigger& t : triggers_) {
+        if (!t.used) {
+          continue;
+        }
+        const double value = t.var->Read();
+        const bool holds = Holds(t.op, value, t.threshold);
+        t.streak = (holds == t.armed) ? t.streak + 1 : 0;  // samples pointing at the next transition
+        if (t.streak < t.debounce) {
+          continue;
+        }
+        t.streak = 0;
+        t.armed = !t.armed;
+        if (!t.armed) {
+          ++t.fired;
+          due[n++] = {t.id, t.var->name, t.op, t.threshold, value, t.roles, {}};
+          std::strcpy(due[n - 1].line, t.line);
+        }
+      }
+    }
+    for (uint32_t k = 0; k < n; ++k) {
+      Fire(due[k]);
+    }
+    return n;
+  }
+
+  /// Start the sampler thread at @p hz samples per second.
+  bool Start(uint32_t hz) {
+    if (hz == 0 || hz > 1000) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(thread_mutex_);
+    if (running_) {
+      return true;
+    }
+    period_ms_ = 1000 / hz;
+    running_ = true;
+    thread_ = std::thread([this]() { Loop(); });
+    return true;
+  }
+
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(thread_mutex_);
+      if (!running_) {
+        return;
+      }
+      running_ = false;
+    }
+    thread_cv_.notify_all();
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+  }
+
+ private:
+  struct Trigger {
+    const VarEntry* var = nullptr;
+    char line[CommandRegistry::kMaxLineLen] = {};  ///< "" = snapshot
+    double threshold = 0;
+    uint32_t debounce = 1;
+    uint32_t streak = 0;  ///< Consecutive samples agreeing with the next transition
+    uint32_t fired = 0;
+    uint32_t roles = kRoleAll;
+    uint32_t id = 0;
+    TriggerOp op = TriggerOp::kGt;
+    bool armed = true;  ///< false after firing until the condition clears
+    bool used = false;
+  };
+
+  /// A fired trigger, copied out so the action runs without mutex_.
+  struct Firing {
+    uint32_t id;
+    const char* var;
+    TriggerOp op;
+    double threshold;
+    double value;
+    uint32_t roles;
+    char line[CommandRegistry::kMaxLineLen];
+  };
+
+  static bool Holds(TriggerOp op, double v, double threshold) {
+    switch (op) {
+      case TriggerOp::kGt:
+        return v > threshold;
+      case TriggerOp::kLt:
+        return v < threshold;
+      case TriggerOp::kGe:
+        return v >= threshold;
+      case TriggerOp::kLe:
+        return v <= threshold;
+      case TriggerOp::kEq:
+        return v == threshold;
+      case TriggerOp::kNe:
+        return v != threshold;
+    }
+    return false;
+  }
+
+  void Fire(const Firing& f) {
+    char out[kMaxOutput];
+    detail::CaptureBuffer capture{out, sizeof(out), 0};
+    char header[160];
+    int n = std::snprintf(header, sizeof(header), "[trigger %u] %s = %.15g (%s %.15g)\r\n", f.id, f.var, f.value,
+                          OpName(f.op), f.threshold);
+    detail::CaptureBuffer::Append(header, static_cast<uint32_t>(n), &capture);
+    if (f.line[0] != '\0') {
+      (void)registry_.ExecuteCapture(f.line, &detail::CaptureBuffer::Append, &capture, f.roles);
+    } else {
+      char snap[VarRegistry::kMaxVars * 96];
+      uint32_t len = vars_.Format(nullptr, snap, sizeof(snap));
+      detail::CaptureBuffer::Append(snap, len, &capture);
+    }
+    TelnetServer::Publish(out, static_cast<uint32_t>((capture.len < sizeof(out)) ? capture.len : sizeof(out) - 1));
+  }
+
+  void Loop() {
+#ifdef SCHED_IDLE
+    struct sched_param param = {};
+    (void)pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+    std::unique_lock<std::mutex> lock(thread_mutex_);
+    while (running_) {
+      thread_cv_.wait_for(lock, std::chrono::milliseconds(period_ms_));
+      if (!running_) {
+        break;
+      }
+      lock.unlock();
+      Sample();
+      lock.lock();
+    }
+  }
+
+  CommandRegistry& registry_;
+  const VarRegistry& vars_;
+  Trigger triggers_[kMaxTriggers];
+  uint32_t next_id_ = 1;
+  std::mutex mutex_;      ///< Trigger table
+  std::mutex run_mutex_;  ///< One Sample() at a time
+
+  bool running_ = false;
+  uint32_t period_ms_ = 100;
+  std::mutex thread_mutex_;
+  std::condition_variable thread_cv_;
+  std::thread thread_;
+};
+
+// ---------------------------------------------------------------------------
+// trigger command
+// ---------------------------------------------------------------------------
+
+namespace detail {
+
+inline void TriggerOut(const char* fmt, ...) {
+  ExecContext* ec = CurrentExec();
+  if (ec == nullptr || ec->output_fn == nullptr) {
+    return;
+  }
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int n = std::vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  if (n > 0) {
+    ec->output_fn(buf, (static_cast<uint32_t>(n) < sizeof(buf)) ? static_cast<uint32_t>(n) : sizeof(buf) - 1,
+                  ec->output_ctx);
+  }
+}
+
+inline int TriggerAdd(TriggerEngine& engine, int argc, char* argv[], uint32_t roles) {
+  int i = 1;
+  uint32_t debounce = 1;
+  if (i + 1 < argc && std::strcmp(argv[i], "-n") == 0) {
+    debounce = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+    i += 2;
+  }
+  TriggerOp op;
+  char* end = nullptr;
+  const double threshold = (i + 2 < argc) ? std::strtod(argv[i + 2], &end) : 0;
+  if (i + 2 >= argc || !TriggerEngine::ParseOp(argv[i + 1], &op) || end == argv[i + 2] || *end != '\0') {
+    TriggerOut("Usage: trigger [-n samples] <var> <op> <value> [command...]  (op: > < >= <= == !=)\r\n");
+    return -1;
+  }
+  const char* var = argv[i];
+  // Rejoin the command, re-quoting arguments with blanks
+  char line[CommandRegistry::kMaxLineLen] = {};
+  uint32_t len = 0;
+  for (i += 3; i < argc; ++i) {
+    const bool quote = (std::strpbrk(argv[i], " \t") != nullptr);
+    int n = std::snprintf(line + len, sizeof(line) - len, "%s%s%s%s", (len > 0) ? " " : "", quote ? "\"" : "", argv[i],
+                          quote ? "\"" : "");
+    if (n < 0 || len + static_cast<uint32_t>(n) >= sizeof(line)) {
+      TriggerOut("trigger: command too long\r\n");
+      return -1;
+    }
+    len += static_cast<uint32_t>(n);
+  }
+  const int32_t id = engine.Add(var, op, threshold, line, debounce, roles);
+  switch (id) {
+    case TriggerEngine::kErrVar:
+      TriggerOut("trigger: unknown variable: %s\r\n", var);
+      return -1;
+    case TriggerEngine::kErrCommand:
+      TriggerOut("trigger: unknown command: %s\r\n", line);
+      return -1;
+    case TriggerEngine::kErrFull:
+      TriggerOut("trigger: table full\r\n");
+      return -1;
+    default:
+      TriggerOut("Trigger %d armed.\r\n", id);
+      return 0;
+  }
+}
+
+inline int TriggerCmd(int argc, char* argv[], void* ctx) {
+  auto& engine = *static_cast<TriggerEngine*>(ctx);
+  ExecContext* ec = CurrentExec();
+  if (argc == 2 && std::strcmp(argv[1], "list") == 0) {
+    char buf[TriggerEngine::kMaxTriggers * 200];
+    uint32_t n = engine.Format(buf, sizeof(buf));
+    if (n == 0) {
+      TriggerOut("No triggers.\r\n");
+    } else if (ec != nullptr && ec->output_fn != nullptr) {
+      ec->output_fn(buf, n, ec->output_ctx);
+    }
+    return 0;
+  }
+  if (argc == 3 && std::strcmp(argv[1], "del") == 0) {
+    if (!engine.Remove(static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)))) {
+      TriggerOut("trigger: no trigger %s\r\n", argv[2]);
+      return -1;
+    }
+    return 0;
+  }
+  return TriggerAdd(engine, argc, argv, (ec != nullptr) ? ec->roles : kRoleAll);
+}
+
+}  // namespace detail
+
+/// Register "trigger [-n N] <var> <op> <value> [command]", "trigger list"
+/// and "trigger del <id>" for @p engine (built on @p registry).
+inline bool RegisterTriggerCommands(CommandRegistry& registry, TriggerEngine& engine) {
+  return registry.Register("trigger", "Run a command when a variable crosses a threshold (list|del)",
+                           detail::TriggerCmd, &engine);
+}
+
+}  // namespace telsh
@@ -0,0 +1,247 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh::VarRegistry -- named live variables readable from the shell
+// ("vars").
+//
+// Design:
+//   - The application registers variables it already owns: std::atomic<T>
+//     (read with a relaxed load) or Seqlock<T> (lock-free snapshot of a
+//     multi-word value), or any reader function
+//   - The observed code never takes a lock or calls into telsh: readers
+//     (shell, triggers, samplers) pay for every read, writers pay nothing
+//     beyond the atomic / seqlock store they already do
+//   - Values are read as double for display and comparisons (integers
+//     beyond 2^53 lose precision)
+//   - Fixed table (kMaxVars) like the command table, zero heap allocation
+
+#pragma once
+
+#include "osp/log.hpp"
+#include "telsh/command_registry.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <atomic>
+#include <mutex>
+#include <type_traits>
+
+namespace telsh {
+
+// ---------------------------------------------------------------------------
+// Seqlock -- single writer, lock-free readers
+// ---------------------------------------------------------------------------
+
+/// Holds a trivially copyable @p T.  Store() from one writer thread never
+/// blocks; Load() retries while a store is in progress.  The payload is
+/// kept in relaxed atomic words, so readers are race-free.
+template <typename T>
+class Seqlock {
+ public:
+  static_assert(std::is_trivially_copyable<T>::value, "Seqlock needs a trivially copyable type");
+
+  Seqlock() = default;
+  explicit Seqlock(const T& value) { Store(value); }
+
+  void Store(const T& value) {
+    uint64_t tmp[kWords] = {};
+    std::memcpy(tmp, &value, sizeof(T));
+    const uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);  // odd: write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    for (uint32_t i = 0; i < kWords; ++i) {
+      words_[i].store(tmp[i], std::memory_order_relaxed);
+    }
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  T Load() const {
+    uint64_t tmp[kWords];
+    uint32_t before;
+    uint32_t after;
+    do {
+      before = seq_.load(std::memory_order_acquire);
+      for (uint32_t i = 0; i < kWords; ++i) {
+        tmp[i] = words_[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = seq_.load(std::memory_order_relaxed);
+    } while ((before & 1U) != 0 || before != after);
+    T value;
+    std::memcpy(&value, tmp, sizeof(T));
+    return value;
+  }
+
+  /// Number of completed stores (changes on every Store()).
+  uint32_t Version() const { return seq_.load(std::memory_order_acquire) / 2; }
+
+ private:
+  static constexpr uint32_t kWords = (sizeof(T) + 7) / 8;
+
+  std::atomic<uint32_t> seq_{0};
+  std::atomic<uint64_t> words_[kWords] = {};
+};
+
+// ---------------------------------------------------------------------------
+// VarRegistry
+// ---------------------------------------------------------------------------
+
+/// Reads one variable; @p ctx is the pointer given at registration.
+using VarReadFn = double (*)(const void* ctx);
+
+struct VarEntry {
+  const char* name;
+  const char* desc;
+  VarReadFn read;
+  const void* ctx;
+
+  double Read() const { return read(ctx); }
+};
+
+class VarRegistry {
+ public:
+  static constexpr uint32_t kMaxVars = 32;
+
+  VarRegistry() = default;
+  VarRegistry(const VarRegistry&) = delete;
+  VarRegistry& operator=(const VarRegistry&) = delete;
+
+  /// Process-wide table used by the "vars" command and the triggers.
+  static VarRegistry& Instance() {
+    static VarRegistry inst;
+    return inst;
+  }
+
+  /// Register a variable read by @p read(@p ctx).  @p name and @p desc
+  /// must outlive the registry (string literals).
+  bool Register(const char* name, VarReadFn read, const void* ctx, const char* desc = nullptr) {
+    if (name == nullptr || read == nullptr) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count_ >= kMaxVars || FindLocked(name) != nullptr) {
+      OSP_LOG_WARN("TELSH", "var '%s' not registered (table full or duplicate)", name);
+      return false;
+    }
+    entries_[count_] = {name, (desc != nullptr) ? desc : "", read, ctx};
+    ++count_;
+    return true;
+  }
+
+  /// Arithmetic std::atomic<T>, read with a relaxed load.
+  template <typename T>
+  bool Register(const char* name, const std::atomic<T>* var, const char* desc = nullptr) {
+    static_assert(std::is_arithmetic<T>::value, "atomic variables must be arithmetic");
+    return Register(name, &ReadAtomic<T>, var, desc);
+  }
+
+  /// Arithmetic Seqlock<T>.
+  template <typename T>
+  bool Register(const char* name, const Seqlock<T>* var, const char* desc = nullptr) {
+    static_assert(std::is_arithmetic<T>::value, "seqlock variables must be arithmetic (use a reader otherwise)");
+    return Register(name, &ReadSeqlock<T>, var, desc);
+  }
+
+  /// Entry registered as @p name, or nullptr.  Entries are never removed,
+  /// so the pointer stays valid.
+  const VarEntry* Find(const char* name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return FindLocked(name);
+  }
+
+  bool Read(const char* name, double* value) const {
+    const VarEntry* e = Find(name);
+    if (e == nullptr || value == nullptr) {
+      return false;
+    }
+    *value = e->Read();
+    return true;
+  }
+
+  uint32_t Count() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return count_;
+  }
+
+  /// Entry @p index (0..Count()-1), or nullptr.
+  const VarEntry* At(uint32_t index) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return (index < count_) ? &entries_[index] : nullptr;
+  }
+
+  /// "name = value" lines (all variables, or the one named @p name).
+  /// @return bytes written (clamped to @p size - 1), 0 if none matched.
+  uint32_t Format(const char* name, char* buf, uint32_t size) const {
+    if (size == 0) {
+      return 0;
+    }
+    buf[0] = '\0';
+    uint32_t len = 0;
+    for (uint32_t i = 0; i < Count() && len + 1 < size; ++i) {
+      const VarEntry* e = At(i);
+      if (name != nullptr && std::strcmp(e->name, name) != 0) {
+        continue;
+      }
+      int n = std::snprintf(buf + len, size - len, "  %-20s = %-14.15g %s\r\n", e->name, e->Read(), e->desc);
+      len = (n < 0) ? len : (len + static_cast<uint32_t>(n) < size) ? len + static_cast<uint32_t>(n) : size - 1;
+    }
+    return len;
+  }
+
+ private:
+  template <typename T>
+  static double ReadAtomic(const void* p) {
+    return static_cast<double>(static_cast<const std::atomic<T>*>(p)->load(std::memory_order_relaxed));
+  }
+
+  template <typename T>
+  static double ReadSeqlock(const void* p) {
+    return static_cast<double>(static_cast<const Seqlock<T>*>(p)->Load());
+  }
+
+  const VarEntry* FindLocked(const char* name) const {
+    for (uint32_t i = 0; i < count_; ++i) {
+      if (std::strcmp(entries_[i].name, name) == 0) {
+        return &entries_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  VarEntry entries_[kMaxVars] = {};
+  uint32_t count_ = 0;
+  mutable std::mutex mutex_;
+};
+
+// ---------------------------------------------------------------------------
+// vars command
+// ---------------------------------------------------------------------------
+
+namespace detail {
+
+inline int VarsCmd(int argc, char* argv[], void* ctx) {
+  const auto& vars = *static_cast<const VarRegistry*>(ctx);
+  ExecContext* ec = CurrentExec();
+  char buf[VarRegistry::kMaxVars * 96];
+  uint32_t n = vars.Format((argc > 1) ? argv[1] : nullptr, buf, sizeof(buf));
+  if (n == 0 && argc > 1) {
+    n = static_cast<uint32_t>(std::snprintf(buf, sizeof(buf), "No variable '%.64s'.\r\n", argv[1]));
+  } else if (n == 0) {
+    n = static_cast<uint32_t>(std::snprintf(buf, sizeof(buf), "No variables.\r\n"));
+  }
+  if (ec != nullptr && ec->output_fn != nullptr) {
+    ec->output_fn(buf, n, ec->output_ctx);
+  }
+  return (argc > 1 && vars.Find(argv[1]) == nullptr) ? -1 : 0;
+}
+
+}  // namespace detail
+
+/// Register "vars [name]" listing the variables of @p vars.
+inline bool RegisterVarsCommand(CommandRegistry& registry, const VarRegistry& vars = VarRegistry::Instance()) {
+  return registry.Register("vars", "Show registered variables: vars [name]", detail::VarsCmd,
+                           const_cast<VarRegistry*>(&vars));
+}
+
+}  // namespace telsh
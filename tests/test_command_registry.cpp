@@ -6,6 +6,8 @@
 #include <cstring>
 
 #include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <thread>
 
 using namespace telsh;
 
@@ -190,6 +192,37 @@ TEST_CASE("CommandRegistry: execute unknown command", "[command_registry]") {
   REQUIRE(std::strstr(out.buf, "Unknown command") != nullptr);
 }
 
+TEST_CASE("CommandRegistry: unknown command suggests close names", "[command_registry]") {
+  CommandRegistry reg;
+  reg.Register("status", "show status", test_cmd_ok);
+  reg.Register("reboot", "reboot", test_cmd_ok);
+  reg.Register("stats", "show stats", test_cmd_ok);
+
+  struct OutCtx {
+    char buf[256];
+    uint32_t len;
+  };
+  OutCtx out = {{}, 0};
+  auto output_fn = [](const char* str, uint32_t len, void* ctx) {
+    auto* o = static_cast<OutCtx*>(ctx);
+    if (o->len + len < sizeof(o->buf)) {
+      std::memcpy(o->buf + o->len, str, len);
+      o->len += len;
+    }
+  };
+
+  char cmd[] = "stauts";
+  REQUIRE(reg.Execute(cmd, output_fn, &out) == -1);
+  out.buf[out.len] = '\0';
+  REQUIRE(std::strstr(out.buf, "Did you mean: stats, status?") != nullptr);  // distance 1 before 2
+  REQUIRE(std::strstr(out.buf, "reboot") == nullptr);
+
+  const char* names[CommandRegistry::kMaxSuggestions];
+  REQUIRE(reg.Suggest("hlep", names, CommandRegistry::kMaxSuggestions) == 1);
+  REQUIRE(std::strcmp(names[0], "help") == 0);
+  REQUIRE(reg.Suggest("xyzzy", names, CommandRegistry::kMaxSuggestions) == 0);
+}
+
 TEST_CASE("CommandRegistry: execute with context", "[command_registry]") {
   CommandRegistry reg;
   int counter = 0;
@@ -264,6 +297,159 @@ TEST_CASE("CommandRegistry: help command", "[command_registry]") {
   REQUIRE(std::strstr(out.buf, "First test") != nullptr);
 }
 
+TEST_CASE("CommandRegistry: help output may call back into the registry", "[command_registry]") {
+  static CommandRegistry reg;
+  static bool found = false;
+  found = false;
+  reg.Register("probe", "re-entrant output", test_cmd_ok);
+  // Would deadlock if help wrote while holding the registry lock
+  auto output_fn = [](const char*, uint32_t, void*) { found = (reg.FindByName("probe") != nullptr); };
+
+  char cmd[] = "help";
+  REQUIRE(reg.Execute(cmd, output_fn, nullptr) == 0);
+  REQUIRE(found);
+}
+
+TEST_CASE("CommandRegistry: help is sorted, aligned and one write", "[command_registry]") {
+  CommandRegistry reg;
+  reg.Register("zeta", "last", test_cmd_ok);
+  reg.Register("alpha", "first", test_cmd_ok);
+  reg.Register("mid_length", "middle", test_cmd_ok);
+
+  struct OutCtx {
+    char buf[1024];
+    uint32_t len;
+    uint32_t writes;
+  };
+  OutCtx out = {{}, 0, 0};
+  auto output_fn = [](const char* str, uint32_t len, void* ctx) {
+    auto* o = static_cast<OutCtx*>(ctx);
+    ++o->writes;
+    if (o->len + len < sizeof(o->buf)) {
+      std::memcpy(o->buf + o->len, str, len);
+      o->len += len;
+    }
+  };
+
+  char cmd[] = "help";
+  REQUIRE(reg.Execute(cmd, output_fn, &out) == 0);
+  out.buf[out.len] = '\0';
+  REQUIRE(out.writes == 1);
+  const char* a = std::strstr(out.buf, "alpha");
+  const char* m = std::strstr(out.buf, "mid_length");
+  const char* z = std::strstr(out.buf, "zeta");
+  REQUIRE(a != nullptr);
+  REQUIRE(a < m);
+  REQUIRE(m < z);
+  REQUIRE(std::strstr(out.buf, "  alpha      - first\r\n") != nullptr);
+
+  // Cache is invalidated by registration
+  reg.Register("beta", "second", test_cmd_ok);
+  out = {{}, 0, 0};
+  char cmd2[] = "help";
+  reg.Execute(cmd2, output_fn, &out);
+  out.buf[out.len] = '\0';
+  REQUIRE(std::strstr(out.buf, "beta") != nullptr);
+  REQUIRE(std::strstr(out.buf, "beta") < std::strstr(out.buf, "mid_length"));
+
+  // help <cmd>
+  out = {{}, 0, 0};
+  char cmd3[] = "help zeta";
+  REQUIRE(reg.Execute(cmd3, output_fn, &out) == 0);
+  out.buf[out.len] = '\0';
+  REQUIRE(std::strstr(out.buf, "zeta\r\n  last") != nullptr);
+
+  char cmd4[] = "help nope";
+  REQUIRE(reg.Execute(cmd4, output_fn, &out) == -1);
+}
+
+TEST_CASE("CommandRegistry: groups and roles gate dispatch and help", "[command_registry]") {
+  constexpr uint8_t kGroupDanger = 3;
+  constexpr uint32_t kRoleAdmin = 1U << 0;
+  constexpr uint32_t kRoleFactory = 1U << 1;
+
+  CommandRegistry reg;
+  reg.Register("status", "public", test_cmd_ok);
+  reg.Register("erase", "admin only", test_cmd_ok);
+  reg.Register("calib", "factory only", test_cmd_ok);
+  REQUIRE(reg.SetAccess("erase", kGroupDanger, kRoleAdmin));
+  REQUIRE(reg.SetAccess("calib", 0, kRoleFactory));
+  REQUIRE_FALSE(reg.SetAccess("nope", 0, 0));
+  REQUIRE_FALSE(reg.SetAccess("status", kMaxGroups, 0));
+
+  struct OutCtx {
+    char buf[512];
+    uint32_t len;
+  };
+  OutCtx out = {{}, 0};
+  auto output_fn = [](const char* str, uint32_t len, void* ctx) {
+    auto* o = static_cast<OutCtx*>(ctx);
+    if (o->len + len < sizeof(o->buf)) {
+      std::memcpy(o->buf + o->len, str, len);
+      o->len += len;
+      o->buf[o->len] = '\0';
+    }
+  };
+
+  ExecContext ec;
+  ec.output_fn = output_fn;
+  ec.output_ctx = &out;
+  ec.roles = kRoleAdmin;
+
+  char c1[] = "erase";
+  REQUIRE(reg.Execute(c1, ec) == 0);
+  char c2[] = "calib";
+  REQUIRE(reg.Execute(c2, ec) == -3);
+  REQUIRE(std::strstr(out.buf, "Permission denied: calib") != nullptr);
+
+  reg.SetGroupEnabled(kGroupDanger, false);
+  REQUIRE_FALSE(reg.IsGroupEnabled(kGroupDanger));
+  out = {{}, 0};
+  char c3[] = "erase";
+  REQUIRE(reg.Execute(c3, ec) == -3);
+  REQUIRE(std::strstr(out.buf, "Command disabled: erase") != nullptr);
+
+  // help hides what the caller cannot run
+  out = {{}, 0};
+  char c4[] = "help";
+  REQUIRE(reg.Execute(c4, ec) == 0);
+  REQUIRE(std::strstr(out.buf, "Available commands") != nullptr);
+  REQUIRE(std::strstr(out.buf, "status") != nullptr);
+  REQUIRE(std::strstr(out.buf, "erase") == nullptr);
+  REQUIRE(std::strstr(out.buf, "calib") == nullptr);
+
+  reg.SetGroupEnabled(kGroupDanger, true);
+  out = {{}, 0};
+  char c5[] = "help";
+  reg.Execute(c5, ec);
+  REQUIRE(std::strstr(out.buf, "erase") != nullptr);
+  REQUIRE(std::strstr(out.buf, "calib") == nullptr);
+}
+
+TEST_CASE("CommandRegistry: SetAccess while a resolved entry is dispatched", "[command_registry]") {
+  constexpr uint32_t kRoleAdmin = 1U << 0;
+  CommandRegistry reg;
+  reg.Register("erase", "admin only", test_cmd_ok);
+  const CmdEntry* entry = reg.Resolve("erase");
+  REQUIRE(entry != nullptr);
+
+  std::thread admin([&reg]() {
+    for (int i = 0; i < 1000; ++i) {
+      reg.SetAccess("erase", 0, (i % 2 == 0) ? kRoleAdmin : 0);
+    }
+  });
+  char name[] = "erase";
+  char* argv[] = {name};
+  ExecContext ec;
+  ec.roles = 0;
+  for (int i = 0; i < 1000; ++i) {
+    const int rc = reg.Dispatch(*entry, 1, argv, ec);
+    REQUIRE((rc == 0 || rc == -3));
+  }
+  admin.join();
+  REQUIRE(reg.Dispatch(*entry, 1, argv, ec) == 0);  // last SetAccess: public
+}
+
 TEST_CASE("CommandRegistry: ForEach", "[command_registry]") {
   CommandRegistry reg;
   reg.Register("a", "cmd a", test_cmd_ok);
@@ -273,3 +459,152 @@ TEST_CASE("CommandRegistry: ForEach", "[command_registry]") {
   reg.ForEach([&count](const CmdEntry&) { ++count; });
   REQUIRE(count == 2);
 }
+
+// ============================================================================
+// Closure / member function registration tests
+// ============================================================================
+
+TEST_CASE("CommandRegistry: capturing lambda", "[command_registry]") {
+  CommandRegistry reg;
+  int hits = 0;
+  int last_argc = 0;
+  REQUIRE(reg.Register("cap", "capturing lambda", [&hits, &last_argc](int argc, char**) {
+    ++hits;
+    last_argc = argc;
+    return 7;
+  }));
+  REQUIRE_FALSE(reg.Register("cap", "duplicate", [&hits](int, char**) { return hits; }));
+
+  auto noop = [](const char*, uint32_t, void*) {};
+  char cmd[] = "cap a b";
+  REQUIRE(reg.Execute(cmd, noop, nullptr) == 7);
+  REQUIRE(hits == 1);
+  REQUIRE(last_argc == 3);
+}
+
+TEST_CASE("CommandRegistry: member function", "[command_registry]") {
+  struct Counter {
+    int value = 0;
+    int Bump(int argc, char* argv[]) {
+      (void)argv;
+      value += argc;
+      return 0;
+    }
+  };
+
+  CommandRegistry reg;
+  Counter counter;
+  REQUIRE(reg.Register<&Counter::Bump>("bump", "member function", &counter));
+  REQUIRE_FALSE(reg.Register<&Counter::Bump>("bump2", "null object", static_cast<Counter*>(nullptr)));
+
+  auto noop = [](const char*, uint32_t, void*) {};
+  char cmd[] = "bump x";
+  REQUIRE(reg.Execute(cmd, noop, nullptr) == 0);
+  REQUIRE(counter.value == 2);
+  REQUIRE(reg.FindByName("bump")->ctx == &counter);
+}
+
+// ============================================================================
+// ExecContext / scratch arena tests
+// ============================================================================
+
+TEST_CASE("ScratchArena: aligned bump allocation", "[command_registry]") {
+  alignas(16) uint8_t block[64];
+  ScratchArena arena(block, sizeof(block));
+
+  void* a = arena.Alloc(3, 1);
+  void* b = arena.Alloc(8, 8);
+  REQUIRE(a == block);
+  REQUIRE(b != nullptr);
+  REQUIRE(reinterpret_cast<uintptr_t>(b) % 8 == 0);
+  REQUIRE(arena.Used() == 16);
+
+  uint32_t mark = arena.Mark();
+  REQUIRE(arena.AllocArray<uint32_t>(12) != nullptr);
+  REQUIRE(arena.Alloc(1, 1) == nullptr);  // exhausted
+  arena.Release(mark);
+  REQUIRE(arena.Used() == 16);
+  REQUIRE(arena.HighWater() == 64);
+
+  arena.Reset();
+  REQUIRE(arena.Alloc(64, 1) == block);
+}
+
+TEST_CASE("CommandRegistry: command sees ExecContext and scratch", "[command_registry]") {
+  static void* scratch = nullptr;
+  static bool saw_ctx = false;
+  auto scratch_cmd = [](int, char**, void*) -> int {
+    saw_ctx = (CurrentExec() != nullptr);
+    scratch = ScratchAlloc(100);
+    return (scratch != nullptr) ? 0 : 1;
+  };
+
+  CommandRegistry reg;
+  reg.Register("scratch", "uses scratch memory", scratch_cmd);
+
+  alignas(16) uint8_t block[256];
+  ScratchArena arena(block, sizeof(block));
+  ExecContext ec;
+  ec.arena = &arena;
+
+  char cmd[] = "scratch";
+  REQUIRE(reg.Execute(cmd, ec) == 0);
+  REQUIRE(saw_ctx);
+  REQUIRE(scratch >= static_cast<void*>(block));
+  REQUIRE(scratch < static_cast<void*>(block + sizeof(block)));
+  REQUIRE(arena.Used() == 0);  // released after the command
+  REQUIRE(arena.HighWater() >= 100);
+  REQUIRE(CurrentExec() == nullptr);
+
+  // Without an arena, ScratchAlloc fails cleanly
+  auto noop = [](const char*, uint32_t, void*) {};
+  char cmd2[] = "scratch";
+  REQUIRE(reg.Execute(cmd2, noop, nullptr) == 1);
+}
+
+TEST_CASE("CommandRegistry: ExecuteCapture collects output", "[command_registry]") {
+  CommandRegistry reg;
+  reg.Register("echo2", "echo args twice", [](int argc, char* argv[], void*) -> int {
+    ExecContext* ec = CurrentExec();
+    for (int round = 0; round < 2; ++round) {
+      for (int i = 1; i < argc; ++i) {
+        ec->output_fn(argv[i], static_cast<uint32_t>(std::strlen(argv[i])), ec->output_ctx);
+      }
+    }
+    return argc;
+  });
+
+  const char line[] = "echo2 ab cd";
+  char buf[64];
+  size_t len = 0;
+  REQUIRE(reg.ExecuteCapture(line, buf, sizeof(buf), &len) == 3);
+  REQUIRE(std::strcmp(buf, "abcdabcd") == 0);
+  REQUIRE(len == 8);
+  REQUIRE(std::strcmp(line, "echo2 ab cd") == 0);  // caller's line untouched
+
+  // Truncated but NUL-terminated; len reports the full size
+  char small[5];
+  REQUIRE(reg.ExecuteCapture("echo2 ab cd", small, sizeof(small), &len) == 3);
+  REQUIRE(std::strcmp(small, "abcd") == 0);
+  REQUIRE(len == 8);
+
+  REQUIRE(reg.ExecuteCapture("nosuch", buf, sizeof(buf)) == -1);
+  REQUIRE(std::strstr(buf, "Unknown command: nosuch") != nullptr);
+}
+
+TEST_CASE("CommandRegistry: ExecuteCapture streaming variant", "[command_registry]") {
+  CommandRegistry reg;
+  reg.Register("two", "two chunks", [](int, char**, void*) -> int {
+    ExecContext* ec = CurrentExec();
+    ec->output_fn("1", 1, ec->output_ctx);
+    ec->output_fn("2", 1, ec->output_ctx);
+    return 0;
+  });
+  int chunks = 0;
+  auto count = [](const char*, uint32_t, void* ctx) { ++*static_cast<int*>(ctx); };
+  REQUIRE(reg.ExecuteCapture("two", count, &chunks) == 0);
+  REQUIRE(chunks == 2);
+
+  std::string too_long(CommandRegistry::kMaxLineLen, 'x');
+  REQUIRE(reg.ExecuteCapture(too_long.c_str(), count, &chunks) == -2);
+}
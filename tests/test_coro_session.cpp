@@ -0,0 +1,208 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for the C++20 coroutine session (built as a separate C++20 target).
+
+#include "telsh/coro_session.hpp"
+#include "telsh/file_commands.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+
+using namespace telsh;
+
+// ============================================================================
+// Helper: socketpair session driven by the executor on the test thread
+// ============================================================================
+
+struct CoroFixture {
+  int client_fd = -1;
+  CommandRegistry registry;
+  TelnetSession session;
+  EpollExecutor exec;
+
+  void Setup() {
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    client_fd = fds[1];
+    SessionConfig cfg;
+    cfg.prompt = "co> ";
+    cfg.banner = nullptr;
+    session.Init(fds[0], registry, cfg);
+  }
+
+  ~CoroFixture() {
+    if (client_fd >= 0) {
+      close(client_fd);
+    }
+  }
+
+  void Pump(int rounds = 3) {
+    for (int i = 0; i < rounds; ++i) {
+      exec.RunOnce(10);
+    }
+  }
+
+  int ClientRecv(char* buf, uint32_t size) {
+    struct timeval tv = {0, 50000};  // 50ms
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ssize_t n = read(client_fd, buf, size - 1);
+    n = (n > 0) ? n : 0;
+    buf[n] = '\0';
+    return static_cast<int>(n);
+  }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+TEST_CASE("CoroSession: frame comes from the pool", "[coro_session]") {
+  CoroFixture f;
+  REQUIRE(f.exec.Valid());
+  f.Setup();
+
+  uint32_t before = CoroFramePool::Instance().Used();
+  {
+    CoroTask task = RunSessionCoro(f.session, f.exec);
+    REQUIRE(task.Valid());
+    REQUIRE_FALSE(task.Done());
+    REQUIRE(CoroFramePool::Instance().Used() == before + 1);
+  }
+  REQUIRE(CoroFramePool::Instance().Used() == before);
+}
+
+TEST_CASE("CoroSession: prompt, command and disconnect", "[coro_session]") {
+  static int calls = 0;
+  calls = 0;
+  CoroFixture f;
+  f.registry.Register("ping", "test ping", [](int, char**, void*) -> int {
+    ++calls;
+    return 0;
+  });
+  f.Setup();
+
+  CoroTask task = RunSessionCoro(f.session, f.exec);
+  char buf[256];
+  f.ClientRecv(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "co> ") != nullptr);
+
+  write(f.client_fd, "ping\r", 5);
+  f.Pump();
+  REQUIRE(calls == 1);
+
+  close(f.client_fd);
+  f.client_fd = -1;
+  f.Pump();
+  REQUIRE(task.Done());
+  REQUIRE(f.session.Fd() < 0);
+}
+
+TEST_CASE("CoroSession: output beyond the socket buffer is flushed on EPOLLOUT", "[coro_session]") {
+  CoroFixture f;
+  f.registry.Register("bulk", "12 KiB of output", [](int, char**, void*) -> int {
+    static char chunk[1024];
+    std::memset(chunk, 'x', sizeof(chunk));
+    ExecContext* ec = CurrentExec();
+    for (int i = 0; i < 12; ++i) {
+      ec->output_fn(chunk, sizeof(chunk), ec->output_ctx);
+    }
+    return 0;
+  });
+  f.Setup();
+  int small = 2048;
+  setsockopt(f.session.Fd(), SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+
+  CoroTask task = RunSessionCoro(f.session, f.exec);
+  char buf[4096];
+  f.ClientRecv(buf, sizeof(buf));
+
+  write(f.client_fd, "bulk\r", 5);
+  f.Pump(1);  // runs the command without blocking on the full socket
+  REQUIRE(f.session.HasPendingOutput());
+
+  uint32_t total = 0;
+  for (int i = 0; i < 200 && f.session.HasPendingOutput(); ++i) {
+    total += static_cast<uint32_t>(f.ClientRecv(buf, sizeof(buf)));
+    f.Pump(1);
+  }
+  REQUIRE_FALSE(f.session.HasPendingOutput());
+  int n = 0;
+  while ((n = f.ClientRecv(buf, sizeof(buf))) > 0) {
+    total += static_cast<uint32_t>(n);
+  }
+  REQUIRE(total >= 12 * 1024);
+  REQUIRE_FALSE(task.Done());
+}
+
+TEST_CASE("CoroSession: posted output is written without client input", "[coro_session]") {
+  CoroFixture f;
+  f.Setup();
+  CoroTask task = RunSessionCoro(f.session, f.exec);
+  char buf[256];
+  f.ClientRecv(buf, sizeof(buf));
+
+  REQUIRE(f.session.Post("alert", 5));
+  f.Pump(1);
+  f.ClientRecv(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "alert\r\n") != nullptr);
+  REQUIRE_FALSE(task.Done());
+}
+
+TEST_CASE("CoroSession: commands run without blocking, get is refused", "[coro_session]") {
+  char root[] = "/tmp/telsh_coro_XXXXXX";
+  REQUIRE(mkdtemp(root) != nullptr);
+  const std::string file = std::string(root) + "/big.bin";
+  FILE* fp = std::fopen(file.c_str(), "wb");
+  REQUIRE(fp != nullptr);
+  static char chunk[4096];
+  std::memset(chunk, 'z', sizeof(chunk));
+  for (int i = 0; i < 64; ++i) {  // 256 KiB, far more than the socket buffer
+    std::fwrite(chunk, 1, sizeof(chunk), fp);
+  }
+  std::fclose(fp);
+
+  CoroFixture f;
+  const char* roots[1] = {root};
+  FileCommandsConfig files;
+  files.roots = roots;
+  files.root_count = 1;
+  REQUIRE(RegisterFileCommands(f.registry, files));
+  f.Setup();
+  int small = 4096;
+  setsockopt(f.session.Fd(), SOL_SOCKET, SO_SNDBUF, &small, sizeof(small));
+
+  CoroTask task = RunSessionCoro(f.session, f.exec);
+  char buf[4096];
+  f.ClientRecv(buf, sizeof(buf));
+
+  write(f.client_fd, "get big.bin\r", 12);
+  f.Pump(1);  // returns at once: no binary negotiation wait, no partial send
+  std::string got;
+  int n = 0;
+  while ((n = f.ClientRecv(buf, sizeof(buf))) > 0) {
+    got.append(buf, static_cast<size_t>(n));
+    f.Pump(1);
+  }
+  REQUIRE(got.find("threaded") != std::string::npos);
+  REQUIRE(got.find("zzzz") == std::string::npos);
+  REQUIRE(got.find("co> ") != std::string::npos);
+  REQUIRE_FALSE(task.Done());
+
+  std::remove(file.c_str());
+  (void)rmdir(root);
+}
+
+#else
+
+TEST_CASE("CoroSession: coroutines unavailable", "[coro_session]") {
+  SUCCEED("compiler lacks C++20 coroutine support");
+}
+
+#endif
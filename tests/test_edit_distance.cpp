@@ -0,0 +1,74 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for telsh::MyersPattern (bit-parallel Levenshtein distance).
+
+#include "telsh/edit_distance.hpp"
+
+#include <cstdint>
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+
+using namespace telsh;
+
+// Reference O(n*m) dynamic programming distance
+static uint32_t NaiveDistance(const char* a, const char* b) {
+  const uint32_t n = static_cast<uint32_t>(std::strlen(a));
+  const uint32_t m = static_cast<uint32_t>(std::strlen(b));
+  uint32_t row[80];
+  for (uint32_t j = 0; j <= m; ++j) {
+    row[j] = j;
+  }
+  for (uint32_t i = 1; i <= n; ++i) {
+    uint32_t diag = row[0];
+    row[0] = i;
+    for (uint32_t j = 1; j <= m; ++j) {
+      uint32_t up = row[j];
+      uint32_t cost = (a[i - 1] == b[j - 1]) ? 0 : 1;
+      uint32_t best = diag + cost;
+      best = (up + 1 < best) ? up + 1 : best;
+      best = (row[j - 1] + 1 < best) ? row[j - 1] + 1 : best;
+      row[j] = best;
+      diag = up;
+    }
+  }
+  return row[m];
+}
+
+TEST_CASE("MyersPattern: basic distances", "[edit_distance]") {
+  MyersPattern p("kitten");
+  REQUIRE(p.Distance("sitting") == 3);
+  REQUIRE(p.Distance("kitten") == 0);
+  REQUIRE(p.Distance("") == 6);
+
+  MyersPattern h("hlep");
+  REQUIRE(h.Distance("help") == 2);
+  REQUIRE(MyersPattern("stauts").Distance("status") == 2);
+  REQUIRE(MyersPattern("").Distance("abc") == 3);
+}
+
+TEST_CASE("MyersPattern: matches naive DP", "[edit_distance]") {
+  const char* words[] = {"reboot", "reset",   "help",     "status",  "stat", "s",
+                         "",       "netstat", "ifconfig", "ifconfg", "aaaa", "abababababab"};
+  MyersPattern p;
+  for (const char* a : words) {
+    p.Init(a, static_cast<uint32_t>(std::strlen(a)));
+    for (const char* b : words) {
+      REQUIRE(p.Distance(b) == NaiveDistance(a, b));
+    }
+  }
+}
+
+TEST_CASE("MyersPattern: 64-byte pattern", "[edit_distance]") {
+  char a[65];
+  char b[65];
+  std::memset(a, 'x', 64);
+  std::memset(b, 'x', 64);
+  a[64] = '\0';
+  b[64] = '\0';
+  b[10] = 'y';
+  b[63] = 'z';
+  MyersPattern p(a);
+  REQUIRE(p.Length() == 64);
+  REQUIRE(p.Distance(b) == 2);
+  REQUIRE(p.Distance(b) == NaiveDistance(a, b));
+}
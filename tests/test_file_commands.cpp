@@ -0,0 +1,294 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for the get/cat/tail file commands.
+
+#include "telsh/file_commands.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace telsh;
+
+// ============================================================================
+// Helper: temporary root directory with registered file commands
+// ============================================================================
+
+struct FileFixture {
+  char root[64] = "/tmp/telsh_files_XXXXXX";
+  const char* roots[1] = {root};
+  FileCommandsConfig cfg;
+  CommandRegistry registry;
+  std::string out;
+
+  FileFixture() {
+    REQUIRE(mkdtemp(root) != nullptr);
+    cfg.roots = roots;
+    cfg.root_count = 1;
+    REQUIRE(RegisterFileCommands(registry, cfg));
+  }
+
+  ~FileFixture() {
+    std::string cmd = std::string("rm -rf ") + root;
+    (void)std::system(cmd.c_str());
+  }
+
+  std::string PathOf(const char* name) const { return std::string(root) + "/" + name; }
+
+  void WriteFile(const char* name, const char* data, size_t len, const char* mode = "wb") {
+    FILE* f = std::fopen(PathOf(name).c_str(), mode);
+    REQUIRE(f != nullptr);
+    std::fwrite(data, 1, len, f);
+    std::fclose(f);
+  }
+
+  static void Collect(const char* str, uint32_t len, void* ctx) { static_cast<std::string*>(ctx)->append(str, len); }
+
+  int Run(const char* line) {
+    char buf[256];
+    std::strncpy(buf, line, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+    out.clear();
+    return registry.Execute(buf, Collect, &out);
+  }
+};
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+TEST_CASE("FileCommands: paths are confined to the roots", "[file_commands]") {
+  FileFixture f;
+  f.WriteFile("a.log", "x\n", 2);
+  REQUIRE(f.Run("cat a.log") == 0);
+  REQUIRE(f.Run("cat ../../etc/passwd") == -1);
+  REQUIRE(f.out.find("Not allowed") != std::string::npos);
+  REQUIRE(f.Run("cat /etc/passwd") == -1);
+  REQUIRE(f.Run("cat missing.log") == -1);
+}
+
+TEST_CASE("FileCommands: cat and tail convert LF to CRLF", "[file_commands]") {
+  FileFixture f;
+  f.WriteFile("a.log", "one\ntwo\r\nthree\nfour\n", 20);
+  REQUIRE(f.Run("cat a.log") == 0);
+  REQUIRE(f.out == "one\r\ntwo\r\nthree\r\nfour\r\n");
+  REQUIRE(f.Run("tail -n 2 a.log") == 0);
+  REQUIRE(f.out == "three\r\nfour\r\n");
+  REQUIRE(f.Run("tail -f a.log") == -1);  // no socket to wait on
+  REQUIRE(f.Run("tail -n foo a.log") == -1);
+  REQUIRE(f.out.find("Usage") != std::string::npos);
+  REQUIRE(f.Run("tail -n -1 a.log") == -1);
+  REQUIRE(f.Run("tail -n 2x a.log") == -1);
+  REQUIRE(f.Run("tail -n 99999999999 a.log") == -1);
+  REQUIRE(f.Run("tail a.log -n") == -1);
+}
+
+TEST_CASE("FileCommands: get streams to the socket doubling IAC", "[file_commands]") {
+  FileFixture f;
+  const char data[] = {'a', '\xFF', 'b', '\n', '\xFF'};
+  f.WriteFile("core.bin", data, sizeof(data));
+
+  int fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  char line[] = "get core.bin";
+  ExecContext ec;
+  ec.sock_fd = fds[0];
+  ec.output_fn = FileFixture::Collect;
+  ec.output_ctx = &f.out;
+  REQUIRE(f.registry.Execute(line, ec) == -1);  // may not block: refused
+  REQUIRE(f.out.find("threaded") != std::string::npos);
+
+  char line2[] = "get core.bin";
+  ec.may_block = true;
+  REQUIRE(f.registry.Execute(line2, ec) == 0);
+  char buf[16];
+  ssize_t n = read(fds[1], buf, sizeof(buf));
+  REQUIRE(n == 7);
+  REQUIRE(std::memcmp(buf, "a\xFF\xFF" "b\n\xFF\xFF", 7) == 0);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_CASE("FileCommands: get sends clean runs with sendfile and escapes the rest", "[file_commands]") {
+  FileFixture f;
+  // Long clean runs (sendfile), short ones next to 0xFF (copied), several chunks
+  std::string data;
+  for (int i = 0; i < 40; ++i) {
+    data.append(static_cast<size_t>(1000 + i * 37), static_cast<char>('a' + i % 26));
+    data.append(i % 3 == 0 ? "\xFF\xFFx\xFF" : "\xFF");
+  }
+  f.WriteFile("big.bin", data.data(), data.size());
+  std::string expect;
+  for (char c : data) {
+    expect += c;
+    if (c == '\xFF') {
+      expect += c;
+    }
+  }
+
+  int fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  std::string got;
+  std::thread reader([&]() {
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fds[1], buf, sizeof(buf))) > 0) {
+      got.append(buf, static_cast<size_t>(n));
+    }
+  });
+  char line[] = "get big.bin";
+  ExecContext ec;
+  ec.sock_fd = fds[0];
+  ec.may_block = true;
+  REQUIRE(f.registry.Execute(line, ec) == 0);
+  shutdown(fds[0], SHUT_WR);
+  reader.join();
+  REQUIRE(got.size() == expect.size());
+  REQUIRE(got == expect);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+TEST_CASE("FileCommands: symlinks out of the root are refused", "[file_commands]") {
+  FileFixture f;
+  REQUIRE(symlink("/etc/passwd", f.PathOf("passwd").c_str()) == 0);
+  REQUIRE(f.Run("cat passwd") == -1);
+  REQUIRE(f.out.find("Not allowed") != std::string::npos);
+
+  // The opened descriptor is what counts: a file below the root is fine
+  f.WriteFile("real.log", "ok\n", 3);
+  REQUIRE(symlink(f.PathOf("real.log").c_str(), f.PathOf("alias.log").c_str()) == 0);
+  REQUIRE(f.Run("cat alias.log") == 0);
+  REQUIRE(f.out == "ok\r\n");
+}
+
+TEST_CASE("FileCommands: tail -f follows appends until Ctrl-C or q", "[file_commands]") {
+  FileFixture f;
+  f.WriteFile("live.log", "old\n", 4);
+
+  int fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  TelnetSession session;
+  SessionConfig scfg;
+  scfg.banner = nullptr;
+  session.Init(fds[0], f.registry, scfg);
+  std::thread runner([&]() { session.Run(); });
+
+  struct timeval tv = {1, 0};
+  setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  std::string got;
+  auto read_until = [&](const char* needle) {
+    char buf[256];
+    while (got.find(needle) == std::string::npos) {
+      ssize_t n = read(fds[1], buf, sizeof(buf));
+      if (n <= 0) {
+        break;
+      }
+      got.append(buf, static_cast<size_t>(n));
+    }
+    return got.find(needle) != std::string::npos;
+  };
+
+  std::string cmd = "tail -n 0 -f " + f.PathOf("live.log") + "\r";
+  REQUIRE(write(fds[1], cmd.data(), cmd.size()) == static_cast<ssize_t>(cmd.size()));
+  REQUIRE(read_until("following"));
+
+  // A window-size update, split across writes, does not stop the follow
+  const uint8_t naws1[] = {0xFF, 0xFA, 31, 0, 100};
+  const uint8_t naws2[] = {0, 40, 0xFF, 0xF0};
+  REQUIRE(write(fds[1], naws1, sizeof(naws1)) == sizeof(naws1));
+  usleep(20000);
+  REQUIRE(write(fds[1], naws2, sizeof(naws2)) == sizeof(naws2));
+  usleep(20000);
+  f.WriteFile("live.log", "new line\n", 9, "ab");
+  REQUIRE(read_until("new line\r\n"));
+  REQUIRE(got.find("old") == std::string::npos);
+
+  // Typed-ahead keys survive and run once the follow ends
+  const char ahead[] = "cat live.log\r";
+  REQUIRE(write(fds[1], ahead, sizeof(ahead) - 1) == sizeof(ahead) - 1);
+  usleep(20000);
+  f.WriteFile("live.log", "more\n", 5, "ab");
+  REQUIRE(read_until("more\r\n"));
+  got.clear();
+  REQUIRE(write(fds[1], "\x03", 1) == 1);
+  REQUIRE(read_until("old\r\nnew line\r\nmore\r\n"));
+
+  session.Stop();
+  runner.join();
+  REQUIRE(session.TermWidth() == 100);
+  close(fds[1]);
+}
+
+TEST_CASE("FileCommands: upload receives binary data into the root", "[file_commands]") {
+  FileFixture f;
+  int fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  TelnetSession session;
+  SessionConfig scfg;
+  scfg.banner = nullptr;
+  session.Init(fds[0], f.registry, scfg);
+  std::thread runner([&]() { session.Run(); });
+
+  struct timeval tv = {1, 0};
+  setsockopt(fds[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  std::string got;
+  auto read_until = [&](const std::string& needle) {
+    char buf[256];
+    while (got.find(needle) == std::string::npos) {
+      ssize_t n = read(fds[1], buf, sizeof(buf));
+      if (n <= 0) {
+        break;
+      }
+      got.append(buf, static_cast<size_t>(n));
+    }
+    return got.find(needle) != std::string::npos;
+  };
+
+  const char cmd[] = "upload fw.bin 5\r";
+  REQUIRE(write(fds[1], cmd, sizeof(cmd) - 1) == sizeof(cmd) - 1);
+  REQUIRE(read_until(std::string("\xFF\xFD\x00", 3)));  // IAC DO BINARY
+  const uint8_t accept[] = {0xFF, 0xFD, 0x00, 0xFF, 0xFB, 0x00};
+  REQUIRE(write(fds[1], accept, sizeof(accept)) == sizeof(accept));
+  REQUIRE(read_until("Ready for 5 bytes"));
+
+  const uint8_t wire[] = {0x01, 0xFF, 0xFF, 0x0D, 0x00, 0x02};
+  REQUIRE(write(fds[1], wire, sizeof(wire)) == sizeof(wire));
+  REQUIRE(read_until(std::string("\xFF\xFE\x00", 3)));  // IAC DONT BINARY
+  const uint8_t release[] = {0xFF, 0xFE, 0x00, 0xFF, 0xFC, 0x00};
+  REQUIRE(write(fds[1], release, sizeof(release)) == sizeof(release));
+  REQUIRE(read_until("Received 5 bytes"));
+
+  FILE* fw = std::fopen(f.PathOf("fw.bin").c_str(), "rb");
+  REQUIRE(fw != nullptr);
+  uint8_t data[8];
+  REQUIRE(std::fread(data, 1, sizeof(data), fw) == 5);
+  std::fclose(fw);
+  REQUIRE(std::memcmp(data, "\x01\xFF\x0D\x00\x02", 5) == 0);
+
+  REQUIRE(write(fds[1], "upload ../x 1\r", 14) == 14);
+  REQUIRE(read_until("Not allowed"));
+
+  // A symlink planted at <name>.part is not followed (or truncated through)
+  char victim[] = "/tmp/telsh_victim_XXXXXX";
+  int vfd = mkstemp(victim);
+  REQUIRE(vfd >= 0);
+  REQUIRE(write(vfd, "keep", 4) == 4);
+  close(vfd);
+  REQUIRE(symlink(victim, f.PathOf("evil.part").c_str()) == 0);
+  REQUIRE(write(fds[1], "upload evil 1\r", 15) == 15);
+  REQUIRE(read_until("open(evil.part)"));
+  struct stat vst;
+  REQUIRE(stat(victim, &vst) == 0);
+  REQUIRE(vst.st_size == 4);
+  unlink(victim);
+
+  session.Stop();
+  runner.join();
+  close(fds[1]);
+}
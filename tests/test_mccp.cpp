@@ -0,0 +1,119 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for MCCP2 session compression (built with TELSH_ENABLE_MCCP).
+
+#include "telsh/telnet_session.hpp"
+
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace telsh;
+
+// ============================================================================
+// Helpers
+// ============================================================================
+
+static std::string ReadFor(int fd, int timeout_ms) {
+  struct timeval tv = {0, timeout_ms * 1000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  std::string out;
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    out.append(buf, static_cast<size_t>(n));
+  }
+  return out;
+}
+
+static std::string Inflate(z_stream& zs, const std::string& in) {
+  std::string out;
+  char buf[4096];
+  zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+  zs.avail_in = static_cast<uInt>(in.size());
+  do {
+    zs.next_out = reinterpret_cast<Bytef*>(buf);
+    zs.avail_out = sizeof(buf);
+    int rc = inflate(&zs, Z_SYNC_FLUSH);
+    REQUIRE((rc == Z_OK || rc == Z_BUF_ERROR || rc == Z_STREAM_END));
+    out.append(buf, sizeof(buf) - zs.avail_out);
+  } while (zs.avail_out == 0);
+  return out;
+}
+
+// ============================================================================
+// Tests
+// ============================================================================
+
+TEST_CASE("MccpStream: fits the fixed pool and round-trips", "[mccp]") {
+  static MccpStream stream;
+  REQUIRE(stream.Start());
+  std::string compressed;
+  auto sink = [](const uint8_t* data, uint32_t len, void* ctx) {
+    static_cast<std::string*>(ctx)->append(reinterpret_cast<const char*>(data), len);
+    return true;
+  };
+  std::string text;
+  for (int i = 0; i < 200; ++i) {
+    text += "sensor[" + std::to_string(i % 8) + "] = ok\r\n";
+  }
+  REQUIRE(stream.Write(text.data(), static_cast<uint32_t>(text.size()), Z_NO_FLUSH, sink, &compressed));
+  REQUIRE(stream.Flush(sink, &compressed));
+  REQUIRE(compressed.size() < text.size() / 4);
+
+  z_stream zs = {};
+  REQUIRE(inflateInit(&zs) == Z_OK);
+  REQUIRE(Inflate(zs, compressed) == text);
+  inflateEnd(&zs);
+  stream.End(nullptr, nullptr);
+  REQUIRE_FALSE(stream.Active());
+}
+
+TEST_CASE("TelnetSession: MCCP2 compresses output after DO COMPRESS2", "[mccp]") {
+  int fds[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+  CommandRegistry registry;
+  registry.Register("dump", "repetitive output", [](int, char**, void*) -> int {
+    ExecContext* ec = CurrentExec();
+    for (int i = 0; i < 100; ++i) {
+      ec->output_fn("0123456789abcdef0123456789abcdef\r\n", 34, ec->output_ctx);
+    }
+    return 0;
+  });
+  auto* session = new TelnetSession();  // large (compression pool), keep off the test stack
+  SessionConfig cfg;
+  cfg.banner = nullptr;
+  cfg.prompt = "z> ";
+  session->Init(fds[0], registry, cfg);
+  std::thread runner([session]() { session->Run(); });
+
+  std::string hello = ReadFor(fds[1], 100);
+  const char will[] = {'\xFF', '\xFB', 86};
+  REQUIRE(hello.find(std::string(will, 3)) != std::string::npos);
+
+  const char doit[] = {'\xFF', '\xFD', 86};
+  REQUIRE(write(fds[1], doit, 3) == 3);
+  std::string start = ReadFor(fds[1], 100);
+  const char sb[] = {'\xFF', '\xFA', 86, '\xFF', '\xF0'};
+  REQUIRE(start.compare(0, 5, std::string(sb, 5)) == 0);
+
+  z_stream zs = {};
+  REQUIRE(inflateInit(&zs) == Z_OK);
+  REQUIRE(write(fds[1], "dump\r", 5) == 5);
+  std::string wire = ReadFor(fds[1], 200);
+  std::string text = Inflate(zs, start.substr(5) + wire);
+  REQUIRE(text.find("dump\r\n") != std::string::npos);
+  REQUIRE(text.find("0123456789abcdef0123456789abcdef\r\n") != std::string::npos);
+  REQUIRE(text.find("z> ", text.size() - 3) != std::string::npos);  // flushed up to the prompt
+  REQUIRE(wire.size() < 3400 / 4);
+  inflateEnd(&zs);
+
+  session->Stop();
+  runner.join();
+  delete session;
+  close(fds[1]);
+}
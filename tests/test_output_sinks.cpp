@@ -0,0 +1,107 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for telsh::SinkFanout and the stock sinks.
+
+#include "telsh/output_sinks.hpp"
+#include "telsh/telnet_server.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace telsh;
+
+TEST_CASE("SinkFanout: one record reaches every sink", "[output_sinks]") {
+  SinkFanout fanout;
+  RingSink ring_a;
+  RingSink ring_b;
+  REQUIRE(fanout.AddSink("a", RingSink::Write, &ring_a) >= 0);
+  int32_t b = fanout.AddSink("b", RingSink::Write, &ring_b);
+  REQUIRE(fanout.SinkCount() == 2);
+
+  REQUIRE_FALSE(fanout.Publish("early\r\n", 7));  // not started
+  REQUIRE(fanout.Start());
+  REQUIRE(fanout.Publish("one\r\n", 5));
+  REQUIRE(fanout.Publish("two\r\n", 5));
+  fanout.Flush();
+
+  char buf[64];
+  REQUIRE(std::string(buf, ring_a.Snapshot(buf, sizeof(buf))) == "one\r\ntwo\r\n");
+  REQUIRE(std::string(buf, ring_b.Snapshot(buf, sizeof(buf))) == "one\r\ntwo\r\n");
+
+  REQUIRE(fanout.RemoveSink(b));
+  REQUIRE(fanout.Publish("three\r\n", 7));
+  fanout.Stop();  // delivers what is queued
+  REQUIRE(std::string(buf, ring_a.Snapshot(buf, sizeof(buf))) == "one\r\ntwo\r\nthree\r\n");
+  REQUIRE(std::string(buf, ring_b.Snapshot(buf, sizeof(buf))) == "one\r\ntwo\r\n");
+}
+
+TEST_CASE("SinkFanout: flight recorder keeps the newest bytes", "[output_sinks]") {
+  RingSink ring;
+  std::string big(RingSink::kSize - 2, 'a');
+  RingSink::Write(big.data(), static_cast<uint32_t>(big.size()), &ring);
+  RingSink::Write("bcde", 4, &ring);
+  static char snap[RingSink::kSize];
+  uint32_t n = ring.Snapshot(snap, sizeof(snap));
+  REQUIRE(n == RingSink::kSize);
+  REQUIRE(std::string(snap + n - 4, 4) == "bcde");
+  REQUIRE(snap[0] == 'a');
+  REQUIRE(std::string(snap, ring.Snapshot(snap, 3)) == "cde");
+}
+
+TEST_CASE("SinkFanout: tel_printf fans out to file and syslog sinks", "[output_sinks]") {
+  char path[] = "/tmp/telsh_sink_XXXXXX";
+  int tmp = mkstemp(path);
+  REQUIRE(tmp >= 0);
+  close(tmp);
+
+  // Local "syslog daemon" on an ephemeral port
+  int udp = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  REQUIRE(bind(udp, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+  socklen_t len = sizeof(addr);
+  REQUIRE(getsockname(udp, reinterpret_cast<struct sockaddr*>(&addr), &len) == 0);
+
+  FileSink file;
+  UdpSyslogSink syslog;
+  REQUIRE(file.Open(path));
+  REQUIRE(syslog.Open(ntohs(addr.sin_port), "unit"));
+  SinkFanout& fanout = SinkFanout::Instance();
+  int32_t f = fanout.AddSink("file", FileSink::Write, &file);
+  int32_t s = fanout.AddSink("syslog", UdpSyslogSink::Write, &syslog);
+  REQUIRE(fanout.Start());
+
+  tel_printf("temp=%d\r\n", 42);
+  fanout.Flush();
+  fanout.RemoveSink(f);
+  fanout.RemoveSink(s);
+  fanout.Stop();
+
+  char buf[128];
+  int fd = open(path, O_RDONLY);
+  ssize_t n = read(fd, buf, sizeof(buf));
+  close(fd);
+  unlink(path);
+  REQUIRE(std::string(buf, static_cast<size_t>(n)) == "temp=42\r\n");
+
+  n = recv(udp, buf, sizeof(buf), MSG_DONTWAIT);
+  close(udp);
+  // <PRI>Mmm dd hh:mm:ss HOSTNAME TAG: MSG
+  const std::string dgram(buf, static_cast<size_t>(n > 0 ? n : 0));
+  REQUIRE(dgram.compare(0, 4, "<14>") == 0);
+  REQUIRE(dgram.size() > 20);
+  REQUIRE(dgram[7] == ' ');
+  REQUIRE(dgram[13] == ':');
+  REQUIRE(dgram[16] == ':');
+  REQUIRE(dgram[19] == ' ');
+  const size_t host_end = dgram.find(' ', 20);
+  REQUIRE(host_end != std::string::npos);
+  REQUIRE(host_end > 20);
+  REQUIRE(dgram.substr(host_end) == " unit: temp=42");
+}
@@ -0,0 +1,133 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for telsh::VarSampler and the plot rendering.
+
+#include "telsh/sampler.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+using namespace telsh;
+
+static const char kLow[] = "\xE2\x96\x81";   // lowest block
+static const char kHigh[] = "\xE2\x96\x88";  // full block
+
+TEST_CASE("VarSampler: ring keeps the newest samples at its rate", "[sampler]") {
+  VarRegistry vars;
+  std::atomic<int32_t> level{0};
+  REQUIRE(vars.Register("level", &level));
+  VarSampler sampler(vars);
+  REQUIRE(sampler.Begin("nosuch", 10, 4, false) == VarSampler::kErrVar);
+  REQUIRE(sampler.Begin("level", 0, 4, false) == VarSampler::kErrRange);
+  REQUIRE(sampler.Begin("level", 10, 4, false) == 0);  // 100 ms period
+
+  const uint64_t t0 = osp::SteadyNowUs() + 1000;
+  for (int32_t i = 1; i <= 6; ++i) {
+    level.store(i);
+    REQUIRE(sampler.Tick(t0 + static_cast<uint64_t>(i - 1) * 100000) == 1);
+    REQUIRE(sampler.Tick(t0 + static_cast<uint64_t>(i - 1) * 100000 + 50000) == 0);
+  }
+  double out[8];
+  uint32_t period = 0;
+  REQUIRE(sampler.Snapshot("level", out, 8, &period) == 4);
+  REQUIRE(period == 100000);
+  REQUIRE(out[0] == 3.0);
+  REQUIRE(out[3] == 6.0);
+
+  // A stalled sampler takes one sample, not a burst
+  REQUIRE(sampler.Tick(t0 + 2000000) == 1);
+  REQUIRE(sampler.Tick(t0 + 2000000) == 0);
+
+  REQUIRE(sampler.End("level"));
+  REQUIRE(sampler.Snapshot("level", out, 8) == 0);
+}
+
+TEST_CASE("RenderSparkline: scales to the range and downsamples", "[sampler]") {
+  const double ramp[8] = {0, 1, 2, 3, 4, 5, 6, 7};
+  char out[64];
+  REQUIRE(detail::RenderSparkline(ramp, 8, 80, out, sizeof(out)) == 24);
+  REQUIRE(std::strncmp(out, kLow, 3) == 0);
+  REQUIRE(std::strcmp(out + 21, kHigh) == 0);
+  REQUIRE(static_cast<uint8_t>(out[11]) == 0x84);  // 4th level
+
+  // 8 values into 2 columns of their means: low, high
+  REQUIRE(detail::RenderSparkline(ramp, 8, 2, out, sizeof(out)) == 6);
+  REQUIRE(std::string(out) == std::string(kLow) + kHigh);
+}
+
+TEST_CASE("VarSampler: sample and plot commands", "[sampler]") {
+  VarRegistry vars;
+  std::atomic<int32_t> level{5};
+  REQUIRE(vars.Register("level", &level));
+  VarSampler sampler(vars);
+  CommandRegistry reg;
+  REQUIRE(RegisterSampleCommands(reg, sampler));
+
+  char buf[2048];
+  REQUIRE(reg.ExecuteCapture("plot level", buf, sizeof(buf)) == -1);
+  REQUIRE(reg.ExecuteCapture("sample level 1000 2000", buf, sizeof(buf)) == -1);
+  REQUIRE(std::strstr(buf, "need 1..1000 Hz") != nullptr);
+  REQUIRE(reg.ExecuteCapture("sample level 1000 8", buf, sizeof(buf)) == 0);
+  for (int i = 0; i < 200 && sampler.Snapshot("level", nullptr, 0) == 0; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  double out[8];
+  for (int i = 0; i < 200 && sampler.Snapshot("level", out, 8) < 8; ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  REQUIRE(sampler.Snapshot("level", out, 8) == 8);
+  REQUIRE(reg.ExecuteCapture("sample stop level", buf, sizeof(buf)) == 0);
+  REQUIRE(sampler.Begin("level", 10, 3, false) == 0);
+  const uint64_t t0 = osp::SteadyNowUs() + 1000;
+  for (int32_t i = 0; i < 3; ++i) {
+    level.store(i * 10);
+    sampler.Tick(t0 + static_cast<uint64_t>(i) * 100000);
+  }
+
+  REQUIRE(reg.ExecuteCapture("sample", buf, sizeof(buf)) == 0);
+  REQUIRE(std::strstr(buf, "level                  10 Hz  3/3 samples") != nullptr);
+
+  REQUIRE(reg.ExecuteCapture("plot level", buf, sizeof(buf)) == 0);
+  const std::string spark = std::string(kLow) + "\xE2\x96\x85" + kHigh + "\r\n";
+  REQUIRE(std::string(buf) == "level: n=3 over 0.3 s  min=0 max=20 avg=10 last=20\r\n" + spark);
+
+  REQUIRE(reg.ExecuteCapture("plot -c level 3", buf, sizeof(buf)) == 0);
+  REQUIRE(std::strstr(buf, "        20|  *\r\n") != nullptr);
+  REQUIRE(std::strstr(buf, "        10| * \r\n") != nullptr);
+  REQUIRE(std::strstr(buf, "         0|*  \r\n") != nullptr);
+}
+
+TEST_CASE("VarSampler: NaN and infinite samples are left out of the plot", "[sampler]") {
+  static const double kSeq[6] = {1, NAN, 3, INFINITY, -INFINITY, 2};
+  static uint32_t next = 0;
+  next = 0;
+  VarRegistry vars;
+  REQUIRE(vars.Register("odd", [](const void*) -> double { return kSeq[next++ % 6]; }, nullptr));
+  VarSampler sampler(vars);
+  CommandRegistry reg;
+  REQUIRE(RegisterSampleCommands(reg, sampler));
+  REQUIRE(sampler.Begin("odd", 10, 6, false) == 0);
+  const uint64_t t0 = osp::SteadyNowUs() + 1000;
+  for (int32_t i = 0; i < 6; ++i) {
+    sampler.Tick(t0 + static_cast<uint64_t>(i) * 100000);
+  }
+
+  char buf[2048];
+  REQUIRE(reg.ExecuteCapture("plot odd", buf, sizeof(buf)) == 0);
+  REQUIRE(std::strstr(buf, "min=1 max=3 avg=2 last=2\r\n") != nullptr);
+  const std::string spark = std::string(kLow) + " " + kHigh + "  " + "\xE2\x96\x85" + "\r\n";
+  REQUIRE(std::string(std::strchr(buf, '\n') + 1) == spark);
+
+  REQUIRE(reg.ExecuteCapture("plot -c odd 3", buf, sizeof(buf)) == 0);
+  REQUIRE(std::strstr(buf, "         3|  *   \r\n") != nullptr);
+  REQUIRE(std::strstr(buf, "         2|     *\r\n") != nullptr);
+  REQUIRE(std::strstr(buf, "         1|*     \r\n") != nullptr);
+
+  // Nothing finite at all: no cells, no chart rows
+  const double none[3] = {NAN, INFINITY, NAN};
+  char out[16];
+  REQUIRE(detail::RenderSparkline(none, 3, 80, out, sizeof(out)) == 0);
+  REQUIRE(out[0] == '\0');
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for telsh::CommandScheduler and CronSpec.
+
+#include "telsh/scheduler.hpp"
+
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+using namespace telsh;
+
+namespace {
+
+struct tm MakeTm(int wday, int mday, int mon, int hour, int min) {
+  struct tm t = {};
+  t.tm_wday = wday;
+  t.tm_mday = mday;
+  t.tm_mon = mon - 1;
+  t.tm_hour = hour;
+  t.tm_min = min;
+  return t;
+}
+
+}  // namespace
+
+// ============================================================================
+// CronSpec
+// ============================================================================
+
+TEST_CASE("CronSpec: fields, ranges, steps and lists", "[scheduler]") {
+  CronSpec c;
+  REQUIRE(c.Parse("*/15 9-17 * * 1-5"));
+  REQUIRE(c.Matches(MakeTm(1, 6, 3, 9, 0)));
+  REQUIRE(c.Matches(MakeTm(5, 6, 3, 17, 45)));
+  REQUIRE_FALSE(c.Matches(MakeTm(5, 6, 3, 17, 46)));
+  REQUIRE_FALSE(c.Matches(MakeTm(0, 6, 3, 12, 0)));  // Sunday
+  REQUIRE_FALSE(c.Matches(MakeTm(2, 6, 3, 8, 0)));
+
+  // Both day fields restricted: either matches; 7 is Sunday
+  REQUIRE(c.Parse("0 0 1,15 * 7"));
+  REQUIRE(c.Matches(MakeTm(3, 15, 6, 0, 0)));
+  REQUIRE(c.Matches(MakeTm(0, 9, 6, 0, 0)));
+  REQUIRE_FALSE(c.Matches(MakeTm(3, 9, 6, 0, 0)));
+
+  REQUIRE_FALSE(c.Parse("* * * *"));
+  REQUIRE_FALSE(c.Parse("60 * * * *"));
+  REQUIRE_FALSE(c.Parse("*/0 * * * *"));
+  REQUIRE_FALSE(c.Parse("5-1 * * * *"));
+  REQUIRE_FALSE(c.Parse("1x * * * *"));
+}
+
+// ============================================================================
+// CommandScheduler
+// ============================================================================
+
+TEST_CASE("CommandScheduler: periodic job on the wheel", "[scheduler]") {
+  CommandRegistry reg;
+  int ticks = 0;
+  reg.Register("tick", "count", [&ticks](int, char**) -> int {
+    ExecContext* ec = CurrentExec();
+    ec->output_fn("tock\r\n", 6, ec->output_ctx);
+    return ++ticks;
+  });
+  RingSink recorder;
+  SchedulerConfig cfg;
+  cfg.recorder = &recorder;
+  CommandScheduler sched(reg, cfg);
+
+  const uint64_t t0 = CommandScheduler::NowMs();
+  REQUIRE(sched.Add("1s", "tick", ScheduleTarget::kRecorder) == 1);
+  REQUIRE(sched.Add("40s", "tick", ScheduleTarget::kRecorder) == 2);  // more than one revolution
+  REQUIRE(sched.Advance(t0 + 500) == 0);
+  REQUIRE(sched.Advance(t0 + 1150) == 1);
+  REQUIRE(sched.Advance(t0 + 2250) == 1);
+  REQUIRE(sched.Advance(t0 + 39000) == 1);  // catch-up runs a late job once
+  REQUIRE(ticks == 3);
+  REQUIRE(sched.Advance(t0 + 40150) >= 1);  // the 40 s job
+
+  char snap[RingSink::kSize];
+  std::string rec(snap, recorder.Snapshot(snap, sizeof(snap)));
+  REQUIRE(rec.find("[schedule 1] tick\r\ntock\r\n") == 0);
+  REQUIRE(rec.find("[schedule 2] tick\r\ntock\r\n") != std::string::npos);
+
+  REQUIRE(sched.Remove(1));
+  REQUIRE_FALSE(sched.Remove(1));
+  REQUIRE(sched.JobCount() == 1);
+
+  REQUIRE(sched.Add("50ms", "tick") == CommandScheduler::kErrSpec);
+  REQUIRE(sched.Add("1s", "nosuch") == CommandScheduler::kErrCommand);
+  REQUIRE(sched.Add("1s", "") == CommandScheduler::kErrCommand);
+  REQUIRE(sched.Add("1s", "   ") == CommandScheduler::kErrCommand);
+  REQUIRE(sched.Add("1s", "tick", ScheduleTarget::kFile, "out.log") == CommandScheduler::kErrOutput);
+}
+
+TEST_CASE("CommandScheduler: cron job runs once per minute", "[scheduler]") {
+  CommandRegistry reg;
+  int runs = 0;
+  reg.Register("tick", "count", [&runs](int, char**) -> int { return ++runs; });
+  RingSink recorder;
+  SchedulerConfig cfg;
+  cfg.recorder = &recorder;
+  CommandScheduler sched(reg, cfg);
+
+  const time_t minute = std::time(nullptr) / 60;
+  const uint64_t t0 = CommandScheduler::NowMs();
+  REQUIRE(sched.Add("* * * * *", "tick", ScheduleTarget::kRecorder) == 1);
+  // Ticks far ahead of the wall clock: the job wakes again while the wall
+  // clock is still in the minute it just ran in
+  sched.Advance(t0 + 61000);
+  sched.Advance(t0 + 122000);
+  if (std::time(nullptr) / 60 == minute) {
+    REQUIRE(runs == 1);
+  }
+}
+
+TEST_CASE("CommandScheduler: schedule command add/list/del", "[scheduler]") {
+  CommandRegistry reg;
+  reg.Register("stats", "dummy", [](int, char**) -> int { return 0; });
+  CommandScheduler sched(reg);
+  REQUIRE(RegisterScheduleCommands(reg, sched));
+
+  char buf[512];
+  REQUIRE(reg.ExecuteCapture("schedule add 30s stats \"a b\"", buf, sizeof(buf)) == 0);
+  REQUIRE(std::strcmp(buf, "Scheduled job 1.\r\n") == 0);
+  REQUIRE(reg.ExecuteCapture("schedule add \"0 * * * *\" stats", buf, sizeof(buf)) == 0);
+  REQUIRE(reg.ExecuteCapture("schedule add -o ring 1s stats", buf, sizeof(buf)) == -1);
+  REQUIRE(std::strstr(buf, "output not available") != nullptr);
+
+  REQUIRE(reg.ExecuteCapture("schedule list", buf, sizeof(buf)) == 0);
+  REQUIRE(std::strstr(buf, "30s") != nullptr);
+  REQUIRE(std::strstr(buf, "stats \"a b\"") != nullptr);
+  REQUIRE(std::strstr(buf, "0 * * * *") != nullptr);
+
+  REQUIRE(reg.ExecuteCapture("schedule del 1", buf, sizeof(buf)) == 0);
+  REQUIRE(reg.ExecuteCapture("schedule del 1", buf, sizeof(buf)) == -1);
+  REQUIRE(sched.JobCount() == 1);
+}
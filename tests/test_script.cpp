@@ -0,0 +1,130 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for telsh::ScriptEngine.
+
+#include "telsh/script.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include <unistd.h>
+
+using namespace telsh;
+
+// ============================================================================
+// Helper: registry with a recording command and a captured ExecContext
+// ============================================================================
+
+struct ScriptFixture {
+  CommandRegistry registry;
+  ScriptEngine engine{registry};
+  ExecContext ec;
+  std::string out;
+  std::string calls;  // "name:arg,arg;" per call
+
+  ScriptFixture() {
+    ec.output_fn = [](const char* s, uint32_t n, void* ctx) { static_cast<std::string*>(ctx)->append(s, n); };
+    ec.output_ctx = &out;
+    registry.Register("rec", "record args, return argv[1]", [this](int argc, char* argv[]) -> int {
+      calls += "rec:";
+      for (int i = 1; i < argc; ++i) {
+        calls += argv[i];
+        calls += (i + 1 < argc) ? "," : "";
+      }
+      calls += ";";
+      return (argc > 1) ? std::atoi(argv[1]) : 0;
+    });
+    REQUIRE(RegisterScriptCommands(registry, engine));
+  }
+};
+
+// ============================================================================
+// Language
+// ============================================================================
+
+TEST_CASE("ScriptEngine: commands, variables and quoting", "[script]") {
+  ScriptFixture f;
+  REQUIRE(f.engine.Run("# bring-up\n"
+                       "rec 0 \"a b\"\n"
+                       "set who board7\n"
+                       "rec 3 $who ${who}x\n"
+                       "echo rc=$? cost=$$5\n",
+                       f.ec) == 3);
+  REQUIRE(f.calls == "rec:0,a b;rec:3,board7,board7x;");
+  REQUIRE(f.out == "rc=3 cost=$5\r\n");
+}
+
+TEST_CASE("ScriptEngine: repeat and if on return codes", "[script]") {
+  ScriptFixture f;
+  int rc = f.engine.Run("repeat 3 i\n"
+                        "  rec $i\n"
+                        "  if rc == 1\n"
+                        "    echo one\n"
+                        "  else\n"
+                        "    if ok\n"
+                        "      echo zero\n"
+                        "    end\n"
+                        "  end\n"
+                        "end\n"
+                        "repeat 0\n"
+                        "  rec 9\n"
+                        "end\n"
+                        "if rc > 1\n"
+                        "  exit 7\n"
+                        "end\n"
+                        "exit 5\n"
+                        "rec 8\n",
+                        f.ec);
+  REQUIRE(rc == 7);
+  REQUIRE(f.calls == "rec:0;rec:1;rec:2;");
+  REQUIRE(f.out == "zero\r\none\r\n");
+}
+
+TEST_CASE("ScriptEngine: compile errors name the line", "[script]") {
+  ScriptFixture f;
+  REQUIRE(f.engine.Run("rec 1\nnosuch 2\n", f.ec) == -2);
+  REQUIRE(f.out == "script:2: unknown command\r\n");
+  REQUIRE(f.calls.empty());  // nothing runs when the script does not compile
+
+  f.out.clear();
+  REQUIRE(f.engine.Run("repeat 2\nrec\n", f.ec) == -2);
+  REQUIRE(f.out.find("missing 'end'") != std::string::npos);
+
+  f.out.clear();
+  REQUIRE(f.engine.Run("if rc = 1\nend\n", f.ec) == -2);
+  REQUIRE(f.out.find("script:1: usage: if") == 0);
+}
+
+// ============================================================================
+// source
+// ============================================================================
+
+TEST_CASE("ScriptEngine: source compiles once and recompiles on change", "[script]") {
+  ScriptFixture f;
+  char path[] = "/tmp/telsh_script_XXXXXX";
+  int fd = mkstemp(path);
+  REQUIRE(fd >= 0);
+  const char v1[] = "rec $1 $2\n";
+  REQUIRE(write(fd, v1, sizeof(v1) - 1) == static_cast<ssize_t>(sizeof(v1) - 1));
+  close(fd);
+
+  std::string cmd = std::string("source ") + path + " 4 x";
+  char buf[128];
+  REQUIRE(f.registry.ExecuteCapture(cmd.c_str(), buf, sizeof(buf)) == 4);
+  REQUIRE(f.registry.ExecuteCapture(cmd.c_str(), buf, sizeof(buf)) == 4);
+  REQUIRE(f.calls == "rec:4,x;rec:4,x;");
+  REQUIRE(f.engine.Compiles() == 1);
+  REQUIRE(f.engine.CacheHits() == 1);
+
+  FILE* fp = std::fopen(path, "w");
+  REQUIRE(fp != nullptr);
+  std::fputs("rec 6 changed longer\n", fp);
+  std::fclose(fp);
+  REQUIRE(f.registry.ExecuteCapture(cmd.c_str(), buf, sizeof(buf)) == 6);
+  REQUIRE(f.engine.Compiles() == 2);
+
+  REQUIRE(f.registry.ExecuteCapture("source /nonexistent/x.tsh", buf, sizeof(buf)) == -2);
+  REQUIRE(std::strstr(buf, "No such file") != nullptr);
+  unlink(path);
+}
@@ -0,0 +1,221 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for telsh::CmdStats, ShmStatsPublisher and ShmStatsReader.
+
+#include "telsh/shm_stats.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <atomic>
+#include <catch2/catch_test_macros.hpp>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <thread>
+
+using namespace telsh;
+
+namespace {
+
+int OkCmd(int, char*[], void*) { return 0; }
+int FailCmd(int, char*[], void*) { return -1; }
+
+const ShmCmdStat* FindCmd(const ShmStats& s, const char* name) {
+  for (uint32_t i = 0; i < s.cmd_count; ++i) {
+    if (std::strcmp(s.cmds[i].name, name) == 0) {
+      return &s.cmds[i];
+    }
+  }
+  return nullptr;
+}
+
+void RegionName(char* buf, size_t size) { std::snprintf(buf, size, "/telsh_test_%d", static_cast<int>(::getpid())); }
+
+}  // namespace
+
+TEST_CASE("CmdStats: calls and failures are counted per command", "[shm_stats]") {
+  CommandRegistry reg;
+  reg.Register("ok", "", OkCmd, nullptr);
+  reg.Register("fail", "", FailCmd, nullptr);
+  char out[64];
+  reg.ExecuteCapture("ok", out, sizeof(out));
+  reg.ExecuteCapture("ok", out, sizeof(out));
+  reg.ExecuteCapture("fail", out, sizeof(out));
+
+  const CmdEntry* ok = reg.FindByName("ok");
+  const CmdEntry* fail = reg.FindByName("fail");
+  REQUIRE(ok->stats->calls.load() == 2);
+  REQUIRE(ok->stats->failures.load() == 0);
+  REQUIRE(fail->stats->calls.load() == 1);
+  REQUIRE(fail->stats->failures.load() == 1);
+}
+
+TEST_CASE("ShmStats: reader maps the published region", "[shm_stats]") {
+  char name[64];
+  RegionName(name, sizeof(name));
+  CommandRegistry reg;
+  reg.Register("ok", "", OkCmd, nullptr);
+  VarRegistry vars;
+  std::atomic<int32_t> temp{42};
+  vars.Register("temp", &temp);
+
+  ShmStatsReader reader;
+  REQUIRE_FALSE(reader.Open(name));
+
+  ShmStatsPublisher pub(nullptr, reg, vars);
+  REQUIRE(pub.Open(name));
+  REQUIRE(reader.Open(name));
+
+  char out[64];
+  reg.ExecuteCapture("ok", out, sizeof(out));
+  temp.store(7);
+  pub.Update();
+
+  ShmStats s;
+  REQUIRE(reader.Snapshot(&s));
+  REQUIRE(s.updates == 2);
+  REQUIRE(s.pid == static_cast<uint32_t>(::getpid()));
+  REQUIRE(s.cmd_count == 1);
+  REQUIRE(FindCmd(s, "ok")->calls == 1);
+  REQUIRE(s.var_count == 1);
+  REQUIRE(std::strcmp(s.vars[0].name, "temp") == 0);
+  REQUIRE(s.vars[0].value == 7.0);
+
+  pub.Close();
+  REQUIRE_FALSE(ShmStatsReader().Open(name));  // unlinked
+}
+
+TEST_CASE("ShmStats: a live region is not taken over, a stale one is", "[shm_stats]") {
+  char name[64];
+  RegionName(name, sizeof(name));
+  CommandRegistry reg;
+  VarRegistry vars;
+  ShmStatsPublisher first(nullptr, reg, vars);
+  ShmStatsPublisher second(nullptr, reg, vars);
+  REQUIRE(first.Open(name));
+  REQUIRE_FALSE(second.Open(name));  // writer alive (this process)
+  first.Close();
+
+  // Region left behind by a process that has exited
+  const pid_t child = fork();
+  if (child == 0) {
+    _exit(0);
+  }
+  REQUIRE(child > 0);
+  REQUIRE(waitpid(child, nullptr, 0) == child);
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  REQUIRE(fd >= 0);
+  REQUIRE(ftruncate(fd, sizeof(ShmStatsRegion)) == 0);
+  void* p = mmap(nullptr, sizeof(ShmStatsRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  REQUIRE(p != MAP_FAILED);
+  auto* stale = static_cast<ShmStatsRegion*>(p);
+  std::memcpy(stale->magic, "TLSH", 4);
+  stale->stats.pid = static_cast<uint32_t>(child);
+  munmap(p, sizeof(ShmStatsRegion));
+
+  REQUIRE(second.Open(name));
+  ShmStats s;
+  REQUIRE(ShmStatsReader::Read(*second.Region(), &s));
+  REQUIRE(s.pid == static_cast<uint32_t>(::getpid()));
+  second.Close();
+
+  char long_name[80];
+  std::memset(long_name, 'x', sizeof(long_name) - 1);
+  long_name[0] = '/';
+  long_name[sizeof(long_name) - 1] = '\0';
+  REQUIRE_FALSE(first.Open(long_name));
+}
+
+TEST_CASE("ShmStats: a region still being set up is not taken over", "[shm_stats]") {
+  char name[64];
+  RegionName(name, sizeof(name));
+  CommandRegistry reg;
+  VarRegistry vars;
+
+  // Another publisher between shm_open()/ftruncate() and its first Update():
+  // no magic, no pid yet, but it holds the lock
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+  REQUIRE(fd >= 0);
+  REQUIRE(flock(fd, LOCK_EX | LOCK_NB) == 0);
+  REQUIRE(ftruncate(fd, sizeof(ShmStatsRegion)) == 0);
+  ShmStatsPublisher pub(nullptr, reg, vars);
+  REQUIRE_FALSE(pub.Open(name));
+  struct stat st;
+  REQUIRE(fstat(fd, &st) == 0);
+  REQUIRE(st.st_nlink == 1);  // not unlinked underneath its owner
+
+  close(fd);  // the owner dies before finishing: now it is stale
+  REQUIRE(pub.Open(name));
+  pub.Close();
+}
+
+TEST_CASE("ShmStats: publishers racing Open() get exactly one region", "[shm_stats]") {
+  char name[64];
+  RegionName(name, sizeof(name));
+  CommandRegistry reg;
+  VarRegistry vars;
+  ShmStatsPublisher a(nullptr, reg, vars);
+  ShmStatsPublisher b(nullptr, reg, vars);
+  for (int round = 0; round < 100; ++round) {
+    std::atomic<int> ready{0};
+    bool ok_a = false;
+    bool ok_b = false;
+    auto race = [&](ShmStatsPublisher& pub, bool& ok) {
+      ready.fetch_add(1);
+      while (ready.load() < 2) {
+      }
+      ok = pub.Open(name);
+    };
+    std::thread ta(race, std::ref(a), std::ref(ok_a));
+    std::thread tb(race, std::ref(b), std::ref(ok_b));
+    ta.join();
+    tb.join();
+    REQUIRE(ok_a != ok_b);
+
+    // The name still refers to the winner's region
+    ShmStatsPublisher& winner = ok_a ? a : b;
+    ShmStatsReader reader;
+    REQUIRE(reader.Open(name));
+    ShmStats before;
+    REQUIRE(reader.Snapshot(&before));
+    winner.Update();
+    ShmStats after;
+    REQUIRE(reader.Snapshot(&after));
+    REQUIRE(after.updates == before.updates + 1);
+    reader.Close();
+    winner.Close();
+  }
+}
+
+TEST_CASE("ShmStats: snapshots stay consistent while the writer runs", "[shm_stats]") {
+  char name[64];
+  RegionName(name, sizeof(name));
+  CommandRegistry reg;
+  reg.Register("ok", "", OkCmd, nullptr);
+  VarRegistry vars;
+  ShmStatsPublisher pub(nullptr, reg, vars);
+  REQUIRE(pub.Open(name));
+
+  std::thread writer([&]() {
+    char out[16];
+    for (int i = 0; i < 2000; ++i) {
+      reg.ExecuteCapture("ok", out, sizeof(out));
+      pub.Update();
+    }
+  });
+  ShmStats s;
+  uint64_t last = 0;
+  bool ordered = true;
+  for (int i = 0; i < 2000; ++i) {
+    if (ShmStatsReader::Read(*pub.Region(), &s)) {
+      // calls is bumped before each Update(), so a consistent copy never
+      // shows more updates than calls + 1 (the one from Open()).
+      ordered &= s.updates >= last && s.updates <= FindCmd(s, "ok")->calls + 1;
+      last = s.updates;
+    }
+  }
+  writer.join();
+  REQUIRE(ordered);
+  REQUIRE(ShmStatsReader::Read(*pub.Region(), &s));
+  REQUIRE(s.updates == 2001);
+}
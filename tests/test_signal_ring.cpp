@@ -0,0 +1,76 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for telsh::SignalRing / tel_printf_signal_safe.
+
+#include "telsh/signal_ring.hpp"
+
+#include <csignal>
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+using namespace telsh;
+
+namespace {
+
+std::string Format(const char* fmt, ...) {
+  char buf[128];
+  va_list ap;
+  va_start(ap, fmt);
+  uint32_t n = detail::SafeFormat(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  return std::string(buf, n);
+}
+
+void Collect(const char* text, uint32_t len, void* ctx) {
+  static_cast<std::string*>(ctx)->append(text, len).append("|");
+}
+
+}  // namespace
+
+TEST_CASE("SignalRing: safe formatter conversions", "[signal_ring]") {
+  REQUIRE(Format("sig %d at %s", 11, "handler") == "sig 11 at handler");
+  REQUIRE(Format("%u %x %X %05d %3u", 42U, 255U, 255U, -42, 7U) == "42 ff FF -0042   7");
+  REQUIRE(Format("%ld %llu %zu %c%%", -1L, 18446744073709551615ULL, size_t{3}, 'z') ==
+          "-1 18446744073709551615 3 z%");
+  REQUIRE(Format("%p", reinterpret_cast<void*>(0x1000)) == "0x1000");
+  REQUIRE(Format("%s %q", nullptr) == "(null) %q");
+}
+
+TEST_CASE("SignalRing: drains in write order and drops when full", "[signal_ring]") {
+  SignalRing ring;
+  REQUIRE(ring.Write("one", 3));
+  REQUIRE(ring.Write("two", 3));
+  std::string out;
+  REQUIRE(ring.Drain(Collect, &out) == 2);
+  REQUIRE(out == "one|two|");
+
+  for (uint32_t i = 0; i < SignalRing::kSlots; ++i) {
+    REQUIRE(ring.Write("x", 1));
+  }
+  REQUIRE_FALSE(ring.Write("lost", 4));
+  REQUIRE(ring.Dropped() == 1);
+  out.clear();
+  REQUIRE(ring.Drain(Collect, &out) == SignalRing::kSlots);
+  REQUIRE(ring.Drain(Collect, &out) == 0);
+}
+
+TEST_CASE("SignalRing: written from a signal handler", "[signal_ring]") {
+  SignalRing& ring = SignalRing::Instance();
+  REQUIRE(ring.OpenWakePipe());
+  std::string out;
+  ring.Drain(Collect, &out);  // discard anything left by other tests
+
+  struct sigaction sa = {};
+  struct sigaction old = {};
+  sa.sa_handler = [](int sig) { tel_printf_signal_safe("caught signal %d", sig); };
+  REQUIRE(sigaction(SIGUSR1, &sa, &old) == 0);
+  REQUIRE(raise(SIGUSR1) == 0);
+  sigaction(SIGUSR1, &old, nullptr);
+
+  char c;
+  REQUIRE(read(ring.WakeFd(), &c, 1) == 1);  // the handler woke the consumer
+  out.clear();
+  REQUIRE(ring.Drain(Collect, &out) == 1);
+  REQUIRE(out == "caught signal " + std::to_string(SIGUSR1) + "|");
+}
@@ -0,0 +1,361 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for telsh::TelnetServer (mostly polled mode, driven from the test thread).
+
+#include "telsh/telnet_server.hpp"
+
+#include <cstring>
+
+#include <arpa/inet.h>
+#include <catch2/catch_test_macros.hpp>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace telsh;
+
+// ============================================================================
+// Helper: loopback client for a polled server
+// ============================================================================
+
+struct PolledFixture {
+  CommandRegistry registry;
+  TelnetServer server;
+  int client_fd = -1;
+
+  explicit PolledFixture(const ServerConfig& cfg = {}) : server(registry, PolledConfig(cfg)) {}
+
+  ~PolledFixture() {
+    if (client_fd >= 0) {
+      close(client_fd);
+    }
+  }
+
+  static ServerConfig PolledConfig(ServerConfig cfg) {
+    cfg.port = 0;  // ephemeral
+    cfg.io_mode = IoMode::kPolled;
+    return cfg;
+  }
+
+  void Connect(uint32_t listener = 0) {
+    client_fd = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(client_fd >= 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(server.Port(listener));
+    REQUIRE(connect(client_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+  }
+
+  // Pump the server a few times so accept/read/write complete
+  void Pump(int rounds = 5) {
+    for (int i = 0; i < rounds; ++i) {
+      server.Poll(10);
+    }
+  }
+
+  void ClientSend(const char* str) { write(client_fd, str, std::strlen(str)); }
+
+  int ClientRecv(char* buf, uint32_t size) {
+    struct timeval tv = {0, 50000};  // 50ms
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ssize_t n = read(client_fd, buf, size - 1);
+    n = (n > 0) ? n : 0;
+    buf[n] = '\0';
+    return static_cast<int>(n);
+  }
+
+  // Collect everything sent until the socket stays quiet for 50ms
+  int ClientRecvAll(char* buf, uint32_t size) {
+    int total = 0;
+    int n = 0;
+    while ((n = ClientRecv(buf + total, size - static_cast<uint32_t>(total))) > 0) {
+      total += n;
+    }
+    return total;
+  }
+};
+
+// ============================================================================
+// Polled mode tests
+// ============================================================================
+
+TEST_CASE("TelnetServer: polled start binds ephemeral port", "[telnet_server]") {
+  PolledFixture f;
+  REQUIRE(f.server.Start());
+  REQUIRE(f.server.Port() != 0);
+  REQUIRE(f.server.ListenFd() >= 0);
+
+  struct pollfd fds[TelnetServer::kMaxSessions + 2];
+  REQUIRE(f.server.GetPollFds(fds, TelnetServer::kMaxSessions + 2) == 2);  // listener, signal ring
+  REQUIRE(fds[0].fd == f.server.ListenFd());
+  REQUIRE(fds[1].fd == SignalRing::Instance().WakeFd());
+}
+
+TEST_CASE("TelnetServer: polled accept shows prompt and runs command", "[telnet_server]") {
+  static int calls = 0;
+  calls = 0;
+  ServerConfig cfg;
+  cfg.prompt = "poll> ";
+  PolledFixture f(cfg);
+  f.registry.Register("ping", "test ping", [](int, char**, void*) -> int {
+    ++calls;
+    return 0;
+  });
+  REQUIRE(f.server.Start());
+
+  f.Connect();
+  f.Pump();
+
+  char buf[512];
+  f.ClientRecv(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "poll> ") != nullptr);
+
+  struct pollfd fds[TelnetServer::kMaxSessions * 2 + 2];
+  REQUIRE(f.server.GetPollFds(fds, TelnetServer::kMaxSessions * 2 + 2) == 4);  // listener, socket, wake fd, signal ring
+
+  f.ClientSend("ping\r");
+  f.Pump();
+  REQUIRE(calls == 1);
+}
+
+TEST_CASE("TelnetServer: polled session released on disconnect", "[telnet_server]") {
+  PolledFixture f;
+  REQUIRE(f.server.Start());
+  f.Connect();
+  f.Pump();
+
+  struct pollfd fds[TelnetServer::kMaxSessions * 2 + 2];
+  REQUIRE(f.server.GetPollFds(fds, TelnetServer::kMaxSessions * 2 + 2) == 4);  // listener, socket, wake fd, signal ring
+
+  close(f.client_fd);
+  f.client_fd = -1;
+  f.Pump();
+  REQUIRE(f.server.GetPollFds(fds, TelnetServer::kMaxSessions * 2 + 2) == 2);
+}
+
+TEST_CASE("TelnetServer: polled session that stops reading is dropped, not waited on", "[telnet_server]") {
+  PolledFixture f;
+  f.registry.Register("flood", "32 MiB of output", [](int, char**, void*) -> int {
+    static char chunk[4096];
+    std::memset(chunk, 'x', sizeof(chunk));
+    ExecContext* ec = CurrentExec();
+    for (int i = 0; i < 8192; ++i) {
+      ec->output_fn(chunk, sizeof(chunk), ec->output_ctx);
+    }
+    return 0;
+  });
+  REQUIRE(f.server.Start());
+  f.Connect();
+  f.Pump();
+
+  f.ClientSend("flood\r");  // and never read the reply
+  f.Pump();                  // would block in send() on a blocking socket
+  REQUIRE(f.server.ActiveCount() == 0);
+}
+
+TEST_CASE("TelnetServer: detached session replays backlog on attach", "[telnet_server]") {
+  ServerConfig cfg;
+  cfg.username = "admin";
+  cfg.password = "pw";
+  cfg.detach_grace_ms = 60000;
+  PolledFixture f(cfg);
+  f.registry.Register("hello", "print marker", [](int, char**, void*) -> int {
+    TelnetServer::Printf("marker-42\r\n");
+    return 0;
+  });
+  REQUIRE(f.server.Start());
+
+  char buf[2048];
+  f.Connect();
+  f.Pump();
+  f.ClientSend("admin\r");
+  f.Pump();
+  f.ClientRecvAll(buf, sizeof(buf));
+  f.ClientSend("pw\r");
+  f.Pump();
+  f.ClientRecvAll(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "Session id 1") != nullptr);
+  f.ClientSend("hello\r");
+  f.Pump();
+
+  close(f.client_fd);
+  f.client_fd = -1;
+  f.Pump();
+  REQUIRE(f.server.DetachedCount() == 1);
+
+  f.Connect();
+  f.Pump();
+  f.ClientSend("admin\r");
+  f.Pump();
+  f.ClientSend("pw\r");
+  f.Pump();
+  f.ClientRecvAll(buf, sizeof(buf));
+  f.ClientSend("attach 1\r");
+  f.Pump();
+  f.ClientRecvAll(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "attached to session 1") != nullptr);
+  REQUIRE(std::strstr(buf, "marker-42") != nullptr);
+  REQUIRE(f.server.DetachedCount() == 0);
+}
+
+TEST_CASE("TelnetServer: sessions without a login are never detachable", "[telnet_server]") {
+  ServerConfig cfg;
+  cfg.detach_grace_ms = 60000;  // ignored: every user would be ""
+  PolledFixture f(cfg);
+  REQUIRE(f.server.Start());
+
+  char buf[2048];
+  f.Connect();
+  f.Pump();
+  f.ClientRecvAll(buf, sizeof(buf));
+  close(f.client_fd);
+  f.client_fd = -1;
+  f.Pump();
+  REQUIRE(f.server.DetachedCount() == 0);
+  REQUIRE(f.server.ActiveCount() == 0);
+
+  f.Connect();
+  f.Pump();
+  f.ClientRecvAll(buf, sizeof(buf));
+  f.ClientSend("attach 1\r");
+  f.Pump();
+  f.ClientRecvAll(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "attached") == nullptr);
+  REQUIRE(std::strstr(buf, "No detached") == nullptr);  // no built-in attach at all
+}
+
+TEST_CASE("TelnetServer: second listener serves its own registry", "[telnet_server]") {
+  static int factory_calls = 0;
+  factory_calls = 0;
+  PolledFixture f;
+  CommandRegistry factory;
+  factory.Register("selftest", "factory only", [](int, char**, void*) -> int {
+    ++factory_calls;
+    return 0;
+  });
+  ServerConfig fcfg;
+  fcfg.port = 0;
+  fcfg.prompt = "factory> ";
+  REQUIRE(f.server.AddListener(factory, fcfg) == 1);
+  REQUIRE(f.server.Start());
+  REQUIRE(f.server.Port(1) != 0);
+  REQUIRE(f.server.Port(1) != f.server.Port(0));
+
+  char buf[2048];
+  f.Connect(1);
+  f.Pump();
+  f.ClientRecvAll(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "factory> ") != nullptr);
+
+  f.ClientSend("selftest\r");
+  f.Pump();
+  REQUIRE(factory_calls == 1);
+  f.ClientRecvAll(buf, sizeof(buf));
+
+  f.server.BroadcastPrintfTo(0, "to-operators\r\n");
+  f.server.BroadcastPrintfTo(1, "to-factory\r\n");
+  f.Pump();
+  f.ClientRecvAll(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "to-operators") == nullptr);
+  REQUIRE(std::strstr(buf, "to-factory") != nullptr);
+}
+
+TEST_CASE("TelnetServer: threaded accept covers every listener", "[telnet_server]") {
+  CommandRegistry ops;
+  CommandRegistry factory;
+  ServerConfig cfg;
+  cfg.port = 0;
+  TelnetServer server(ops, cfg);
+  REQUIRE(server.AddListener(factory, cfg) == 1);
+  REQUIRE(server.Start());
+  REQUIRE(server.AddListener(factory, cfg) == -1);  // too late once running
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(server.Port(1));
+  REQUIRE(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+
+  struct timeval tv = {0, 500000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  char buf[64];
+  REQUIRE(read(fd, buf, sizeof(buf)) > 0);
+
+  server.Stop();
+  REQUIRE_FALSE(server.IsRunning());
+  close(fd);
+}
+
+TEST_CASE("TelnetServer: socket policy applied to accepted connections", "[telnet_server]") {
+  ServerConfig cfg;
+  cfg.socket_policy = SocketPolicy::Interactive();
+  cfg.socket_policy.cork_responses = true;
+  PolledFixture f(cfg);
+  f.registry.Register("two", "two-part reply", [](int, char**, void*) -> int {
+    ExecContext* ec = CurrentExec();
+    ec->output_fn("part1 ", 6, ec->output_ctx);
+    ec->output_fn("part2\r\n", 7, ec->output_ctx);
+    return 0;
+  });
+  REQUIRE(f.server.Start());
+  f.Connect();
+  f.Pump();
+
+  struct pollfd fds[TelnetServer::kMaxSessions * 2 + 2];
+  REQUIRE(f.server.GetPollFds(fds, TelnetServer::kMaxSessions * 2 + 2) == 4);  // listener, socket, wake fd, signal ring
+  int32_t val = 0;
+  socklen_t len = sizeof(val);
+  REQUIRE(getsockopt(fds[1].fd, IPPROTO_TCP, TCP_NODELAY, &val, &len) == 0);
+  REQUIRE(val == 1);
+  len = sizeof(val);
+  REQUIRE(getsockopt(fds[1].fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &val, &len) == 0);
+  REQUIRE(val == 16 * 1024);
+
+  // Corked response and prompt still arrive without delay
+  char buf[512];
+  f.ClientRecvAll(buf, sizeof(buf));
+  f.ClientSend("two\r");
+  f.Pump(1);
+  f.ClientRecvAll(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "part1 part2\r\ntelsh> ") != nullptr);
+  len = sizeof(val);
+  REQUIRE(getsockopt(fds[1].fd, IPPROTO_TCP, TCP_CORK, &val, &len) == 0);
+  REQUIRE(val == 0);
+}
+
+TEST_CASE("TelnetServer: signal-safe printf broadcast by the poll loop", "[telnet_server]") {
+  PolledFixture f;
+  REQUIRE(f.server.Start());
+  f.Connect();
+  f.Pump();
+  char buf[512];
+  f.ClientRecvAll(buf, sizeof(buf));
+
+  REQUIRE(tel_printf_signal_safe("fault at %p\r\n", reinterpret_cast<void*>(0xdead)));
+  f.Pump();
+  f.ClientRecvAll(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "fault at 0xdead\r\n") != nullptr);
+}
+
+TEST_CASE("TelnetServer: Printf inside ExecuteCapture is captured", "[telnet_server]") {
+  PolledFixture f;
+  f.registry.Register("report", "printf reply", [](int, char**, void*) -> int {
+    TelnetServer::Printf("state=%d\r\n", 7);
+    return 0;
+  });
+  REQUIRE(f.server.Start());
+  f.Connect();
+  f.Pump();
+  char buf[512];
+  f.ClientRecvAll(buf, sizeof(buf));
+
+  char out[64];
+  REQUIRE(f.registry.ExecuteCapture("report", out, sizeof(out)) == 0);
+  REQUIRE(std::strcmp(out, "state=7\r\n") == 0);
+  f.Pump();
+  REQUIRE(f.ClientRecvAll(buf, sizeof(buf)) == 0);  // nothing broadcast
+}
@@ -9,6 +9,7 @@
 #include <cstring>
 
 #include <catch2/catch_test_macros.hpp>
+#include <string>
 #include <sys/socket.h>
 #include <thread>
 #include <unistd.h>
@@ -302,3 +303,336 @@ TEST_CASE("TelnetSession: auth failure", "[telnet_session]") {
   f.ClientRecv(buf, sizeof(buf));
   REQUIRE(std::strstr(buf, "Login failed") != nullptr);
 }
+
+TEST_CASE("TelnetSession: account table grants roles", "[telnet_session]") {
+  static int runs = 0;
+  runs = 0;
+  static const UserAccount kUsers[] = {
+      {"op", "op", 1U << 0},
+      {"root", "root", kRoleAll},
+  };
+
+  SessionFixture f;
+  f.registry.Register("reboot", "admin only", [](int, char**, void*) -> int {
+    ++runs;
+    return 0;
+  });
+  f.registry.SetAccess("reboot", 0, 1U << 1);
+
+  SessionConfig cfg;
+  cfg.users = kUsers;
+  cfg.user_count = 2;
+  cfg.prompt = "$ ";
+  cfg.banner = nullptr;
+  f.Setup(cfg);
+
+  char buf[512];
+  f.ClientSend("op\r");
+  f.ClientSend("op\r");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  f.ClientRecv(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "Login OK") != nullptr);
+
+  f.ClientSend("reboot\r");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  f.ClientRecv(buf, sizeof(buf));
+  REQUIRE(std::strstr(buf, "Permission denied") != nullptr);
+  REQUIRE(runs == 0);
+}
+
+// ============================================================================
+// Binary transfers (RFC 856)
+// ============================================================================
+
+// Read until the session's WILL BINARY + DO BINARY arrive, then answer them.
+static void AnswerBinaryRequest(int fd, bool accept) {
+  const uint8_t want[] = {tel::kIAC, tel::kWILL, tel::kOptBinary, tel::kIAC, tel::kDO, tel::kOptBinary};
+  std::string seen;
+  char buf[64];
+  while (seen.find(std::string(reinterpret_cast<const char*>(want), sizeof(want))) == std::string::npos) {
+    ssize_t n = read(fd, buf, sizeof(buf));
+    REQUIRE(n > 0);
+    seen.append(buf, static_cast<size_t>(n));
+  }
+  const uint8_t reply[] = {tel::kIAC, accept ? tel::kDO : tel::kDONT, tel::kOptBinary,
+                           tel::kIAC, accept ? tel::kWILL : tel::kWONT, tel::kOptBinary};
+  REQUIRE(write(fd, reply, sizeof(reply)) == static_cast<ssize_t>(sizeof(reply)));
+}
+
+TEST_CASE("TelnetSession: binary mode send and receive", "[telnet_session]") {
+  static bool negotiated = false;
+  static uint8_t received[4] = {};
+  static uint64_t received_len = 0;
+  SessionFixture f;
+  f.registry.Register("xfer", "binary round trip", [](int, char**, void*) -> int {
+    TelnetSession* s = CurrentExec()->session;
+    negotiated = s->SetBinary(true);
+    const uint8_t blob[] = {0x00, 0xFF, 0x41};
+    s->SendBinary(blob, sizeof(blob));
+    received_len = s->ReceiveBinary(
+        sizeof(received),
+        [](const uint8_t* data, uint32_t len, void* ctx) {
+          auto* pos = static_cast<uint64_t*>(ctx);
+          std::memcpy(received + *pos, data, len);
+          *pos += len;
+          return true;
+        },
+        &received_len);
+    s->SetBinary(false, 100);
+    return 0;
+  });
+  SessionConfig cfg;
+  cfg.banner = nullptr;
+  f.Setup(cfg);
+
+  f.ClientSend("xfer\r");
+  struct timeval tv = {1, 0};
+  setsockopt(f.client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  AnswerBinaryRequest(f.client_fd, true);
+
+  uint8_t buf[4];
+  REQUIRE(read(f.client_fd, buf, sizeof(buf)) == 4);
+  REQUIRE(std::memcmp(buf, "\x00\xFF\xFF\x41", 4) == 0);
+
+  // Payload 0xFF 0x0D 0x00 0x7F, with a telnet NOP in the middle
+  const uint8_t wire[] = {0xFF, 0xFF, 0x0D, tel::kIAC, 241, 0x00, 0x7F};
+  REQUIRE(write(f.client_fd, wire, sizeof(wire)) == static_cast<ssize_t>(sizeof(wire)));
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+
+  REQUIRE(negotiated);
+  REQUIRE(received_len == 4);
+  REQUIRE(std::memcmp(received, "\xFF\x0D\x00\x7F", 4) == 0);
+}
+
+TEST_CASE("TelnetSession: binary mode refused by client", "[telnet_session]") {
+  static int result = -1;
+  SessionFixture f;
+  f.registry.Register("bin", "try binary", [](int, char**, void*) -> int {
+    result = CurrentExec()->session->SetBinary(true) ? 1 : 0;
+    return 0;
+  });
+  SessionConfig cfg;
+  cfg.banner = nullptr;
+  f.Setup(cfg);
+
+  f.ClientSend("bin\r");
+  struct timeval tv = {1, 0};
+  setsockopt(f.client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  AnswerBinaryRequest(f.client_fd, false);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  REQUIRE(result == 0);
+}
+
+// ============================================================================
+// Latency histograms / TIMING-MARK (RFC 860)
+// ============================================================================
+
+TEST_CASE("TelnetSession: latency histogram percentiles", "[telnet_session]") {
+  LatencyHistogram h;
+  REQUIRE(h.PercentileUs(500) == 0);
+  for (int i = 0; i < 98; ++i) {
+    h.Record(10);  // bucket [8, 16)
+  }
+  h.Record(1000);
+  h.Record(5000);
+  REQUIRE(h.Count() == 100);
+  REQUIRE(h.MaxUs() == 5000);
+  REQUIRE(h.PercentileUs(500) == 15);
+  REQUIRE(h.PercentileUs(990) == 1023);
+  REQUIRE(h.PercentileUs(1000) == 5000);
+  h.Reset();
+  REQUIRE(h.Count() == 0);
+}
+
+TEST_CASE("TelnetSession: TIMING-MARK answered after preceding echo", "[telnet_session]") {
+  SessionFixture f;
+  SessionConfig cfg;
+  cfg.prompt = "> ";
+  cfg.banner = nullptr;
+  f.Setup(cfg);
+
+  const uint8_t input[] = {'a', 'b', tel::kIAC, tel::kDO, tel::kOptTimingMark};
+  f.ClientSendRaw(input, sizeof(input));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  char buf[64];
+  int n = f.ClientRecv(buf, sizeof(buf));
+  REQUIRE(n == 5);
+  REQUIRE(std::memcmp(buf, "ab\xFF\xFB\x06", 5) == 0);
+  REQUIRE(f.session.Latency().echo.Count() == 1);
+  REQUIRE(f.session.Latency().command.Count() == 0);
+}
+
+TEST_CASE("TelnetSession: latency command probes RTT", "[telnet_session]") {
+  SessionFixture f;
+  RegisterLatencyCommand(f.registry);
+  SessionConfig cfg;
+  cfg.prompt = "> ";
+  cfg.banner = nullptr;
+  f.Setup(cfg);
+
+  f.ClientSend("latency\r");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  char buf[1024];
+  int n = f.ClientRecv(buf, sizeof(buf));
+  REQUIRE(n > 0);
+  std::string out(buf, static_cast<size_t>(n));
+  REQUIRE(out.find("this session:") != std::string::npos);
+  REQUIRE(out.find("all sessions:") != std::string::npos);
+  const uint8_t probe[] = {tel::kIAC, tel::kDO, tel::kOptTimingMark};
+  REQUIRE(out.find(std::string(reinterpret_cast<const char*>(probe), sizeof(probe))) != std::string::npos);
+  REQUIRE(f.session.Latency().command.Count() == 1);
+
+  const uint8_t answer[] = {tel::kIAC, tel::kWILL, tel::kOptTimingMark};
+  f.ClientSendRaw(answer, sizeof(answer));
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  REQUIRE(f.session.Latency().rtt.Count() == 1);
+
+  f.ClientSend("latency\r");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  n = f.ClientRecv(buf, sizeof(buf));
+  out.assign(buf, static_cast<size_t>(n));
+  REQUIRE(out.find("  rtt     n=1 ") != std::string::npos);
+}
+
+// ============================================================================
+// Posted output (single writer)
+// ============================================================================
+
+TEST_CASE("TelnetSession: NAWS window size", "[telnet_session]") {
+  SessionFixture f;
+  f.registry.Register("size", "print window size", [](int, char**, void*) -> int {
+    ExecContext* ec = CurrentExec();
+    ec->session->Printf("%ux%u\r\n", ec->session->TermWidth(), ec->session->TermHeight());
+    return 0;
+  });
+  SessionConfig cfg;
+  cfg.prompt = "> ";
+  cfg.banner = nullptr;
+  f.Setup(cfg);
+
+  // 255 columns (escaped as IAC IAC) x 40 rows
+  const uint8_t naws[] = {tel::kIAC, tel::kSB, tel::kOptNAWS, 0, 0xFF, 0xFF, 0, 40, tel::kIAC, tel::kSE};
+  f.ClientSendRaw(naws, sizeof(naws));
+  f.ClientSend("size\r");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  char buf[256];
+  int n = f.ClientRecv(buf, sizeof(buf));
+  REQUIRE(n > 0);
+  REQUIRE(std::string(buf, static_cast<size_t>(n)).find("255x40\r\n") != std::string::npos);
+}
+
+TEST_CASE("TelnetSession: posted record redraws prompt and partial input", "[telnet_session]") {
+  SessionFixture f;
+  SessionConfig cfg;
+  cfg.prompt = "> ";
+  cfg.banner = nullptr;
+  f.Setup(cfg);
+
+  f.ClientSend("ab");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  f.DrainClient();
+
+  std::thread producer([&f]() { REQUIRE(f.session.Post("alert", 5)); });
+  producer.join();
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  char buf[128];
+  int n = f.ClientRecv(buf, sizeof(buf));
+  REQUIRE(std::string(buf, static_cast<size_t>(n)) == "\r\x1b[Kalert\r\n> ab");
+
+  // Typing continues on the redrawn line
+  f.ClientSend("c");
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  n = f.ClientRecv(buf, sizeof(buf));
+  REQUIRE(std::string(buf, static_cast<size_t>(n)) == "c");
+}
+
+// ============================================================================
+// MemoryTransport: the same state machine without a socket
+// ============================================================================
+
+static std::string OutputOf(const MemoryTransport& peer) {
+  static char buf[MemoryTransport::kOutputSize + 1];
+  return std::string(buf, peer.Output(buf, sizeof(buf)));
+}
+
+TEST_CASE("TelnetSession: memory transport runs commands in-process", "[telnet_session]") {
+  CommandRegistry registry;
+  registry.Register("hello", "say hi", [](int, char*[], void*) -> int {
+    ExecContext* ec = CurrentExec();
+    REQUIRE(ec->session == nullptr);
+    ec->output_fn("hi there\r\n", 10, ec->output_ctx);
+    return 0;
+  });
+  SessionConfig cfg;
+  cfg.prompt = "> ";
+  cfg.banner = nullptr;
+
+  BasicTelnetSession<MemoryTransport> session;
+  MemoryTransport& peer = session.GetTransport();
+  session.Init(0, registry, cfg);
+  session.Begin();
+  REQUIRE(OutputOf(peer).find("> ") != std::string::npos);
+
+  peer.ClearOutput();
+  REQUIRE(peer.Feed("hello\r"));
+  REQUIRE(session.OnReadable());
+  REQUIRE(OutputOf(peer) == "hello\r\nhi there\r\n> ");
+
+  // Nothing queued: the step is a no-op, not a disconnect
+  REQUIRE(session.OnReadable());
+
+  peer.CloseInput();
+  REQUIRE_FALSE(session.OnReadable());
+  session.Disconnected();
+  REQUIRE(peer.IsShutdown());
+}
+
+TEST_CASE("TelnetSession: memory transport Run() returns at end of input", "[telnet_session]") {
+  CommandRegistry registry;
+  SessionConfig cfg;
+  cfg.prompt = "> ";
+  cfg.banner = nullptr;
+
+  BasicTelnetSession<MemoryTransport> session;
+  MemoryTransport& peer = session.GetTransport();
+  REQUIRE(peer.Feed("ab\x7f" "c\r"));
+  peer.CloseInput();
+  session.Init(0, registry, cfg);
+  session.Run();
+
+  REQUIRE(peer.IsShutdown());
+  REQUIRE(OutputOf(peer).find("Unknown command: ac") != std::string::npos);
+}
+
+TEST_CASE("TelnetSession: memory transport Run() waits for input and posts", "[telnet_session]") {
+  CommandRegistry registry;
+  SessionConfig cfg;
+  cfg.prompt = "> ";
+  cfg.banner = nullptr;
+
+  BasicTelnetSession<MemoryTransport> session;
+  MemoryTransport& peer = session.GetTransport();
+  session.Init(0, registry, cfg);
+  std::thread runner([&session]() { session.Run(); });
+
+  auto wait_for = [&peer](const char* needle) {
+    for (int i = 0; i < 200; ++i) {
+      if (OutputOf(peer).find(needle) != std::string::npos) {
+        return true;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return false;
+  };
+  REQUIRE(wait_for("> "));
+  REQUIRE(peer.Feed("x"));
+  REQUIRE(wait_for("> x"));
+  REQUIRE(session.Post("alert", 5));  // real eventfd alongside the fake socket
+  REQUIRE(wait_for("alert\r\n> x"));
+
+  session.Stop();  // wakes the waiting Poll()
+  runner.join();
+  REQUIRE(peer.IsShutdown());
+}
@@ -0,0 +1,95 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for telsh::TriggerEngine.
+
+#include "telsh/triggers.hpp"
+
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+
+using namespace telsh;
+
+namespace {
+
+// Runs engine->Sample() inside ExecuteCapture so the published firing
+// output is captured instead of broadcast.
+struct TriggerFixture {
+  CommandRegistry reg;
+  VarRegistry vars;
+  std::atomic<int32_t> temp{20};
+  TriggerEngine engine{reg, vars};
+  int resets = 0;
+
+  TriggerFixture() {
+    REQUIRE(vars.Register("temp", &temp));
+    reg.Register("fan", "fan control", [this](int, char**) -> int {
+      ++resets;
+      ExecContext* ec = CurrentExec();
+      ec->output_fn("fan on\r\n", 8, ec->output_ctx);
+      return 0;
+    });
+    reg.Register("sample", "run one trigger pass", [this](int, char**) -> int {
+      return static_cast<int>(engine.Sample());
+    });
+    REQUIRE(RegisterTriggerCommands(reg, engine));
+  }
+
+  std::string Sample(int32_t value, int* fired) {
+    temp.store(value, std::memory_order_relaxed);
+    char buf[1024];
+    *fired = reg.ExecuteCapture("sample", buf, sizeof(buf));
+    return buf;
+  }
+};
+
+}  // namespace
+
+TEST_CASE("TriggerEngine: fires once per crossing with debounce", "[triggers]") {
+  TriggerFixture f;
+  REQUIRE(f.engine.Add("temp", TriggerOp::kGt, 80, "fan", 2) == 1);
+
+  int fired = 0;
+  f.Sample(85, &fired);
+  REQUIRE(fired == 0);  // one sample is not enough
+  f.Sample(70, &fired);
+  f.Sample(85, &fired);
+  REQUIRE(fired == 0);
+  std::string out = f.Sample(90, &fired);
+  REQUIRE(fired == 1);
+  REQUIRE(out == "[trigger 1] temp = 90 (> 80)\r\nfan on\r\n");
+
+  f.Sample(95, &fired);
+  f.Sample(75, &fired);  // one low sample does not re-arm
+  f.Sample(95, &fired);
+  REQUIRE(fired == 0);
+  f.Sample(75, &fired);
+  f.Sample(75, &fired);  // re-armed
+  f.Sample(95, &fired);
+  f.Sample(95, &fired);
+  REQUIRE(fired == 1);
+  REQUIRE(f.resets == 2);
+}
+
+TEST_CASE("TriggerEngine: trigger command and snapshot action", "[triggers]") {
+  TriggerFixture f;
+  char buf[512];
+  REQUIRE(f.reg.ExecuteCapture("trigger temp <= -10", buf, sizeof(buf)) == 0);
+  REQUIRE(std::strcmp(buf, "Trigger 1 armed.\r\n") == 0);
+  REQUIRE(f.reg.ExecuteCapture("trigger -n 3 temp > 50 fan", buf, sizeof(buf)) == 0);
+  REQUIRE(f.reg.ExecuteCapture("trigger nosuch > 1", buf, sizeof(buf)) == -1);
+  REQUIRE(f.reg.ExecuteCapture("trigger temp => 1", buf, sizeof(buf)) == -1);
+  REQUIRE(f.reg.ExecuteCapture("trigger temp > 1 nosuch", buf, sizeof(buf)) == -1);
+
+  REQUIRE(f.reg.ExecuteCapture("trigger list", buf, sizeof(buf)) == 0);
+  REQUIRE(std::strstr(buf, "  1   temp <= -10 x1 fired=0 -> snapshot\r\n") != nullptr);
+  REQUIRE(std::strstr(buf, "  2   temp > 50 x3 fired=0 -> fan\r\n") != nullptr);
+
+  int fired = 0;
+  std::string out = f.Sample(-12, &fired);
+  REQUIRE(fired == 1);
+  REQUIRE(out.find("[trigger 1] temp = -12 (<= -10)\r\n  temp") == 0);
+
+  REQUIRE(f.reg.ExecuteCapture("trigger del 1", buf, sizeof(buf)) == 0);
+  REQUIRE(f.engine.TriggerCount() == 1);
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2024 liudegui. MIT License.
+// Tests for telsh::Seqlock and telsh::VarRegistry.
+
+#include "telsh/vars.hpp"
+
+#include <cstring>
+
+#include <catch2/catch_test_macros.hpp>
+#include <thread>
+
+using namespace telsh;
+
+TEST_CASE("Seqlock: readers never see a torn value", "[vars]") {
+  struct Pair {
+    uint64_t a;
+    uint64_t b;
+    uint32_t c;
+  };
+  Seqlock<Pair> lock(Pair{0, 0, 0});
+  std::thread writer([&lock]() {
+    for (uint64_t i = 1; i <= 20000; ++i) {
+      lock.Store(Pair{i, i * 7, static_cast<uint32_t>(i)});
+    }
+  });
+  bool torn = false;
+  for (int i = 0; i < 20000; ++i) {
+    const Pair p = lock.Load();
+    torn |= (p.b != p.a * 7) || (p.c != static_cast<uint32_t>(p.a));
+  }
+  writer.join();
+  REQUIRE_FALSE(torn);
+  REQUIRE(lock.Load().a == 20000);
+  REQUIRE(lock.Version() == 20001);
+}
+
+TEST_CASE("VarRegistry: atomics, seqlocks, readers and the vars command", "[vars]") {
+  VarRegistry vars;
+  std::atomic<int32_t> temp{-5};
+  std::atomic<uint64_t> packets{12};
+  Seqlock<double> voltage(3.25);
+  REQUIRE(vars.Register("temp", &temp, "board temperature"));
+  REQUIRE(vars.Register("packets", &packets));
+  REQUIRE(vars.Register("voltage", &voltage, "rail V"));
+  REQUIRE(vars.Register("answer", [](const void*) { return 42.0; }, nullptr));
+  REQUIRE_FALSE(vars.Register("temp", &temp));
+  REQUIRE(vars.Count() == 4);
+
+  double v = 0;
+  temp.store(71);
+  REQUIRE(vars.Read("temp", &v));
+  REQUIRE(v == 71.0);
+  REQUIRE(vars.Read("voltage", &v));
+  REQUIRE(v == 3.25);
+  REQUIRE_FALSE(vars.Read("nosuch", &v));
+
+  CommandRegistry reg;
+  REQUIRE(RegisterVarsCommand(reg, vars));
+  char buf[512];
+  REQUIRE(reg.ExecuteCapture("vars", buf, sizeof(buf)) == 0);
+  REQUIRE(std::strstr(buf, "temp                 = 71             board temperature\r\n") != nullptr);
+  REQUIRE(std::strstr(buf, "answer               = 42") != nullptr);
+  REQUIRE(reg.ExecuteCapture("vars voltage", buf, sizeof(buf)) == 0);
+  REQUIRE(std::strncmp(buf, "  voltage              = 3.25", 29) == 0);
+  REQUIRE(reg.ExecuteCapture("vars nosuch", buf, sizeof(buf)) == -1);
+  REQUIRE(std::strcmp(buf, "No variable 'nosuch'.\r\n") == 0);
+}
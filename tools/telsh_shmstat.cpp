@@ -0,0 +1,113 @@
+// Copyright (c) 2024 liudegui. MIT License.
+//
+// telsh_shmstat -- samples the shared-memory stats region of a running
+// telsh process (ShmStatsPublisher) without touching its sockets or locks.
+//
+// Usage:
+//   ./telsh_shmstat [-n /telsh_stats] [-i interval_ms] [-c count]
+//   (no -i: print one snapshot; with -i: one line per sample with rates)
+
+#include "telsh/shm_stats.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <chrono>
+#include <thread>
+
+namespace {
+
+void PrintSnapshot(const telsh::ShmStats& s) {
+  std::printf("pid %u  updates %llu  period %u ms\n", s.pid, static_cast<unsigned long long>(s.updates),
+              s.period_ms);
+  std::printf("sessions %u active, %u detached  accepted %llu  rejected %llu\n", s.sessions_active,
+              s.sessions_detached, static_cast<unsigned long long>(s.accepted),
+              static_cast<unsigned long long>(s.rejected));
+  std::printf("dropped  sinks %llu  signal %llu  post %llu\n", static_cast<unsigned long long>(s.sink_dropped),
+              static_cast<unsigned long long>(s.signal_dropped), static_cast<unsigned long long>(s.post_dropped));
+  std::printf("\n%-24s %12s %10s %12s\n", "command", "calls", "failures", "avg us");
+  for (uint32_t i = 0; i < s.cmd_count; ++i) {
+    const telsh::ShmCmdStat& c = s.cmds[i];
+    if (c.calls == 0) {
+      continue;
+    }
+    std::printf("%-24s %12llu %10llu %12.1f\n", c.name, static_cast<unsigned long long>(c.calls),
+                static_cast<unsigned long long>(c.failures),
+                static_cast<double>(c.total_us) / static_cast<double>(c.calls));
+  }
+  if (s.var_count > 0) {
+    std::printf("\n%-24s %s\n", "variable", "value");
+  }
+  for (uint32_t i = 0; i < s.var_count; ++i) {
+    std::printf("%-24s %.15g\n", s.vars[i].name, s.vars[i].value);
+  }
+}
+
+uint64_t TotalCalls(const telsh::ShmStats& s) {
+  uint64_t n = 0;
+  for (uint32_t i = 0; i < s.cmd_count; ++i) {
+    n += s.cmds[i].calls;
+  }
+  return n;
+}
+
+/// One line per sample: counters plus command calls/s since the last one.
+void PrintLine(const telsh::ShmStats& s, const telsh::ShmStats& prev, double secs) {
+  const double rate = (secs > 0) ? static_cast<double>(TotalCalls(s) - TotalCalls(prev)) / secs : 0.0;
+  std::printf("%6u %6u %10llu %10llu %10.1f %10llu %10llu %10llu\n", s.sessions_active, s.sessions_detached,
+              static_cast<unsigned long long>(s.accepted), static_cast<unsigned long long>(s.rejected), rate,
+              static_cast<unsigned long long>(s.sink_dropped), static_cast<unsigned long long>(s.signal_dropped),
+              static_cast<unsigned long long>(s.post_dropped));
+  std::fflush(stdout);
+}
+
+telsh::ShmStats g_cur;
+telsh::ShmStats g_prev;
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  const char* name = telsh::kShmStatsDefaultName;
+  uint32_t interval_ms = 0;
+  uint32_t count = 0;  // 0 = until interrupted
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (std::strcmp(argv[i], "-n") == 0) {
+      name = argv[i + 1];
+    } else if (std::strcmp(argv[i], "-i") == 0) {
+      interval_ms = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+    } else if (std::strcmp(argv[i], "-c") == 0) {
+      count = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+    } else {
+      std::fprintf(stderr, "usage: %s [-n name] [-i interval_ms] [-c count]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  telsh::ShmStatsReader reader;
+  if (!reader.Open(name)) {
+    std::fprintf(stderr, "%s: no telsh stats region (or layout version != %u)\n", name, telsh::kShmStatsVersion);
+    return 1;
+  }
+  if (!reader.Snapshot(&g_cur)) {
+    std::fprintf(stderr, "%s: no consistent snapshot\n", name);
+    return 1;
+  }
+  if (interval_ms == 0) {
+    PrintSnapshot(g_cur);
+    return 0;
+  }
+
+  std::printf("%6s %6s %10s %10s %10s %10s %10s %10s\n", "active", "detach", "accepted", "rejected", "cmds/s",
+              "sink_drop", "sig_drop", "post_drop");
+  for (uint32_t n = 0; count == 0 || n < count; ++n) {
+    g_prev = g_cur;
+    std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    if (!reader.Snapshot(&g_cur)) {
+      continue;  // writer busy for the whole retry budget; try next period
+    }
+    const double secs = static_cast<double>(g_cur.update_ns - g_prev.update_ns) / 1e9;
+    PrintLine(g_cur, g_prev, secs);
+  }
+  return 0;
+}